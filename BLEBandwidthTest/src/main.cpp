@@ -6,60 +6,143 @@
 /*    Description:  IQ2 project                                               */
 /*                                                                            */
 /*----------------------------------------------------------------------------*/
-#include <string>
 #include "vex.h"
 
+#include "host_commands.h"
+#include "link_bench.h"
+
 using namespace vex;
 
 // A global instance of vex::brain used for printing to the IQ2 brain screen
 vex::brain       Brain;
 
-// define your global instances of motors and other devices here
+// Link benchmark: waits for 'b' commands from the host (c0de_linkbench,
+// see link_bench.h) and runs each one: a block packet per write, at the
+// write size, pace, flush policy and stdout buffer it asks for, then a
+// summary packet. Runs go one at a time; commands that arrive during a run
+// are read after it.
 
-int packetsize = 8;
-const int increment = 8;
+#define CUSTOM_BUFFER_SIZE  10240
+char custom_buffer[CUSTOM_BUFFER_SIZE];
 
-void packetSizeUp() {
-    // packetsize += increment;
-    uint8_t c = 'A';
-    int row = 1;
-    int col = 1;
-    for (int i = 0; i < 10; i++)
+uint8_t block[link_bench_max_write];
+
+uint32_t time_us(void)
+{
+    return static_cast<uint32_t>(timer::systemHighResolution());
+}
+
+// stdout as the run wants it. newlib flushes what is pending before
+// switching buffers, so this is fine between runs, not just at startup.
+void set_buffer(uint16_t size)
+{
+    fflush(stdout);
+    if (size == 0)
     {
-        int ret = printf("%s", std::string(400, c).c_str());
-        fflush(stdout);
-        this_thread::sleep_for(100);
-        Brain.Screen.setCursor(row, col);
-        if (++row > 5)
-        {
-            row = 1;
-            col = (col > 8) ? 1 : col + 8;
-        }
-        Brain.Screen.print("p(%c):%d", c, ret);
-        c++;
+        setvbuf(stdout, nullptr, _IONBF, 0);
+    }
+    else
+    {
+        setvbuf(stdout, custom_buffer, _IOFBF, (size < CUSTOM_BUFFER_SIZE) ? size : CUSTOM_BUFFER_SIZE);
     }
-    printf("\n");
-    fflush(stdout);
 }
 
-void packetSizeDown() {
-    packetsize -= increment;
+void show(const link_bench_config& config, const link_bench_result& result)
+{
+    const uint32_t ms = (result.elapsed_us >= 1000) ? result.elapsed_us / 1000 : 1;
+    Brain.Screen.clearScreen();
+    Brain.Screen.setCursor(1, 1);
+    Brain.Screen.print("run %d: %d B x%d", config.id, config.write_size, config.writes_per_tick);
+    Brain.Screen.setCursor(2, 1);
+    Brain.Screen.print("buf %d flush %d", config.buffer_size, config.flush);
+    Brain.Screen.setCursor(3, 1);
+    Brain.Screen.print("%lu B/s", static_cast<unsigned long>(result.bytes * 1000ull / ms));
+    Brain.Screen.setCursor(4, 1);
+    Brain.Screen.print("short %lu", static_cast<unsigned long>(result.short_writes));
+    Brain.Screen.setCursor(5, 1);
+    Brain.Screen.print("max %lu us", static_cast<unsigned long>(result.longest_write_us));
 }
 
-#define CUSTOM_BUFFER_SIZE  10240
-char custom_buffer[CUSTOM_BUFFER_SIZE];
+void run(const link_bench_config& config)
+{
+    set_buffer(config.buffer_size);
+
+    link_bench_result result;
+    result.id = config.id;
+    const uint32_t duration_us = config.duration_ms * 1000u;
+    const uint32_t start = time_us();
+    uint32_t next_tick = start;
+    uint32_t sequence = 0;
+    while (time_us() - start < duration_us)
+    {
+        for (uint16_t i = 0; i < config.writes_per_tick; i++)
+        {
+            const uint32_t before = time_us();
+            link_bench_block(block, config.write_size, config.id, sequence++, before);
+            const size_t written = fwrite(block, 1, config.write_size, stdout);
+            if (config.flush == link_bench_flush_write)
+            {
+                fflush(stdout);
+            }
+            const uint32_t took = time_us() - before;
+            result.writes++;
+            result.bytes += written;
+            if (written < config.write_size)
+            {
+                result.short_writes++;
+            }
+            if (took > result.longest_write_us)
+            {
+                result.longest_write_us = took;
+            }
+        }
+        if (config.flush == link_bench_flush_tick)
+        {
+            fflush(stdout);
+        }
+        if (config.tick_ms > 0)
+        {
+            // keep to the schedule; a tick that ran over starts the next
+            // one late rather than bunching writes up to catch up
+            next_tick += config.tick_ms * 1000u;
+            const int32_t wait_us = static_cast<int32_t>(next_tick - time_us());
+            if (wait_us > 0)
+            {
+                this_thread::sleep_for((wait_us + 999) / 1000);
+            }
+            else
+            {
+                next_tick = time_us();
+            }
+        }
+    }
+    result.elapsed_us = time_us() - start;
+
+    fflush(stdout);
+    const size_t len = link_bench_done(block, result);
+    fwrite(block, 1, len, stdout);
+    fflush(stdout);
+    show(config, result);
+}
 
 int main()
 {
     setvbuf(stdout, custom_buffer, _IOFBF, CUSTOM_BUFFER_SIZE);
+    Brain.Screen.print("link bench: waiting");
 
-    Brain.buttonUp.pressed( packetSizeUp );
-    Brain.buttonDown.pressed( packetSizeDown );
-
+    command_parser<max_command_payload> parser;
     while(1) {
-        // std::string s(packetsize - 7, 'A');
-        // printf("%4d %s\n", packetsize, s.c_str());
+        int c;
+        while ((c = vexSerialReadChar(1)) >= 0)
+        {
+            link_bench_config config;
+            if (parser.feed(static_cast<uint8_t>(c)) && (parser.command() == link_bench_command)
+                && config.unpack(parser.payload(), parser.size()))
+            {
+                run(config);
+            }
+        }
         // Allow other tasks to run
-        this_thread::sleep_for(100);
+        this_thread::sleep_for(10);
     }
 }
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// MSB-first bit packing onto any byte container with push_back(). Bits are
+// collected in an accumulator and pushed a whole byte at a time, so a
+// packet_buffer keeps its running CRC without knowing about bits.
+template<typename Container>
+class bit_writer
+{
+private:
+    Container& m_buf;
+    uint32_t m_acc = 0; // fewer than 8 pending bits between calls
+    int m_pending = 0;
+    std::size_t m_bits = 0;
+
+public:
+    explicit bit_writer(Container& buf)
+        : m_buf(buf)
+    {}
+
+    // Low `width` bits of value; width <= 24
+    void write(uint32_t value, int width)
+    {
+        m_acc = (m_acc << width) | (value & ((1u << width) - 1));
+        m_pending += width;
+        m_bits += width;
+        while (m_pending >= 8)
+        {
+            m_pending -= 8;
+            m_buf.push_back(static_cast<uint8_t>(m_acc >> m_pending));
+        }
+        m_acc &= (1u << m_pending) - 1;
+    }
+
+    // Two's complement; value must fit in `width` bits
+    void write_signed(int32_t value, int width)
+    {
+        write(static_cast<uint32_t>(value), width);
+    }
+
+    // Low `width` bits of value; width <= 64
+    void write_long(uint64_t value, int width)
+    {
+        while (width > 16)
+        {
+            width -= 16;
+            write(static_cast<uint32_t>(value >> width), 16);
+        }
+        write(static_cast<uint32_t>(value), width);
+    }
+
+    // Pad the last byte with zeros
+    void flush()
+    {
+        if (m_pending > 0)
+        {
+            write(0, 8 - m_pending);
+        }
+    }
+
+    std::size_t bits_written() const { return m_bits; }
+};
+
+class bit_reader
+{
+private:
+    const uint8_t* m_data;
+    std::size_t m_size_bits;
+    std::size_t m_pos = 0;
+    bool m_overrun = false;
+
+public:
+    bit_reader(const uint8_t* data, std::size_t len)
+        : m_data(data)
+        , m_size_bits(len * 8)
+    {}
+
+    // width <= 24; reads past the end return zeros and set overrun()
+    uint32_t read(int width)
+    {
+        if (width == 0)
+        {
+            return 0;
+        }
+        if (m_pos + width > m_size_bits)
+        {
+            m_overrun = true;
+        }
+        // the next 4 bytes hold all of it, since width + (m_pos & 7) <= 31
+        const std::size_t byte = m_pos >> 3;
+        const std::size_t size = m_size_bits >> 3;
+        uint32_t window = 0;
+        if (byte + 4 <= size)
+        {
+            const uint8_t* p = m_data + byte;
+            window = (static_cast<uint32_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        }
+        else
+        {
+            for (std::size_t i = 0; i < 4; i++)
+            {
+                window = (window << 8) | (byte + i < size ? m_data[byte + i] : 0);
+            }
+        }
+        const uint32_t value = (window << (m_pos & 7)) >> (32 - width);
+        m_pos += width;
+        return value;
+    }
+
+    int32_t read_signed(int width)
+    {
+        const uint32_t value = read(width);
+        const uint32_t sign = 1u << (width - 1);
+        return static_cast<int32_t>(value ^ sign) - static_cast<int32_t>(sign);
+    }
+
+    // width <= 64
+    uint64_t read_long(int width)
+    {
+        uint64_t value = 0;
+        while (width > 16)
+        {
+            width -= 16;
+            value = (value << 16) | read(16);
+        }
+        return (value << width) | read(width);
+    }
+
+    bool overrun() const { return m_overrun; }
+    std::size_t remaining_bits() const { return m_pos < m_size_bits ? m_size_bits - m_pos : 0; }
+};
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+
+// Fixed-size byte ring of variable-length timestamped records, for the
+// logger's pre-trigger capture: u32 timestamp_us, u8 size, `size` bytes.
+// push() makes room by dropping the oldest records, so the ring always
+// holds the most recent Capacity bytes' worth. Not thread safe; push() and
+// pop() run on the control loop.
+template<std::size_t Capacity>
+class capture_ring
+{
+public:
+    static constexpr std::size_t record_header_len = 5;
+
+private:
+    std::array<uint8_t, Capacity> m_bytes{};
+    std::size_t m_tail = 0; // index of the oldest record's first byte
+    std::size_t m_size = 0; // bytes in use from m_tail on, wrapping
+    uint32_t m_records = 0;
+    uint32_t m_dropped = 0;
+
+    // i-th byte from the oldest record on
+    uint8_t at(std::size_t i) const { return m_bytes[(m_tail + i) % Capacity]; }
+
+    void put(uint8_t byte)
+    {
+        m_bytes[(m_tail + m_size) % Capacity] = byte;
+        m_size++;
+    }
+
+    void drop_front(std::size_t len)
+    {
+        m_tail = (m_tail + len) % Capacity;
+        m_size -= len;
+        m_records--;
+    }
+
+public:
+    static constexpr std::size_t capacity() noexcept { return Capacity; }
+
+    std::size_t size() const noexcept { return m_size; }
+    bool empty() const noexcept { return m_records == 0; }
+    uint32_t records() const noexcept { return m_records; }
+    // records pushed out by newer ones since the last clear()
+    uint32_t dropped() const noexcept { return m_dropped; }
+
+    void clear(void)
+    {
+        m_tail = 0;
+        m_size = 0;
+        m_records = 0;
+        m_dropped = 0;
+    }
+
+    // false if the record can never fit
+    bool push(uint32_t timestamp_us, const uint8_t* data, uint8_t size)
+    {
+        const std::size_t len = record_header_len + size;
+        if (len > Capacity)
+        {
+            return false;
+        }
+        while (Capacity - m_size < len)
+        {
+            drop_front(front_len());
+            m_dropped++;
+        }
+        put(static_cast<uint8_t>(timestamp_us >> 24));
+        put(static_cast<uint8_t>(timestamp_us >> 16));
+        put(static_cast<uint8_t>(timestamp_us >> 8));
+        put(static_cast<uint8_t>(timestamp_us));
+        put(size);
+        for (uint8_t i = 0; i < size; i++)
+        {
+            put(data[i]);
+        }
+        m_records++;
+        return true;
+    }
+
+    // Length of the oldest record, header included; 0 if there is none
+    std::size_t front_len(void) const
+    {
+        return empty() ? 0 : record_header_len + at(4);
+    }
+
+    // Copy the oldest record, header included, to `out` and drop it;
+    // returns its length, 0 if the ring is empty
+    template<typename Container>
+    std::size_t pop(Container& out)
+    {
+        const std::size_t len = front_len();
+        for (std::size_t i = 0; i < len; i++)
+        {
+            out.push_back(at(i));
+        }
+        if (len > 0)
+        {
+            drop_front(len);
+        }
+        return len;
+    }
+};
+
+template<>
+class capture_ring<0>
+{
+public:
+    static constexpr std::size_t record_header_len = 5;
+    static constexpr std::size_t capacity() noexcept { return 0; }
+    std::size_t size() const noexcept { return 0; }
+    bool empty() const noexcept { return true; }
+    uint32_t records() const noexcept { return 0; }
+    uint32_t dropped() const noexcept { return 0; }
+    void clear(void) {}
+    bool push(uint32_t, const uint8_t*, uint8_t) { return false; }
+    std::size_t front_len(void) const { return 0; }
+    template<typename Container> std::size_t pop(Container&) { return 0; }
+};
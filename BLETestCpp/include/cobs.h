@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+
+// ------------------------------------------------------------
+// COBS framing (PacketWriter::set_framing)
+//
+//   0x00, COBS(command, length, payload, CRC16), 0x00
+//
+// The packet is the usual one with its 0xc0 0xde dropped; the CRC still
+// covers 0xc0 0xde, so the host checks it exactly as before. Consistent
+// overhead byte stuffing leaves no 0x00 inside a frame: each code byte
+// gives the distance to the next 0x00 it replaced, 0xff a run of 254
+// bytes with no 0x00 after it. A frame is found at the next 0x00 whatever
+// came before, and since it never ends in 0x0a the brain's stdout never
+// turns its last byte into \r\n.
+//
+// The leading 0x00 keeps console text (or a packet cut short) written
+// just before a frame from running into it. For a packet of n bytes
+// (0xc0 0xde included) a frame takes n + 1 + (n - 3) / 254 bytes: one more
+// than the packet up to 256 bytes.
+// ------------------------------------------------------------
+
+// How packets are delimited on the link
+enum class packet_framing : uint8_t
+{
+    sync_word, // 0xc0 0xde in front of every packet
+    cobs,      // 0x00, COBS of the packet without 0xc0 0xde, 0x00
+};
+
+constexpr uint8_t cobs_delimiter = 0x00;
+
+// Bytes a COBS frame takes past the end of the n-byte packet it was
+// encoded from
+constexpr std::size_t cobs_max_overhead(std::size_t n)
+{
+    return 1 + ((n > 3) ? (n - 3) / 254 : 0);
+}
+
+// Encode the n-byte packet at p (0xc0 0xde first) in place into a frame;
+// returns its length. p needs cobs_max_overhead(n) bytes of room after the
+// packet. Packets of at most 256 bytes are rewritten where they are; a
+// longer one moves the rest of the packet one byte along for every 254
+// bytes in a row without a 0x00.
+inline std::size_t cobs_encode_in_place(uint8_t* p, std::size_t n)
+{
+    p[0] = cobs_delimiter;
+    std::size_t code = 1; // where the current code byte goes
+    std::size_t end = n;
+    for (std::size_t i = 2; i < end; i++)
+    {
+        if (i - code == 255)
+        {
+            std::memmove(p + i + 1, p + i, end - i);
+            end++;
+            p[code] = 0xff;
+            code = i;
+            continue;
+        }
+        if (p[i] == 0)
+        {
+            p[code] = static_cast<uint8_t>(i - code);
+            code = i;
+        }
+    }
+    p[code] = static_cast<uint8_t>(end - code);
+    p[end] = cobs_delimiter;
+    return end + 1;
+}
+
+constexpr std::size_t cobs_error = ~static_cast<std::size_t>(0);
+
+// Decode the n bytes between two delimiters (so none of them is 0x00) into
+// out, which has room for n; returns the decoded length, or cobs_error if
+// they aren't a COBS frame
+inline std::size_t cobs_decode(const uint8_t* in, std::size_t n, uint8_t* out)
+{
+    if (n == 0)
+    {
+        return cobs_error;
+    }
+    // Without a 0xff code every byte but the first lands one place back,
+    // and each code byte turns into the 0x00 it stands for; so copy it all
+    // and hop from code to code
+    std::memcpy(out, in + 1, n - 1);
+    std::size_t code = 0;
+    while (in[code] != 0xff)
+    {
+        const std::size_t next = code + in[code];
+        if ((next >= n) || (next == code))
+        {
+            return (next == n) ? n - 1 : cobs_error;
+        }
+        out[next - 1] = 0;
+        code = next;
+    }
+
+    // frames longer than 254 bytes (or noise) take it run by run
+    std::size_t i = 0;
+    std::size_t o = 0;
+    while (i < n)
+    {
+        const uint8_t c = in[i++];
+        if (c - 1u > n - i)
+        {
+            return cobs_error;
+        }
+        std::memcpy(out + o, in + i, c - 1u);
+        i += c - 1u;
+        o += c - 1u;
+        if ((c != 0xff) && (i < n))
+        {
+            out[o++] = 0;
+        }
+    }
+    return o;
+}
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+
+// CRC-16-CCITT parameters
+constexpr uint16_t POLYNOMIAL_CRC16 = 0x1021;
+constexpr uint16_t CRC16_INIT = 0x0000;
+
+// Number of entries in crc16_shift_table; packets longer than this are
+// shifted in several steps
+constexpr std::size_t CRC16_SHIFT_TABLE_SIZE = 256;
+
+
+// ------------------------------------------------------------
+// Compile-time helpers (C++11 constexpr: single return, recursion only)
+// ------------------------------------------------------------
+namespace crc16_detail
+{
+    template<std::size_t... I> struct index_sequence {};
+
+    template<class A, class B> struct concat;
+    template<std::size_t... A, std::size_t... B>
+    struct concat<index_sequence<A...>, index_sequence<B...>>
+    {
+        using type = index_sequence<A..., (sizeof...(A) + B)...>;
+    };
+
+    // log-depth generator, so 1024-entry tables don't hit the template depth limit
+    template<std::size_t N> struct make_index_sequence
+        : concat<typename make_index_sequence<N / 2>::type,
+                 typename make_index_sequence<N - N / 2>::type> {};
+    template<> struct make_index_sequence<0> { using type = index_sequence<>; };
+    template<> struct make_index_sequence<1> { using type = index_sequence<0>; };
+
+    // multiply by x, modulo the polynomial
+    constexpr uint16_t mulx(uint16_t r)
+    {
+        return (r & 0x8000) ? static_cast<uint16_t>((r << 1) ^ POLYNOMIAL_CRC16)
+                            : static_cast<uint16_t>(r << 1);
+    }
+
+    constexpr uint16_t mulmod_step(uint16_t a, uint16_t b, int bit, uint16_t r)
+    {
+        return (bit < 0) ? r
+                         : mulmod_step(a, b, bit - 1,
+                                       static_cast<uint16_t>(mulx(r) ^ (((a >> bit) & 1) ? b : 0)));
+    }
+
+    // a * b mod polynomial
+    constexpr uint16_t mulmod(uint16_t a, uint16_t b)
+    {
+        return mulmod_step(a, b, 15, 0);
+    }
+
+    // x^(8 * nbytes) mod polynomial, i.e. the effect of nbytes zero bytes on the register
+    constexpr uint16_t x8n(std::size_t nbytes)
+    {
+        return (nbytes == 0) ? 1
+             : (nbytes & 1)  ? mulmod(x8n(nbytes - 1), 0x0100)
+                             : mulmod(x8n(nbytes / 2), x8n(nbytes / 2));
+    }
+
+    constexpr uint16_t table_entry_step(uint16_t crc, int bits)
+    {
+        return (bits == 0) ? crc : table_entry_step(mulx(crc), bits - 1);
+    }
+
+    // CRC of one byte followed by `shift` zero bytes
+    constexpr uint16_t table_entry(std::size_t byte, std::size_t shift)
+    {
+        return mulmod(table_entry_step(static_cast<uint16_t>(byte << 8), 8), x8n(shift));
+    }
+
+    // CRC of n bytes at p, as CRC(first half) shifted over the second half
+    // xor CRC(second half), so the recursion is only log2(n) deep
+    constexpr uint16_t crc_range(const uint8_t* p, std::size_t n)
+    {
+        return (n == 0) ? 0
+             : (n == 1) ? table_entry(p[0], 0)
+             : static_cast<uint16_t>(mulmod(crc_range(p, n / 2), x8n(n - n / 2)) ^ crc_range(p + n / 2, n - n / 2));
+    }
+
+    template<class Seq> struct slice_tables;
+    template<std::size_t... I>
+    struct slice_tables<index_sequence<I...>>
+    {
+        // table k occupies entries [256 * k, 256 * k + 255]
+        static constexpr uint16_t table[sizeof...(I)] = { table_entry(I % 256, I / 256)... };
+    };
+    template<std::size_t... I>
+    constexpr uint16_t slice_tables<index_sequence<I...>>::table[sizeof...(I)];
+
+    template<class Seq> struct shift_table;
+    template<std::size_t... I>
+    struct shift_table<index_sequence<I...>>
+    {
+        static constexpr uint16_t table[sizeof...(I)] = { x8n(I)... };
+    };
+    template<std::size_t... I>
+    constexpr uint16_t shift_table<index_sequence<I...>>::table[sizeof...(I)];
+}
+
+// Compile-time CRC16 of `len` bytes of a constexpr array
+constexpr uint16_t crc16_constexpr(const uint8_t* data, std::size_t len)
+{
+    return crc16_detail::crc_range(data, len);
+}
+
+// Lookup tables for slice-by-N: crc16_tables<N>::table[256 * k + b] is the
+// CRC of byte b followed by k zero bytes
+template<std::size_t N>
+struct crc16_tables : crc16_detail::slice_tables<typename crc16_detail::make_index_sequence<256 * N>::type>
+{
+    static_assert(N == 1 || N == 2 || N == 4 || N == 8, "crc16_tables<N>: N must be 1, 2, 4 or 8");
+};
+
+// crc16_shift_table[n] == x^(8n) mod POLYNOMIAL_CRC16
+using crc16_shift_table = crc16_detail::shift_table<
+    typename crc16_detail::make_index_sequence<CRC16_SHIFT_TABLE_SIZE>::type>;
+
+
+// ------------------------------------------------------------
+// Runtime CRC16
+// ------------------------------------------------------------
+
+// Feed one byte into a running CRC
+inline uint16_t crc16_update(uint16_t crc, uint8_t byte)
+{
+    return static_cast<uint16_t>((crc << 8) ^ crc16_tables<1>::table[(crc >> 8) ^ byte]);
+}
+
+// Feed `len` bytes into a running CRC; Slices > 1 processes 2, 4 or 8 bytes
+// per step at the cost of 512, 2048 or 4096 bytes of table. 8 is meant for
+// the host decoder; the brain stays on 4.
+template<std::size_t Slices = 1>
+uint16_t crc16_update(uint16_t crc, const uint8_t* data, std::size_t len)
+{
+    const uint16_t* const t = crc16_tables<Slices>::table;
+    if (Slices == 8)
+    {
+        for (; len >= 8; len -= 8, data += 8)
+        {
+            crc = t[256 * 7 + ((crc >> 8) ^ data[0])]
+                ^ t[256 * 6 + ((crc & 0xff) ^ data[1])]
+                ^ t[256 * 5 + data[2]]
+                ^ t[256 * 4 + data[3]]
+                ^ t[256 * 3 + data[4]]
+                ^ t[256 * 2 + data[5]]
+                ^ t[256 * 1 + data[6]]
+                ^ t[data[7]];
+        }
+    }
+    if (Slices >= 4)
+    {
+        for (; len >= 4; len -= 4, data += 4)
+        {
+            crc = t[256 * 3 + ((crc >> 8) ^ data[0])]
+                ^ t[256 * 2 + ((crc & 0xff) ^ data[1])]
+                ^ t[256 * 1 + data[2]]
+                ^ t[data[3]];
+        }
+    }
+    else if (Slices == 2)
+    {
+        for (; len >= 2; len -= 2, data += 2)
+        {
+            crc = t[256 + ((crc >> 8) ^ data[0])]
+                ^ t[(crc & 0xff) ^ data[1]];
+        }
+    }
+    for (; len > 0; --len, ++data)
+    {
+        crc = static_cast<uint16_t>((crc << 8) ^ t[(crc >> 8) ^ *data]);
+    }
+    return crc;
+}
+
+template<std::size_t Slices = 1>
+uint16_t crc16(const uint8_t* data, std::size_t len)
+{
+    return crc16_update<Slices>(CRC16_INIT, data, len);
+}
+
+// a * b mod POLYNOMIAL_CRC16
+inline uint16_t crc16_multiply(uint16_t a, uint16_t b)
+{
+    uint16_t r = 0;
+    for (int bit = 15; bit >= 0; --bit)
+    {
+        r = (r & 0x8000) ? static_cast<uint16_t>((r << 1) ^ POLYNOMIAL_CRC16)
+                         : static_cast<uint16_t>(r << 1);
+        if ((a >> bit) & 1)
+        {
+            r ^= b;
+        }
+    }
+    return r;
+}
+
+// Advance a CRC over `nbytes` zero bytes without touching the data
+inline uint16_t crc16_shift(uint16_t crc, std::size_t nbytes)
+{
+    while (nbytes >= CRC16_SHIFT_TABLE_SIZE)
+    {
+        crc = crc16_multiply(crc, crc16_shift_table::table[CRC16_SHIFT_TABLE_SIZE - 1]);
+        nbytes -= CRC16_SHIFT_TABLE_SIZE - 1;
+    }
+    return crc16_multiply(crc, crc16_shift_table::table[nbytes]);
+}
+
+// CRC16_INIT is zero and there is no final xor, so the CRC is linear:
+// overwriting the zero bytes at [offset, offset + 2) of an n-byte message with
+// `value` changes its CRC by crc16(value) shifted over the bytes after it.
+inline uint16_t crc16_patch_u16(uint16_t crc, uint16_t value, std::size_t bytes_after)
+{
+    uint16_t delta = crc16_update(CRC16_INIT, static_cast<uint8_t>(value >> 8));
+    delta = crc16_update(delta, static_cast<uint8_t>(value));
+    return crc ^ crc16_shift(delta, bytes_after);
+}
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include "crc16.h"
+
+
+// ------------------------------------------------------------
+// Commands from the host, read from stdin
+//
+// Same framing as the packets the brain sends: 0xc0 0xde, command,
+// var-int length, payload, CRC16. Commands are lower case, after the
+// packet they ask for:
+//   'f' (0x66)  resend the 0x46 data format; empty payload
+//   'h' (0x68)  trigger a pre-trigger capture, sent back as 0x48; empty
+//               payload
+//   'r' (0x72)  sample periods: var-int code, var-int period in ms, any
+//               number of pairs; the brain rounds each to whole ticks, and
+//               a period of 0 goes back to the one the entry was added
+//               with. Periods are part of the 0x46 format, so a new one
+//               comes with a new schema hash.
+//   's' (0x73)  subscribe: var-int codes to sample and send; an empty
+//               payload subscribes every code
+//   'u' (0x75)  unsubscribe: var-int codes to stop sampling; an empty
+//               payload unsubscribes every code. Unsubscribed entries stay
+//               in the 0x46 format, so codes don't move, but their getters
+//               aren't called and nothing is sent for them.
+//   'v' (0x76)  vision: u8 1 to send 0x49/0x56 snapshots, 0 to pause them
+// 'b' (0x62) is taken by the link benchmark in BLEBandwidthTest (see
+// link_bench.h).
+// Anything else on stdin (e.g. typed into a console) is skipped while
+// looking for the next 0xc0 0xde.
+// ------------------------------------------------------------
+
+constexpr uint8_t format_request_command = 0x66;
+constexpr uint8_t capture_trigger_command = 0x68;
+constexpr uint8_t rate_command = 0x72;
+constexpr uint8_t subscribe_command = 0x73;
+constexpr uint8_t unsubscribe_command = 0x75;
+constexpr uint8_t vision_command = 0x76;
+
+// Longest command payload the brain accepts: a subscribe or unsubscribe
+// for 32 two-byte codes
+constexpr std::size_t max_command_payload = 64;
+
+// Var-int at p[i], as pack_var_int() writes it: one byte below 128, else
+// two bytes, big-endian, with the top bit set. Advances i; false if it runs
+// past len.
+inline bool read_command_var_int(const uint8_t* p, std::size_t len, std::size_t& i, uint16_t& value)
+{
+    if (i >= len)
+    {
+        return false;
+    }
+    if (!(p[i] & 0x80))
+    {
+        value = p[i++];
+        return true;
+    }
+    if (i + 1 >= len)
+    {
+        return false;
+    }
+    value = static_cast<uint16_t>(((p[i] & 0x7f) << 8) | p[i + 1]);
+    i += 2;
+    return true;
+}
+
+// Frame a command for the brain: 0xc0 0xde, command, var-int length,
+// payload, CRC16; for the host side
+template<typename Container>
+void pack_host_command(Container& out, uint8_t command, const uint8_t* payload, std::size_t len)
+{
+    const std::size_t start = out.size();
+    out.push_back(0xc0);
+    out.push_back(0xde);
+    out.push_back(command);
+    if (len < 128)
+    {
+        out.push_back(static_cast<uint8_t>(len));
+    }
+    else
+    {
+        out.push_back(static_cast<uint8_t>((len >> 8) | 0x80));
+        out.push_back(static_cast<uint8_t>(len));
+    }
+    for (std::size_t i = 0; i < len; i++)
+    {
+        out.push_back(payload[i]);
+    }
+    uint16_t crc = CRC16_INIT;
+    for (std::size_t i = start; i < out.size(); i++)
+    {
+        crc = crc16_update(crc, out[i]);
+    }
+    out.push_back(static_cast<uint8_t>(crc >> 8));
+    out.push_back(static_cast<uint8_t>(crc));
+}
+
+// Byte-at-a-time command framer, so stdin can be drained a byte at a time
+// without blocking; MaxPayload bounds the payload it accepts
+template<std::size_t MaxPayload>
+class command_parser
+{
+private:
+    enum state : uint8_t
+    {
+        want_sync0,
+        want_sync1,
+        want_command,
+        want_len0,
+        want_len1,
+        want_payload,
+        want_crc0,
+        want_crc1,
+    };
+
+    std::array<uint8_t, MaxPayload> m_payload{};
+    state m_state = want_sync0;
+    uint8_t m_command = 0;
+    uint16_t m_len = 0;
+    uint16_t m_received = 0;
+    uint16_t m_crc = CRC16_INIT;
+    uint8_t m_crc_high = 0;
+    uint32_t m_crc_errors = 0;
+
+    void next(state s, uint8_t byte)
+    {
+        m_crc = crc16_update(m_crc, byte);
+        m_state = s;
+    }
+
+    void payload_or_crc(void)
+    {
+        m_received = 0;
+        m_state = (m_len == 0) ? want_crc0 : want_payload;
+    }
+
+public:
+    // Returns true when `byte` completes a command with a valid CRC; it
+    // stays in command() and payload() until the next feed()
+    bool feed(uint8_t byte)
+    {
+        switch (m_state)
+        {
+            case want_sync0:
+                if (byte == 0xc0)
+                {
+                    m_crc = CRC16_INIT;
+                    next(want_sync1, byte);
+                }
+                return false;
+
+            case want_sync1:
+                if (byte == 0xde)
+                {
+                    next(want_command, byte);
+                }
+                else if (byte != 0xc0) // another 0xc0 may still start one
+                {
+                    m_state = want_sync0;
+                }
+                return false;
+
+            case want_command:
+                m_command = byte;
+                next(want_len0, byte);
+                return false;
+
+            case want_len0:
+                m_len = byte & 0x7f;
+                next(want_len1, byte);
+                if (!(byte & 0x80))
+                {
+                    if (m_len > MaxPayload)
+                    {
+                        m_state = want_sync0;
+                        return false;
+                    }
+                    payload_or_crc();
+                }
+                return false;
+
+            case want_len1:
+                m_len = static_cast<uint16_t>((m_len << 8) | byte);
+                next(want_payload, byte);
+                if (m_len > MaxPayload)
+                {
+                    m_state = want_sync0;
+                    return false;
+                }
+                payload_or_crc();
+                return false;
+
+            case want_payload:
+                m_payload[m_received++] = byte;
+                next(want_payload, byte);
+                if (m_received == m_len)
+                {
+                    m_state = want_crc0;
+                }
+                return false;
+
+            case want_crc0:
+                m_crc_high = byte;
+                m_state = want_crc1;
+                return false;
+
+            case want_crc1:
+            default:
+                m_state = want_sync0;
+                if (((m_crc_high << 8) | byte) != m_crc)
+                {
+                    m_crc_errors++;
+                    return false;
+                }
+                return true;
+        }
+    }
+
+    uint8_t command() const { return m_command; }
+    const uint8_t* payload() const { return m_payload.data(); }
+    std::size_t size() const { return m_len; }
+    uint32_t crc_errors() const { return m_crc_errors; }
+};
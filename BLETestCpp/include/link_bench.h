@@ -0,0 +1,237 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "crc16.h"
+
+
+// ------------------------------------------------------------
+// Link benchmark (BLEBandwidthTest and c0de_linkbench)
+//
+// The host starts a run with a 'b' (0x62) command, framed as in
+// host_commands.h; payload, big-endian:
+//   u8  run id, echoed in everything the run sends
+//   u16 write size: bytes per fwrite, each one whole 0x42 block packet
+//   u16 writes per tick
+//   u16 tick in ms; 0 writes back to back
+//   u8  flush: 0 leaves it to stdio, 1 flushes after every write, 2 after
+//       every tick
+//   u16 stdout buffer size (setvbuf); 0 is unbuffered
+//   u16 duration in ms
+//
+// The brain answers with one block per write, 'B' (0x42):
+//   u8 run id, u32 sequence from 0, u32 brain timer (us) just before the
+//   fwrite, then filler bytes link_bench_filler(sequence, i) up to the
+//   write size
+// and when the run is over, 'K' (0x4B):
+//   u8 run id, u32 writes, u32 bytes fwrite took, u32 elapsed us,
+//   u32 short writes (fwrite took less than the whole block), u32 longest
+//   fwrite in us
+// Both are framed like every other brain packet, with a 2-byte length.
+// ------------------------------------------------------------
+
+constexpr uint8_t link_bench_command = 0x62;
+constexpr uint8_t link_bench_block_command = 0x42;
+constexpr uint8_t link_bench_done_command = 0x4b;
+
+constexpr std::size_t link_bench_config_len = 12;
+constexpr std::size_t link_bench_done_len = 21;
+// sync, command, 2-byte length, CRC
+constexpr std::size_t link_bench_framing_len = 7;
+// run id, sequence and time
+constexpr std::size_t link_bench_block_header_len = 9;
+constexpr std::size_t link_bench_min_write = link_bench_framing_len + link_bench_block_header_len;
+constexpr std::size_t link_bench_max_write = 2048;
+
+enum link_bench_flush : uint8_t
+{
+    link_bench_flush_none = 0,
+    link_bench_flush_write = 1,
+    link_bench_flush_tick = 2,
+};
+
+namespace link_bench_detail
+{
+inline void put_u16(uint8_t* p, uint16_t v)
+{
+    p[0] = static_cast<uint8_t>(v >> 8);
+    p[1] = static_cast<uint8_t>(v);
+}
+
+inline void put_u32(uint8_t* p, uint32_t v)
+{
+    put_u16(p, static_cast<uint16_t>(v >> 16));
+    put_u16(p + 2, static_cast<uint16_t>(v));
+}
+
+inline uint16_t get_u16(const uint8_t* p)
+{
+    return static_cast<uint16_t>((p[0] << 8) | p[1]);
+}
+
+inline uint32_t get_u32(const uint8_t* p)
+{
+    return (static_cast<uint32_t>(get_u16(p)) << 16) | get_u16(p + 2);
+}
+
+// 0xc0 0xde, command and 2-byte length at p; returns the header length
+inline std::size_t put_header(uint8_t* p, uint8_t command, std::size_t len)
+{
+    p[0] = 0xc0;
+    p[1] = 0xde;
+    p[2] = command;
+    put_u16(p + 3, static_cast<uint16_t>(len | 0x8000));
+    return 5;
+}
+
+// CRC of the `len` bytes at p, written after them; returns len + 2
+inline std::size_t put_crc(uint8_t* p, std::size_t len)
+{
+    put_u16(p + len, crc16<4>(p, len));
+    return len + 2;
+}
+} // namespace link_bench_detail
+
+struct link_bench_config
+{
+    uint8_t id = 0;
+    uint16_t write_size = 64;
+    uint16_t writes_per_tick = 1;
+    uint16_t tick_ms = 20;
+    uint8_t flush = link_bench_flush_write;
+    uint16_t buffer_size = 0;
+    uint16_t duration_ms = 5000;
+
+    // link_bench_config_len bytes at p
+    void pack(uint8_t* p) const
+    {
+        using namespace link_bench_detail;
+        p[0] = id;
+        put_u16(p + 1, write_size);
+        put_u16(p + 3, writes_per_tick);
+        put_u16(p + 5, tick_ms);
+        p[7] = flush;
+        put_u16(p + 8, buffer_size);
+        put_u16(p + 10, duration_ms);
+    }
+
+    // False if the payload is short or asks for what a run can't do
+    bool unpack(const uint8_t* p, std::size_t len)
+    {
+        using namespace link_bench_detail;
+        if (len < link_bench_config_len)
+        {
+            return false;
+        }
+        id = p[0];
+        write_size = get_u16(p + 1);
+        writes_per_tick = get_u16(p + 3);
+        tick_ms = get_u16(p + 5);
+        flush = p[7];
+        buffer_size = get_u16(p + 8);
+        duration_ms = get_u16(p + 10);
+        return (write_size >= link_bench_min_write) && (write_size <= link_bench_max_write)
+            && (writes_per_tick > 0) && (flush <= link_bench_flush_tick);
+    }
+};
+
+struct link_bench_result
+{
+    uint8_t id = 0;
+    uint32_t writes = 0;
+    uint32_t bytes = 0;
+    uint32_t elapsed_us = 0;
+    uint32_t short_writes = 0;
+    uint32_t longest_write_us = 0;
+
+    // link_bench_done_len bytes at p
+    void pack(uint8_t* p) const
+    {
+        using namespace link_bench_detail;
+        p[0] = id;
+        put_u32(p + 1, writes);
+        put_u32(p + 5, bytes);
+        put_u32(p + 9, elapsed_us);
+        put_u32(p + 13, short_writes);
+        put_u32(p + 17, longest_write_us);
+    }
+
+    bool unpack(const uint8_t* p, std::size_t len)
+    {
+        using namespace link_bench_detail;
+        if (len < link_bench_done_len)
+        {
+            return false;
+        }
+        id = p[0];
+        writes = get_u32(p + 1);
+        bytes = get_u32(p + 5);
+        elapsed_us = get_u32(p + 9);
+        short_writes = get_u32(p + 13);
+        longest_write_us = get_u32(p + 17);
+        return true;
+    }
+};
+
+// Filler byte i of a block's payload (counted from the start of the
+// payload); differs from block to block, so a block spliced from two
+// others doesn't check out
+inline uint8_t link_bench_filler(uint32_t sequence, std::size_t i)
+{
+    return static_cast<uint8_t>(sequence * 151 + i * 7 + (sequence >> 8));
+}
+
+// Whole 0x42 packet of `write_size` bytes at p
+inline void link_bench_block(uint8_t* p, std::size_t write_size, uint8_t id, uint32_t sequence, uint32_t time_us)
+{
+    using namespace link_bench_detail;
+    const std::size_t len = write_size - link_bench_framing_len;
+    uint8_t* payload = p + put_header(p, link_bench_block_command, len);
+    payload[0] = id;
+    put_u32(payload + 1, sequence);
+    put_u32(payload + 5, time_us);
+    for (std::size_t i = link_bench_block_header_len; i < len; i++)
+    {
+        payload[i] = link_bench_filler(sequence, i);
+    }
+    put_crc(p, write_size - 2);
+}
+
+// Whole 0x4B packet at p; returns its length
+inline std::size_t link_bench_done(uint8_t* p, const link_bench_result& result)
+{
+    using namespace link_bench_detail;
+    const std::size_t header = put_header(p, link_bench_done_command, link_bench_done_len);
+    result.pack(p + header);
+    return put_crc(p, header + link_bench_done_len);
+}
+
+// Checks a block's payload against its sequence number; false if any
+// filler byte is off
+inline bool link_bench_check_block(const uint8_t* payload, std::size_t len)
+{
+    if (len < link_bench_block_header_len)
+    {
+        return false;
+    }
+    const uint32_t sequence = link_bench_detail::get_u32(payload + 1);
+    for (std::size_t i = link_bench_block_header_len; i < len; i++)
+    {
+        if (payload[i] != link_bench_filler(sequence, i))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+inline uint32_t link_bench_block_sequence(const uint8_t* payload)
+{
+    return link_bench_detail::get_u32(payload + 1);
+}
+
+inline uint32_t link_bench_block_time_us(const uint8_t* payload)
+{
+    return link_bench_detail::get_u32(payload + 5);
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 1 has the logger time and count its own work and publish it as channels
+// of its own (see StructuredLogger::add_telemetry_channels()); 0 leaves
+// every hook an empty inline function
+#ifndef LOGGER_TELEMETRY
+#define LOGGER_TELEMETRY 0
+#endif
+
+// ticks between telemetry samples
+#ifndef LOGGER_TELEMETRY_DIVISOR
+#define LOGGER_TELEMETRY_DIVISOR 50
+#endif
+
+
+// What the logger measured of itself. The times are the worst (or, for
+// stall_us, the total) since the previous sample; the counts run from
+// startup, so a lost packet doesn't lose any.
+struct logger_telemetry_snapshot
+{
+    uint32_t frame_getter_us;   // getters and snapshot reads of one frame
+    uint16_t slowest_code;      // entry (or snapshot group's first entry) with
+    uint32_t slowest_getter_us; // the slowest getter, and what it took
+    uint32_t build_us;          // one packet, prepare_buffer() to send_packet()
+    uint32_t stall_us;          // writing to the output sink and flushing it
+    uint32_t max_stall_us;      // the longest of those
+    uint32_t bytes;             // handed to the output, framed
+    uint32_t splits;            // packets a frame's values didn't fit in
+    uint32_t drops;             // bytes pushed to a full buffer, numbers too big to pack
+};
+
+// Hooks the logger calls around each phase. Like the rest of the logger
+// it expects vex.h to be included first, for the timer. The state is one
+// per program, as there is one logger per brain; the sender thread and the
+// control loop update it without locking, so a count can be off by one.
+template<bool Enabled>
+class basic_logger_telemetry
+{
+private:
+    struct state
+    {
+        logger_telemetry_snapshot window{};
+        uint32_t frame_us = 0;
+        uint32_t build_start_us = 0;
+    };
+
+    static state& live(void)
+    {
+        static state s;
+        return s;
+    }
+
+public:
+    static constexpr bool enabled = true;
+
+    static uint32_t now(void)
+    {
+        return static_cast<uint32_t>(vex::timer::systemHighResolution());
+    }
+
+    // Sampling of a new frame starts
+    static void frame(void)
+    {
+        live().frame_us = 0;
+    }
+
+    // A getter (or snapshot read) for `code` took `us`
+    static void getter_time(uint16_t code, uint32_t us)
+    {
+        state& s = live();
+        s.frame_us += us;
+        if (s.frame_us > s.window.frame_getter_us)
+        {
+            s.window.frame_getter_us = s.frame_us;
+        }
+        if (us > s.window.slowest_getter_us)
+        {
+            s.window.slowest_getter_us = us;
+            s.window.slowest_code = code;
+        }
+    }
+
+    // ... that started at `start`
+    static void getter_done(uint16_t code, uint32_t start)
+    {
+        getter_time(code, now() - start);
+    }
+
+    static void build_start(void)
+    {
+        live().build_start_us = now();
+    }
+
+    static void build_done(void)
+    {
+        state& s = live();
+        const uint32_t us = now() - s.build_start_us;
+        if (us > s.window.build_us)
+        {
+            s.window.build_us = us;
+        }
+    }
+
+    // A write to the output sink and flush that started at `start` returned
+    static void stall_done(uint32_t start)
+    {
+        state& s = live();
+        const uint32_t us = now() - start;
+        s.window.stall_us += us;
+        if (us > s.window.max_stall_us)
+        {
+            s.window.max_stall_us = us;
+        }
+    }
+
+    static void sent(std::size_t bytes)
+    {
+        live().window.bytes += static_cast<uint32_t>(bytes);
+    }
+
+    static void split(void)
+    {
+        live().window.splits++;
+    }
+
+    static void drop(void)
+    {
+        live().window.drops++;
+    }
+
+    // Copy out what was measured and start the next window
+    static void read(logger_telemetry_snapshot& out)
+    {
+        state& s = live();
+        out = s.window;
+        s.window.frame_getter_us = 0;
+        s.window.slowest_code = 0;
+        s.window.slowest_getter_us = 0;
+        s.window.build_us = 0;
+        s.window.stall_us = 0;
+        s.window.max_stall_us = 0;
+    }
+};
+
+template<>
+class basic_logger_telemetry<false>
+{
+public:
+    static constexpr bool enabled = false;
+
+    static uint32_t now(void) { return 0; }
+    static void frame(void) {}
+    static void getter_time(uint16_t, uint32_t) {}
+    static void getter_done(uint16_t, uint32_t) {}
+    static void build_start(void) {}
+    static void build_done(void) {}
+    static void stall_done(uint32_t) {}
+    static void sent(std::size_t) {}
+    static void split(void) {}
+    static void drop(void) {}
+    static void read(logger_telemetry_snapshot&) {}
+};
+
+using logger_telemetry = basic_logger_telemetry<LOGGER_TELEMETRY != 0>;
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "output_sink.h"
+
+// Logical output channels; PacketWriter puts every packet on one by its
+// command (see output_channel_of), and text written with send_text() on
+// console
+enum class output_channel : uint8_t
+{
+    control, // 0x44, 0x43, 0x52, 0x54 and the 0x46 format they depend on
+    vision,  // 0x49, 0x56
+    console, // text
+    bulk,    // 0x48 captures
+};
+constexpr std::size_t output_channel_count = 4;
+
+inline output_channel output_channel_of(uint8_t command)
+{
+    switch (command & 0x7f)
+    {
+        case 0x49:
+        case 0x56:
+            return output_channel::vision;
+        case 0x48:
+            return output_channel::bulk;
+        default:
+            return output_channel::control;
+    }
+}
+
+// FIFO of whole packets (or text chunks) over a fixed buffer, built in
+// place like output_arena: write at tail(), then commit(). Each item has a
+// u16 length and the u16 scheduler tick it was queued at in front of it.
+// Items stay contiguous; the queue is compacted when the tail runs out of
+// room, and make_room() drops the oldest items if that isn't enough.
+class packet_queue
+{
+public:
+    static constexpr std::size_t item_header_len = 4;
+
+private:
+    uint8_t* m_data = nullptr;
+    std::size_t m_capacity = 0;
+    std::size_t m_head = 0; // header of the oldest item
+    std::size_t m_end = 0;  // one past the newest item
+    uint32_t m_dropped = 0;
+
+    void compact(void)
+    {
+        if (m_head > 0)
+        {
+            std::memmove(m_data, m_data + m_head, m_end - m_head);
+            m_end -= m_head;
+            m_head = 0;
+        }
+    }
+
+public:
+    void attach(uint8_t* data, std::size_t capacity)
+    {
+        m_data = data;
+        m_capacity = capacity;
+        m_head = 0;
+        m_end = 0;
+    }
+
+    bool attached() const noexcept { return m_data != nullptr; }
+    bool empty() const noexcept { return m_head == m_end; }
+    // bytes queued, item headers included
+    std::size_t pending() const noexcept { return m_end - m_head; }
+    // items dropped by make_room()
+    uint32_t dropped() const noexcept { return m_dropped; }
+
+    // whether an `n`-byte item fits without dropping anything
+    bool has_room(std::size_t n) const noexcept
+    {
+        return m_capacity - pending() >= item_header_len + n;
+    }
+
+    uint8_t* tail() noexcept { return m_data + m_end + item_header_len; }
+    std::size_t available() const noexcept
+    {
+        return (m_end + item_header_len < m_capacity) ? m_capacity - m_end - item_header_len : 0;
+    }
+
+    // `n` bytes were written at tail() during scheduler tick `tick`
+    void commit(std::size_t n, uint16_t tick)
+    {
+        m_data[m_end] = static_cast<uint8_t>(n >> 8);
+        m_data[m_end + 1] = static_cast<uint8_t>(n);
+        m_data[m_end + 2] = static_cast<uint8_t>(tick >> 8);
+        m_data[m_end + 3] = static_cast<uint8_t>(tick);
+        m_end += item_header_len + n;
+    }
+
+    // whether an `n`-byte item fits at all, with the queue emptied
+    bool fits(std::size_t n) const noexcept
+    {
+        return m_capacity >= item_header_len + n;
+    }
+
+    // Try to have `n` bytes available at tail(), dropping the oldest
+    // items if need be; false, dropping nothing, if even an empty queue is
+    // too small
+    bool make_room(std::size_t n)
+    {
+        if (available() >= n)
+        {
+            return true;
+        }
+        if (!fits(n))
+        {
+            return false;
+        }
+        compact();
+        while ((available() < n) && !empty())
+        {
+            pop_front();
+            m_dropped++;
+            compact();
+        }
+        return available() >= n;
+    }
+
+    const uint8_t* front_data() const noexcept { return m_data + m_head + item_header_len; }
+    std::size_t front_size() const noexcept { return (m_data[m_head] << 8) | m_data[m_head + 1]; }
+    uint16_t front_tick() const noexcept { return static_cast<uint16_t>((m_data[m_head + 2] << 8) | m_data[m_head + 3]); }
+
+    void pop_front(void)
+    {
+        m_head += item_header_len + front_size();
+        if (m_head == m_end)
+        {
+            m_head = 0;
+            m_end = 0;
+        }
+    }
+};
+
+// Priority scheduler between output channels, in place of output_arena
+// (see PacketWriter::set_output_scheduler): packets are queued per channel
+// and written out by service(), once per tick, highest priority (lowest
+// number) first.
+//
+// Each channel, and the link as a whole, can have a budget of bytes per
+// tick. A budget is a token bucket refilled by that much every tick and
+// capped at it: a packet goes out while the bucket is above zero, and may
+// overdraw it, so a packet bigger than the budget still goes, and the next
+// ticks make up for it. Priority 0 channels only count against the link
+// budget, they aren't held back by it: a control packet goes out the tick
+// it is queued, and only waits on the link behind at most one
+// lower-priority packet. Set the link budget to what the link carries in a
+// tick, so that is all that ever waits in the radio's own buffers, where
+// nothing can be reordered. Vision and console data take whatever is left
+// over; when a channel's queue is full its oldest items are dropped, so
+// what does go out is the newest. A packet too big for its channel's queue
+// even when that is empty goes out as it is sent, right after everything
+// queued ahead of it.
+//
+// Not thread safe; queue and service from the same thread.
+class output_scheduler
+{
+private:
+    struct channel
+    {
+        packet_queue queue;
+        uint8_t priority = 0;
+        uint16_t budget = 0; // 0 is unlimited
+        int32_t credit = 0;
+        uint32_t bytes_sent = 0;
+        uint16_t max_wait_ticks = 0;
+    };
+
+    std::array<channel, output_channel_count> m_channels{};
+    uint16_t m_link_budget = 0;
+    int32_t m_link_credit = 0;
+    uint16_t m_tick = 0;
+
+    static void refill(int32_t& credit, uint16_t budget)
+    {
+        credit += budget;
+        if (credit > budget)
+        {
+            credit = budget;
+        }
+    }
+
+    channel& at(output_channel ch) { return m_channels[static_cast<std::size_t>(ch)]; }
+    const channel& at(output_channel ch) const { return m_channels[static_cast<std::size_t>(ch)]; }
+
+public:
+    // Queue `ch`'s packets in `backing`, at `priority` (0 is the highest),
+    // sending at most `budget` bytes of them per tick (0 for no limit).
+    // Packets on channels without a queue are written out as they are sent.
+    template<std::size_t N>
+    void set_channel(output_channel ch, std::array<uint8_t, N>& backing, uint8_t priority, uint16_t budget = 0)
+    {
+        static_assert(N < 65536, "output_scheduler: queue too big for the u16 item lengths");
+        channel& c = at(ch);
+        c.queue.attach(backing.data(), N);
+        c.priority = priority;
+        c.budget = budget;
+        c.credit = budget;
+    }
+
+    // Bytes per tick the link carries; 0 (the default) doesn't pace it
+    void set_link_budget(uint16_t bytes_per_tick)
+    {
+        m_link_budget = bytes_per_tick;
+        m_link_credit = bytes_per_tick;
+    }
+
+    // The queue for `ch`'s packets, or nullptr if they aren't queued
+    packet_queue* queue(output_channel ch)
+    {
+        channel& c = at(ch);
+        return c.queue.attached() ? &c.queue : nullptr;
+    }
+
+    uint16_t tick(void) const noexcept { return m_tick; }
+    std::size_t pending(output_channel ch) const { return at(ch).queue.pending(); }
+    uint32_t dropped(output_channel ch) const { return at(ch).queue.dropped(); }
+    uint32_t bytes_sent(output_channel ch) const { return at(ch).bytes_sent; }
+    // longest a packet on `ch` has waited, in service() calls
+    uint16_t max_wait_ticks(output_channel ch) const { return at(ch).max_wait_ticks; }
+
+    // Write out what the budgets allow, highest priority first; once per
+    // tick
+    void service(void)
+    {
+        if (m_link_budget > 0)
+        {
+            refill(m_link_credit, m_link_budget);
+        }
+        for (auto& c : m_channels)
+        {
+            if (c.budget > 0)
+            {
+                refill(c.credit, c.budget);
+            }
+        }
+
+        // channels by priority, in channel order within one
+        std::array<channel*, output_channel_count> order;
+        for (std::size_t i = 0; i < output_channel_count; i++)
+        {
+            std::size_t j = i;
+            for (; (j > 0) && (order[j - 1]->priority > m_channels[i].priority); j--)
+            {
+                order[j] = order[j - 1];
+            }
+            order[j] = &m_channels[i];
+        }
+
+        bool wrote = false;
+        for (channel* c : order)
+        {
+            const bool paced = (m_link_budget > 0) && (c->priority > 0);
+            while (!c->queue.empty() && (!paced || (m_link_credit > 0)))
+            {
+                if ((c->budget > 0) && (c->credit <= 0))
+                {
+                    break;
+                }
+                const std::size_t len = c->queue.front_size();
+                logger_sink().write(c->queue.front_data(), len);
+                wrote = true;
+                const uint16_t waited = static_cast<uint16_t>(m_tick - c->queue.front_tick());
+                if (waited > c->max_wait_ticks)
+                {
+                    c->max_wait_ticks = waited;
+                }
+                c->bytes_sent += len;
+                c->credit -= static_cast<int32_t>(len);
+                m_link_credit -= static_cast<int32_t>(len);
+                c->queue.pop_front();
+            }
+        }
+        if (wrote)
+        {
+            logger_sink().flush();
+        }
+        m_tick++;
+    }
+
+    // Write out everything queued, whatever the budgets
+    void drain(void)
+    {
+        for (auto& c : m_channels)
+        {
+            write_all(c);
+        }
+        logger_sink().flush();
+    }
+
+    // The same for `ch` alone, e.g. ahead of a packet too big for its queue
+    void drain(output_channel ch)
+    {
+        write_all(at(ch));
+        logger_sink().flush();
+    }
+
+private:
+    static void write_all(channel& c)
+    {
+        while (!c.queue.empty())
+        {
+            logger_sink().write(c.queue.front_data(), c.queue.front_size());
+            c.bytes_sent += c.queue.front_size();
+            c.queue.pop_front();
+        }
+    }
+};
@@ -0,0 +1,312 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+#include "vex.h"
+
+// Where the logger's bytes end up: every packet, arena flush and scheduler
+// write goes to logger_sink(), an instance of this type; e.g.
+//   -DLOGGER_OUTPUT_SINK='tee_sink<stdout_sink, file_sink<4096>>'
+// records to the SD card while still streaming to the host. A sink is any
+// class with
+//   void write(const uint8_t* data, std::size_t len)
+//   void flush(void)
+// called as one write per packet (or run of whole packets, or text) and a
+// flush where the logger used to fflush stdout; the type is fixed at
+// compile time, so neither is a virtual call.
+#ifndef LOGGER_OUTPUT_SINK
+#define LOGGER_OUTPUT_SINK stdout_sink
+#endif
+
+
+// stdout, as the logger has always written it
+class stdout_sink
+{
+public:
+    void write(const uint8_t* data, std::size_t len)
+    {
+        fwrite(data, 1, len, stdout);
+    }
+
+    void flush(void)
+    {
+        fflush(stdout);
+    }
+};
+
+// The newest Capacity bytes written, in RAM; older bytes are overwritten
+// as newer ones come in, so what read() returns can start part way into
+// a packet (the host skips to the next sync word). Not thread safe.
+template<std::size_t Capacity>
+class ring_sink
+{
+private:
+    std::array<uint8_t, Capacity> m_bytes{};
+    std::size_t m_tail = 0; // oldest byte
+    std::size_t m_size = 0;
+    uint64_t m_written = 0;
+    uint64_t m_overwritten = 0;
+
+public:
+    static constexpr std::size_t capacity() noexcept { return Capacity; }
+
+    std::size_t size() const noexcept { return m_size; }
+    // bytes written since startup, and how many of them were lost to newer ones
+    uint64_t written() const noexcept { return m_written; }
+    uint64_t overwritten() const noexcept { return m_overwritten; }
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        m_written += len;
+        if (len >= Capacity)
+        {
+            // only the last Capacity bytes survive
+            m_overwritten += m_size + len - Capacity;
+            std::memcpy(m_bytes.data(), data + len - Capacity, Capacity);
+            m_tail = 0;
+            m_size = Capacity;
+            return;
+        }
+        if (m_size + len > Capacity)
+        {
+            const std::size_t drop = m_size + len - Capacity;
+            m_tail = (m_tail + drop) % Capacity;
+            m_size -= drop;
+            m_overwritten += drop;
+        }
+        const std::size_t head = (m_tail + m_size) % Capacity;
+        const std::size_t first = (len < Capacity - head) ? len : Capacity - head;
+        std::memcpy(&m_bytes[head], data, first);
+        std::memcpy(m_bytes.data(), data + first, len - first);
+        m_size += len;
+    }
+
+    void flush(void) {}
+
+    // Take up to `max` of the oldest bytes out; returns how many
+    std::size_t read(uint8_t* out, std::size_t max)
+    {
+        const std::size_t len = (max < m_size) ? max : m_size;
+        const std::size_t first = (len < Capacity - m_tail) ? len : Capacity - m_tail;
+        std::memcpy(out, &m_bytes[m_tail], first);
+        std::memcpy(out + first, m_bytes.data(), len - first);
+        m_tail = (m_tail + len) % Capacity;
+        m_size -= len;
+        return len;
+    }
+
+    void clear(void)
+    {
+        m_tail = 0;
+        m_size = 0;
+    }
+};
+
+// Recording to a file, e.g. on the brain's SD card, in whole BlockSize
+// blocks: one unbuffered write per block, every block at a multiple of
+// BlockSize in the file. Each block starts with an index record, so a
+// reader can start at any block (c0de_decode --block-file, and
+// c0de::read_block_file()):
+//   0xc0 0xdb, u8 version (1), u8 log2(BlockSize), u32 block number from
+//   0, u32 brain timer (us) when the block was started, u16 bytes of the
+//   block in use (index record included; 0 for all of it), u16 offset of
+//   the first write that starts in the block, 0xffff if none does
+// then the bytes written, as they came. flush() leaves the block open;
+// sync() writes out a partial one and close() does and closes the file.
+constexpr uint8_t file_sink_magic0 = 0xc0;
+constexpr uint8_t file_sink_magic1 = 0xdb;
+constexpr uint8_t file_sink_version = 1;
+constexpr std::size_t file_sink_index_len = 16;
+constexpr uint16_t file_sink_no_start = 0xffff;
+
+template<std::size_t BlockSize>
+class file_sink
+{
+    static_assert((BlockSize >= 512) && (BlockSize <= 65536) && ((BlockSize & (BlockSize - 1)) == 0),
+                  "file_sink: BlockSize must be a power of two from 512 to 65536");
+
+private:
+    FILE* m_file = nullptr;
+    std::array<uint8_t, BlockSize> m_block{};
+    std::size_t m_used = 0; // 0 until the block has its index record
+    uint16_t m_first_start = file_sink_no_start;
+    uint32_t m_block_number = 0;
+    uint32_t m_blocks_written = 0;
+    uint32_t m_failed_writes = 0;
+
+    static void put_u16(uint8_t* p, uint16_t v)
+    {
+        p[0] = static_cast<uint8_t>(v >> 8);
+        p[1] = static_cast<uint8_t>(v);
+    }
+
+    static void put_u32(uint8_t* p, uint32_t v)
+    {
+        put_u16(p, static_cast<uint16_t>(v >> 16));
+        put_u16(p + 2, static_cast<uint16_t>(v));
+    }
+
+    static uint8_t log2_block_size(void)
+    {
+        uint8_t n = 0;
+        while ((static_cast<std::size_t>(1) << n) < BlockSize)
+        {
+            n++;
+        }
+        return n;
+    }
+
+    void start_block(void)
+    {
+        m_block[0] = file_sink_magic0;
+        m_block[1] = file_sink_magic1;
+        m_block[2] = file_sink_version;
+        m_block[3] = log2_block_size();
+        put_u32(&m_block[4], m_block_number);
+        put_u32(&m_block[8], static_cast<uint32_t>(vex::timer::systemHighResolution()));
+        m_used = file_sink_index_len;
+        m_first_start = file_sink_no_start;
+    }
+
+    // Finish the index record and write the block out, padded to BlockSize
+    void write_block(void)
+    {
+        put_u16(&m_block[12], static_cast<uint16_t>(m_used == BlockSize ? 0 : m_used));
+        put_u16(&m_block[14], m_first_start);
+        std::memset(&m_block[m_used], 0, BlockSize - m_used);
+        if (fwrite(m_block.data(), 1, BlockSize, m_file) == BlockSize)
+        {
+            m_blocks_written++;
+        }
+        else
+        {
+            m_failed_writes++;
+        }
+        m_block_number++;
+        m_used = 0;
+    }
+
+public:
+    static constexpr std::size_t block_size() noexcept { return BlockSize; }
+
+    ~file_sink()
+    {
+        close();
+    }
+
+    // Start recording to `path`, replacing it; false if it can't be opened
+    bool open(const char* path)
+    {
+        close();
+        m_file = fopen(path, "wb");
+        if (m_file == nullptr)
+        {
+            return false;
+        }
+        // the blocks are the buffering
+        setvbuf(m_file, nullptr, _IONBF, 0);
+        m_block_number = 0;
+        m_blocks_written = 0;
+        m_failed_writes = 0;
+        return true;
+    }
+
+    bool is_open(void) const noexcept { return m_file != nullptr; }
+    uint32_t blocks_written(void) const noexcept { return m_blocks_written; }
+    // blocks the file took less of than BlockSize (e.g. the card is full)
+    uint32_t failed_writes(void) const noexcept { return m_failed_writes; }
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        if ((m_file == nullptr) || (len == 0))
+        {
+            return;
+        }
+        if (m_used == 0)
+        {
+            start_block();
+        }
+        if (m_first_start == file_sink_no_start)
+        {
+            m_first_start = static_cast<uint16_t>(m_used);
+        }
+        while (len > 0)
+        {
+            const std::size_t n = (len < BlockSize - m_used) ? len : BlockSize - m_used;
+            std::memcpy(&m_block[m_used], data, n);
+            m_used += n;
+            data += n;
+            len -= n;
+            if (m_used == BlockSize)
+            {
+                write_block();
+                // the rest of this write continues a packet
+                if (len > 0)
+                {
+                    start_block();
+                }
+            }
+        }
+    }
+
+    // Packets go out a block at a time; see sync()
+    void flush(void) {}
+
+    // Write out the block in progress, padded, e.g. before the program
+    // stops or the card is taken out
+    void sync(void)
+    {
+        if ((m_file != nullptr) && (m_used > 0))
+        {
+            write_block();
+        }
+    }
+
+    void close(void)
+    {
+        if (m_file != nullptr)
+        {
+            sync();
+            fclose(m_file);
+            m_file = nullptr;
+        }
+    }
+};
+
+// Both sinks get every write, from the same bytes
+template<typename First, typename Second>
+class tee_sink
+{
+private:
+    First m_first;
+    Second m_second;
+
+public:
+    First& first(void) { return m_first; }
+    Second& second(void) { return m_second; }
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        m_first.write(data, len);
+        m_second.write(data, len);
+    }
+
+    void flush(void)
+    {
+        m_first.flush();
+        m_second.flush();
+    }
+};
+
+using logger_output_sink = LOGGER_OUTPUT_SINK;
+
+// The sink the logger writes to; one per program, like stdout
+inline logger_output_sink& logger_sink(void)
+{
+    static logger_output_sink sink;
+    return sink;
+}
@@ -0,0 +1,347 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "bit_stream.h"
+
+
+// ------------------------------------------------------------
+// Rice-coded structured data (0x52)
+//
+// payload: schema hash, keyframe:1 seq:7, var-int first code, 1-byte
+// bitmap length and bitmap as in 0x43, then MSB first
+//   k:4, then for every element of every present value, in code order,
+//   u = zig-zag of the element's difference from its last sent value:
+//     k < 15:  q = u >> k in unary (q ones and a zero), then the low k
+//              bits of u; q >= 15 is sent as 15 ones and u at full width
+//     k = 15:  u at full width, for packets that don't compress
+//   padded to a whole byte.
+//
+// Elements are the big-endian values of 0x44, 1, 2, 4 or 8 bytes wide, an
+// array entry's one by one. Differences are taken on their bits modulo
+// 2^width, so floats and unsigned values need nothing special and the
+// decoder gets the exact bits back. A keyframe's differences are from
+// zero; between keyframes a lost packet (a gap in seq) leaves the decoder
+// out of step until the next one.
+// ------------------------------------------------------------
+
+constexpr int rice_parameter_bits = 4;
+constexpr int rice_raw = 15;           // k of a packet sent at full width
+constexpr uint32_t rice_escape = 15;   // unary length of an escaped value
+constexpr int rice_keyframe_flag = 0x80;
+
+inline uint64_t rice_mask(int width)
+{
+    return width >= 64 ? ~static_cast<uint64_t>(0) : (static_cast<uint64_t>(1) << width) - 1;
+}
+
+inline uint64_t rice_load(const uint8_t* p, int size)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < size; i++)
+    {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+inline void rice_store(uint8_t* p, int size, uint64_t value)
+{
+    for (int i = size - 1; i >= 0; i--)
+    {
+        p[i] = static_cast<uint8_t>(value);
+        value >>= 8;
+    }
+}
+
+// zig-zag of the `width`-bit two's complement difference `diff`: 0, -1, 1,
+// -2 ... map to 0, 1, 2, 3 ..., so small changes either way are small
+inline uint64_t rice_zigzag(uint64_t diff, int width)
+{
+    const uint64_t sign = static_cast<uint64_t>(1) << (width - 1);
+    const uint64_t extended = ((diff & rice_mask(width)) ^ sign) - sign;
+    return (extended << 1) ^ (0 - (extended >> 63));
+}
+
+// Inverse of rice_zigzag(), modulo 2^width
+inline uint64_t rice_unzigzag(uint64_t u, int width)
+{
+    return ((u >> 1) ^ (0 - (u & 1))) & rice_mask(width);
+}
+
+inline uint32_t rice_bits(uint64_t u, int k, int width)
+{
+    if (k == rice_raw)
+    {
+        return width;
+    }
+    const uint64_t q = u >> k;
+    return q < rice_escape ? static_cast<uint32_t>(q) + 1 + k : rice_escape + width;
+}
+
+template<typename Container>
+void rice_write(bit_writer<Container>& bits, uint64_t u, int k, int width)
+{
+    if (k == rice_raw)
+    {
+        bits.write_long(u, width);
+        return;
+    }
+    const uint64_t q = u >> k;
+    if (q < rice_escape)
+    {
+        // q ones, a zero and k bits: at most 29 bits, so in two writes
+        // only when it's over 24
+        const int unary = static_cast<int>(q) + 1;
+        if (unary + k <= 24)
+        {
+            bits.write((((2u << q) - 2) << k) | (static_cast<uint32_t>(u) & ((1u << k) - 1)), unary + k);
+        }
+        else
+        {
+            bits.write((2u << q) - 2, unary);
+            bits.write(static_cast<uint32_t>(u) & ((1u << k) - 1), k);
+        }
+    }
+    else
+    {
+        bits.write((1u << rice_escape) - 1, rice_escape);
+        bits.write_long(u, width);
+    }
+}
+
+inline uint64_t rice_read(bit_reader& bits, int k, int width)
+{
+    if (k == rice_raw)
+    {
+        return bits.read_long(width);
+    }
+    uint32_t q = 0;
+    while ((q < rice_escape) && bits.read(1))
+    {
+        q++;
+    }
+    if (q == rice_escape)
+    {
+        return bits.read_long(width);
+    }
+    return (static_cast<uint64_t>(q) << k) | bits.read(k);
+}
+
+// Encoder side: a frame's values are added in code order, then encode()
+// packs them into as many 0x52 bodies as it takes. The zig-zag mapped
+// differences are kept in a fixed buffer, at the values' own width;
+// nothing is allocated. Each packet gets the k that makes it smallest.
+template<std::size_t MaxChannels, std::size_t MaxBytes>
+class rice_encoder
+{
+private:
+    struct channel
+    {
+        uint16_t code;
+        uint8_t element_size;
+        uint16_t offset; // into m_mapped
+        uint16_t size;
+    };
+
+    std::array<channel, MaxChannels> m_channels{};
+    std::array<uint8_t, MaxBytes> m_mapped{}; // big-endian, like the values
+    std::size_t m_count = 0;
+    std::size_t m_bytes = 0;
+    bool m_keyframe = false;
+    uint8_t m_seq = 0;
+
+    // zig-zag mapped differences of channel i, one call per element
+    template<typename Func>
+    void for_each_difference(std::size_t i, Func func) const
+    {
+        const channel& ch = m_channels[i];
+        const int width = 8 * ch.element_size;
+        for (int j = 0; j < ch.size; j += ch.element_size)
+        {
+            func(rice_load(&m_mapped[ch.offset + j], ch.element_size), width);
+        }
+    }
+
+    // bits of channels [first, end) at every k. An element of bit length L
+    // costs 1 + k bits at k >= L and escapes at k <= L - 5, so only the 4
+    // k in between are worked out one by one.
+    void cost(std::size_t first, std::size_t end, std::array<uint32_t, 16>& bits) const
+    {
+        std::array<uint32_t, rice_raw> from{};    // elements by L
+        std::array<uint32_t, rice_raw> escaped{}; // their bits, by L - 5
+        uint32_t raw = 0;
+        bits.fill(0);
+        for (std::size_t i = first; i < end; i++)
+        {
+            for_each_difference(i, [&](uint64_t u, int width) {
+                raw += width;
+                const int length = (u == 0) ? 0 : 64 - __builtin_clzll(u);
+                if (length < rice_raw)
+                {
+                    from[length]++;
+                }
+                for (int k = (length > 4) ? length - 4 : 0; (k < length) && (k < rice_raw); k++)
+                {
+                    bits[k] += rice_bits(u, k, width);
+                }
+                if (length >= 5)
+                {
+                    escaped[(length - 5 < rice_raw) ? length - 5 : rice_raw - 1] += rice_escape + width;
+                }
+            });
+        }
+        uint32_t escapes = 0;
+        for (int k = rice_raw - 1; k >= 0; k--)
+        {
+            escapes += escaped[k];
+            bits[k] += escapes;
+        }
+        uint32_t below = 0;
+        for (int k = 0; k < rice_raw; k++)
+        {
+            below += from[k];
+            bits[k] += below * (1 + k);
+        }
+        bits[rice_raw] = raw;
+    }
+
+    static int best(const std::array<uint32_t, 16>& bits)
+    {
+        int k = 0;
+        for (int i = 1; i < 16; i++)
+        {
+            if (bits[i] < bits[k])
+            {
+                k = i;
+            }
+        }
+        return k;
+    }
+
+    static std::size_t var_int_size(uint16_t num)
+    {
+        return num < 128 ? 1 : 2;
+    }
+
+public:
+    static constexpr std::size_t max_channels = MaxChannels;
+
+    // Start a frame; a keyframe's differences are from zero
+    void begin(bool keyframe)
+    {
+        m_count = 0;
+        m_bytes = 0;
+        m_keyframe = keyframe;
+    }
+
+    bool keyframe() const noexcept { return m_keyframe; }
+    bool empty() const noexcept { return m_count == 0; }
+    std::size_t size() const noexcept { return m_count; }
+
+    // Add `size` bytes of `element_size`-byte elements at `value`, codes in
+    // ascending order. `reference` holds the code's last sent value and
+    // gets this one. False if the frame is full.
+    bool add(uint16_t code, int element_size, const uint8_t* value, uint8_t* reference, int size)
+    {
+        if ((m_count >= MaxChannels) || (m_bytes + size > MaxBytes))
+        {
+            return false;
+        }
+        for (int j = 0; j < size; j += element_size)
+        {
+            const uint64_t v = rice_load(value + j, element_size);
+            const uint64_t r = m_keyframe ? 0 : rice_load(reference + j, element_size);
+            rice_store(&m_mapped[m_bytes + j], element_size, rice_zigzag(v - r, 8 * element_size));
+        }
+        std::memcpy(reference, value, size);
+        m_channels[m_count++] = channel{code, static_cast<uint8_t>(element_size), static_cast<uint16_t>(m_bytes),
+                                        static_cast<uint16_t>(size)};
+        m_bytes += size;
+        return true;
+    }
+
+    // Pack a 0x52 body (after the schema hash) of the channels from `next`
+    // on that fit in `capacity` bytes; returns the first one left over,
+    // size() when done, `next` itself if not even it fits
+    template<typename Container>
+    std::size_t encode(Container& buf, std::size_t next, std::size_t capacity)
+    {
+        if (next >= m_count)
+        {
+            return next;
+        }
+        const uint16_t first_code = m_channels[next].code;
+        const std::size_t fixed = 1 + var_int_size(first_code) + 1;
+
+        // usually all that are left fit. If not, take channels while they
+        // fit at the k that suits all of them, then pick the k that suits
+        // the ones taken; that can only make the packet smaller.
+        std::array<uint32_t, 16> bits;
+        cost(next, m_count, bits);
+        const int frame_k = best(bits);
+        const std::size_t all_bitmap_len = (m_channels[m_count - 1].code - first_code) / 8 + 1;
+        const bool all_fit = fixed + all_bitmap_len + (rice_parameter_bits + bits[frame_k] + 7) / 8 <= capacity;
+        std::size_t end = all_fit ? m_count : next;
+        uint32_t taken_bits = rice_parameter_bits;
+        for (std::size_t i = next; !all_fit && (i < m_count); i++)
+        {
+            uint32_t channel_bits = 0;
+            for_each_difference(i, [&channel_bits, frame_k](uint64_t u, int width) {
+                channel_bits += rice_bits(u, frame_k, width);
+            });
+            const std::size_t bitmap_len = (m_channels[i].code - first_code) / 8 + 1;
+            if (fixed + bitmap_len + (taken_bits + channel_bits + 7) / 8 > capacity)
+            {
+                break;
+            }
+            taken_bits += channel_bits;
+            end = i + 1;
+        }
+        if (end == next)
+        {
+            return next;
+        }
+        if (end < m_count)
+        {
+            cost(next, end, bits);
+        }
+        const int k = best(bits);
+
+        buf.push_back(static_cast<uint8_t>((m_keyframe ? rice_keyframe_flag : 0) | (m_seq++ & 0x7f)));
+        if (first_code < 128)
+        {
+            buf.push_back(static_cast<uint8_t>(first_code));
+        }
+        else
+        {
+            buf.push_back(static_cast<uint8_t>((first_code >> 8) | 0x80));
+            buf.push_back(static_cast<uint8_t>(first_code));
+        }
+        const std::size_t bitmap_len = (m_channels[end - 1].code - first_code) / 8 + 1;
+        buf.push_back(static_cast<uint8_t>(bitmap_len));
+        std::size_t i = next;
+        for (std::size_t byte = 0; byte < bitmap_len; byte++)
+        {
+            uint8_t present = 0;
+            for (; (i < end) && (static_cast<std::size_t>(m_channels[i].code - first_code) < 8 * (byte + 1)); i++)
+            {
+                present |= 1 << ((m_channels[i].code - first_code) & 7);
+            }
+            buf.push_back(present);
+        }
+        bit_writer<Container> writer(buf);
+        writer.write(static_cast<uint32_t>(k), rice_parameter_bits);
+        for (std::size_t j = next; j < end; j++)
+        {
+            for_each_difference(j, [&writer, k](uint64_t u, int width) {
+                rice_write(writer, u, k, width);
+            });
+        }
+        writer.flush();
+        return end;
+    }
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+// What push() does when the ring is full
+enum class overflow_policy
+{
+    drop_newest, // keep what's queued, reject the new value
+    drop_oldest, // discard the oldest queued value to make room
+};
+
+// Fixed-capacity, lock-free single-producer/single-consumer ring.
+// push() must only be called from one thread and pop() from one other
+// thread; nothing here depends on vex, so it runs the same under std::thread.
+//
+// Every slot has a sequence number saying whose turn it is: i when free
+// for the producer's i-th push, i + 1 when it holds that value, and it
+// moves on by Capacity when the consumer is done with it. The consumer
+// claims the oldest value by moving the tail before it copies the slot,
+// and drop_oldest only overwrites a value the producer took back from the
+// tail itself, so neither side ever touches a slot the other is using. If
+// the consumer has just claimed the oldest value and is still copying it,
+// a drop_oldest push drops the new value instead.
+template<typename T, std::size_t Capacity, overflow_policy Policy = overflow_policy::drop_newest>
+class spsc_ring
+{
+    static_assert((Capacity & (Capacity - 1)) == 0 && Capacity > 0, "spsc_ring: Capacity must be a power of two");
+
+private:
+    std::array<T, Capacity> m_slots{};
+    std::array<std::atomic<uint32_t>, Capacity> m_turns;
+    // free-running counters; index into m_slots with & (Capacity - 1)
+    std::atomic<uint32_t> m_head{0}; // next slot to write, only the producer stores
+    std::atomic<uint32_t> m_tail{0}; // next slot to read, the producer also moves it when dropping oldest
+    std::atomic<uint32_t> m_dropped{0};
+
+public:
+    spsc_ring()
+    {
+        for (std::size_t i = 0; i < Capacity; i++)
+        {
+            m_turns[i].store(static_cast<uint32_t>(i), std::memory_order_relaxed);
+        }
+    }
+
+    static constexpr std::size_t capacity() noexcept { return Capacity; }
+
+    std::size_t size() const noexcept
+    {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    bool empty() const noexcept { return size() == 0; }
+
+    // Values lost to the overflow policy
+    uint32_t dropped() const noexcept { return m_dropped.load(std::memory_order_relaxed); }
+
+    // Producer side; returns false if `value` was dropped
+    bool push(const T& value)
+    {
+        const uint32_t head = m_head.load(std::memory_order_relaxed);
+        std::atomic<uint32_t>& turn = m_turns[head & (Capacity - 1)];
+        if (turn.load(std::memory_order_acquire) != head)
+        {
+            // full: the slot still holds the value Capacity pushes back,
+            // or the consumer is copying it out
+            if (Policy == overflow_policy::drop_newest)
+            {
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            uint32_t oldest = head - static_cast<uint32_t>(Capacity);
+            if (!m_tail.compare_exchange_strong(oldest, oldest + 1, std::memory_order_acq_rel))
+            {
+                // the consumer claimed it first and may still be copying
+                m_dropped.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_slots[head & (Capacity - 1)] = value;
+        turn.store(head + 1, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; returns false if the ring is empty
+    bool pop(T& value)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        while (true)
+        {
+            if (tail == m_head.load(std::memory_order_acquire))
+            {
+                return false;
+            }
+            // claim the slot before reading it; under drop_oldest the
+            // producer may have taken it back first, then try the next
+            if (Policy == overflow_policy::drop_newest)
+            {
+                m_tail.store(tail + 1, std::memory_order_relaxed);
+                break;
+            }
+            if (m_tail.compare_exchange_strong(tail, tail + 1, std::memory_order_acq_rel))
+            {
+                break;
+            }
+        }
+        std::atomic<uint32_t>& turn = m_turns[tail & (Capacity - 1)];
+        value = m_slots[tail & (Capacity - 1)];
+        turn.store(tail + static_cast<uint32_t>(Capacity), std::memory_order_release);
+        return true;
+    }
+};
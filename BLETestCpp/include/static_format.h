@@ -0,0 +1,215 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "crc16.h"
+
+
+// ------------------------------------------------------------
+// Compile-time byte strings, for packets that never change
+//
+// byte_seq<...> holds its bytes as a static constexpr array, so anything
+// assembled from them (var-ints, big-endian numbers, names) ends up as
+// read-only data in flash. Channel names become types with LOGGER_NAME:
+//   LOGGER_NAME("Heading")   // channel_name<'H', 'e', 'a', 'd', 'i', 'n', 'g'>
+// ------------------------------------------------------------
+
+template<uint8_t... Bs>
+struct byte_seq
+{
+    static constexpr std::size_t size = sizeof...(Bs);
+    static constexpr uint8_t data[sizeof...(Bs) ? sizeof...(Bs) : 1] = { Bs... };
+};
+template<uint8_t... Bs>
+constexpr uint8_t byte_seq<Bs...>::data[sizeof...(Bs) ? sizeof...(Bs) : 1];
+
+template<typename... Seqs> struct concat_bytes;
+template<> struct concat_bytes<> { using type = byte_seq<>; };
+template<uint8_t... Bs>
+struct concat_bytes<byte_seq<Bs...>> { using type = byte_seq<Bs...>; };
+template<uint8_t... A, uint8_t... B, typename... Rest>
+struct concat_bytes<byte_seq<A...>, byte_seq<B...>, Rest...> : concat_bytes<byte_seq<A..., B...>, Rest...> {};
+
+template<typename... Seqs>
+using concat_bytes_t = typename concat_bytes<Seqs...>::type;
+
+// CRC16 of a byte_seq
+template<typename Seq>
+struct byte_seq_crc : std::integral_constant<uint16_t, crc16_constexpr(Seq::data, Seq::size)> {};
+
+// Same bytes as pack<uint16_t>(), pack<uint32_t>() and pack_var_int()
+template<uint16_t V>
+using u16_bytes = byte_seq<static_cast<uint8_t>(V >> 8), static_cast<uint8_t>(V)>;
+
+template<uint32_t V>
+using u32_bytes = byte_seq<static_cast<uint8_t>(V >> 24), static_cast<uint8_t>(V >> 16),
+                           static_cast<uint8_t>(V >> 8), static_cast<uint8_t>(V)>;
+
+template<uint16_t V>
+using var_int_bytes = typename std::conditional<(V < 128),
+    byte_seq<static_cast<uint8_t>(V)>,
+    byte_seq<static_cast<uint8_t>((V >> 8) | 0x80), static_cast<uint8_t>(V)>>::type;
+
+template<char... Cs>
+struct channel_name
+{
+    static constexpr std::size_t size = sizeof...(Cs);
+    // null-terminated, in flash
+    static constexpr char data[sizeof...(Cs) + 1] = { Cs..., '\0' };
+
+    // name and null, as in a 0x46 description
+    using bytes = byte_seq<static_cast<uint8_t>(Cs)..., 0>;
+};
+template<char... Cs>
+constexpr char channel_name<Cs...>::data[sizeof...(Cs) + 1];
+
+// Appends characters to Name up to the first null
+template<typename Name, char... Rest>
+struct channel_name_builder
+{
+    using type = Name;
+};
+template<char... Cs, char... Rest>
+struct channel_name_builder<channel_name<Cs...>, '\0', Rest...>
+{
+    using type = channel_name<Cs...>;
+};
+template<char... Cs, char C, char... Rest>
+struct channel_name_builder<channel_name<Cs...>, C, Rest...> : channel_name_builder<channel_name<Cs..., C>, Rest...> {};
+
+template<std::size_t LiteralSize, char... Cs>
+struct make_channel_name : channel_name_builder<channel_name<>, Cs...>
+{
+    static_assert(LiteralSize - 1 <= sizeof...(Cs), "LOGGER_NAME: name longer than LOGGER_NAME_MAX");
+};
+
+// C++11 has no string literals as template arguments, so LOGGER_NAME spells
+// the literal out one character at a time, up to LOGGER_NAME_MAX of them
+#define LOGGER_NAME_MAX 32
+#define LOGGER_NAME_AT(s, i) ((i) < sizeof(s) ? (s)[(i) < sizeof(s) ? (i) : 0] : '\0')
+#define LOGGER_NAME(s) make_channel_name<sizeof(s), \
+    LOGGER_NAME_AT(s, 0),  LOGGER_NAME_AT(s, 1),  LOGGER_NAME_AT(s, 2),  LOGGER_NAME_AT(s, 3),  \
+    LOGGER_NAME_AT(s, 4),  LOGGER_NAME_AT(s, 5),  LOGGER_NAME_AT(s, 6),  LOGGER_NAME_AT(s, 7),  \
+    LOGGER_NAME_AT(s, 8),  LOGGER_NAME_AT(s, 9),  LOGGER_NAME_AT(s, 10), LOGGER_NAME_AT(s, 11), \
+    LOGGER_NAME_AT(s, 12), LOGGER_NAME_AT(s, 13), LOGGER_NAME_AT(s, 14), LOGGER_NAME_AT(s, 15), \
+    LOGGER_NAME_AT(s, 16), LOGGER_NAME_AT(s, 17), LOGGER_NAME_AT(s, 18), LOGGER_NAME_AT(s, 19), \
+    LOGGER_NAME_AT(s, 20), LOGGER_NAME_AT(s, 21), LOGGER_NAME_AT(s, 22), LOGGER_NAME_AT(s, 23), \
+    LOGGER_NAME_AT(s, 24), LOGGER_NAME_AT(s, 25), LOGGER_NAME_AT(s, 26), LOGGER_NAME_AT(s, 27), \
+    LOGGER_NAME_AT(s, 28), LOGGER_NAME_AT(s, 29), LOGGER_NAME_AT(s, 30), LOGGER_NAME_AT(s, 31)>::type()
+
+
+// ------------------------------------------------------------
+// IEEE 754 single-precision bits of a std::ratio, rounded to nearest even
+// like static_cast<float>(num) / den; for |num| and den below 2^32
+// ------------------------------------------------------------
+namespace static_format_detail
+{
+    constexpr uint64_t scaled_num(uint64_t n, int k) { return k >= 0 ? n << k : n; }
+    constexpr uint64_t scaled_den(uint64_t d, int k) { return k >= 0 ? d : d << -k; }
+    constexpr uint64_t scaled(uint64_t n, uint64_t d, int k) { return scaled_num(n, k) / scaled_den(d, k); }
+
+    // k with 2^23 <= n * 2^k / d < 2^24
+    constexpr int mantissa_shift(uint64_t n, uint64_t d, int k)
+    {
+        return (scaled(n, d, k) < (1ull << 23)) ? mantissa_shift(n, d, k + 1)
+             : (scaled(n, d, k) >= (1ull << 24)) ? mantissa_shift(n, d, k - 1)
+             : k;
+    }
+
+    constexpr uint64_t round_even(uint64_t num, uint64_t den)
+    {
+        return ((2 * (num % den) > den) || ((2 * (num % den) == den) && ((num / den) & 1)))
+             ? num / den + 1 : num / den;
+    }
+
+    // mantissa m in [2^23, 2^24]; rounding up may carry into the exponent
+    constexpr uint32_t float_bits_of(uint64_t m, int k, bool negative)
+    {
+        return (m == (1ull << 24)) ? float_bits_of(m >> 1, k - 1, negative)
+             : ((negative ? 0x80000000u : 0u)
+                | (static_cast<uint32_t>(127 + 23 - k) << 23)
+                | static_cast<uint32_t>(m & 0x7fffff));
+    }
+
+    constexpr uint32_t float_bits_at(uint64_t n, uint64_t d, int k, bool negative)
+    {
+        return float_bits_of(round_even(scaled_num(n, k), scaled_den(d, k)), k, negative);
+    }
+
+    constexpr uint32_t ratio_float_bits(intmax_t num, intmax_t den)
+    {
+        return (num == 0) ? 0
+             : float_bits_at(static_cast<uint64_t>(num < 0 ? -num : num), static_cast<uint64_t>(den),
+                             mantissa_shift(static_cast<uint64_t>(num < 0 ? -num : num),
+                                            static_cast<uint64_t>(den), 0),
+                             num < 0);
+    }
+}
+
+// Same bytes as pack(buf, static_cast<float>(Ratio::num) / Ratio::den)
+template<typename Ratio>
+using ratio_float_bytes = u32_bytes<static_format_detail::ratio_float_bits(Ratio::num, Ratio::den)>;
+
+
+// ------------------------------------------------------------
+// 0x46 packets from a list of entry descriptions, each a byte_seq; split
+// where StructuredLogger::send_data_format() would split them in a
+// Capacity-byte buffer
+// ------------------------------------------------------------
+
+// 0xc0 0xde, command, 2-byte length, Payload, CRC16
+template<uint8_t Command, typename Payload>
+struct static_packet
+{
+    using header = byte_seq<0xc0, 0xde, Command,
+                            static_cast<uint8_t>((Payload::size >> 8) | 0x80), static_cast<uint8_t>(Payload::size)>;
+    using unsigned_type = concat_bytes_t<header, Payload>;
+    using type = concat_bytes_t<unsigned_type, u16_bytes<byte_seq_crc<unsigned_type>::value>>;
+
+    static_assert(Payload::size < 32768, "static_packet: payload too long for the 2-byte length");
+};
+
+template<std::size_t Capacity, uint16_t Hash, typename Current, typename Done, typename... Descriptions>
+struct static_format_packets;
+
+template<std::size_t Capacity, uint16_t Hash, typename Current, typename Done>
+struct static_format_packets<Capacity, Hash, Current, Done>
+{
+    using type = concat_bytes_t<Done, typename static_packet<0x46, concat_bytes_t<u16_bytes<Hash>, Current>>::type>;
+};
+
+template<bool Split, std::size_t Capacity, uint16_t Hash, typename Current, typename Done, typename D, typename... Rest>
+struct static_format_step;
+
+template<std::size_t Capacity, uint16_t Hash, typename Current, typename Done, typename D, typename... Rest>
+struct static_format_step<false, Capacity, Hash, Current, Done, D, Rest...>
+    : static_format_packets<Capacity, Hash, concat_bytes_t<Current, D>, Done, Rest...> {};
+
+template<std::size_t Capacity, uint16_t Hash, typename Current, typename Done, typename D, typename... Rest>
+struct static_format_step<true, Capacity, Hash, Current, Done, D, Rest...>
+    : static_format_packets<Capacity, Hash, D,
+          concat_bytes_t<Done, typename static_packet<0x46, concat_bytes_t<u16_bytes<Hash>, Current>>::type>,
+          Rest...> {};
+
+// header, schema hash, descriptions so far, this one, CRC
+template<std::size_t Capacity, uint16_t Hash, typename Current, typename Done, typename D, typename... Rest>
+struct static_format_packets<Capacity, Hash, Current, Done, D, Rest...>
+    : static_format_step<(5 + 2 + Current::size + D::size + 2 > Capacity), Capacity, Hash, Current, Done, D, Rest...>
+{
+    static_assert(5 + 2 + D::size + 2 <= Capacity, "static_format_packets: description doesn't fit in an empty packet");
+};
+
+// The whole 0x46 format of a schema, ready to write out: `hash` is the
+// schema hash (the CRC16 of the descriptions back to back) and `packets`
+// the byte_seq of every packet, hash and CRCs included
+template<std::size_t Capacity, typename... Descriptions>
+struct static_format
+{
+    using descriptions = concat_bytes_t<Descriptions...>;
+    static constexpr uint16_t hash = byte_seq_crc<descriptions>::value;
+    using packets = typename static_format_packets<Capacity, hash, byte_seq<>, byte_seq<>, Descriptions...>::type;
+};
+template<std::size_t Capacity, typename... Descriptions>
+constexpr uint16_t static_format<Capacity, Descriptions...>::hash;
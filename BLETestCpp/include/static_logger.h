@@ -0,0 +1,175 @@
+#pragma once
+
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "structured_logger.h"
+
+
+// ------------------------------------------------------------
+// Compile-time typed logger front end
+//
+//   auto logger = make_static_logger<10>(   // tick period in ms
+//       log_entry(LOGGER_NAME("Heading"), []() -> float { return brain_inertial.heading(); }),
+//       log_entry<true>(LOGGER_NAME("ax"), []() -> float { return brain_inertial.acceleration(vex::xaxis); }),
+//       log_entry(LOGGER_NAME("dist_front"), []() -> int16_t { return dist_front.objectDistance(mm); }));
+//
+// The channel list is a template pack, so send_structured_data() unrolls to
+// a straight sequence of getter calls and packs with no heap, no vtables and
+// no std::function. Every entry is sent on every call. Names, small-scale
+// flags and the tick period are template arguments too, so the 0x46
+// packets are assembled at compile time (see static_format.h), CRCs and
+// schema hash included: send_data_format() is one write from flash, and
+// entries hold nothing but their getters. Codes are assigned in order
+// starting at 0, and packets are split exactly where StructuredLogger would
+// split them, so the 0x44 and 0x46 packets are byte-identical for the same
+// channel list. Unlike StructuredLogger it doesn't send the 0x46 packets by
+// itself; call send_data_format().
+// ------------------------------------------------------------
+
+template<typename T, typename Name, bool SmallScale, typename Getter>
+struct StaticEntry
+{
+    using value_type = T;
+    using name_type = Name;
+    static constexpr bool small_scale = SmallScale;
+
+    Getter getter;
+};
+
+// log_entry<true>(...) for a small-scale entry
+template<bool SmallScale = false, char... Cs, typename Func>
+StaticEntry<typename std::decay<decltype(std::declval<Func>()())>::type, channel_name<Cs...>, SmallScale, Func>
+log_entry(channel_name<Cs...>, Func func)
+{
+    return { func };
+}
+
+// The compile-time 0x46 format of a channel list
+template<uint16_t TickMs, std::size_t Capacity, typename Codes, typename... Entries>
+struct static_logger_format;
+
+template<uint16_t TickMs, std::size_t Capacity, std::size_t... Codes, typename... Entries>
+struct static_logger_format<TickMs, Capacity, crc16_detail::index_sequence<Codes...>, Entries...>
+    : static_format<Capacity, entry_description<static_cast<uint16_t>(Codes), typename Entries::value_type,
+                                                Entries::small_scale, typename Entries::name_type, TickMs>...>
+{};
+
+// Where each entry of a 0x44 packet lands; first entry of each packet is
+// placed right after the header and schema hash, the rest continue until
+// the next one (plus the CRC) no longer fits in Capacity bytes
+template<typename Tuple, std::size_t Capacity, std::size_t I, bool First = (I == 0)>
+struct static_data_layout
+{
+    using prev = static_data_layout<Tuple, Capacity, I - 1>;
+    using value_type = typename std::tuple_element<I, Tuple>::type::value_type;
+
+    static constexpr int size = var_int_size(I) + sizeof(value_type); // code + data
+    static constexpr bool starts_packet =
+        prev::fill + size + PacketWriter::crc_len > static_cast<int>(Capacity);
+    static constexpr int fill =
+        (starts_packet ? PacketWriter::header_len + PacketWriter::schema_hash_len : prev::fill) + size;
+    static constexpr int packets = prev::packets + (starts_packet ? 1 : 0);
+    static constexpr int data_size = prev::data_size + size;
+};
+
+template<typename Tuple, std::size_t Capacity, std::size_t I>
+struct static_data_layout<Tuple, Capacity, I, true>
+{
+    using value_type = typename std::tuple_element<I, Tuple>::type::value_type;
+
+    static constexpr int size = var_int_size(I) + sizeof(value_type);
+    static constexpr bool starts_packet = false;
+    static constexpr int fill = PacketWriter::header_len + PacketWriter::schema_hash_len + size;
+    static constexpr int packets = 1;
+    static constexpr int data_size = size;
+
+    static_assert(fill + PacketWriter::crc_len <= static_cast<int>(Capacity),
+                  "static_data_layout: entry doesn't fit in an empty packet");
+};
+
+template<uint16_t TickMs, typename... Entries>
+class StaticStructuredLogger : public PacketWriter
+{
+public:
+    using entries_type = std::tuple<Entries...>;
+    static constexpr std::size_t entry_count = sizeof...(Entries);
+    static constexpr std::size_t buffer_size = 104;
+
+    using format_type = static_logger_format<TickMs, buffer_size,
+        typename crc16_detail::make_index_sequence<sizeof...(Entries)>::type, Entries...>;
+    using format_packets = typename format_type::packets;
+
+    template<std::size_t I>
+    using layout = static_data_layout<entries_type, buffer_size, I>;
+
+    // total payload bytes of one frame, and the number of 0x44 packets it takes
+    static constexpr int data_size = layout<entry_count - 1>::data_size;
+    static constexpr int data_packets = layout<entry_count - 1>::packets;
+
+private:
+    static_assert(sizeof...(Entries) > 0, "StaticStructuredLogger: no entries");
+    static_assert(sizeof...(Entries) < 32768, "StaticStructuredLogger: too many entries for a var-int code");
+
+    std::array<uint8_t, buffer_size> m_bufferStorage{};
+    packet_buffer m_buffer{m_bufferStorage};
+    entries_type m_entries;
+
+    template<std::size_t I>
+    using index = std::integral_constant<std::size_t, I>;
+
+    template<std::size_t I>
+    void pack_data(index<I>)
+    {
+        using value_type = typename layout<I>::value_type;
+        if (layout<I>::starts_packet)
+        {
+            send_packet(m_buffer);
+            prepare_buffer(m_buffer, 0x44);
+            pack<uint16_t>(m_buffer, format_type::hash);
+        }
+        pack_var_int(m_buffer, static_cast<uint16_t>(I));
+        ::pack(m_buffer, static_cast<value_type>(std::get<I>(m_entries).getter()));
+        pack_data(index<I + 1>());
+    }
+
+    void pack_data(index<entry_count>) {}
+
+public:
+    explicit StaticStructuredLogger(Entries... entries)
+        : m_entries(entries...)
+    {}
+
+    // m_buffer points into this object's own storage
+    StaticStructuredLogger(const StaticStructuredLogger& other)
+        : m_entries(other.m_entries)
+    {}
+
+    static constexpr uint16_t schema_hash(void)
+    {
+        return format_type::hash;
+    }
+
+    // Every 0x46 packet, straight from flash
+    void send_data_format(void)
+    {
+        send_bytes(format_packets::data, format_packets::size);
+    }
+
+    void send_structured_data(void)
+    {
+        prepare_buffer(m_buffer, 0x44); // structured_data_command
+        pack<uint16_t>(m_buffer, format_type::hash);
+        pack_data(index<0>());
+        send_packet(m_buffer);
+    }
+};
+
+// TickMs is the time between send_structured_data() calls, advertised in
+// the 0x46 packets
+template<uint16_t TickMs = 20, typename... Entries>
+StaticStructuredLogger<TickMs, Entries...> make_static_logger(Entries... entries)
+{
+    return StaticStructuredLogger<TickMs, Entries...>(entries...);
+}
@@ -1,11 +1,38 @@
 #pragma once
 
 #include <array>
+#include <atomic>
+#include <cmath>
 #include <cstddef>
 #include <cstring>
 #include <functional>
+#include <limits>
+#include <ratio>
 #include <type_traits>
 
+#include "capture_ring.h"
+#include "cobs.h"
+#include "crc16.h"
+#include "host_commands.h"
+#include "logger_telemetry.h"
+#include "output_scheduler.h"
+#include "output_sink.h"
+#include "rice_codec.h"
+#include "spsc_ring.h"
+#include "static_format.h"
+#include "vision_codec.h"
+
+// what sample_structured_data() does when the sender thread falls behind
+#ifndef LOGGER_SAMPLE_OVERFLOW_POLICY
+#define LOGGER_SAMPLE_OVERFLOW_POLICY overflow_policy::drop_oldest
+#endif
+
+// bytes of RAM for the pre-trigger capture ring, see capture_structured_data();
+// 0 (the default) leaves capture out, e.g. -DLOGGER_CAPTURE_SIZE=16384 for
+// a few seconds of a dozen channels at 1 kHz
+#ifndef LOGGER_CAPTURE_SIZE
+#define LOGGER_CAPTURE_SIZE 0
+#endif
 
 inline void print(const char* fmt, ...)
 {
@@ -45,6 +72,14 @@ public:
     bool full() const noexcept { return m_size == m_capacity; }
     void clear() noexcept { m_size = 0; }
 
+    // Point at different backing storage; drops the current contents
+    void rebind(T* data, std::size_t capacity) noexcept
+    {
+        m_data = data;
+        m_capacity = capacity;
+        m_size = 0;
+    }
+
     iterator begin() noexcept { return m_data; }
     iterator end() noexcept { return m_data + m_size; }
     const_iterator begin() const noexcept { return m_data; }
@@ -58,7 +93,11 @@ public:
 
     void push_back(const T& value)
     {
-        if (m_size >= m_capacity) return;
+        if (m_size >= m_capacity)
+        {
+            logger_telemetry::drop();
+            return;
+        }
         m_data[m_size++] = value;
     }
 
@@ -67,7 +106,11 @@ public:
     {
         for (auto it = std::begin(c); it != std::end(c); ++it)
         {
-            if (m_size >= m_capacity) return;
+            if (m_size >= m_capacity)
+            {
+                logger_telemetry::drop();
+                return;
+            }
             m_data[m_size++] = *it;
         }
     }
@@ -127,6 +170,248 @@ void pack(Container& buf, double value)
     pack_integer_be(buf, bits);
 }
 
+// Inverse of pack(): read a big-endian value back out of packed bytes
+template<typename T>
+typename std::enable_if<std::is_integral<T>::value, T>::type unpack(const uint8_t* bytes)
+{
+    typename std::make_unsigned<T>::type bits = 0;
+    for (uint32_t i = 0; i < sizeof(T); ++i) {
+        bits = static_cast<typename std::make_unsigned<T>::type>((bits << 8) | bytes[i]);
+    }
+    return static_cast<T>(bits);
+}
+
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value, T>::type unpack(const uint8_t* bytes)
+{
+    typedef typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type bits_type;
+    const bits_type bits = unpack<bits_type>(bytes);
+    T value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+// ------------------------------------------------------------
+// Fixed-point channels
+// ------------------------------------------------------------
+// A float quantized to an 8 or 16-bit Storage as round((value - Offset) / Scale),
+// clamped to [Min, Max]. All four are std::ratio so the range can be checked
+// against Storage at compile time, e.g. heading in 0.01 degree steps:
+//   fixed_point<int16_t, std::ratio<1, 100>, std::ratio<-180>, std::ratio<180>>
+template<typename Storage, typename Scale, typename Min, typename Max, typename Offset = std::ratio<0>>
+struct fixed_point
+{
+    using storage_type = Storage;
+    using scale_ratio = Scale;
+    using offset_ratio = Offset;
+    using raw_min = std::ratio_divide<std::ratio_subtract<Min, Offset>, Scale>;
+    using raw_max = std::ratio_divide<std::ratio_subtract<Max, Offset>, Scale>;
+
+    static_assert(std::is_integral<Storage>::value && sizeof(Storage) <= 2,
+                  "fixed_point: Storage must be an 8 or 16-bit integer");
+    static_assert(Scale::num > 0, "fixed_point: Scale must be positive");
+    static_assert(std::ratio_less<Min, Max>::value, "fixed_point: Min must be less than Max");
+    static_assert(raw_min::num >= static_cast<intmax_t>(std::numeric_limits<Storage>::min()) * raw_min::den,
+                  "fixed_point: Min doesn't fit in Storage at this Scale and Offset");
+    static_assert(raw_max::num <= static_cast<intmax_t>(std::numeric_limits<Storage>::max()) * raw_max::den,
+                  "fixed_point: Max doesn't fit in Storage at this Scale and Offset");
+
+    static constexpr float scale() { return static_cast<float>(Scale::num) / Scale::den; }
+    static constexpr float offset() { return static_cast<float>(Offset::num) / Offset::den; }
+    static constexpr float min() { return static_cast<float>(Min::num) / Min::den; }
+    static constexpr float max() { return static_cast<float>(Max::num) / Max::den; }
+
+    Storage raw;
+
+    static fixed_point from(float value)
+    {
+        // also catches NaN
+        if (!(value >= min())) value = min();
+        if (value > max()) value = max();
+        return fixed_point{ static_cast<Storage>(std::lround((value - offset()) / scale())) };
+    }
+
+    explicit operator double() const
+    {
+        return raw * static_cast<double>(scale()) + offset();
+    }
+};
+
+template<typename T> struct is_fixed_point : std::false_type {};
+template<typename S, typename Sc, typename Mn, typename Mx, typename O>
+struct is_fixed_point<fixed_point<S, Sc, Mn, Mx, O>> : std::true_type {};
+
+template<typename Storage> struct fixed_point_fmt {
+   static_assert(always_false<Storage>::value, "Unsupported fixed_point storage");
+};
+template <> struct fixed_point_fmt<int8_t>   { enum : uint8_t { code = 'x' }; };
+template <> struct fixed_point_fmt<uint8_t>  { enum : uint8_t { code = 'X' }; };
+template <> struct fixed_point_fmt<int16_t>  { enum : uint8_t { code = 'y' }; };
+template <> struct fixed_point_fmt<uint16_t> { enum : uint8_t { code = 'Y' }; };
+
+template<typename S, typename Sc, typename Mn, typename Mx, typename O>
+struct fmt<fixed_point<S, Sc, Mn, Mx, O>> { enum : uint8_t { code = fixed_point_fmt<S>::code }; };
+
+template<typename Container, typename S, typename Sc, typename Mn, typename Mx, typename O>
+void pack(Container& buf, fixed_point<S, Sc, Mn, Mx, O> value)
+{
+    pack_integer_be(buf, value.raw);
+}
+
+template<typename T>
+typename std::enable_if<is_fixed_point<T>::value, T>::type unpack(const uint8_t* bytes)
+{
+    return T{ unpack<typename T::storage_type>(bytes) };
+}
+
+// Extra bytes at the end of an entry's 0x46 description: fixed-point
+// entries carry their scale and offset as floats so the host can dequantize
+template<typename T, typename Enable = void>
+struct format_extra
+{
+    static constexpr int size = 0;
+    using bytes = byte_seq<>;
+    template<typename Container> static void pack(Container&) {}
+};
+
+template<typename T>
+struct format_extra<T, typename std::enable_if<is_fixed_point<T>::value>::type>
+{
+    static constexpr int size = 8;
+    using bytes = concat_bytes_t<ratio_float_bytes<typename T::scale_ratio>,
+                                 ratio_float_bytes<typename T::offset_ratio>>;
+    template<typename Container> static void pack(Container& buf)
+    {
+        ::pack(buf, T::scale());
+        ::pack(buf, T::offset());
+    }
+};
+
+// ------------------------------------------------------------
+// Array channels
+// ------------------------------------------------------------
+// A std::array of N scalars or fixed_points is one entry: one code, one
+// getter call per frame, the N values packed back to back, so the axes of
+// a sensor stay together and share their code. Its fmt code is 'a'; the
+// element's fmt code and N follow the period in the 0x46 description,
+// then the element's own extra bytes. The host splits it into N series
+// named name[0] .. name[N-1].
+template<typename T> struct is_array_channel : std::false_type {};
+template<typename T, std::size_t N>
+struct is_array_channel<std::array<T, N>> : std::true_type {};
+
+template<typename T, std::size_t N>
+struct fmt<std::array<T, N>>
+{
+    static_assert(!is_array_channel<T>::value, "Array channels can't be nested");
+    static_assert(N > 0 && N < 256, "Array channels hold 1 to 255 elements");
+    enum : uint8_t { code = 'a', element_code = fmt<T>::code };
+};
+
+template<typename Container, typename T, std::size_t N>
+void pack(Container& buf, const std::array<T, N>& value)
+{
+    for (const T& element : value)
+    {
+        ::pack(buf, element);
+    }
+}
+
+template<typename T>
+typename std::enable_if<is_array_channel<T>::value, T>::type unpack(const uint8_t* bytes)
+{
+    typedef typename T::value_type element_type;
+    T value;
+    for (std::size_t i = 0; i < value.size(); i++)
+    {
+        value[i] = unpack<element_type>(bytes + i * sizeof(element_type));
+    }
+    return value;
+}
+
+// Bytes per element on the wire, for 0x52's per-element differences
+template<typename T> struct wire_element_size { enum : int { value = sizeof(T) }; };
+template<typename T, std::size_t N>
+struct wire_element_size<std::array<T, N>> { enum : int { value = sizeof(T) }; };
+
+template<typename T, std::size_t N>
+struct format_extra<std::array<T, N>>
+{
+    static constexpr int size = 2 + format_extra<T>::size;
+    using bytes = concat_bytes_t<byte_seq<fmt<T>::code, static_cast<uint8_t>(N)>,
+                                 typename format_extra<T>::bytes>;
+    template<typename Container> static void pack(Container& buf)
+    {
+        buf.push_back(fmt<T>::code);
+        buf.push_back(static_cast<uint8_t>(N));
+        format_extra<T>::pack(buf);
+    }
+};
+
+// How far a value moved, for deadbands; arrays by their largest element change
+template<typename T>
+double value_distance(const T& a, const T& b)
+{
+    return std::fabs(static_cast<double>(a) - static_cast<double>(b));
+}
+
+template<typename T, std::size_t N>
+double value_distance(const std::array<T, N>& a, const std::array<T, N>& b)
+{
+    double distance = 0;
+    for (std::size_t i = 0; i < N; i++)
+    {
+        distance = std::fmax(distance, value_distance(a[i], b[i]));
+    }
+    return distance;
+}
+
+// An entry's whole 0x46 description as a byte_seq: code, fmt, name, null,
+// period, extra; what Entry::pack_name_and_format() packs at runtime
+template<uint16_t Code, typename T, bool SmallScale, typename Name, uint16_t PeriodMs>
+using entry_description = concat_bytes_t<
+    var_int_bytes<Code>,
+    byte_seq<static_cast<uint8_t>(SmallScale ? (fmt<T>::code | 0b10000000) : fmt<T>::code)>,
+    typename Name::bytes,
+    var_int_bytes<PeriodMs>,
+    typename format_extra<T>::bytes>;
+
+template<typename FixedPoint>
+FixedPoint quantize_value(float value)
+{
+    return FixedPoint::from(value);
+}
+
+template<typename FixedPoint, typename T, std::size_t N>
+std::array<FixedPoint, N> quantize_value(const std::array<T, N>& values)
+{
+    std::array<FixedPoint, N> quantized;
+    for (std::size_t i = 0; i < N; i++)
+    {
+        quantized[i] = FixedPoint::from(values[i]);
+    }
+    return quantized;
+}
+
+// Getter wrapper for StructuredLogger::add(): quantize<heading_type>(func);
+// a getter returning std::array<float, N> becomes std::array<heading_type, N>
+template<typename FixedPoint, typename Func>
+struct quantized_getter
+{
+    Func func;
+    auto operator()() const -> decltype(quantize_value<FixedPoint>(func()))
+    {
+        return quantize_value<FixedPoint>(func());
+    }
+};
+
+template<typename FixedPoint, typename Func>
+quantized_getter<FixedPoint, Func> quantize(Func func)
+{
+    static_assert(is_fixed_point<FixedPoint>::value, "quantize<T>: T must be a fixed_point");
+    return quantized_getter<FixedPoint, Func>{ func };
+}
+
 // Variable-length integer packing
 template<typename Container, typename T>
 void pack_var_int(Container& buf, T num)
@@ -143,15 +428,19 @@ void pack_var_int(Container& buf, T num)
         pack<uint16_t>(buf, static_cast<uint16_t>(num | 0x8000));
         return;
     }
+    logger_telemetry::drop();
     printf("WARNING: Number too large to pack (in pack_var_int): %lld\n", (long long)num);
 }
 
 template<typename T>
-int var_int_size(T num)
+constexpr int var_int_size(T num)
 {
     return (num < 128) ? 1 : 2;
 }
 
+// Largest number pack_var_int() takes
+constexpr uint16_t max_var_int = 32767;
+
 template<typename Container>
 void pack_len(Container& buf, int offset)
 {
@@ -159,7 +448,8 @@ void pack_len(Container& buf, int offset)
     const int payload_len = buf.size() - offset - 2;
     if (payload_len >= 32768)
     {
-        printf("WARNING: Number too large to pack (in pack_len): \n", payload_len);
+        logger_telemetry::drop();
+        printf("WARNING: Number too large to pack (in pack_len): %d\n", payload_len);
         return;
     }
 
@@ -169,38 +459,221 @@ void pack_len(Container& buf, int offset)
 }
 
 
-// CRC-16-CCITT parameters
-constexpr uint16_t POLYNOMIAL_CRC16 = 0x1021;
-constexpr uint16_t CRC16_INIT = 0x0000;
-
-// Generic CRC16 for any container supporting size(), operator[], and push_back()
+// CRC16 for any contiguous byte container with data(), size() and
+// push_back(), sliced 4 bytes at a time (see crc16.h); packet_buffer has
+// its own overload below, with the CRC already kept as bytes go in.
 // Appends CRC16 to the end of the container (MSB first)
 template <typename Container>
 void append_crc16(Container& buf)
 {
-    uint16_t crc = CRC16_INIT;
-    // Compute CRC over existing data
-    for (size_t i = 0; i < buf.size(); ++i)
+    const uint16_t crc = crc16<4>(reinterpret_cast<const uint8_t*>(buf.data()), buf.size());
+    // Append CRC (MSB first)
+    buf.push_back(static_cast<uint8_t>(crc >> 8)); // high byte
+    buf.push_back(static_cast<uint8_t>(crc));      // low byte
+}
+
+// Byte buffer for outgoing packets; keeps a running CRC16 of everything
+// appended, so the CRC is ready as soon as the last byte is packed
+class packet_buffer : public static_vector<uint8_t>
+{
+private:
+    uint16_t m_crc = CRC16_INIT;
+    uint8_t* m_storage;
+    std::size_t m_max_size;
+    std::size_t m_max_frame_size;
+
+public:
+    // Packets of up to `max_size` bytes; backing storage beyond that is room
+    // for framing them in place (see PacketWriter::set_framing)
+    template<std::size_t N>
+    explicit packet_buffer(std::array<uint8_t, N>& backing, std::size_t max_size = N)
+        : static_vector<uint8_t>(backing)
+        , m_storage(backing.data())
+        , m_max_size(max_size)
+        , m_max_frame_size(N)
+    {
+        rebind(m_storage, m_max_size);
+    }
+
+    uint16_t crc() const noexcept { return m_crc; }
+
+    // Largest packet this buffer builds, wherever it builds it
+    std::size_t max_size() const noexcept { return m_max_size; }
+    // and the room it takes framed
+    std::size_t max_frame_size() const noexcept { return m_max_frame_size; }
+
+    // Build the next packet in place at `data` (e.g. the tail of an
+    // output_arena) instead of in the buffer's own storage
+    void attach(uint8_t* data, std::size_t capacity) noexcept
+    {
+        rebind(data, (capacity < m_max_size) ? capacity : m_max_size);
+        m_crc = CRC16_INIT;
+    }
+
+    // Go back to building packets in the buffer's own storage
+    void detach() noexcept
+    {
+        rebind(m_storage, m_max_size);
+        m_crc = CRC16_INIT;
+    }
+
+    void clear() noexcept
+    {
+        static_vector<uint8_t>::clear();
+        m_crc = CRC16_INIT;
+    }
+
+    void push_back(const uint8_t& value)
     {
-        crc ^= (uint16_t)buf[i] << 8;  // Align byte to MSB
-        for (uint8_t j = 0; j < 8; ++j)
+        if (full())
         {
-            if (crc & 0x8000)
-            {
-                crc = (crc << 1) ^ POLYNOMIAL_CRC16;
-            }
-            else
+            logger_telemetry::drop();
+            return;
+        }
+        static_vector<uint8_t>::push_back(value);
+        m_crc = crc16_update(m_crc, value);
+    }
+
+    template<class Container>
+    void append(const Container& c)
+    {
+        for (auto it = std::begin(c); it != std::end(c); ++it)
+        {
+            if (full())
             {
-                crc <<= 1;
+                logger_telemetry::drop();
+                return;
             }
+            push_back(static_cast<uint8_t>(*it));
         }
     }
-    // Append CRC (MSB first)
+
+    // Overwrite two zero placeholder bytes (e.g. the length) and fix up the
+    // running CRC without rescanning the buffer
+    void patch_u16(std::size_t offset, uint16_t value)
+    {
+        (*this)[offset]     = static_cast<uint8_t>(value >> 8);
+        (*this)[offset + 1] = static_cast<uint8_t>(value);
+        m_crc = crc16_patch_u16(m_crc, value, size() - offset - 2);
+    }
+};
+
+inline void pack_len(packet_buffer& buf, int offset)
+{
+    // -2 bytes for encoded length
+    const int payload_len = buf.size() - offset - 2;
+    if (payload_len >= 32768)
+    {
+        logger_telemetry::drop();
+        printf("WARNING: Number too large to pack (in pack_len): %d\n", payload_len);
+        return;
+    }
+    buf.patch_u16(offset, static_cast<uint16_t>(payload_len | 0x8000));
+}
+
+inline void append_crc16(packet_buffer& buf)
+{
+    const uint16_t crc = buf.crc();
     buf.push_back(static_cast<uint8_t>(crc >> 8)); // high byte
     buf.push_back(static_cast<uint8_t>(crc));      // low byte
 }
 
-uint8_t get_vision_object_type(vex::aivision::object& obj)
+// Microsecond timestamp from the brain's timer; wraps after about 71 minutes
+inline uint32_t logger_time_us(void)
+{
+    return static_cast<uint32_t>(vex::timer::systemHighResolution());
+}
+
+// Next byte the host wrote to stdin (the user serial channel), or -1 if
+// nothing is waiting; never blocks
+inline int logger_read_byte(void)
+{
+    return vexSerialReadChar(1);
+}
+
+// Large output buffer that packets are built in directly (see
+// PacketWriter::set_output_arena) and written out to the output sink with a
+// single write + flush, instead of one of each per packet. Flushes when
+// `flush_bytes` are pending or the oldest pending byte is `flush_latency_us`
+// old, and whenever flush() is called, e.g. once per frame.
+class output_arena
+{
+private:
+    uint8_t* m_data;
+    std::size_t m_capacity;
+    std::size_t m_size = 0;
+    std::size_t m_flush_bytes;
+    uint32_t m_flush_latency_us = 20000;
+    uint32_t m_pending_since_us = 0;
+
+    uint32_t m_flushes = 0;
+    uint32_t m_bytes_written = 0;
+
+public:
+    template<std::size_t N>
+    explicit output_arena(std::array<uint8_t, N>& backing)
+        : m_data(backing.data())
+        , m_capacity(N)
+        , m_flush_bytes(N)
+    {}
+
+    void set_flush_threshold(std::size_t bytes, uint32_t latency_us)
+    {
+        m_flush_bytes = (bytes < m_capacity) ? bytes : m_capacity;
+        m_flush_latency_us = latency_us;
+    }
+
+    uint8_t* tail() noexcept { return m_data + m_size; }
+    std::size_t available() const noexcept { return m_capacity - m_size; }
+    std::size_t pending() const noexcept { return m_size; }
+    uint32_t flushes() const noexcept { return m_flushes; }
+    uint32_t bytes_written() const noexcept { return m_bytes_written; }
+
+    // `n` bytes were written at tail()
+    void commit(std::size_t n)
+    {
+        const bool was_empty = (m_size == 0);
+        m_size += n;
+        if (m_size >= m_flush_bytes)
+        {
+            flush();
+        }
+        else if (was_empty)
+        {
+            m_pending_since_us = logger_time_us();
+        }
+        else
+        {
+            poll();
+        }
+    }
+
+    // Flush if the pending bytes have waited longer than the latency threshold
+    void poll(void)
+    {
+        if ((m_size > 0) && ((logger_time_us() - m_pending_since_us) >= m_flush_latency_us))
+        {
+            flush();
+        }
+    }
+
+    void flush(void)
+    {
+        if (m_size == 0)
+        {
+            return;
+        }
+        const uint32_t start = logger_telemetry::now();
+        logger_sink().write(m_data, m_size);
+        logger_sink().flush();
+        logger_telemetry::stall_done(start);
+        m_bytes_written += m_size;
+        m_flushes++;
+        m_size = 0;
+    }
+};
+
+inline uint8_t get_vision_object_type(vex::aivision::object& obj)
 {
     // encode obj.type in the top 2 bits of the returned byte
     switch (obj.type)
@@ -222,164 +695,1655 @@ uint8_t get_vision_object_type(vex::aivision::object& obj)
     }
 }
 
-class EntryBase
+// Clamp a vex object to the field widths of the 0x56 vision stream; false,
+// and `rec` untouched, for an object type the stream can't carry
+inline bool make_vision_record(vex::aivision::object& obj, vision_record& rec)
 {
-public:
-    virtual ~EntryBase() {}
-    virtual uint16_t code() const = 0;
-    virtual const std::string& name() const = 0;
-    virtual int fmt_size() const = 0;
-    virtual int data_size() const = 0;
-    virtual bool pack(static_vector<uint8_t>& buf) = 0;
-    virtual bool pack_name_and_format(static_vector<uint8_t>& buf) = 0;
-};
+    const uint8_t type = get_vision_object_type(obj);
+    if (type == 0xFF)
+    {
+        return false;
+    }
+    rec = vision_record{};
+    rec.type = type >> 6;
+    rec.id = obj.id & 0b111111;
+    auto clamp = [](int value, int width) -> uint16_t {
+        const int max = (1 << width) - 1;
+        return static_cast<uint16_t>(value < 0 ? 0 : (value > max ? max : value));
+    };
+    if (rec.type == vision_type_tag)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            rec.field[2 * i] = clamp(obj.tag.x[i], vision_tag_widths[2 * i]);
+            rec.field[2 * i + 1] = clamp(obj.tag.y[i], vision_tag_widths[2 * i + 1]);
+        }
+        const long angle = std::lround(obj.angle * 10) % vision_angle_modulus;
+        rec.field[8] = static_cast<uint16_t>(angle < 0 ? angle + vision_angle_modulus : angle);
+    }
+    else
+    {
+        rec.field[0] = clamp(obj.originX, vision_object_widths[0]);
+        rec.field[1] = clamp(obj.originY, vision_object_widths[1]);
+        rec.field[2] = clamp(obj.width, vision_object_widths[2]);
+        rec.field[3] = clamp(obj.height, vision_object_widths[3]);
+        rec.field[4] = clamp(obj.score, vision_object_widths[4]);
+    }
+    return true;
+}
 
-template<class T>
-class Entry : public EntryBase
+// Packet framing shared by the logger front ends:
+// 0xc0 0xde, command, 2-byte length, payload, CRC16
+// or, with set_framing(packet_framing::cobs), the same packet COBS-framed
+// (cobs.h)
+//
+// With the extended header on, the command byte has its top bit set and the
+// payload starts with a u16 sequence number, counted per command and
+// wrapping, and the u32 logger_time_us() the packet's values were sampled
+// at; the host can then tell lost packets from late ones, and sampling time
+// from arrival time.
+class PacketWriter
 {
 private:
-    uint16_t m_code;
-    std::string m_name;
-    std::function<T()> m_getter;
-    bool m_small_scale;
-    int m_fmt_size;
-    int m_data_size;
+    output_arena* m_arena = nullptr;
+    output_scheduler* m_scheduler = nullptr;
+    bool m_extended_header = false;
+    packet_framing m_framing = packet_framing::sync_word;
+    // next sequence number, by command & 0x1f; 0x46 can go out from the
+    // control loop and the sender thread
+    std::array<std::atomic<uint16_t>, 32> m_sequence{};
 
 public:
-    Entry(const uint16_t code, const std::string &name, std::function<T()> getter, bool small_scale = false)
-        : m_code(code)
-        , m_name(name)
-        , m_getter(getter)
-        , m_fmt_size(var_int_size(code) + 1 + name.size() + 1) // code + fmt + name + null
-        , m_data_size(var_int_size(code) + sizeof(T)) // code + data
-        , m_small_scale(small_scale)
-    {}
+    static constexpr int header_len = 5;
+    static constexpr int crc_len = 2;
+    // every 0x46, 0x44, 0x48 and 0x54 payload starts with the schema hash
+    static constexpr int schema_hash_len = 2;
+    static constexpr uint8_t extended_header_flag = 0x80;
+    static constexpr int extended_header_len = 6;
 
-    virtual uint16_t code() const override { return m_code; }
-    virtual const std::string& name() const override { return m_name; }
-    virtual int fmt_size() const override { return m_fmt_size; }
-    virtual int data_size() const override { return m_data_size; }
+protected:
+    // Off by default; StaticStructuredLogger's packet layout is fixed at
+    // compile time without it
+    void set_extended_header(bool on)
+    {
+        m_extended_header = on;
+    }
+
+    // Sync word framing by default. COBS frames are encoded in place in
+    // send_packet(), in the room past the end of the packet that
+    // packet_buffer::max_frame_size() leaves; StaticStructuredLogger's
+    // buffers and its static_format packets have none.
+    void set_framing(packet_framing framing)
+    {
+        m_framing = framing;
+    }
+
+public:
+    // Room a packet built in `buf` takes in the output, framed
+    std::size_t frame_size(const packet_buffer& buf) const
+    {
+        return (m_framing == packet_framing::cobs) ? buf.max_frame_size() : buf.max_size();
+    }
 
-    virtual bool pack(static_vector<uint8_t>& buf) override
+    // header_len, plus extended_header_len when that is on
+    int header_size(void) const
     {
-        if (m_data_size + buf.size() > buf.capacity())
+        return m_extended_header ? header_len + extended_header_len : header_len;
+    }
+
+    // Build packets directly in `arena` and leave flushing to it, instead of
+    // writing and flushing the output sink (output_sink.h) per packet;
+    // nullptr goes back to that.
+    // The arena isn't thread-safe, so don't combine it with start_sender().
+    void set_output_arena(output_arena* arena)
+    {
+        flush_output();
+        m_arena = arena;
+    }
+
+    // Queue packets per channel in `scheduler` and write them out by
+    // priority and budget in flush_output() (see output_scheduler);
+    // channels it has no queue for still go to the output arena, if any,
+    // or straight out. nullptr writes out everything queued and stops
+    // queueing. Not thread-safe either.
+    void set_output_scheduler(output_scheduler* scheduler)
+    {
+        if (m_scheduler != nullptr)
         {
-            return false;
+            const uint32_t start = logger_telemetry::now();
+            m_scheduler->drain();
+            logger_telemetry::stall_done(start);
         }
-        pack_var_int(buf, m_code);
-        ::pack(buf, m_getter());
-        return true;
+        m_scheduler = scheduler;
     }
 
-    virtual bool pack_name_and_format(static_vector<uint8_t>& buf) override
+    // Write out everything pending in the output arena, and what the
+    // scheduler's budgets allow of its queues; once per frame
+    void flush_output(void)
     {
-        if (m_fmt_size + buf.size() > buf.capacity())
+        if (m_scheduler != nullptr)
         {
-            return false;
+            const uint32_t start = logger_telemetry::now();
+            m_scheduler->service();
+            logger_telemetry::stall_done(start);
+        }
+        if (m_arena != nullptr)
+        {
+            m_arena->flush();
+        }
+    }
+
+    // `sample_time_us` goes in the extended header; take it before reading
+    // the values the packet carries
+    void prepare_buffer(packet_buffer& buf, uint8_t command, uint32_t sample_time_us)
+    {
+        logger_telemetry::build_start();
+        // room for the packet and for framing it in place
+        const std::size_t frame = frame_size(buf);
+        const std::size_t framing_room = frame - buf.max_size();
+        packet_queue* const queue = scheduled_queue(command);
+        // framing_room comes off what's available, so an arena that can't
+        // take a whole framed packet even when flushed is passed over like
+        // a full one
+        if (queue != nullptr)
+        {
+            if (queue->make_room(frame))
+            {
+                buf.attach(queue->tail(), queue->available() - framing_room);
+            }
+            else
+            {
+                // too big for the queue even when emptied: it goes out
+                // straight after what the queue holds, not through the
+                // arena, so the channel keeps its order
+                drain_channel(output_channel_of(command));
+                buf.detach();
+            }
+        }
+        else if (m_arena != nullptr)
+        {
+            if (m_arena->available() < frame)
+            {
+                m_arena->flush();
+            }
+            if (m_arena->available() >= frame)
+            {
+                buf.attach(m_arena->tail(), m_arena->available() - framing_room);
+            }
+            else
+            {
+                buf.detach();
+            }
+        }
+        else
+        {
+            buf.detach();
+        }
+        buf.push_back(0xc0); // special header
+        buf.push_back(0xde); // special header
+        buf.push_back(m_extended_header ? (command | extended_header_flag) : command);
+        buf.push_back(0x00); // placeholder for length
+        buf.push_back(0x00); // placeholder for length
+        if (m_extended_header)
+        {
+            buf.push_back(0x00); // placeholder for sequence number
+            buf.push_back(0x00); // placeholder for sequence number
+            pack<uint32_t>(buf, sample_time_us);
+        }
+    }
+
+    // For packets whose values are read as they are packed
+    void prepare_buffer(packet_buffer& buf, uint8_t command)
+    {
+        prepare_buffer(buf, command, m_extended_header ? logger_time_us() : 0);
+    }
+
+    // Write out ready-made packets as they are, e.g. a static_format from
+    // flash, whatever the framing; copied into the control queue or the
+    // output arena if it has room
+    void send_bytes(const uint8_t* data, std::size_t len)
+    {
+        write_bytes(output_channel::control, data, len);
+    }
+
+    // False while `ch` is queued and full: another `n`-byte packet would
+    // push out an older one. For senders that would rather wait, like
+    // send_capture().
+    bool output_has_room(output_channel ch, std::size_t n)
+    {
+        packet_queue* const queue = scheduled_queue(ch);
+        return (queue == nullptr) || queue->has_room(n);
+    }
+
+    // Console text, between packets; on the console channel when there is
+    // a scheduler, so it doesn't hold up control packets
+    void send_text(const char* text, std::size_t len)
+    {
+        write_bytes(output_channel::console, reinterpret_cast<const uint8_t*>(text), len);
+    }
+
+    void send_packet(packet_buffer& buf)
+    {
+        // length, sequence number and CRC are patched in place, wherever the
+        // packet was built; a packet that is prepared but never sent doesn't
+        // use up a sequence number
+        pack_len(buf, 3);
+        if (buf[2] & extended_header_flag)
+        {
+            buf.patch_u16(header_len, m_sequence[buf[2] & 0x1f].fetch_add(1, std::memory_order_relaxed));
+        }
+        append_crc16(buf);
+        const uint8_t command = buf[2];
+        const std::size_t len = (m_framing == packet_framing::cobs) ? cobs_encode_in_place(buf.data(), buf.size())
+                                                                    : buf.size();
+        logger_telemetry::build_done();
+        logger_telemetry::sent(len);
+        packet_queue* const queue = scheduled_queue(command);
+        if ((queue != nullptr) && (buf.data() == queue->tail()))
+        {
+            queue->commit(len, m_scheduler->tick());
+        }
+        else if ((m_arena != nullptr) && (buf.data() == m_arena->tail()))
+        {
+            m_arena->commit(len);
+        }
+        else
+        {
+            const uint32_t start = logger_telemetry::now();
+            logger_sink().write(buf.data(), len);
+            logger_sink().flush();
+            logger_telemetry::stall_done(start);
+        }
+    }
+
+private:
+    packet_queue* scheduled_queue(uint8_t command)
+    {
+        return (m_scheduler != nullptr) ? m_scheduler->queue(output_channel_of(command)) : nullptr;
+    }
+
+    packet_queue* scheduled_queue(output_channel ch)
+    {
+        return (m_scheduler != nullptr) ? m_scheduler->queue(ch) : nullptr;
+    }
+
+    // What `ch`'s queue holds goes out ahead of a packet too big for it
+    void drain_channel(output_channel ch)
+    {
+        const uint32_t start = logger_telemetry::now();
+        m_scheduler->drain(ch);
+        logger_telemetry::stall_done(start);
+    }
+
+    void write_bytes(output_channel ch, const uint8_t* data, std::size_t len)
+    {
+        logger_telemetry::sent(len);
+        packet_queue* const queue = scheduled_queue(ch);
+        if (queue != nullptr)
+        {
+            if (queue->make_room(len))
+            {
+                std::memcpy(queue->tail(), data, len);
+                queue->commit(len, m_scheduler->tick());
+                return;
+            }
+            drain_channel(ch);
+        }
+        else if (m_arena != nullptr)
+        {
+            if (m_arena->available() < len)
+            {
+                m_arena->flush();
+            }
+            if (m_arena->available() >= len)
+            {
+                std::memcpy(m_arena->tail(), data, len);
+                m_arena->commit(len);
+                return;
+            }
+        }
+        const uint32_t start = logger_telemetry::now();
+        logger_sink().write(data, len);
+        logger_sink().flush();
+        logger_telemetry::stall_done(start);
+    }
+};
+
+// One sampled frame (or part of one) queued for the sender thread
+struct sample_record
+{
+    uint32_t timestamp_us;
+    uint8_t size;
+    std::array<uint8_t, 96> data; // (code, value) pairs, as in a 0x44 payload
+};
+
+// ------------------------------------------------------------
+// Snapshot groups
+// ------------------------------------------------------------
+// A group runs its read function once per frame, before any entry is
+// sampled, filling a POD struct; its entries are projections of fields of
+// that struct. The read makes as many device calls as it needs (the SDK
+// has no call returning all of an IMU's axes), but they are made back to
+// back, so a frame's values are a coherent snapshot of the device, each
+// field is read once however many entries use it, and no getter queries a
+// device in the middle of packing:
+//   struct imu_snapshot { float heading; std::array<float, 3> accel; };
+//   auto& imu = logger.add_snapshot<imu_snapshot>([](imu_snapshot& s) { ... });
+//   logger.add(LOGGER_NAME("Heading"), imu.field(&imu_snapshot::heading));
+// A group is only read in frames where one of its entries is sampled.
+class SnapshotGroupBase
+{
+private:
+    SnapshotGroupBase* m_next = nullptr;
+    bool m_due = false;
+    uint16_t m_first_code = 0xFFFF; // code of the group's first entry
+    uint32_t m_read_time_us = 0;
+    uint32_t m_max_read_time_us = 0;
+
+    friend class StructuredLogger;
+
+protected:
+    virtual void read_snapshot(void) = 0;
+
+public:
+    virtual ~SnapshotGroupBase() {}
+
+    void read(void)
+    {
+        const uint32_t start = logger_time_us();
+        read_snapshot();
+        m_read_time_us = logger_time_us() - start;
+        if (m_read_time_us > m_max_read_time_us)
+        {
+            m_max_read_time_us = m_read_time_us;
+        }
+    }
+
+    // time the last read took, and the longest one so far
+    uint32_t read_time_us(void) const { return m_read_time_us; }
+    uint32_t max_read_time_us(void) const { return m_max_read_time_us; }
+};
+
+template<typename Snapshot> class SnapshotGroup;
+
+// Getter of one field of a snapshot
+template<typename Snapshot, typename T>
+struct snapshot_field
+{
+    SnapshotGroup<Snapshot>* group;
+    T Snapshot::* member;
+    T operator()() const { return group->snapshot().*member; }
+};
+
+template<typename Snapshot>
+class SnapshotGroup : public SnapshotGroupBase
+{
+    static_assert(std::is_pod<Snapshot>::value, "SnapshotGroup: Snapshot must be a POD struct");
+
+protected:
+    Snapshot m_snapshot{};
+
+public:
+    const Snapshot& snapshot(void) const { return m_snapshot; }
+
+    template<typename T>
+    snapshot_field<Snapshot, T> field(T Snapshot::* member)
+    {
+        return snapshot_field<Snapshot, T>{ this, member };
+    }
+};
+
+// Read is called as read(Snapshot&)
+template<typename Snapshot, typename Read>
+class SnapshotReader : public SnapshotGroup<Snapshot>
+{
+private:
+    Read m_read;
+
+protected:
+    virtual void read_snapshot(void) override { m_read(this->m_snapshot); }
+
+public:
+    explicit SnapshotReader(Read read) : m_read(read) {}
+};
+
+// The group a getter reads from, if any
+template<typename Func>
+SnapshotGroupBase* getter_snapshot(const Func&)
+{
+    return nullptr;
+}
+
+template<typename Snapshot, typename T>
+SnapshotGroupBase* getter_snapshot(const snapshot_field<Snapshot, T>& getter)
+{
+    return getter.group;
+}
+
+template<typename FixedPoint, typename Func>
+SnapshotGroupBase* getter_snapshot(const quantized_getter<FixedPoint, Func>& getter)
+{
+    return getter_snapshot(getter.func);
+}
+
+class EntryBase
+{
+public:
+    virtual ~EntryBase() {}
+    virtual uint16_t code() const = 0;
+    virtual const char* name() const = 0;
+    virtual int fmt_size() const = 0;
+    virtual int data_size() const = 0;
+    virtual int value_size() const = 0;
+    virtual int element_size() const = 0;
+    virtual uint16_t divisor() const = 0;
+    virtual void set_divisor(uint16_t divisor, uint16_t max_divisor) = 0;
+    virtual bool subscribed() const = 0;
+    virtual void set_subscribed(bool on) = 0;
+    virtual SnapshotGroupBase* snapshot() const = 0;
+    virtual void set_deadband(double deadband) = 0;
+    virtual bool sample_changed(uint8_t* shadow, bool force) = 0;
+    virtual void sample(uint8_t* value) = 0;
+    virtual bool pack(packet_buffer& buf) = 0;
+    virtual bool pack_name_and_format(packet_buffer& buf, uint16_t tick_ms) = 0;
+};
+
+// `name` isn't copied: it's a channel_name in flash, or a copy that
+// StructuredLogger::add() made of a std::string
+template<class T>
+class Entry : public EntryBase
+{
+private:
+    uint16_t m_code;
+    const char* m_name;
+    uint8_t m_name_len;
+    bool m_small_scale;
+    std::function<T()> m_getter;
+    int m_fmt_size;
+    int m_data_size;
+    // read by the sender thread when it sends 0x46
+    std::atomic<uint16_t> m_divisor;
+    uint16_t m_added_divisor;
+    bool m_subscribed = true;
+    SnapshotGroupBase* m_snapshot;
+    double m_deadband = 0;
+
+public:
+    Entry(const uint16_t code, const char* name, std::size_t name_len, std::function<T()> getter, bool small_scale = false, uint16_t divisor = 1,
+          SnapshotGroupBase* snapshot = nullptr)
+        : m_code(code)
+        , m_name(name)
+        , m_name_len(static_cast<uint8_t>(name_len))
+        , m_small_scale(small_scale)
+        , m_getter(getter)
+        , m_fmt_size(var_int_size(code) + 1 + m_name_len + 1 + format_extra<T>::size) // code + fmt + name + null + extra
+        , m_data_size(var_int_size(code) + sizeof(T)) // code + data
+        , m_divisor(divisor ? divisor : 1)
+        , m_added_divisor(divisor ? divisor : 1)
+        , m_snapshot(snapshot)
+    {}
+
+    virtual uint16_t code() const override { return m_code; }
+    virtual const char* name() const override { return m_name; }
+    virtual int fmt_size() const override { return m_fmt_size; }
+    virtual int data_size() const override { return m_data_size; }
+    virtual int value_size() const override { return sizeof(T); }
+    virtual int element_size() const override { return wire_element_size<T>::value; }
+    virtual uint16_t divisor() const override { return m_divisor.load(std::memory_order_relaxed); }
+    // 0 goes back to the divisor the entry was added with; either way no
+    // more than `max_divisor`, so the 0x46 sample period fits its var-int
+    virtual void set_divisor(uint16_t divisor, uint16_t max_divisor) override
+    {
+        divisor = divisor ? divisor : m_added_divisor;
+        m_divisor.store((divisor > max_divisor) ? max_divisor : divisor, std::memory_order_relaxed);
+    }
+    virtual bool subscribed() const override { return m_subscribed; }
+    virtual void set_subscribed(bool on) override { m_subscribed = on; }
+    virtual SnapshotGroupBase* snapshot() const override { return m_snapshot; }
+    virtual void set_deadband(double deadband) override { m_deadband = deadband; }
+
+    // The getter's value, timed for the telemetry
+    T get(void)
+    {
+        const uint32_t start = logger_telemetry::now();
+        const T value = m_getter();
+        logger_telemetry::getter_done(m_code, start);
+        return value;
+    }
+
+    // Sample the getter; if the value moved more than the deadband away from
+    // the last sent value in `shadow` (or `force` is set), store it there
+    virtual bool sample_changed(uint8_t* shadow, bool force) override
+    {
+        const T value = get();
+        std::array<uint8_t, sizeof(T)> bytesStorage;
+        static_vector<uint8_t> bytes{bytesStorage};
+        ::pack(bytes, value);
+        if (!force)
+        {
+            if (m_deadband > 0)
+            {
+                if (value_distance(value, unpack<T>(shadow)) <= m_deadband)
+                {
+                    return false;
+                }
+            }
+            else if (std::memcmp(bytes.data(), shadow, sizeof(T)) == 0)
+            {
+                return false;
+            }
+        }
+        std::memcpy(shadow, bytes.data(), sizeof(T));
+        return true;
+    }
+
+    // Sample the getter into `value`, packed as in 0x44
+    virtual void sample(uint8_t* value) override
+    {
+        std::array<uint8_t, sizeof(T)> bytesStorage;
+        static_vector<uint8_t> bytes{bytesStorage};
+        ::pack(bytes, get());
+        std::memcpy(value, bytes.data(), sizeof(T));
+    }
+
+    virtual bool pack(packet_buffer& buf) override
+    {
+        // leave room for the CRC
+        if (m_data_size + buf.size() + PacketWriter::crc_len > buf.capacity())
+        {
+            return false;
+        }
+        pack_var_int(buf, m_code);
+        ::pack(buf, get());
+        return true;
+    }
+
+    virtual bool pack_name_and_format(packet_buffer& buf, uint16_t tick_ms) override
+    {
+        const uint16_t period_ms = tick_ms * divisor();
+        if (m_fmt_size + var_int_size(period_ms) + buf.size() + PacketWriter::crc_len > buf.capacity())
+        {
+            return false;
+        }
+        // send code to identify value
+        pack_var_int(buf, m_code);
+        // send format code
+        const uint8_t fmt_code = m_small_scale ? (fmt<T>::code | 0b10000000) : fmt<T>::code;
+        buf.push_back(fmt_code);
+        // send name (null-terminated)
+        for (uint8_t i = 0; i < m_name_len; i++)
+        {
+            buf.push_back(static_cast<uint8_t>(m_name[i]));
         }
-        // send code to identify value
-        pack_var_int(buf, m_code);
-        // send format code
-        const uint8_t fmt_code = m_small_scale ? (fmt<T>::code | 0b10000000) : fmt<T>::code;
-        buf.push_back(fmt_code);
-        // send name (null-terminated)
-        buf.append(m_name);
         buf.push_back('\0');
+        // send sample period, so the host can timestamp decimated entries
+        pack_var_int(buf, period_ms);
+        format_extra<T>::pack(buf);
         return true;
     }
 };
 
-class StructuredLogger
+class StructuredLogger : public PacketWriter
 {
+public:
+    static constexpr std::size_t registry_size = 50;
+    static constexpr uint16_t invalid_code = 0xFFFF;
+
 private:
-    std::array<uint8_t, 104> m_bufferStorage{};
-    static_vector<uint8_t> m_buffer{m_bufferStorage};
-    std::array<uint8_t, 15*AIVISION_MAX_OBJECTS> m_aiBufferStorage{};
-    static_vector<uint8_t> m_aiBuffer{m_aiBufferStorage};
+    // storage past a packet is room for COBS framing it in place
+    static constexpr std::size_t packet_size = 104;
+    std::array<uint8_t, packet_size + cobs_max_overhead(packet_size)> m_bufferStorage{};
+    packet_buffer m_buffer{m_bufferStorage, packet_size};
+    // one byte of type/id plus at most 14 bytes of AprilTag per object in 0x49
+    static constexpr std::size_t vision_raw_size = 15 * AIVISION_MAX_OBJECTS;
+    using vision_encoder_type = vision_encoder<AIVISION_MAX_OBJECTS>;
+    static constexpr std::size_t vision_payload_size =
+        vision_raw_size > vision_encoder_type::max_size ? vision_raw_size : vision_encoder_type::max_size;
+    static constexpr std::size_t vision_packet_size = header_len + extended_header_len + vision_payload_size + crc_len;
+    std::array<uint8_t, vision_packet_size + cobs_max_overhead(vision_packet_size)> m_aiBufferStorage{};
+    packet_buffer m_aiBuffer{m_aiBufferStorage, vision_packet_size};
+
+    // inter-frame vision stream state for send_vision_changes()
+    vision_encoder_type m_visionEncoder;
+    std::array<vision_record, AIVISION_MAX_OBJECTS> m_visionRecords{};
+    uint16_t m_vision_keyframe_interval = 25;
+    uint16_t m_vision_frames_since_keyframe = 0;
+    bool m_vision_keyframe_requested = true;
+    bool m_vision_enabled = true;
+
+    // read in the order they were added, at the start of every frame
+    SnapshotGroupBase* m_snapshots = nullptr;
+    SnapshotGroupBase** m_snapshots_end = &m_snapshots;
+
+    std::array<EntryBase *, registry_size> m_registryStorage{};
+    static_vector<EntryBase *> m_registry{m_registryStorage};
+    uint16_t m_next_code = 0;
+    int m_fmt_size = 0;
+    int m_data_size = 0;
+
+    // 0x46 goes out before the next frame after startup, a schema change
+    // or a host request, instead of on a timer. With start_sender() the
+    // sender thread sends it and the control loop asks for it, so these
+    // are shared. m_schema is the schema hash (low 16 bits) and how many
+    // entries it covers (high 16), published together by the control loop
+    // after each change; the sender reads no entry past that count, so
+    // never one add() is still filling in.
+    std::atomic<uint32_t> m_schema{CRC16_INIT};
+    std::atomic<bool> m_format_requested{true};
+    command_parser<max_command_payload> m_commands;
+
+    // last sent value of every entry, packed back to back in code order
+    std::array<uint8_t, registry_size * 8> m_shadowStorage{};
+    std::size_t m_shadow_size = 0;
+    uint16_t m_keyframe_interval = 50;
+    uint16_t m_frames_since_keyframe = 0;
+    bool m_keyframe_requested = true;
+
+    // last value of every entry sent in 0x52, laid out like the shadow
+    // buffer, and the frame being coded against it
+    std::array<uint8_t, registry_size * 8> m_riceReferenceStorage{};
+    rice_encoder<registry_size, registry_size * 8> m_riceEncoder;
+    // seq, bitmap length, one bitmap byte and k; what a 0x52 packet of one
+    // entry at full width takes besides the code and value
+    static constexpr int rice_header_len = 4;
+
+    // an entry with divisor n is sampled every n-th tick; one tick per
+    // send_structured_data(), send_structured_changes() or
+    // send_structured_compressed() call
+    uint32_t m_tick = 0;
+    std::atomic<uint16_t> m_tick_ms{20};
+
+    // logger.* channels in the registry yet (LOGGER_TELEMETRY)
+    bool m_telemetry_added = false;
+
+    // samples handed from the control loop to the sender thread
+    static constexpr std::size_t sample_ring_size = 32;
+    spsc_ring<sample_record, sample_ring_size, LOGGER_SAMPLE_OVERFLOW_POLICY> m_samples;
+    static constexpr std::size_t send_packet_size = 512;
+    std::array<uint8_t, send_packet_size + cobs_max_overhead(send_packet_size)> m_sendBufferStorage{};
+    packet_buffer m_sendBuffer{m_sendBufferStorage, send_packet_size};
+    vex::thread* m_sender = nullptr;
+    uint32_t m_sender_period_ms = 10;
+    // m_schema the sender thread last sent 0x46 for; its 0x54 go out under
+    // that hash, never under one the host hasn't been sent yet
+    uint32_t m_sender_schema = 0xFFFFFFFF;
+
+    // pre-trigger capture: the newest capture_structured_data() frames,
+    // frozen by a trigger and sent as 0x48 packets
+    enum class capture_state : uint8_t
+    {
+        recording,
+        post_trigger, // still recording, m_capture_frames_left more frames
+        sending,
+    };
+    static constexpr uint8_t capture_last_packet = 0x01;
+    // capture number, flags, u32 trigger time
+    static constexpr int capture_header_len = 6;
+    // largest record that fits in an m_buffer packet
+    static constexpr std::size_t capture_record_size = packet_size - header_len - extended_header_len - schema_hash_len
+                                                     - capture_header_len - crc_len - capture_ring<0>::record_header_len;
+    capture_ring<LOGGER_CAPTURE_SIZE> m_capture;
+    capture_state m_capture_state = capture_state::recording;
+    std::atomic<bool> m_capture_requested{false};
+    std::function<bool()> m_capture_trigger;
+    uint16_t m_capture_post_frames = 0;
+    uint16_t m_capture_frames_left = 0;
+    uint8_t m_capture_number = 0;
+    uint32_t m_capture_time_us = 0;
+    uint8_t m_capture_packets_per_call = 2;
+
+    // copy_name: `name` doesn't outlive the call, so the entry gets a copy
+    template<typename T>
+    uint16_t add_impl(const char* name, std::size_t name_len, bool copy_name, std::function<T()> func, bool small_scale, uint16_t divisor,
+                      SnapshotGroupBase* snapshot)
+    {
+        if (m_registry.full())
+        {
+            print("add_impl failure: m_registry is full; can't add '%s'", name);
+            return invalid_code;
+        }
+        if (name_len > 255)
+        {
+            print("add_impl failure: name longer than 255 characters: '%s'", name);
+            return invalid_code;
+        }
+        // value and description each have to fit in an empty packet, even
+        // a 0x52 one at full width, and the value in the shadow buffer
+        const int packet_overhead = header_len + extended_header_len + schema_hash_len + crc_len;
+        const int data_size = var_int_size(m_next_code) + sizeof(T);
+        const int rice_size = rice_header_len + var_int_size(m_next_code) + sizeof(T);
+        const int fmt_size = var_int_size(m_next_code) + 1 + name_len + 1 + 2 + format_extra<T>::size;
+        if (data_size + packet_overhead > static_cast<int>(packet_size)
+            || rice_size + packet_overhead > static_cast<int>(packet_size)
+            || data_size > static_cast<int>(sizeof(sample_record::data))
+            || fmt_size + packet_overhead > static_cast<int>(packet_size)
+            || m_shadow_size + sizeof(T) > m_shadowStorage.size())
+        {
+            print("add_impl failure: '%s' doesn't fit in a packet", name);
+            return invalid_code;
+        }
+        if (copy_name)
+        {
+            // entries live as long as the logger, and so does the copy
+            char* const copy = new char[name_len + 1];
+            std::memcpy(copy, name, name_len + 1);
+            name = copy;
+        }
+        if (divisor > max_divisor())
+        {
+            divisor = max_divisor();
+        }
+        EntryBase * const entry = (EntryBase *)(new Entry<T>(m_next_code++, name, name_len, func, small_scale, divisor, snapshot));
+        m_fmt_size += entry->fmt_size();
+        m_data_size += entry->data_size();
+        m_shadow_size += entry->value_size();
+        m_registry.push_back(entry);
+        if ((snapshot != nullptr) && (snapshot->m_first_code == invalid_code))
+        {
+            snapshot->m_first_code = entry->code();
+        }
+        schema_changed();
+        return entry->code();
+    }
+
+    static int sender_thread(void* arg)
+    {
+        StructuredLogger* const logger = static_cast<StructuredLogger*>(arg);
+        while (true)
+        {
+            logger->send_samples();
+            vex::this_thread::sleep_for(logger->m_sender_period_ms);
+        }
+        return 0;
+    }
+
+    void push_sample(sample_record& record, const packet_buffer& buf)
+    {
+        record.size = static_cast<uint8_t>(buf.size());
+        m_samples.push(record);
+    }
+
+    // Read the groups of the entries sampled this frame: every entry when
+    // `all` is set, else the due ones
+    void read_snapshots(bool all)
+    {
+        logger_telemetry::frame();
+        if (m_snapshots == nullptr)
+        {
+            return;
+        }
+        for (auto &entry : m_registry)
+        {
+            if ((entry->snapshot() != nullptr) && is_sampled(entry, all))
+            {
+                entry->snapshot()->m_due = true;
+            }
+        }
+        for (SnapshotGroupBase* group = m_snapshots; group != nullptr; group = group->m_next)
+        {
+            if (group->m_due)
+            {
+                group->read();
+                logger_telemetry::getter_time(group->m_first_code, group->read_time_us());
+                group->m_due = false;
+            }
+        }
+    }
+
+    // entries with the same divisor are spread over ticks by their code;
+    // those of a snapshot group all go by the group's first code, so they
+    // are due together and the group is read once for all of them.
+    // Unsubscribed entries are never due.
+    bool is_due(const EntryBase* entry) const
+    {
+        const SnapshotGroupBase* const snapshot = entry->snapshot();
+        const uint16_t code = snapshot != nullptr ? snapshot->m_first_code : entry->code();
+        return entry->subscribed() && ((m_tick % entry->divisor()) == (code % entry->divisor()));
+    }
+
+    // Whether a frame samples the entry: every subscribed entry when `all`
+    // is set (keyframes, captures), else the due ones
+    bool is_sampled(const EntryBase* entry, bool all) const
+    {
+        return all ? entry->subscribed() : is_due(entry);
+    }
+
+    bool is_changed(const uint8_t* changed, std::size_t code) const
+    {
+        return (changed[code / 8] >> (code % 8)) & 1;
+    }
+
+    // Most ticks between samples whose period, tick_ms * divisor, still
+    // fits the var-int in 0x46
+    uint16_t max_divisor(void) const
+    {
+        return static_cast<uint16_t>(max_var_int / m_tick_ms);
+    }
+
+    // Called on the control loop after anything in the 0x46 format changes
+    void schema_changed(void)
+    {
+        const uint16_t count = static_cast<uint16_t>(m_registry.size());
+        m_schema.store((static_cast<uint32_t>(count) << 16) | compute_schema_hash(count), std::memory_order_release);
+        m_format_requested = true;
+        // 0x43 has no schema hash: the next frame is a keyframe, so the
+        // host sees the new hash before any bitmap in the new layout
+        m_keyframe_requested = true;
+        // captured frames are only valid under the schema they were taken with
+        m_capture.clear();
+        m_capture_state = capture_state::recording;
+    }
+
+    // subscribe_command/unsubscribe_command: var-int codes; none means all
+    void apply_subscriptions(bool on, const uint8_t* payload, std::size_t len)
+    {
+        if (len == 0)
+        {
+            for (uint16_t code = 0; code < m_registry.size(); code++)
+            {
+                set_subscribed(code, on);
+            }
+            return;
+        }
+        std::size_t i = 0;
+        uint16_t code;
+        while (read_command_var_int(payload, len, i, code))
+        {
+            set_subscribed(code, on);
+        }
+    }
+
+    // rate_command: (var-int code, var-int period in ms) pairs
+    void apply_periods(const uint8_t* payload, std::size_t len)
+    {
+        std::size_t i = 0;
+        uint16_t code;
+        uint16_t period_ms;
+        while (read_command_var_int(payload, len, i, code) && read_command_var_int(payload, len, i, period_ms))
+        {
+            // nearest whole number of ticks, at least one; set_divisor()
+            // caps it at the longest period 0x46 can describe
+            const uint32_t ticks = (static_cast<uint32_t>(period_ms) + m_tick_ms / 2) / m_tick_ms;
+            const uint16_t divisor = static_cast<uint16_t>((ticks > max_divisor()) ? max_divisor() : ticks);
+            set_divisor(code, (period_ms == 0) ? 0 : (divisor ? divisor : 1));
+        }
+    }
+
+    void push_capture(uint32_t timestamp_us, const packet_buffer& buf)
+    {
+        m_capture.push(timestamp_us, buf.data(), static_cast<uint8_t>(buf.size()));
+    }
+
+    // CRC16 of the first `count` entries' 0x46 descriptions back to back in
+    // code order, i.e. of the 0x46 payloads without their leading hash
+    uint16_t compute_schema_hash(uint16_t count)
+    {
+        decltype(m_bufferStorage) storage{};
+        packet_buffer buf{storage, packet_size};
+        uint16_t hash = CRC16_INIT;
+        for (uint16_t code = 0; code < count; code++)
+        {
+            buf.clear();
+            m_registry[code]->pack_name_and_format(buf, m_tick_ms);
+            hash = crc16_update(hash, buf.data(), buf.size());
+        }
+        return hash;
+    }
+
+    // prepare_buffer() for the packets that start with the schema hash
+    void prepare_schema_buffer(packet_buffer& buf, uint8_t command, uint32_t sample_time_us, uint16_t hash)
+    {
+        prepare_buffer(buf, command, sample_time_us);
+        pack<uint16_t>(buf, hash);
+    }
+
+    void prepare_schema_buffer(packet_buffer& buf, uint8_t command, uint32_t sample_time_us)
+    {
+        prepare_schema_buffer(buf, command, sample_time_us, schema_hash());
+    }
+
+    // The 0x46 packets, built in `buf`: m_buffer from the control loop,
+    // the sender thread's own storage from send_samples(). The entries and
+    // the hash they go out under come from the same published schema.
+    void send_format_packets(packet_buffer& buf)
+    {
+        send_format_packets(buf, m_schema.load(std::memory_order_acquire));
+    }
+
+    void send_format_packets(packet_buffer& buf, uint32_t schema)
+    {
+        const uint32_t now = logger_time_us();
+        const uint16_t tick_ms = m_tick_ms;
+        const uint16_t hash = static_cast<uint16_t>(schema);
+        const uint16_t count = static_cast<uint16_t>(schema >> 16);
+        prepare_schema_buffer(buf, 0x46, now, hash); // data_format_command
+        for (uint16_t code = 0; code < count; code++)
+        {
+            EntryBase* const entry = m_registry[code];
+            if (!entry->pack_name_and_format(buf, tick_ms))
+            {
+                send_packet(buf);
+                prepare_schema_buffer(buf, 0x46, now, hash);
+                entry->pack_name_and_format(buf, tick_ms);
+            }
+        }
+        send_packet(buf);
+    }
+
+    // A request that comes in while it's being sent is kept for next time
+    void send_pending_format(packet_buffer& buf)
+    {
+        if (m_format_requested.exchange(false))
+        {
+            send_format_packets(buf);
+        }
+    }
+
+    // 0x44 packets for every entry, from the values in the shadow buffer
+    void send_shadow_keyframe(uint32_t sample_time_us)
+    {
+        prepare_schema_buffer(m_buffer, 0x44, sample_time_us); // structured_data_command
+        int offset = 0;
+        for (auto &entry : m_registry)
+        {
+            if (!entry->subscribed())
+            {
+                offset += entry->value_size();
+                continue;
+            }
+            if (entry->data_size() + m_buffer.size() + crc_len > m_buffer.capacity())
+            {
+                logger_telemetry::split();
+                send_packet(m_buffer);
+                prepare_schema_buffer(m_buffer, 0x44, sample_time_us);
+            }
+            pack_var_int(m_buffer, entry->code());
+            for (int i = 0; i < entry->value_size(); i++)
+            {
+                m_buffer.push_back(m_shadowStorage[offset + i]);
+            }
+            offset += entry->value_size();
+        }
+        send_packet(m_buffer);
+    }
+
+    // 0x43 packets for the entries flagged in `changed`, from the shadow buffer
+    void send_shadow_changes(const uint8_t* changed, uint32_t sample_time_us)
+    {
+        const std::size_t count = m_registry.size();
+        std::size_t first = 0;
+        int first_offset = 0;
+        while (true)
+        {
+            // skip to the next changed entry
+            while ((first < count) && !is_changed(changed, first))
+            {
+                first_offset += m_registry[first]->value_size();
+                first++;
+            }
+            if (first >= count)
+            {
+                return;
+            }
 
-    std::array<EntryBase *, 50> m_registryStorage{};
-    static_vector<EntryBase *> m_registry{m_registryStorage};
-    uint16_t m_next_code = 0;
-    int m_fmt_size = 0;
-    int m_data_size = 0;
+            // take as many entries as fit: first code, bitmap length, bitmap, values
+            const std::size_t fixed = header_size() + var_int_size(first) + 1 + crc_len;
+            std::size_t end = first;
+            std::size_t values_size = 0;
+            for (std::size_t code = first; code < count; code++)
+            {
+                if (!is_changed(changed, code))
+                {
+                    continue;
+                }
+                const std::size_t value_size = m_registry[code]->value_size();
+                const std::size_t bitmap_len = (code - first) / 8 + 1;
+                if (fixed + bitmap_len + values_size + value_size > m_buffer.capacity())
+                {
+                    logger_telemetry::split();
+                    break;
+                }
+                values_size += value_size;
+                end = code + 1;
+            }
 
-    static constexpr int header_len = 5;
+            prepare_buffer(m_buffer, 0x43, sample_time_us); // structured_changes_command
+            pack_var_int(m_buffer, first);
+            const std::size_t bitmap_len = (end - first + 7) / 8;
+            m_buffer.push_back(static_cast<uint8_t>(bitmap_len));
+            for (std::size_t byte = 0; byte < bitmap_len; byte++)
+            {
+                uint8_t bits = 0;
+                for (std::size_t bit = 0; bit < 8; bit++)
+                {
+                    const std::size_t code = first + 8 * byte + bit;
+                    if ((code < end) && is_changed(changed, code))
+                    {
+                        bits |= 1 << bit;
+                    }
+                }
+                m_buffer.push_back(bits);
+            }
+            for (std::size_t code = first; code < end; code++)
+            {
+                const int value_size = m_registry[code]->value_size();
+                if (is_changed(changed, code))
+                {
+                    for (int i = 0; i < value_size; i++)
+                    {
+                        m_buffer.push_back(m_shadowStorage[first_offset + i]);
+                    }
+                }
+                first_offset += value_size;
+            }
+            send_packet(m_buffer);
+            first = end;
+        }
+    }
 
-    template<typename T>
-    void add_impl(const std::string name, std::function<T()> func, bool small_scale = false)
+    // The logger's own channels, "logger.*", every LOGGER_TELEMETRY_DIVISOR
+    // ticks (see logger_telemetry.h). Added with the first frame or 0x46,
+    // after the user's channels, so their codes are the same with telemetry
+    // on or off; channels added later come after these.
+    // A template so that none of it is compiled in with telemetry off.
+    template<typename Enabled>
+    void add_telemetry_channels(Enabled)
     {
-        if (m_registry.full())
+        if (m_telemetry_added)
         {
-            print("add_impl failure: m_registry is full; can't add '%s'", name);
             return;
         }
-        EntryBase * const entry = (EntryBase *)(new Entry<T>(m_next_code++, name, func, small_scale));
-        m_fmt_size += entry->fmt_size();
-        m_data_size += entry->data_size();
-        m_registry.push_back(entry);
+        m_telemetry_added = true;
+        using snapshot = logger_telemetry_snapshot;
+        auto& group = add_snapshot<snapshot>([](snapshot& s) { logger_telemetry::read(s); });
+        const uint16_t divisor = LOGGER_TELEMETRY_DIVISOR;
+        add(LOGGER_NAME("logger.getter_us"), group.field(&snapshot::frame_getter_us), false, divisor);
+        add(LOGGER_NAME("logger.slowest_code"), group.field(&snapshot::slowest_code), false, divisor);
+        add(LOGGER_NAME("logger.slowest_us"), group.field(&snapshot::slowest_getter_us), false, divisor);
+        add(LOGGER_NAME("logger.build_us"), group.field(&snapshot::build_us), false, divisor);
+        add(LOGGER_NAME("logger.stall_us"), group.field(&snapshot::stall_us), false, divisor);
+        add(LOGGER_NAME("logger.max_stall_us"), group.field(&snapshot::max_stall_us), false, divisor);
+        add(LOGGER_NAME("logger.bytes"), group.field(&snapshot::bytes), false, divisor);
+        add(LOGGER_NAME("logger.splits"), group.field(&snapshot::splits), false, divisor);
+        add(LOGGER_NAME("logger.drops"), group.field(&snapshot::drops), false, divisor);
+    }
+
+    void add_telemetry_channels(std::false_type) {}
+
+    // Called first thing by everything that starts a frame or sends 0x46
+    void add_late_channels(void)
+    {
+        add_telemetry_channels(std::integral_constant<bool, logger_telemetry::enabled>());
     }
 
 public:
     StructuredLogger() {}
 
+    // Returns the entry's code, or invalid_code if the registry is full.
+    // The entry is sampled and sent every `divisor` ticks.
     template<typename Func>
-    void add(const std::string name, Func func, bool small_scale = false)
+    uint16_t add(const std::string name, Func func, bool small_scale = false, uint16_t divisor = 1)
     {
-        add_impl(name, std::function<decltype(func())()>(func), small_scale);
+        return add_impl(name.c_str(), name.size(), true, std::function<decltype(func())()>(func), small_scale, divisor,
+                        getter_snapshot(func));
     }
 
-    template<typename Container>
-    void prepare_buffer(Container& buf, uint8_t command)
+    // Same, with the name left in flash instead of copied to the heap:
+    // add(LOGGER_NAME("Heading"), ...)
+    template<char... Cs, typename Func>
+    uint16_t add(channel_name<Cs...>, Func func, bool small_scale = false, uint16_t divisor = 1)
     {
-        buf.clear();
-        buf.push_back(0xc0); // special header
-        buf.push_back(0xde); // special header
-        buf.push_back(command);
-        buf.push_back(0x00); // placeholder for length
-        buf.push_back(0x00); // placeholder for length
+        return add_impl(channel_name<Cs...>::data, sizeof...(Cs), false, std::function<decltype(func())()>(func), small_scale, divisor,
+                        getter_snapshot(func));
     }
 
-    template<typename Container>
-    void send_packet(Container& buf)
+    // A snapshot group, read by `read(Snapshot&)` at the start of each
+    // send_structured_data(), send_structured_changes() and
+    // sample_structured_data() that samples one of its fields; add those
+    // with group.field(&Snapshot::x). A group makes a frame's values one
+    // coherent snapshot, not fewer device calls than separate getters would.
+    // Groups live as long as the logger.
+    template<typename Snapshot, typename Read>
+    SnapshotGroup<Snapshot>& add_snapshot(Read read)
     {
-        pack_len(buf, 3);
-        append_crc16(buf);
-        fwrite(buf.data(), 1, buf.size(), stdout);
-        fflush(stdout);
+        SnapshotReader<Snapshot, Read>* const group = new SnapshotReader<Snapshot, Read>(read);
+        *m_snapshots_end = group;
+        m_snapshots_end = &group->m_next;
+        return *group;
+    }
+
+    // Time between send_structured_data()/send_structured_changes() calls;
+    // only used to advertise each entry's sample period in 0x46 packets.
+    // 0 is ignored. Divisors too long for the new tick are shortened.
+    void set_tick_period(uint16_t tick_ms)
+    {
+        if (tick_ms != 0 && tick_ms != m_tick_ms)
+        {
+            m_tick_ms = tick_ms;
+            for (auto &entry : m_registry)
+            {
+                entry->set_divisor(entry->divisor(), max_divisor());
+            }
+            schema_changed();
+        }
+    }
+
+    // Changes smaller than `deadband` don't count as changes in
+    // send_structured_changes(); 0 (the default) sends any change
+    void set_deadband(uint16_t code, double deadband)
+    {
+        if (code < m_registry.size())
+        {
+            m_registry[code]->set_deadband(deadband);
+        }
+    }
+
+    // Sequence numbers and sample timestamps on every packet (see
+    // PacketWriter); 6 more bytes per packet
+    void set_extended_header(bool on)
+    {
+        PacketWriter::set_extended_header(on);
+    }
+
+    // COBS frames instead of the 0xc0 0xde sync word (see cobs.h); one more
+    // byte per packet, for resync at the next 0x00 and no \r\n quirk.
+    // Hosts have to be told: c0de_decode --cobs.
+    void set_framing(packet_framing framing)
+    {
+        PacketWriter::set_framing(framing);
+    }
+
+    // Frames between full 0x44 keyframes in send_structured_changes(), and
+    // 0x52 ones in send_structured_compressed()
+    void set_keyframe_interval(uint16_t frames)
+    {
+        m_keyframe_interval = frames;
+    }
+
+    // Make the next send_structured_changes(), send_structured_compressed()
+    // and send_vision_changes() full keyframes
+    void request_keyframe(void)
+    {
+        m_keyframe_requested = true;
+        m_vision_keyframe_requested = true;
+    }
+
+    // Snapshots between 0x56 keyframes in send_vision_changes()
+    void set_vision_keyframe_interval(uint16_t snapshots)
+    {
+        m_vision_keyframe_interval = snapshots;
     }
 
+    // Hash of the registry that leads every 0x46, 0x44, 0x48, 0x52 and 0x54 payload; the
+    // host keeps the formats it has seen by hash, and asks for a resend
+    // (format_request_command) when data arrives with one it doesn't know.
+    // Computed by the control loop when the registry changes, so reading it
+    // from the sender thread never walks the registry.
+    uint16_t schema_hash(void) const
+    {
+        return static_cast<uint16_t>(m_schema.load(std::memory_order_acquire));
+    }
+
+    // Sent by itself before the first frame, after the registry or tick
+    // period changes, and when the host asks for it; calling it directly
+    // still works
     void send_data_format(void)
     {
-        prepare_buffer(m_buffer, 0x46); // data_format_command
-        for (auto &entry : m_registry)
+        add_late_channels();
+        m_format_requested = false;
+        send_format_packets(m_buffer);
+    }
+
+    // Handle the commands the host sent since the last call (see
+    // host_commands.h); call once per tick
+    void poll_host_commands(void)
+    {
+        int byte;
+        while ((byte = logger_read_byte()) >= 0)
         {
-            if (!entry->pack_name_and_format(m_buffer))
+            if (!m_commands.feed(static_cast<uint8_t>(byte)))
             {
-                send_packet(m_buffer);
-                prepare_buffer(m_buffer, 0x46);
-                entry->pack_name_and_format(m_buffer);
+                continue;
+            }
+            if (m_commands.command() == format_request_command)
+            {
+                // a host that lost the format lost the last values too
+                m_format_requested = true;
+                request_keyframe();
+            }
+            else if (m_commands.command() == capture_trigger_command)
+            {
+                trigger_capture();
+            }
+            else if ((m_commands.command() == subscribe_command) || (m_commands.command() == unsubscribe_command))
+            {
+                apply_subscriptions(m_commands.command() == subscribe_command, m_commands.payload(), m_commands.size());
+            }
+            else if (m_commands.command() == rate_command)
+            {
+                apply_periods(m_commands.payload(), m_commands.size());
+            }
+            else if ((m_commands.command() == vision_command) && (m_commands.size() >= 1))
+            {
+                set_vision_enabled(m_commands.payload()[0] != 0);
             }
         }
-        send_packet(m_buffer);
+    }
+
+    // Unsubscribed entries stay registered, with the same code and in the
+    // 0x46 format, but their getters aren't called (nor their snapshot
+    // groups read, unless another entry needs them) and nothing is sent for
+    // them. The host changes this with subscribe_command and
+    // unsubscribe_command.
+    void set_subscribed(uint16_t code, bool on)
+    {
+        if (code >= m_registry.size())
+        {
+            return;
+        }
+        EntryBase* const entry = m_registry[code];
+        if (on && !entry->subscribed())
+        {
+            // the shadow buffer holds whatever was sent before it stopped
+            m_keyframe_requested = true;
+        }
+        entry->set_subscribed(on);
+    }
+
+    bool subscribed(uint16_t code) const
+    {
+        return (code < m_registry.size()) && m_registry[code]->subscribed();
+    }
+
+    // Sample the entry every `divisor` ticks from now on; 0 goes back to the
+    // divisor it was added with. Capped at max_divisor(). The host changes
+    // this with rate_command.
+    void set_divisor(uint16_t code, uint16_t divisor)
+    {
+        if (code >= m_registry.size())
+        {
+            return;
+        }
+        EntryBase* const entry = m_registry[code];
+        const uint16_t before = entry->divisor();
+        entry->set_divisor(divisor, max_divisor());
+        if (entry->divisor() != before)
+        {
+            // the sample period is part of the format
+            schema_changed();
+        }
+    }
+
+    // Pause (false) or resume send_vision_data() and send_vision_changes();
+    // the host changes this with vision_command. Check vision_enabled()
+    // before taking the snapshot, so a paused camera costs nothing.
+    void set_vision_enabled(bool on)
+    {
+        if (on && !m_vision_enabled)
+        {
+            m_vision_keyframe_requested = true;
+        }
+        m_vision_enabled = on;
+    }
+
+    bool vision_enabled(void) const
+    {
+        return m_vision_enabled;
     }
 
     void send_structured_data(void)
     {
-        prepare_buffer(m_buffer, 0x44); // structured_data_command
+        add_late_channels();
+        send_pending_format(m_buffer);
+        const uint32_t sample_time_us = logger_time_us();
+        read_snapshots(false);
+        prepare_schema_buffer(m_buffer, 0x44, sample_time_us); // structured_data_command
+        int packed = 0;
         for (auto &entry : m_registry)
         {
+            if (!is_due(entry))
+            {
+                continue;
+            }
             if (!entry->pack(m_buffer))
             {
+                logger_telemetry::split();
                 send_packet(m_buffer);
-                prepare_buffer(m_buffer, 0x44);
+                prepare_schema_buffer(m_buffer, 0x44, sample_time_us);
                 entry->pack(m_buffer);
             }
+            packed++;
+        }
+        if (packed || m_registry.empty())
+        {
+            send_packet(m_buffer);
+        }
+        m_tick++;
+        // the host now has newer values than the shadow buffer
+        m_keyframe_requested = true;
+    }
+
+    // Like send_structured_data(), but between keyframes only sends the due
+    // entries that changed since they were last sent, as 0x43 packets:
+    // var-int first code, 1-byte bitmap length, bitmap (bit i of byte i / 8
+    // set if code first + i is present), then the present values in code
+    // order. Keyframes sample every entry, due or not.
+    void send_structured_changes(void)
+    {
+        add_late_channels();
+        send_pending_format(m_buffer);
+        const uint32_t sample_time_us = logger_time_us();
+        const bool keyframe = m_keyframe_requested || (m_frames_since_keyframe >= m_keyframe_interval);
+        read_snapshots(keyframe);
+        std::array<uint8_t, (registry_size + 7) / 8> changed{};
+        int offset = 0;
+        for (auto &entry : m_registry)
+        {
+            if (is_sampled(entry, keyframe) && entry->sample_changed(&m_shadowStorage[offset], keyframe))
+            {
+                changed[entry->code() / 8] |= 1 << (entry->code() % 8);
+            }
+            offset += entry->value_size();
+        }
+
+        if (keyframe)
+        {
+            send_shadow_keyframe(sample_time_us);
+            m_keyframe_requested = false;
+            m_frames_since_keyframe = 0;
+        }
+        else
+        {
+            send_shadow_changes(changed.data(), sample_time_us);
+            m_frames_since_keyframe++;
+        }
+        m_tick++;
+    }
+
+    // Like send_structured_data(), but Rice coded as 0x52 packets (see
+    // rice_codec.h): each value goes as its difference from the value last
+    // sent for it, which for sensors that move a little per tick takes a
+    // few bits instead of the value's full width. Keyframes code every
+    // entry from zero, so a host that missed a packet is back in step by
+    // the next one; set_keyframe_interval() and request_keyframe() apply
+    // here too.
+    void send_structured_compressed(void)
+    {
+        add_late_channels();
+        send_pending_format(m_buffer);
+        const uint32_t sample_time_us = logger_time_us();
+        const bool keyframe = m_keyframe_requested || (m_frames_since_keyframe >= m_keyframe_interval);
+        read_snapshots(keyframe);
+        m_riceEncoder.begin(keyframe);
+        std::array<uint8_t, sizeof(sample_record::data)> value;
+        int offset = 0;
+        for (auto &entry : m_registry)
+        {
+            if (is_sampled(entry, keyframe))
+            {
+                entry->sample(value.data());
+                m_riceEncoder.add(entry->code(), entry->element_size(), value.data(), &m_riceReferenceStorage[offset],
+                                  entry->value_size());
+            }
+            offset += entry->value_size();
+        }
+
+        std::size_t next = 0;
+        while (next < m_riceEncoder.size())
+        {
+            if (next > 0)
+            {
+                logger_telemetry::split();
+            }
+            prepare_schema_buffer(m_buffer, 0x52, sample_time_us); // compressed_data_command
+            const std::size_t end = m_riceEncoder.encode(m_buffer, next, m_buffer.capacity() - m_buffer.size() - crc_len);
+            if (end == next)
+            {
+                // add_impl() made sure every entry fits
+                break;
+            }
+            send_packet(m_buffer);
+            next = end;
+        }
+
+        if (keyframe)
+        {
+            m_keyframe_requested = false;
+            m_frames_since_keyframe = 0;
+        }
+        else
+        {
+            m_frames_since_keyframe++;
+        }
+        m_tick++;
+    }
+
+    // Sample the due entries into a timestamped record for the sender
+    // thread, without touching stdout; the control loop never waits on the
+    // link. When the ring is full LOGGER_SAMPLE_OVERFLOW_POLICY decides
+    // which record is lost, see sample_drops().
+    void sample_structured_data(void)
+    {
+        add_late_channels();
+        sample_record record;
+        record.timestamp_us = logger_time_us();
+        read_snapshots(false);
+        packet_buffer buf{record.data};
+        for (auto &entry : m_registry)
+        {
+            if (!is_due(entry))
+            {
+                continue;
+            }
+            if (!entry->pack(buf))
+            {
+                logger_telemetry::split();
+                push_sample(record, buf);
+                buf.clear();
+                entry->pack(buf);
+            }
+        }
+        if (!buf.empty())
+        {
+            push_sample(record, buf);
+        }
+        m_tick++;
+    }
+
+    // Start a vex::thread that calls send_samples() every `period_ms`
+    void start_sender(uint32_t period_ms = 10)
+    {
+        m_sender_period_ms = period_ms;
+        if (m_sender == nullptr)
+        {
+            m_sender = new vex::thread(sender_thread, this);
+        }
+    }
+
+    // Write out every queued record as 0x54 packets, coalescing as many
+    // records as fit in each: schema hash, then per record 4-byte timestamp
+    // in us, 1-byte size, then `size` bytes of (code, value) pairs. Only
+    // call this from one thread.
+    void send_samples(void)
+    {
+        // a schema published by the control loop may not have its 0x46
+        // request set yet, so a new one is sent whether or not it is
+        const bool requested = m_format_requested.exchange(false);
+        const uint32_t schema = m_schema.load(std::memory_order_acquire);
+        if (requested || (schema != m_sender_schema))
+        {
+            // in the sender's own storage, as packet_size packets like any 0x46
+            packet_buffer format{m_sendBufferStorage, packet_size};
+            send_format_packets(format, schema);
+            m_sender_schema = schema;
+        }
+        const uint16_t hash = static_cast<uint16_t>(m_sender_schema);
+        sample_record record;
+        bool pending = false;
+        while (m_samples.pop(record))
+        {
+            const std::size_t record_len = 4 + 1 + record.size;
+            if (pending && (m_sendBuffer.size() + record_len + crc_len > m_sendBuffer.capacity()))
+            {
+                send_packet(m_sendBuffer);
+                pending = false;
+            }
+            if (!pending)
+            {
+                // the extended header carries the first record's timestamp
+                prepare_schema_buffer(m_sendBuffer, 0x54, record.timestamp_us, hash); // sample_records_command
+                pending = true;
+            }
+            pack<uint32_t>(m_sendBuffer, record.timestamp_us);
+            pack<uint8_t>(m_sendBuffer, record.size);
+            for (uint8_t i = 0; i < record.size; i++)
+            {
+                m_sendBuffer.push_back(record.data[i]);
+            }
+        }
+        if (pending)
+        {
+            send_packet(m_sendBuffer);
+        }
+    }
+
+    // Records lost because the sender thread fell behind
+    uint32_t sample_drops(void) const
+    {
+        return m_samples.dropped();
+    }
+
+    // Sample every subscribed entry, whatever its divisor, into the capture
+    // ring without sending anything; the ring keeps the newest
+    // LOGGER_CAPTURE_SIZE bytes of frames. Call it at the capture rate,
+    // e.g. every 1 ms, from the control loop. After a trigger (see
+    // trigger_capture() and set_capture_trigger()) and
+    // set_capture_post_trigger() more frames, the ring is frozen until
+    // send_capture() has sent it all, then recording starts over.
+    void capture_structured_data(void)
+    {
+        add_late_channels();
+        if ((m_capture.capacity() == 0) || (m_capture_state == capture_state::sending))
+        {
+            return;
+        }
+        const uint32_t sample_time_us = logger_time_us();
+        read_snapshots(true);
+        std::array<uint8_t, capture_record_size> storage;
+        packet_buffer buf{storage};
+        for (auto &entry : m_registry)
+        {
+            if (!entry->subscribed())
+            {
+                continue;
+            }
+            // an entry too big for a capture record is left out
+            if (!entry->pack(buf) && !buf.empty())
+            {
+                push_capture(sample_time_us, buf);
+                buf.clear();
+                entry->pack(buf);
+            }
+        }
+        if (!buf.empty())
+        {
+            push_capture(sample_time_us, buf);
+        }
+
+        // the request is taken as the capture starts, so one made while
+        // it is recorded or sent starts the next
+        if ((m_capture_state == capture_state::recording)
+            && (m_capture_requested.exchange(false) || (m_capture_trigger && m_capture_trigger())))
+        {
+            m_capture_time_us = sample_time_us;
+            m_capture_frames_left = m_capture_post_frames;
+            m_capture_number++;
+            m_capture_state = capture_state::post_trigger;
+        }
+        if (m_capture_state == capture_state::post_trigger)
+        {
+            if (m_capture_frames_left == 0)
+            {
+                m_capture_state = capture_state::sending;
+            }
+            else
+            {
+                m_capture_frames_left--;
+            }
+        }
+    }
+
+    // Freeze the capture ring at the next capture_structured_data(); safe
+    // to call from another thread, e.g. a brain button callback. The host
+    // can do the same with capture_trigger_command. While a capture is
+    // being recorded or sent, one more trigger is kept and starts the next
+    // as soon as recording starts over; further ones are merged into it.
+    void trigger_capture(void)
+    {
+        m_capture_requested.store(true);
+    }
+
+    // Also freeze the ring the first frame `trigger` returns true after,
+    // e.g. on a snapshot field:
+    //   logger.set_capture_trigger([&]() { return std::fabs(imu.snapshot().accel[0]) > 2; });
+    void set_capture_trigger(std::function<bool()> trigger)
+    {
+        m_capture_trigger = trigger;
+    }
+
+    // Frames to keep recording after a trigger, so the capture shows what
+    // followed it too; the rest of the ring is what led up to it
+    void set_capture_post_trigger(uint16_t frames)
+    {
+        m_capture_post_frames = frames;
+    }
+
+    // 0x48 packets send_capture() sends per call
+    void set_capture_rate(uint8_t packets_per_call)
+    {
+        m_capture_packets_per_call = packets_per_call;
+    }
+
+    bool capture_pending(void) const
+    {
+        return m_capture_state == capture_state::sending;
+    }
+
+    // Send up to set_capture_rate() packets of a frozen capture, as 0x48:
+    // schema hash, capture number, flags (capture_last_packet on the last
+    // one), u32 trigger time in us, then records as in 0x54. Call once per
+    // tick, next to the live data, so the capture goes out as fast as the
+    // link allows without holding the live data up; with an output
+    // scheduler, as fast as its bulk queue drains.
+    void send_capture(void)
+    {
+        for (uint8_t n = 0; (n < m_capture_packets_per_call) && (m_capture_state == capture_state::sending)
+                            && output_has_room(output_channel::bulk, frame_size(m_buffer)); n++)
+        {
+            prepare_schema_buffer(m_buffer, 0x48, m_capture_time_us); // capture_command
+            const bool last = m_buffer.size() + capture_header_len + m_capture.size() + crc_len <= m_buffer.capacity();
+            m_buffer.push_back(m_capture_number);
+            m_buffer.push_back(last ? capture_last_packet : 0);
+            pack<uint32_t>(m_buffer, m_capture_time_us);
+            while (!m_capture.empty() && (m_buffer.size() + m_capture.front_len() + crc_len <= m_buffer.capacity()))
+            {
+                m_capture.pop(m_buffer);
+            }
+            send_packet(m_buffer);
+            if (last)
+            {
+                m_capture.clear();
+                m_capture_state = capture_state::recording;
+            }
         }
-        send_packet(m_buffer);
     }
 
     void send_vision_data(vex::safearray<vex::aivision::object, AIVISION_MAX_OBJECTS>& objs)
     {
+        if (!m_vision_enabled)
+        {
+            return;
+        }
         const int objs_len = objs.getLength();
         prepare_buffer(m_aiBuffer, 0x49); // vision_data_command
         for (int i = 0; i < objs_len; i++)
@@ -393,6 +2357,42 @@ public:
         send_packet(m_aiBuffer);
     }
 
+    // Bit-packed alternative to send_vision_data() (see vision_codec.h):
+    // objects matching one in the previous snapshot by type, id and position
+    // are sent as a "same" flag or small deltas, as 0x56 packets
+    void send_vision_changes(vex::safearray<vex::aivision::object, AIVISION_MAX_OBJECTS>& objs)
+    {
+        if (!m_vision_enabled)
+        {
+            return;
+        }
+        const int objs_len = objs.getLength();
+        std::size_t count = 0;
+        for (int i = 0; i < objs_len && count < m_visionRecords.size(); i++)
+        {
+            vex::aivision::object& obj = objs[i];
+            if (obj.exists && make_vision_record(obj, m_visionRecords[count]))
+            {
+                count++;
+            }
+        }
+
+        const bool keyframe = m_vision_keyframe_requested
+                           || (m_vision_frames_since_keyframe >= m_vision_keyframe_interval);
+        prepare_buffer(m_aiBuffer, 0x56); // vision_changes_command
+        m_visionEncoder.encode(m_aiBuffer, m_visionRecords.data(), count, keyframe);
+        send_packet(m_aiBuffer);
+        if (keyframe)
+        {
+            m_vision_keyframe_requested = false;
+            m_vision_frames_since_keyframe = 0;
+        }
+        else
+        {
+            m_vision_frames_since_keyframe++;
+        }
+    }
+
     template<typename Container>
     void pack_vision_object(Container& buf, vex::aivision::object& obj)
     {
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include "bit_stream.h"
+
+
+// ------------------------------------------------------------
+// Bit-packed, inter-frame AI vision stream (0x56)
+//
+// payload, MSB first:
+//   keyframe:1 seq:7 count:6, then per object
+//     mode:2 = 0 new:   type:2 id:6 fields at full width
+//              1 same:  ref           (unchanged since the previous frame)
+//              2 delta: ref k-1:3     per field changed:1, then a k-bit
+//                                     signed delta if it changed
+//   ref indexes the previous frame's objects and takes just enough bits to
+//   cover its count; a keyframe never uses refs, and the payload is padded
+//   to a whole byte.
+//
+// Fields: color/code/model objects are originX:9 originY:8 width:9
+// height:8 score:7; AprilTags are four corners (x:9 y:8) and angle:12 in
+// 0.1 degree steps, whose deltas wrap at 360 degrees.
+// ------------------------------------------------------------
+
+constexpr uint8_t vision_type_tag = 3;
+constexpr int vision_max_fields = 9;
+constexpr uint16_t vision_angle_modulus = 3600;
+
+constexpr uint8_t vision_object_widths[vision_max_fields] = { 9, 8, 9, 8, 7 };
+constexpr uint8_t vision_tag_widths[vision_max_fields] = { 9, 8, 9, 8, 9, 8, 9, 8, 12 };
+
+enum vision_mode : uint8_t
+{
+    vision_mode_new = 0,
+    vision_mode_same = 1,
+    vision_mode_delta = 2,
+};
+
+// An AI vision object, already clamped to the field widths above
+struct vision_record
+{
+    uint8_t type; // top 2 bits of get_vision_object_type()
+    uint8_t id;   // 6 bits
+    uint16_t field[vision_max_fields];
+};
+
+inline int vision_field_count(uint8_t type)
+{
+    return type == vision_type_tag ? 9 : 5;
+}
+
+inline int vision_field_width(uint8_t type, int i)
+{
+    return type == vision_type_tag ? vision_tag_widths[i] : vision_object_widths[i];
+}
+
+inline bool vision_field_wraps(uint8_t type, int i)
+{
+    return type == vision_type_tag && i == 8;
+}
+
+// Bits needed to index n values
+constexpr int vision_index_bits(std::size_t n)
+{
+    return n <= 1 ? 0 : 1 + vision_index_bits((n + 1) / 2);
+}
+
+// Bits needed for k-bit two's complement of value
+inline int vision_signed_bits(int32_t value)
+{
+    int k = 1;
+    while (value < -(1 << (k - 1)) || value > (1 << (k - 1)) - 1)
+    {
+        k++;
+    }
+    return k;
+}
+
+template<std::size_t MaxObjects>
+class vision_encoder
+{
+    static_assert(MaxObjects > 0 && MaxObjects < 64, "vision_encoder: count is 6 bits");
+
+public:
+    static constexpr int header_bits = 1 + 7 + 6;
+    // a new AprilTag, or an AprilTag with every field changed by 8 bits
+    static constexpr int max_new_bits = 2 + 2 + 6 + 4 * (9 + 8) + 12;
+    static constexpr int max_delta_bits = 2 + vision_index_bits(MaxObjects) + 3 + vision_max_fields * (1 + 8);
+    static constexpr int max_object_bits = max_new_bits > max_delta_bits ? max_new_bits : max_delta_bits;
+    static constexpr std::size_t max_size = (header_bits + MaxObjects * max_object_bits + 7) / 8;
+
+private:
+    std::array<vision_record, MaxObjects> m_prev{};
+    std::size_t m_prev_count = 0;
+    uint8_t m_seq = 0;
+    uint16_t m_match_distance = 32;
+
+    static int32_t field_delta(const vision_record& cur, const vision_record& prev, int i)
+    {
+        int32_t d = static_cast<int32_t>(cur.field[i]) - prev.field[i];
+        if (vision_field_wraps(cur.type, i))
+        {
+            if (d >= vision_angle_modulus / 2) d -= vision_angle_modulus;
+            if (d < -(vision_angle_modulus / 2)) d += vision_angle_modulus;
+        }
+        return d;
+    }
+
+    // nearest unused object of the same type and id in the previous frame
+    int find_ref(const vision_record& cur, const std::array<bool, MaxObjects>& used) const
+    {
+        int best = -1;
+        int best_distance = m_match_distance + 1;
+        for (std::size_t j = 0; j < m_prev_count; j++)
+        {
+            const vision_record& prev = m_prev[j];
+            if (used[j] || prev.type != cur.type || prev.id != cur.id)
+            {
+                continue;
+            }
+            const int distance = std::abs(cur.field[0] - prev.field[0]) + std::abs(cur.field[1] - prev.field[1]);
+            if (distance < best_distance)
+            {
+                best = static_cast<int>(j);
+                best_distance = distance;
+            }
+        }
+        return best;
+    }
+
+public:
+    // Objects whose position moved more than this (|dx| + |dy| in pixels)
+    // are sent as new rather than matched against the previous frame
+    void set_match_distance(uint16_t pixels)
+    {
+        m_match_distance = pixels;
+    }
+
+    // Forget the previous frame; the next encode() is a keyframe
+    void reset(void)
+    {
+        m_prev_count = 0;
+    }
+
+    template<typename Container>
+    void encode(Container& buf, const vision_record* objs, std::size_t count, bool keyframe)
+    {
+        if (count > MaxObjects)
+        {
+            count = MaxObjects;
+        }
+        keyframe = keyframe || (m_prev_count == 0);
+        const int ref_bits = vision_index_bits(m_prev_count);
+        std::array<bool, MaxObjects> used{};
+
+        bit_writer<Container> bits(buf);
+        bits.write(keyframe ? 1 : 0, 1);
+        bits.write(m_seq++, 7);
+        bits.write(static_cast<uint32_t>(count), 6);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            const vision_record& cur = objs[i];
+            const int fields = vision_field_count(cur.type);
+            const int ref = keyframe ? -1 : find_ref(cur, used);
+            int k = 0;
+            if (ref >= 0)
+            {
+                for (int f = 0; f < fields; f++)
+                {
+                    const int32_t d = field_delta(cur, m_prev[ref], f);
+                    if (d != 0)
+                    {
+                        const int need = vision_signed_bits(d);
+                        k = need > k ? need : k;
+                    }
+                }
+            }
+
+            if (ref < 0 || k > 8)
+            {
+                bits.write(vision_mode_new, 2);
+                bits.write(cur.type, 2);
+                bits.write(cur.id, 6);
+                for (int f = 0; f < fields; f++)
+                {
+                    bits.write(cur.field[f], vision_field_width(cur.type, f));
+                }
+                continue;
+            }
+
+            used[ref] = true;
+            if (k == 0)
+            {
+                bits.write(vision_mode_same, 2);
+                bits.write(static_cast<uint32_t>(ref), ref_bits);
+            }
+            else
+            {
+                bits.write(vision_mode_delta, 2);
+                bits.write(static_cast<uint32_t>(ref), ref_bits);
+                bits.write(static_cast<uint32_t>(k - 1), 3);
+                for (int f = 0; f < fields; f++)
+                {
+                    const int32_t d = field_delta(cur, m_prev[ref], f);
+                    bits.write(d != 0 ? 1 : 0, 1);
+                    if (d != 0)
+                    {
+                        bits.write_signed(d, k);
+                    }
+                }
+            }
+        }
+        bits.flush();
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            m_prev[i] = objs[i];
+        }
+        m_prev_count = count;
+    }
+};
+
+template<std::size_t MaxObjects>
+class vision_decoder
+{
+private:
+    std::array<vision_record, MaxObjects> m_prev{};
+    std::size_t m_prev_count = 0;
+    uint8_t m_seq = 0;
+    bool m_synced = false;
+
+public:
+    // Decodes one 0x56 payload into out[MaxObjects]. Returns the object
+    // count, or -1 if the payload is malformed or refers to a frame that
+    // was lost; after that only a keyframe resynchronizes.
+    int decode(const uint8_t* data, std::size_t len, vision_record* out)
+    {
+        bit_reader bits(data, len);
+        const bool keyframe = bits.read(1) != 0;
+        const uint8_t seq = static_cast<uint8_t>(bits.read(7));
+        const std::size_t count = bits.read(6);
+        if (!keyframe && (!m_synced || seq != ((m_seq + 1) & 0x7f)))
+        {
+            m_synced = false;
+            return -1;
+        }
+        if (count > MaxObjects)
+        {
+            m_synced = false;
+            return -1;
+        }
+
+        const int ref_bits = keyframe ? 0 : vision_index_bits(m_prev_count);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            vision_record& cur = out[i];
+            const uint32_t mode = bits.read(2);
+            if (mode == vision_mode_new)
+            {
+                cur.type = static_cast<uint8_t>(bits.read(2));
+                cur.id = static_cast<uint8_t>(bits.read(6));
+                for (int f = 0; f < vision_max_fields; f++)
+                {
+                    cur.field[f] = f < vision_field_count(cur.type)
+                                 ? static_cast<uint16_t>(bits.read(vision_field_width(cur.type, f)))
+                                 : 0;
+                }
+                continue;
+            }
+            const uint32_t ref = bits.read(ref_bits);
+            if (keyframe || mode > vision_mode_delta || ref >= m_prev_count)
+            {
+                m_synced = false;
+                return -1;
+            }
+            cur = m_prev[ref];
+            if (mode == vision_mode_delta)
+            {
+                const int k = static_cast<int>(bits.read(3)) + 1;
+                for (int f = 0; f < vision_field_count(cur.type); f++)
+                {
+                    if (!bits.read(1))
+                    {
+                        continue;
+                    }
+                    int32_t value = cur.field[f] + bits.read_signed(k);
+                    if (vision_field_wraps(cur.type, f))
+                    {
+                        value = (value + vision_angle_modulus) % vision_angle_modulus;
+                    }
+                    cur.field[f] = static_cast<uint16_t>(value);
+                }
+            }
+        }
+        if (bits.overrun())
+        {
+            m_synced = false;
+            return -1;
+        }
+
+        for (std::size_t i = 0; i < count; i++)
+        {
+            m_prev[i] = out[i];
+        }
+        m_prev_count = count;
+        m_seq = seq;
+        m_synced = true;
+        return static_cast<int>(count);
+    }
+};
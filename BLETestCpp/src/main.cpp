@@ -192,6 +192,7 @@ bool RemoteControlCodeEnabled = true;
 #include "iq_cpp.h"
 
 #include "structured_logger.h"
+#include <cmath>
 #include <cstdint>
 #include <cstring>
 #include <type_traits>
@@ -237,8 +238,74 @@ uint16_t get_button_states(void)
     );
 }
 
+// IMU channels go out as 2-byte fixed point instead of 4-byte floats
+using angle_i16 = fixed_point<int16_t, std::ratio<1, 100>,  std::ratio<-180>,  std::ratio<180>>;  // 0.01 deg
+using accel_i16 = fixed_point<int16_t, std::ratio<1, 1000>, std::ratio<-8>,    std::ratio<8>>;    // 0.001 g
+using gyro_i16  = fixed_point<int16_t, std::ratio<1, 10>,   std::ratio<-2000>, std::ratio<2000>>; // 0.1 dps
+
+// every IMU and controller value of a frame comes from one pass over the
+// device, its calls back to back
+struct imu_snapshot
+{
+    float heading;
+    float roll;
+    float pitch;
+    std::array<float, 3> accel;
+    std::array<float, 3> gyro;
+};
+
+struct controller_snapshot
+{
+    uint16_t buttons;
+    std::array<int8_t, 4> axes;
+};
+
+// nine calls: the SDK reads the inertial sensor one axis at a time
+void read_imu(imu_snapshot& s)
+{
+    s.heading = brain_inertial.orientation(vex::yaw, degrees);
+    s.roll    = brain_inertial.orientation(vex::roll, degrees);
+    s.pitch   = brain_inertial.orientation(vex::pitch, degrees);
+    s.accel   = {{ static_cast<float>(brain_inertial.acceleration(vex::xaxis)),
+                   static_cast<float>(brain_inertial.acceleration(vex::yaxis)),
+                   static_cast<float>(brain_inertial.acceleration(vex::zaxis)) }};
+    s.gyro    = {{ static_cast<float>(brain_inertial.gyroRate(vex::xaxis, vex::dps)),
+                   static_cast<float>(brain_inertial.gyroRate(vex::yaxis, vex::dps)),
+                   static_cast<float>(brain_inertial.gyroRate(vex::zaxis, vex::dps)) }};
+}
+
+void read_controller(controller_snapshot& s)
+{
+    s.buttons = get_button_states();
+    s.axes    = {{ static_cast<int8_t>(controller.AxisA.position()),
+                   static_cast<int8_t>(controller.AxisB.position()),
+                   static_cast<int8_t>(controller.AxisC.position()),
+                   static_cast<int8_t>(controller.AxisD.position()) }};
+}
+
 StructuredLogger logger{};
 
+#if LOGGER_CAPTURE_SIZE > 0
+// built with -DLOGGER_CAPTURE_SIZE=16384 or so: freezes the last few
+// seconds of every channel at 1 kHz and sends them
+void trigger_capture_button(void)
+{
+    logger.trigger_capture();
+}
+#endif
+
+// packets are built directly in here and written out once per tick
+#define OUTPUT_ARENA_SIZE  2048
+std::array<uint8_t, OUTPUT_ARENA_SIZE> output_arena_storage;
+output_arena arena{output_arena_storage};
+
+// vision and capture packets queue behind the control telemetry instead of
+// going out in the middle of it; see output_scheduler
+std::array<uint8_t, 512> control_queue_storage;
+std::array<uint8_t, 1024> vision_queue_storage;
+std::array<uint8_t, 512> bulk_queue_storage;
+output_scheduler scheduler;
+
 int main()
 {
     // Disable line buffering: use fully buffered mode (_IOFBF)
@@ -251,39 +318,81 @@ int main()
 
     brain.buttonUp.pressed(print_num);
     brain.buttonDown.pressed(print_something);
+#if LOGGER_CAPTURE_SIZE > 0
+    brain.buttonCheck.pressed(trigger_capture_button);
+#endif
+
+    // logger ticks every 10 ms: IMU at 100 Hz, controller at 50 Hz,
+    // distance sensors at 10 Hz
+    logger.set_tick_period(10);
+    logger.set_keyframe_interval(100);
+    logger.set_output_arena(&arena);
+    scheduler.set_channel(output_channel::control, control_queue_storage, 0);
+    scheduler.set_channel(output_channel::vision, vision_queue_storage, 1);
+    scheduler.set_channel(output_channel::bulk, bulk_queue_storage, 2);
+    // bytes the radio link carries per tick, from c0de_analyze; paces
+    // vision and captures so they never hold up the next control packet
+    //scheduler.set_link_budget(60);
+    logger.set_output_scheduler(&scheduler);
+    // sequence numbers and sample times on every packet, for c0de_analyze
+    //logger.set_extended_header(true);
 
-    logger.add("ButtonStates", get_button_states);
-
-    logger.add("Axis A",     []() -> int8_t { return controller.AxisA.position(); });
-    logger.add("Axis B",     []() -> int8_t { return controller.AxisB.position(); });
-    logger.add("Axis C",     []() -> int8_t { return controller.AxisC.position(); });
-    logger.add("Axis D",     []() -> int8_t { return controller.AxisD.position(); });
-    logger.add("Heading",    []() -> float { return brain_inertial.orientation(vex::yaw, degrees); });
-    logger.add("Roll",       []() -> float { return brain_inertial.orientation(vex::roll, degrees); });
-    logger.add("Pitch",      []() -> float { return brain_inertial.orientation(vex::pitch, degrees); });
-    //logger.add("ax",         []() -> float { return brain_inertial.acceleration(vex::xaxis); }, true);
-    //logger.add("ay",         []() -> float { return brain_inertial.acceleration(vex::yaxis); }, true);
-    //logger.add("az",         []() -> float { return brain_inertial.acceleration(vex::zaxis); }, true);
-    //logger.add("gx",         []() -> float { return brain_inertial.gyroRate(vex::xaxis, vex::dps); }, true);
-    //logger.add("gy",         []() -> float { return brain_inertial.gyroRate(vex::yaxis, vex::dps); }, true);
-    //logger.add("gz",         []() -> float { return brain_inertial.gyroRate(vex::zaxis, vex::dps); }, true);
-    logger.add("dist_front", []() -> int16_t { return dist_front.objectDistance(mm); });
-    logger.add("dist_rear",  []() -> int16_t { return dist_rear.objectDistance(mm); });
-    //logger.add("optical_left.brightness", []() -> float { return optical_left.brightness(); });
-    //logger.add("optical_right.brightness",[]() -> float { return optical_right.brightness(); });
-
-    while (true)
+    auto& imu = logger.add_snapshot<imu_snapshot>(read_imu);
+    auto& pad = logger.add_snapshot<controller_snapshot>(read_controller);
+
+    logger.add(LOGGER_NAME("ButtonStates"), pad.field(&controller_snapshot::buttons), false, 2);
+    logger.add(LOGGER_NAME("Axes"),         pad.field(&controller_snapshot::axes), false, 2);
+    const uint16_t heading = logger.add(LOGGER_NAME("Heading"), quantize<angle_i16>(imu.field(&imu_snapshot::heading)));
+    const uint16_t roll    = logger.add(LOGGER_NAME("Roll"),    quantize<angle_i16>(imu.field(&imu_snapshot::roll)));
+    const uint16_t pitch   = logger.add(LOGGER_NAME("Pitch"),   quantize<angle_i16>(imu.field(&imu_snapshot::pitch)));
+    logger.add(LOGGER_NAME("accel"),        quantize<accel_i16>(imu.field(&imu_snapshot::accel)), true);
+    logger.add(LOGGER_NAME("gyro"),         quantize<gyro_i16>(imu.field(&imu_snapshot::gyro)), true);
+    logger.add(LOGGER_NAME("dist_front"),   []() -> int16_t { return dist_front.objectDistance(mm); }, false, 10);
+    logger.add(LOGGER_NAME("dist_rear"),    []() -> int16_t { return dist_rear.objectDistance(mm); }, false, 10);
+    //logger.add(LOGGER_NAME("optical_left.brightness"), []() -> float { return optical_left.brightness(); }, false, 20);
+    //logger.add(LOGGER_NAME("optical_right.brightness"),[]() -> float { return optical_right.brightness(); }, false, 20);
+
+    // only send orientation changes bigger than sensor noise
+    logger.set_deadband(heading, 0.1);
+    logger.set_deadband(roll, 0.1);
+    logger.set_deadband(pitch, 0.1);
+
+#if LOGGER_CAPTURE_SIZE > 0
+    // a bump of more than 2 g freezes the capture too, with 0.1 s after it
+    logger.set_capture_trigger([&]() { return std::fabs(imu.snapshot().accel[0]) > 2.0f; });
+    logger.set_capture_post_trigger(100);
+#endif
+
+    // the logger sends the 0x46 format itself: before the first frame and
+    // whenever the host asks for it. The host picks the channels and their
+    // rates at runtime with c0de_ctl; everything is sent until it does.
+    for (uint32_t tick = 0; true; tick++)
     {
-        logger.send_data_format();
-        for (int i = 0; i < 50; i++)
+        logger.poll_host_commands();
+        logger.send_structured_changes();
+        // Rice-coded instead (c0de_decode reads it, the web page doesn't yet)
+        //logger.send_structured_compressed();
+        // the host can pause vision (see host_commands.h); don't even take
+        // the snapshot then
+        if (((tick % 4) == 3) && logger.vision_enabled())
+        {
+            ai_vision.takeSnapshot(vex::aivision::ALL_OBJECTS);
+            logger.send_vision_changes(ai_vision.objects);
+        }
+#if LOGGER_CAPTURE_SIZE > 0
+        logger.send_capture();
+        logger.flush_output();
+        // every entry into the capture ring at 1 kHz between ticks. Each
+        // call reads every snapshot group and getter, so this is ten times
+        // the device reads.
+        repeat(10)
         {
-            logger.send_structured_data();
-            if ((i % 2))
-            {
-                ai_vision.takeSnapshot(vex::aivision::ALL_OBJECTS);
-                logger.send_vision_data(ai_vision.objects);
-            }
-            wait(20, msec);
+            logger.capture_structured_data();
+            wait(1, msec);
         }
+#else
+        logger.flush_output();
+        wait(10, msec);
+#endif
     }
 }
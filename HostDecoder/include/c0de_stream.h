@@ -0,0 +1,1446 @@
+#pragma once
+
+#include <bitset>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "cobs.h"
+#include "crc16.h"
+#include "rice_codec.h"
+#include "sync_scan.h"
+#include "vision_codec.h"
+
+
+// ------------------------------------------------------------
+// Host-side decoder for the structured_logger.h stream
+//
+//   0xc0 0xde, command, var-int length, payload, CRC16 (over everything
+//   before it); whatever isn't a valid packet is console text
+//
+// packet_framer splits a byte stream fed in arbitrary chunks into packets
+// and text; cobs_framer does the same for COBS framing (cobs.h). stream_decoder keeps the 0x46 channel table and turns packets
+// into values and vision objects for a stream_handler. Nothing allocates
+// per packet: the framer only copies a packet that straddles two chunks,
+// and the decoder only grows its tables on 0x46.
+//
+// 0x46, 0x44, 0x48, 0x52 and 0x54 payloads start with the brain's u16 schema hash, the
+// CRC16 of all the 0x46 entry descriptions back to back. A schema_cache
+// keeps every description seen by hash, so data from a schema seen before
+// (e.g. after a reconnect) decodes without waiting for its 0x46.
+//
+// A command byte with the top bit set has the extended header: the payload
+// starts with a u16 sequence number, counted per command, and the u32 brain
+// timer (us) the packet's values were sampled at.
+// ------------------------------------------------------------
+
+namespace c0de
+{
+
+// The brain's stdout turns a trailing \n into \r\n; a CRC whose low byte
+// was 0x0a arrives as 0x0d, followed by an extra 0x0a
+constexpr uint8_t crc_lf = 0x0a;
+constexpr uint8_t crc_cr = 0x0d;
+
+constexpr uint8_t extended_header_flag = 0x80;
+constexpr std::size_t extended_header_len = 6;
+
+struct framer_stats
+{
+    uint64_t bytes = 0;
+    uint64_t packets = 0;
+    uint64_t crc_errors = 0;
+    uint64_t crc_fixed = 0;      // accepted after undoing the \r\n quirk
+    uint64_t oversize = 0;       // headers with a length over max_payload
+    uint64_t text_bytes = 0;
+};
+
+// Var-int as written by pack_var_int(): one byte below 0x80, else two
+// bytes with the top bit set
+inline std::size_t read_var_int(const uint8_t* p, uint16_t& value)
+{
+    if (p[0] & 0x80)
+    {
+        value = static_cast<uint16_t>(((p[0] & 0x7f) << 8) | p[1]);
+        return 2;
+    }
+    value = p[0];
+    return 1;
+}
+
+// Loss, reordering and duplicates in one command's sequence numbers.
+// Numbers are unwrapped against the highest seen so far, so a gap of more
+// than 32767 packets is taken as going backwards.
+class sequence_tracker
+{
+public:
+    static constexpr std::size_t window = 1024;
+
+private:
+    int64_t m_first = 0;
+    int64_t m_highest = -1;
+    uint64_t m_received = 0;
+    uint64_t m_reordered = 0;
+    uint64_t m_duplicates = 0;
+    uint64_t m_too_late = 0;
+    // bit (n % window) set if n was received, for n within window of m_highest
+    std::bitset<window> m_seen;
+
+public:
+    // Returns the unwrapped sequence number
+    int64_t add(uint16_t sequence)
+    {
+        if (m_highest < 0)
+        {
+            m_first = m_highest = sequence;
+            m_received = 1;
+            m_seen.set(sequence % window);
+            return sequence;
+        }
+        const int64_t n = m_highest + static_cast<int16_t>(sequence - static_cast<uint16_t>(m_highest));
+        if (n > m_highest)
+        {
+            // forget the numbers that fall out of the window
+            for (int64_t k = m_highest + 1; k <= n && k - m_highest <= static_cast<int64_t>(window); k++)
+            {
+                m_seen.reset(k % window);
+            }
+            m_highest = n;
+        }
+        else if (n <= m_highest - static_cast<int64_t>(window) || n < m_first)
+        {
+            // can't tell a duplicate from a late packet this far back
+            m_too_late++;
+            return n;
+        }
+        else if (m_seen.test(n % window))
+        {
+            m_duplicates++;
+            return n;
+        }
+        else
+        {
+            m_reordered++;
+        }
+        m_seen.set(n % window);
+        m_received++;
+        return n;
+    }
+
+    // Distinct packets received, and the ones missing between the first
+    // and the highest
+    uint64_t received() const { return m_received; }
+    uint64_t expected() const { return m_highest < 0 ? 0 : static_cast<uint64_t>(m_highest - m_first + 1); }
+    uint64_t lost() const { return expected() > m_received ? expected() - m_received : 0; }
+    // arrived after a higher number
+    uint64_t reordered() const { return m_reordered; }
+    uint64_t duplicates() const { return m_duplicates; }
+    uint64_t too_late() const { return m_too_late; }
+};
+
+class packet_framer
+{
+private:
+    std::vector<uint8_t> m_carry; // incomplete packet from the previous chunk
+    std::size_t m_max_payload;
+    sync_scan_fn m_find_sync = best_sync_scan();
+    bool m_skip_lf = false;
+    framer_stats m_stats;
+
+    // Bytes needed at the start of buf to tell what it is
+    std::size_t required_size(const uint8_t* buf, std::size_t n) const
+    {
+        if (n < 4)
+        {
+            return 4;
+        }
+        if ((buf[3] & 0x80) && n < 5)
+        {
+            return 5;
+        }
+        uint16_t len;
+        const std::size_t header = 3 + read_var_int(buf + 3, len);
+        return header + len + 2;
+    }
+
+    // drop the 0x0a left over from a packet that ended the previous scan
+    void skip_lf(const uint8_t*& data, const uint8_t* end)
+    {
+        if (m_skip_lf && data < end)
+        {
+            m_skip_lf = false;
+            if (*data == crc_lf)
+            {
+                data++;
+            }
+        }
+    }
+
+    template<typename Sink>
+    void emit_text(const uint8_t* p, std::size_t n, Sink& sink)
+    {
+        if (n > 0)
+        {
+            m_stats.text_bytes += n;
+            sink.on_text(reinterpret_cast<const char*>(p), n);
+        }
+    }
+
+    // Handles every complete packet and all text in buf; returns how many
+    // bytes were used, the rest being the start of an incomplete packet
+    template<typename Sink>
+    std::size_t scan(const uint8_t* buf, std::size_t n, Sink& sink)
+    {
+        std::size_t i = 0;
+        std::size_t text_start = 0;
+        while (i < n)
+        {
+            // packets usually follow each other directly, so try right here
+            // before calling out to the search
+            std::size_t j = i;
+            if (n - i < 2 || buf[i] != sync0 || buf[i + 1] != sync1)
+            {
+                j += m_find_sync(buf + i, n - i);
+            }
+            if (j >= n)
+            {
+                break;
+            }
+            if (n - j < 4 || ((buf[j + 3] & 0x80) && n - j < 5))
+            {
+                emit_text(buf + text_start, j - text_start, sink);
+                return j;
+            }
+            uint16_t len;
+            const std::size_t header = 3 + read_var_int(buf + j + 3, len);
+            if (len > m_max_payload)
+            {
+                m_stats.oversize++;
+                i = j + 2;
+                continue;
+            }
+            const std::size_t total = header + len + 2;
+            if (j + total > n)
+            {
+                emit_text(buf + text_start, j - text_start, sink);
+                return j;
+            }
+
+            const uint16_t crc = crc16<8>(buf + j, header + len);
+            const uint8_t* stored = buf + j + header + len;
+            const bool valid = crc == ((stored[0] << 8) | stored[1]);
+            const bool fixed = !valid && stored[1] == crc_cr && crc == ((stored[0] << 8) | crc_lf);
+            if (valid || fixed)
+            {
+                emit_text(buf + text_start, j - text_start, sink);
+                m_stats.packets++;
+                sink.on_packet(buf[j + 2], buf + j + header, len);
+                i = j + total;
+                if (fixed)
+                {
+                    m_stats.crc_fixed++;
+                    if (i < n && buf[i] == crc_lf)
+                    {
+                        i++;
+                    }
+                    else if (i == n)
+                    {
+                        m_skip_lf = true;
+                    }
+                }
+                text_start = i;
+            }
+            else
+            {
+                // the sync word is text, like the rest of this one; keep
+                // looking inside it
+                m_stats.crc_errors++;
+                i = j + 2;
+            }
+        }
+        emit_text(buf + text_start, n - text_start, sink);
+        return n;
+    }
+
+public:
+    // Headers claiming a longer payload are taken as noise; the longest the
+    // brain sends is a vision packet of a few hundred bytes
+    explicit packet_framer(std::size_t max_payload = 4096)
+        : m_max_payload(max_payload)
+    {}
+
+    const framer_stats& stats() const { return m_stats; }
+
+    // Override the sync word search find_sync() picked for this CPU
+    void set_sync_scan(sync_scan_fn scan)
+    {
+        m_find_sync = scan;
+    }
+
+    // Sink needs on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    // and on_text(const char* text, std::size_t len)
+    template<typename Sink>
+    void feed(const uint8_t* data, std::size_t len, Sink& sink)
+    {
+        m_stats.bytes += len;
+        const uint8_t* const end = data + len;
+        skip_lf(data, end);
+        while (!m_carry.empty())
+        {
+            const std::size_t used = scan(m_carry.data(), m_carry.size(), sink);
+            m_carry.erase(m_carry.begin(), m_carry.begin() + used);
+            if (m_carry.empty())
+            {
+                break;
+            }
+            // top up the pending packet, no further
+            if (data == end)
+            {
+                return;
+            }
+            const std::size_t need = required_size(m_carry.data(), m_carry.size()) - m_carry.size();
+            const std::size_t take = need < static_cast<std::size_t>(end - data) ? need : end - data;
+            m_carry.insert(m_carry.end(), data, data + take);
+            data += take;
+        }
+        skip_lf(data, end);
+        const std::size_t used = scan(data, end - data, sink);
+        m_carry.assign(data + used, end);
+    }
+
+    // End of input: a packet still pending is just text
+    template<typename Sink>
+    void finish(Sink& sink)
+    {
+        emit_text(m_carry.data(), m_carry.size(), sink);
+        m_carry.clear();
+    }
+};
+
+
+// Frames of PacketWriter's COBS framing: 0x00, COBS(packet without 0xc0
+// 0xde), 0x00. Every 0x00 ends a frame, so nothing is scanned twice and a
+// corrupt frame costs that frame only. Bytes between two 0x00 that don't
+// decode to a packet with a good CRC are text; crc_errors counts the ones
+// that decode to a packet of the right length with a bad CRC.
+class cobs_framer
+{
+private:
+    std::size_t m_max_frame; // bytes between two 0x00
+    std::vector<uint8_t> m_carry;   // frame straddling two chunks
+    std::vector<uint8_t> m_decoded; // 0xc0 0xde, then the decoded frame
+    bool m_overflow = false; // m_carry hit m_max_frame; skip to the next 0x00
+    framer_stats m_stats;
+
+    template<typename Sink>
+    void emit_text(const uint8_t* p, std::size_t n, Sink& sink)
+    {
+        if (n > 0)
+        {
+            m_stats.text_bytes += n;
+            sink.on_text(reinterpret_cast<const char*>(p), n);
+        }
+    }
+
+    template<typename Sink>
+    void frame(const uint8_t* p, std::size_t n, Sink& sink)
+    {
+        if (n == 0)
+        {
+            return;
+        }
+        if (n > m_max_frame)
+        {
+            m_stats.oversize++;
+            emit_text(p, n, sink);
+            return;
+        }
+        const std::size_t len = cobs_decode(p, n, m_decoded.data() + 2);
+        if ((len != cobs_error) && (len >= 4) && (!(m_decoded[3] & 0x80) || (len >= 5)))
+        {
+            const uint8_t* const d = m_decoded.data();
+            uint16_t payload_len;
+            const std::size_t header = 3 + read_var_int(d + 3, payload_len);
+            if (header + payload_len + 2 == len + 2)
+            {
+                const std::size_t crc_at = header + payload_len;
+                if (crc16<8>(d, crc_at) == ((d[crc_at] << 8) | d[crc_at + 1]))
+                {
+                    m_stats.packets++;
+                    sink.on_packet(d[2], d + header, payload_len);
+                    return;
+                }
+                m_stats.crc_errors++;
+            }
+        }
+        emit_text(p, n, sink);
+    }
+
+public:
+    // `max_payload` as for packet_framer; longer frames are text
+    explicit cobs_framer(std::size_t max_payload = 4096)
+        : m_max_frame(1 + (max_payload + 5) + (max_payload + 4) / 254)
+        , m_decoded(m_max_frame + 2)
+    {
+        m_decoded[0] = sync0;
+        m_decoded[1] = sync1;
+    }
+
+    const framer_stats& stats() const { return m_stats; }
+
+    // Sink as for packet_framer::feed()
+    template<typename Sink>
+    void feed(const uint8_t* data, std::size_t len, Sink& sink)
+    {
+        m_stats.bytes += len;
+        const uint8_t* const end = data + len;
+        while (data < end)
+        {
+            const uint8_t* const zero = static_cast<const uint8_t*>(
+                std::memchr(data, cobs_delimiter, static_cast<std::size_t>(end - data)));
+            const uint8_t* const stop = (zero != nullptr) ? zero : end;
+            if (m_overflow)
+            {
+                emit_text(data, static_cast<std::size_t>(stop - data), sink);
+            }
+            else if (m_carry.empty() && (zero != nullptr))
+            {
+                // the usual case: the whole frame is in this chunk
+                frame(data, static_cast<std::size_t>(zero - data), sink);
+            }
+            else
+            {
+                m_carry.insert(m_carry.end(), data, stop);
+                if (m_carry.size() > m_max_frame)
+                {
+                    // text, like any frame too long to be a packet, up to
+                    // the next 0x00
+                    m_stats.oversize++;
+                    emit_text(m_carry.data(), m_carry.size(), sink);
+                    m_carry.clear();
+                    m_overflow = true;
+                }
+                else if (zero != nullptr)
+                {
+                    frame(m_carry.data(), m_carry.size(), sink);
+                    m_carry.clear();
+                }
+            }
+            if (zero != nullptr)
+            {
+                m_overflow = false;
+            }
+            data = stop + ((zero != nullptr) ? 1 : 0);
+        }
+    }
+
+    // End of input: a frame still open is just text
+    template<typename Sink>
+    void finish(Sink& sink)
+    {
+        emit_text(m_carry.data(), m_carry.size(), sink);
+        m_carry.clear();
+        m_overflow = false;
+    }
+};
+
+
+// ------------------------------------------------------------
+// Channel table and value decoding
+// ------------------------------------------------------------
+
+struct channel_format
+{
+    std::string name;
+    char fmt = 0;               // fmt<T>::code
+    bool small_scale = false;
+    uint16_t period_ms = 0;
+    uint16_t size = 0;          // bytes per value; 0 if fmt is unknown
+    float scale = 1;            // fixed-point channels: value = raw * scale + offset
+    float offset = 0;
+    bool valid = false;
+    // array channels ('a') are decoded as one series per element, each
+    // with a format of its own in `elements`: name[i], the element's fmt,
+    // scale and offset, and `element` = i
+    uint8_t element = 0;
+    std::vector<channel_format> elements;
+    // index of the channel's first value in stream_decoder::last_values()
+    std::size_t value_index = 0;
+};
+
+inline bool is_fixed_point_fmt(char fmt)
+{
+    return fmt == 'x' || fmt == 'X' || fmt == 'y' || fmt == 'Y';
+}
+
+inline bool is_array_fmt(char fmt)
+{
+    return fmt == 'a';
+}
+
+inline uint8_t fmt_size(char fmt)
+{
+    switch (fmt)
+    {
+        case 'b': case 'B': case 'x': case 'X':
+            return 1;
+        case 'h': case 'H': case 'e': case 'y': case 'Y':
+            return 2;
+        case 'i': case 'I': case 'l': case 'L': case 'f':
+            return 4;
+        case 'q': case 'Q': case 'd':
+            return 8;
+        default:
+            return 0;
+    }
+}
+
+inline uint64_t read_be(const uint8_t* p, std::size_t size)
+{
+    uint64_t value = 0;
+    for (std::size_t i = 0; i < size; i++)
+    {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+inline float read_float_be(const uint8_t* p)
+{
+    const uint32_t bits = static_cast<uint32_t>(read_be(p, 4));
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+inline double half_to_double(uint16_t h)
+{
+    const int exponent = (h >> 10) & 0x1f;
+    const int mantissa = h & 0x3ff;
+    const double sign = (h & 0x8000) ? -1.0 : 1.0;
+    if (exponent == 0)
+    {
+        return sign * std::ldexp(mantissa, -24);
+    }
+    if (exponent == 31)
+    {
+        return mantissa ? NAN : sign * INFINITY;
+    }
+    return sign * std::ldexp(mantissa + 1024, exponent - 25);
+}
+
+// One big-endian value of channel `ch` at p
+inline double decode_value(const channel_format& ch, const uint8_t* p)
+{
+    const uint64_t raw = read_be(p, ch.size);
+    switch (ch.fmt)
+    {
+        case 'b': return static_cast<int8_t>(raw);
+        case 'B': return static_cast<uint8_t>(raw);
+        case 'h': return static_cast<int16_t>(raw);
+        case 'H': return static_cast<uint16_t>(raw);
+        case 'i': case 'l': return static_cast<int32_t>(raw);
+        case 'I': case 'L': return static_cast<uint32_t>(raw);
+        case 'q': return static_cast<double>(static_cast<int64_t>(raw));
+        case 'Q': return static_cast<double>(raw);
+        case 'e': return half_to_double(static_cast<uint16_t>(raw));
+        case 'f': return read_float_be(p);
+        case 'd':
+        {
+            double value;
+            std::memcpy(&value, &raw, sizeof(value));
+            return value;
+        }
+        case 'x': return static_cast<int8_t>(raw) * static_cast<double>(ch.scale) + ch.offset;
+        case 'X': return static_cast<uint8_t>(raw) * static_cast<double>(ch.scale) + ch.offset;
+        case 'y': return static_cast<int16_t>(raw) * static_cast<double>(ch.scale) + ch.offset;
+        case 'Y': return static_cast<uint16_t>(raw) * static_cast<double>(ch.scale) + ch.offset;
+        default: return NAN;
+    }
+}
+
+// Channel descriptions by schema hash: the 0x46 payloads of one schema
+// without their hashes, back to back
+class schema_cache
+{
+private:
+    std::map<uint16_t, std::vector<uint8_t>> m_schemas;
+
+public:
+    const std::vector<uint8_t>* find(uint16_t hash) const
+    {
+        const auto it = m_schemas.find(hash);
+        return it == m_schemas.end() ? nullptr : &it->second;
+    }
+
+    // false, and nothing stored, if the descriptions don't hash to `hash`
+    bool add(uint16_t hash, const uint8_t* descriptions, std::size_t len)
+    {
+        if (crc16<8>(descriptions, len) != hash)
+        {
+            return false;
+        }
+        m_schemas[hash].assign(descriptions, descriptions + len);
+        return true;
+    }
+
+    const std::map<uint16_t, std::vector<uint8_t>>& schemas() const { return m_schemas; }
+};
+
+struct decoder_stats
+{
+    uint64_t values = 0;
+    uint64_t vision_frames = 0;
+    uint64_t vision_unsynced = 0;   // 0x56 frames skipped until the next keyframe
+    uint64_t rice_unsynced = 0;     // 0x52 packets skipped until the next keyframe
+    uint64_t changes_unsynced = 0;  // 0x43 skipped until data confirms the schema
+    uint64_t unknown_codes = 0;     // data for a channel before its 0x46
+    uint64_t unknown_schemas = 0;   // 0x44/0x54 skipped, their schema not seen yet
+    uint64_t schema_changes = 0;
+    uint64_t lost_packets = 0;      // gaps in extended header sequence numbers
+    uint64_t capture_values = 0;    // values of pre-trigger captures (0x48)
+    uint64_t captures = 0;          // captures received up to their last packet
+    uint64_t malformed = 0;
+    uint64_t unknown_commands = 0;
+};
+
+// Callbacks from stream_decoder; everything defaults to ignoring the data
+class stream_handler
+{
+public:
+    virtual ~stream_handler() {}
+
+    virtual void on_text(const char* text, std::size_t len) { (void)text; (void)len; }
+    virtual void on_format(uint16_t code, const channel_format& ch) { (void)code; (void)ch; }
+    // the channel table now holds schema `hash`, from a 0x46 or the cache
+    virtual void on_schema(uint16_t hash) { (void)hash; }
+    // data arrived with a schema that isn't cached; a live host should ask
+    // the brain for its format (format_request_command)
+    virtual void on_unknown_schema(uint16_t hash) { (void)hash; }
+    // extended header of the packet about to be decoded; cmd without the flag
+    virtual void on_header(uint8_t cmd, uint16_t sequence, uint32_t time_us)
+    {
+        (void)cmd; (void)sequence; (void)time_us;
+    }
+    // time_us is the brain timer the value was sampled at: from 0x54 records
+    // and extended headers, -1 otherwise; packet counts valid packets from
+    // the start of the stream
+    virtual void on_value(uint64_t packet, int64_t time_us, uint16_t code, const channel_format& ch, double value)
+    {
+        (void)packet; (void)time_us; (void)code; (void)ch; (void)value;
+    }
+    // a value of pre-trigger capture `capture` (0x48): history, sampled at
+    // time_us on the brain, kept apart from the live values
+    virtual void on_capture_value(uint8_t capture, int64_t time_us, uint16_t code, const channel_format& ch, double value)
+    {
+        (void)capture; (void)time_us; (void)code; (void)ch; (void)value;
+    }
+    // the last packet of capture `capture`, triggered at trigger_time_us
+    virtual void on_capture_end(uint8_t capture, uint32_t trigger_time_us)
+    {
+        (void)capture; (void)trigger_time_us;
+    }
+    virtual void on_vision(uint64_t packet, const vision_record* objs, std::size_t count)
+    {
+        (void)packet; (void)objs; (void)count;
+    }
+    virtual void on_unknown(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        (void)cmd; (void)payload; (void)len;
+    }
+};
+
+class stream_decoder
+{
+public:
+    static constexpr std::size_t max_vision_objects = 63;
+
+private:
+    stream_handler& m_handler;
+    packet_framer m_framer;
+    cobs_framer m_cobs_framer;
+    packet_framing m_framing = packet_framing::sync_word;
+    std::vector<channel_format> m_channels;
+    std::vector<double> m_last; // latest value of every series, for 0x43 consumers
+    vision_decoder<max_vision_objects> m_vision;
+    vision_record m_visionRecords[max_vision_objects];
+    uint64_t m_packet = 0;
+    decoder_stats m_stats;
+    // by command & 0x1f, as on the brain
+    sequence_tracker m_sequences[32];
+
+    schema_cache m_own_cache;
+    schema_cache* m_cache = &m_own_cache;
+    uint16_t m_schema = 0;
+    bool m_have_schema = false;
+    // number of the capture being decoded, -1 for live data
+    int m_capture = -1;
+    // 0x46 descriptions of m_pending_schema received so far
+    std::vector<uint8_t> m_pending;
+    uint16_t m_pending_schema = 0;
+    // 0x52 state: the last value of every channel, raw, at m_rice_offsets
+    // by code, and the 0x44 body a packet decodes to
+    std::vector<uint8_t> m_rice_reference;
+    std::vector<std::size_t> m_rice_offsets;
+    std::vector<uint8_t> m_rice_body;
+    uint8_t m_rice_seq = 0;
+    bool m_rice_synced = false;
+    // 0x43 carries no schema hash, so it's only decoded once a 0x44, 0x52
+    // or 0x54 has shown the channel table is the brain's current one
+    bool m_changes_synced = false;
+
+    const channel_format* channel(uint16_t code)
+    {
+        if (code >= m_channels.size() || !m_channels[code].valid || m_channels[code].size == 0)
+        {
+            m_stats.unknown_codes++;
+            return nullptr;
+        }
+        return &m_channels[code];
+    }
+
+    void value(int64_t time_us, uint16_t code, const channel_format& ch, const uint8_t* p)
+    {
+        if (!ch.elements.empty())
+        {
+            for (const channel_format& element : ch.elements)
+            {
+                value(time_us, code, element, p);
+                p += element.size;
+            }
+            return;
+        }
+        const double v = decode_value(ch, p);
+        if (m_capture >= 0)
+        {
+            m_stats.capture_values++;
+            m_handler.on_capture_value(static_cast<uint8_t>(m_capture), time_us, code, ch, v);
+            return;
+        }
+        m_last[ch.value_index] = v;
+        m_stats.values++;
+        m_handler.on_value(m_packet, time_us, code, ch, v);
+    }
+
+    // fmt and extra bytes at p, up to end, into ch; false if they run past end
+    static bool read_value_format(channel_format& ch, uint8_t fmt, const uint8_t*& p, const uint8_t* end)
+    {
+        ch.fmt = static_cast<char>(fmt);
+        ch.size = fmt_size(ch.fmt);
+        if (is_fixed_point_fmt(ch.fmt))
+        {
+            if (end - p < 8)
+            {
+                return false;
+            }
+            ch.scale = read_float_be(p);
+            ch.offset = read_float_be(p + 4);
+            p += 8;
+        }
+        return true;
+    }
+
+    // extra bytes of an 'a' channel: element fmt, count, element extra
+    static bool read_array_format(channel_format& ch, const uint8_t*& p, const uint8_t* end)
+    {
+        if (end - p < 2)
+        {
+            return false;
+        }
+        const uint8_t element_fmt = p[0];
+        const std::size_t count = p[1];
+        p += 2;
+        channel_format element;
+        element.small_scale = ch.small_scale;
+        element.period_ms = ch.period_ms;
+        element.valid = true;
+        if (!read_value_format(element, element_fmt, p, end))
+        {
+            return false;
+        }
+        ch.size = 0;
+        // a nested array or an unknown element type can't be skipped
+        if (element.size == 0)
+        {
+            return true;
+        }
+        ch.elements.assign(count, element);
+        for (std::size_t i = 0; i < count; i++)
+        {
+            ch.elements[i].name = ch.name + "[" + std::to_string(i) + "]";
+            ch.elements[i].element = static_cast<uint8_t>(i);
+        }
+        ch.size = static_cast<uint16_t>(count * element.size);
+        return true;
+    }
+
+    // Replace the channel table with the descriptions of schema `hash`
+    void install_schema(uint16_t hash, const std::vector<uint8_t>& descriptions)
+    {
+        if (m_have_schema && hash != m_schema)
+        {
+            m_stats.schema_changes++;
+        }
+        m_channels.clear();
+        m_last.clear();
+        m_schema = hash;
+        m_have_schema = true;
+        decode_descriptions(descriptions.data(), descriptions.size());
+        m_rice_offsets.assign(m_channels.size(), 0);
+        std::size_t offset = 0;
+        for (std::size_t code = 0; code < m_channels.size(); code++)
+        {
+            m_rice_offsets[code] = offset;
+            offset += m_channels[code].size;
+        }
+        m_rice_reference.assign(offset, 0);
+        m_rice_synced = false;
+        m_changes_synced = false;
+        m_handler.on_schema(hash);
+    }
+
+    // Makes `hash` the current schema if it's known; counts the packet as
+    // skipped if not
+    bool use_schema(uint16_t hash)
+    {
+        if (m_have_schema && hash == m_schema)
+        {
+            return true;
+        }
+        const std::vector<uint8_t>* descriptions = m_cache->find(hash);
+        if (descriptions == nullptr)
+        {
+            m_stats.unknown_schemas++;
+            m_handler.on_unknown_schema(hash);
+            return false;
+        }
+        install_schema(hash, *descriptions);
+        return true;
+    }
+
+    // 0x46: schema hash, then descriptions; a schema's descriptions are
+    // complete when they hash to it
+    void decode_format(const uint8_t* p, std::size_t len)
+    {
+        if (len < 2)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        const uint16_t hash = static_cast<uint16_t>(read_be(p, 2));
+        // descriptions go out in code order, so code 0 starts them over
+        if (hash != m_pending_schema || (len > 2 && p[2] == 0x00))
+        {
+            m_pending.clear();
+            m_pending_schema = hash;
+        }
+        m_pending.insert(m_pending.end(), p + 2, p + len);
+        if (m_cache->add(hash, m_pending.data(), m_pending.size()))
+        {
+            if (!m_have_schema || hash != m_schema)
+            {
+                install_schema(hash, m_pending);
+            }
+            m_pending.clear();
+        }
+    }
+
+    // code, fmt byte, name, null, period var-int, extra; as many as fit in len
+    void decode_descriptions(const uint8_t* p, std::size_t len)
+    {
+        std::size_t i = 0;
+        while (i < len)
+        {
+            // code and fmt byte
+            if (i + ((p[i] & 0x80) ? 3 : 2) > len)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            uint16_t code;
+            i += read_var_int(p + i, code);
+            const uint8_t fmt_byte = p[i++];
+            const void* nul = std::memchr(p + i, 0, len - i);
+            if (nul == nullptr)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            const std::size_t name_len = static_cast<const uint8_t*>(nul) - (p + i);
+            channel_format ch;
+            ch.name.assign(reinterpret_cast<const char*>(p + i), name_len);
+            i += name_len + 1;
+            ch.small_scale = (fmt_byte & 0x80) != 0;
+            if (i + 1 > len || ((p[i] & 0x80) && i + 2 > len))
+            {
+                m_stats.malformed++;
+                return;
+            }
+            i += read_var_int(p + i, ch.period_ms);
+            const uint8_t* extra = p + i;
+            bool complete;
+            if (is_array_fmt(static_cast<char>(fmt_byte & 0x7f)))
+            {
+                ch.fmt = 'a';
+                complete = read_array_format(ch, extra, p + len);
+            }
+            else
+            {
+                complete = read_value_format(ch, fmt_byte & 0x7f, extra, p + len);
+            }
+            if (!complete)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            i = extra - p;
+            ch.valid = true;
+            if (code >= m_channels.size())
+            {
+                m_channels.resize(code + 1);
+            }
+            // each series gets a slot in m_last, elements of an array in a row
+            ch.value_index = m_last.size();
+            for (channel_format& element : ch.elements)
+            {
+                element.value_index = m_last.size();
+                m_last.push_back(NAN);
+            }
+            if (ch.elements.empty())
+            {
+                m_last.push_back(NAN);
+            }
+            m_channels[code] = ch;
+            if (ch.elements.empty())
+            {
+                m_handler.on_format(code, m_channels[code]);
+            }
+            for (const channel_format& element : m_channels[code].elements)
+            {
+                m_handler.on_format(code, element);
+            }
+        }
+    }
+
+    // 0x44 body: (code, value) pairs
+    void decode_data(const uint8_t* p, std::size_t len, int64_t time_us)
+    {
+        std::size_t i = 0;
+        while (i < len)
+        {
+            uint16_t code;
+            if ((p[i] & 0x80) && i + 2 > len)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            i += read_var_int(p + i, code);
+            const channel_format* ch = channel(code);
+            if (ch == nullptr)
+            {
+                return;
+            }
+            if (i + ch->size > len)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            value(time_us, code, *ch, p + i);
+            i += ch->size;
+        }
+    }
+
+    // 0x43: first code, bitmap length, bitmap, values of the set bits
+    void decode_changes(const uint8_t* p, std::size_t len, int64_t time_us)
+    {
+        if (len < 3)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        if (!m_changes_synced)
+        {
+            m_stats.changes_unsynced++;
+            return;
+        }
+        uint16_t code;
+        std::size_t i = read_var_int(p, code);
+        const std::size_t bitmap_len = p[i++];
+        const uint8_t* bitmap = p + i;
+        i += bitmap_len;
+        if (i > len)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        for (std::size_t bit = 0; bit < bitmap_len * 8 && i < len; bit++, code++)
+        {
+            if (!(bitmap[bit >> 3] & (1 << (bit & 7))))
+            {
+                continue;
+            }
+            const channel_format* ch = channel(code);
+            if (ch == nullptr)
+            {
+                return;
+            }
+            if (i + ch->size > len)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            value(time_us, code, *ch, p + i);
+            i += ch->size;
+        }
+    }
+
+    // 0x44: schema hash, then (code, value) pairs
+    void decode_data_packet(const uint8_t* p, std::size_t len, int64_t time_us)
+    {
+        if (len < 2)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        if (use_schema(static_cast<uint16_t>(read_be(p, 2))))
+        {
+            m_changes_synced = true;
+            decode_data(p + 2, len - 2, time_us);
+        }
+    }
+
+    // 0x52: schema hash, keyframe:1 seq:7, first code, bitmap length,
+    // bitmap, then the Rice-coded differences of the set bits' values (see
+    // rice_codec.h), rebuilt into a 0x44 body
+    void decode_compressed(const uint8_t* p, std::size_t len, int64_t time_us)
+    {
+        if (len < 5)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        if (!use_schema(static_cast<uint16_t>(read_be(p, 2))))
+        {
+            return;
+        }
+        m_changes_synced = true;
+        const bool keyframe = (p[2] & rice_keyframe_flag) != 0;
+        const uint8_t seq = p[2] & 0x7f;
+        if (!keyframe && (!m_rice_synced || seq != ((m_rice_seq + 1) & 0x7f)))
+        {
+            m_rice_synced = false;
+            m_stats.rice_unsynced++;
+            return;
+        }
+        std::size_t i = 3;
+        if ((p[i] & 0x80) && i + 2 > len)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        uint16_t code;
+        i += read_var_int(p + i, code);
+        if (i >= len)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        const std::size_t bitmap_len = p[i++];
+        const uint8_t* bitmap = p + i;
+        i += bitmap_len;
+        if (i > len)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        bit_reader bits(p + i, len - i);
+        const int k = static_cast<int>(bits.read(rice_parameter_bits));
+        m_rice_body.clear();
+        for (std::size_t bit = 0; bit < bitmap_len * 8; bit++, code++)
+        {
+            if (!(bitmap[bit >> 3] & (1 << (bit & 7))))
+            {
+                continue;
+            }
+            const channel_format* ch = channel(code);
+            if (ch == nullptr)
+            {
+                m_rice_synced = false;
+                return;
+            }
+            if (code < 128)
+            {
+                m_rice_body.push_back(static_cast<uint8_t>(code));
+            }
+            else
+            {
+                m_rice_body.push_back(static_cast<uint8_t>((code >> 8) | 0x80));
+                m_rice_body.push_back(static_cast<uint8_t>(code));
+            }
+            const std::size_t element_size = ch->elements.empty() ? ch->size : ch->elements[0].size;
+            uint8_t* reference = &m_rice_reference[m_rice_offsets[code]];
+            for (std::size_t j = 0; j < ch->size; j += element_size)
+            {
+                const int width = static_cast<int>(8 * element_size);
+                const uint64_t diff = rice_unzigzag(rice_read(bits, k, width), width);
+                const uint64_t last = keyframe ? 0 : rice_load(reference + j, static_cast<int>(element_size));
+                rice_store(reference + j, static_cast<int>(element_size), last + diff);
+                m_rice_body.insert(m_rice_body.end(), reference + j, reference + j + element_size);
+            }
+        }
+        if (bits.overrun())
+        {
+            m_stats.malformed++;
+            m_rice_synced = false;
+            return;
+        }
+        m_rice_seq = seq;
+        m_rice_synced = true;
+        decode_data(m_rice_body.data(), m_rice_body.size(), time_us);
+    }
+
+    // 0x54: schema hash, then records of u32 timestamp_us, u8 size, 0x44 body
+    void decode_samples(const uint8_t* p, std::size_t len)
+    {
+        if (len < 2)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        if (use_schema(static_cast<uint16_t>(read_be(p, 2))))
+        {
+            m_changes_synced = true;
+            decode_records(p + 2, len - 2);
+        }
+    }
+
+    // 0x48: schema hash, capture number, flags, u32 trigger time in us,
+    // then records as in 0x54
+    void decode_capture(const uint8_t* p, std::size_t len)
+    {
+        if (len < 8)
+        {
+            m_stats.malformed++;
+            return;
+        }
+        if (!use_schema(static_cast<uint16_t>(read_be(p, 2))))
+        {
+            return;
+        }
+        const uint8_t capture = p[2];
+        const bool last = (p[3] & 0x01) != 0;
+        m_capture = capture;
+        decode_records(p + 8, len - 8);
+        m_capture = -1;
+        if (last)
+        {
+            m_stats.captures++;
+            m_handler.on_capture_end(capture, static_cast<uint32_t>(read_be(p + 4, 4)));
+        }
+    }
+
+    // u32 timestamp_us, u8 size, `size` bytes of (code, value) pairs; as many
+    // as fit in len
+    void decode_records(const uint8_t* p, std::size_t len)
+    {
+        std::size_t i = 0;
+        while (i + 5 <= len)
+        {
+            const int64_t time_us = static_cast<int64_t>(read_be(p + i, 4));
+            const std::size_t size = p[i + 4];
+            i += 5;
+            if (i + size > len)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            decode_data(p + i, size, time_us);
+            i += size;
+        }
+    }
+
+    // 0x49: type/id byte, then var-int/u8 fields as in pack_vision_object()
+    void decode_vision(const uint8_t* p, std::size_t len)
+    {
+        std::size_t count = 0;
+        std::size_t i = 0;
+        while (i < len && count < max_vision_objects)
+        {
+            vision_record& rec = m_visionRecords[count];
+            rec = vision_record{};
+            rec.type = p[i] >> 6;
+            rec.id = p[i] & 0b111111;
+            i++;
+            // var-int, u8 pairs, then a var-int angle (tags) or u8 score
+            const int pairs = rec.type == vision_type_tag ? 4 : 2;
+            int f = 0;
+            for (int k = 0; k < pairs; k++)
+            {
+                if (i >= len || i + ((p[i] & 0x80) ? 3 : 2) > len)
+                {
+                    m_stats.malformed++;
+                    return;
+                }
+                uint16_t x;
+                i += read_var_int(p + i, x);
+                rec.field[f++] = x;
+                rec.field[f++] = p[i++];
+            }
+            if (i >= len)
+            {
+                m_stats.malformed++;
+                return;
+            }
+            if (rec.type == vision_type_tag)
+            {
+                if ((p[i] & 0x80) && i + 2 > len)
+                {
+                    m_stats.malformed++;
+                    return;
+                }
+                uint16_t angle;
+                i += read_var_int(p + i, angle);
+                rec.field[f] = angle;
+            }
+            else
+            {
+                rec.field[f] = p[i++];
+            }
+            count++;
+        }
+        m_stats.vision_frames++;
+        m_handler.on_vision(m_packet, m_visionRecords, count);
+    }
+
+    void decode_vision_changes(const uint8_t* p, std::size_t len)
+    {
+        const int count = m_vision.decode(p, len, m_visionRecords);
+        if (count < 0)
+        {
+            m_stats.vision_unsynced++;
+            return;
+        }
+        m_stats.vision_frames++;
+        m_handler.on_vision(m_packet, m_visionRecords, static_cast<std::size_t>(count));
+    }
+
+public:
+    explicit stream_decoder(stream_handler& handler, std::size_t max_payload = 4096)
+        : m_handler(handler)
+        , m_framer(max_payload)
+        , m_cobs_framer(max_payload)
+    {}
+
+    // What the brain was set to, see PacketWriter::set_framing
+    void set_framing(packet_framing framing)
+    {
+        m_framing = framing;
+    }
+
+    void feed(const uint8_t* data, std::size_t len)
+    {
+        if (m_framing == packet_framing::cobs)
+        {
+            m_cobs_framer.feed(data, len, *this);
+        }
+        else
+        {
+            m_framer.feed(data, len, *this);
+        }
+    }
+
+    void finish(void)
+    {
+        if (m_framing == packet_framing::cobs)
+        {
+            m_cobs_framer.finish(*this);
+        }
+        else
+        {
+            m_framer.finish(*this);
+        }
+    }
+
+    // Share one cache between decoders, e.g. of several robots running the
+    // same program; it must outlive the decoder
+    void set_schema_cache(schema_cache& cache)
+    {
+        m_cache = &cache;
+    }
+
+    schema_cache& schemas() { return *m_cache; }
+
+    const framer_stats& framing() const
+    {
+        return (m_framing == packet_framing::cobs) ? m_cobs_framer.stats() : m_framer.stats();
+    }
+    const decoder_stats& stats() const { return m_stats; }
+    const std::vector<channel_format>& channels() const { return m_channels; }
+    // extended header sequence numbers of `cmd`
+    const sequence_tracker& sequences(uint8_t cmd) const { return m_sequences[cmd & 0x1f]; }
+    // by channel_format::value_index; NaN until a series has been received
+    const std::vector<double>& last_values() const { return m_last; }
+
+    // packet_framer sink
+    void on_text(const char* text, std::size_t len)
+    {
+        m_handler.on_text(text, len);
+    }
+
+    void on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        int64_t time_us = -1;
+        if (cmd & extended_header_flag)
+        {
+            if (len < extended_header_len)
+            {
+                m_stats.malformed++;
+                m_packet++;
+                return;
+            }
+            cmd &= ~extended_header_flag;
+            const uint16_t sequence = static_cast<uint16_t>(read_be(payload, 2));
+            time_us = static_cast<int64_t>(read_be(payload + 2, 4));
+            sequence_tracker& tracker = m_sequences[cmd & 0x1f];
+            // a late packet takes back a loss counted earlier
+            m_stats.lost_packets -= tracker.lost();
+            tracker.add(sequence);
+            m_stats.lost_packets += tracker.lost();
+            m_handler.on_header(cmd, sequence, static_cast<uint32_t>(time_us));
+            payload += extended_header_len;
+            len -= extended_header_len;
+        }
+        switch (cmd)
+        {
+            case 0x46: decode_format(payload, len); break;
+            case 0x44: decode_data_packet(payload, len, time_us); break;
+            case 0x43: decode_changes(payload, len, time_us); break;
+            case 0x52: decode_compressed(payload, len, time_us); break;
+            case 0x54: decode_samples(payload, len); break;
+            case 0x48: decode_capture(payload, len); break;
+            case 0x49: decode_vision(payload, len); break;
+            case 0x56: decode_vision_changes(payload, len); break;
+            default:
+                m_stats.unknown_commands++;
+                m_handler.on_unknown(cmd, payload, len);
+                break;
+        }
+        m_packet++;
+    }
+};
+
+// ------------------------------------------------------------
+// Captures
+// ------------------------------------------------------------
+
+inline int hex_digit(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Bytes of every "[NOTIFY] bytes: [c0 de ...]" line of a BLE Hook capture
+inline std::vector<uint8_t> read_ble_log(FILE* f)
+{
+    std::vector<uint8_t> bytes;
+    static const char marker[] = "[NOTIFY] bytes: [";
+    char line[8192];
+    while (std::fgets(line, sizeof(line), f) != nullptr)
+    {
+        const char* p = std::strstr(line, marker);
+        if (p == nullptr)
+        {
+            continue;
+        }
+        for (p += sizeof(marker) - 1; *p != '\0' && *p != ']'; p++)
+        {
+            const int hi = hex_digit(p[0]);
+            const int lo = hi < 0 ? -1 : hex_digit(p[1]);
+            if (lo >= 0)
+            {
+                bytes.push_back(static_cast<uint8_t>((hi << 4) | lo));
+                p++;
+            }
+        }
+    }
+    return bytes;
+}
+
+struct block_file_stats
+{
+    uint64_t blocks = 0;
+    uint64_t lost_blocks = 0; // block numbers missing from the sequence
+    uint64_t bad_bytes = 0;   // skipped because no index record checked out
+};
+
+// Bytes a file_sink (output_sink.h) recorded, in block order, without the
+// index records. Where a block is missing or damaged, the next block's
+// bytes start at the first write that starts in it, so the stream picks
+// up at a whole packet; a reader that finds no index record skips ahead
+// 512 bytes, the smallest block size.
+inline std::vector<uint8_t> read_block_file(FILE* f, block_file_stats* stats = nullptr)
+{
+    static constexpr std::size_t index_len = 16;
+    static constexpr std::size_t min_block = 512;
+    static constexpr uint16_t no_start = 0xffff;
+
+    std::vector<uint8_t> file;
+    std::vector<uint8_t> chunk(1 << 20);
+    std::size_t n;
+    while ((n = std::fread(chunk.data(), 1, chunk.size(), f)) > 0)
+    {
+        file.insert(file.end(), chunk.begin(), chunk.begin() + n);
+    }
+
+    block_file_stats local;
+    block_file_stats& st = (stats != nullptr) ? *stats : local;
+    std::vector<uint8_t> bytes;
+    bytes.reserve(file.size());
+    std::size_t pos = 0;
+    uint32_t expected = 0;
+    bool in_step = false; // the block before this one was read
+    while (pos + index_len <= file.size())
+    {
+        const uint8_t* p = &file[pos];
+        const std::size_t block = (p[3] >= 9 && p[3] <= 16) ? (std::size_t(1) << p[3]) : 0;
+        std::size_t used = (p[12] << 8) | p[13];
+        if (used == 0)
+        {
+            used = block;
+        }
+        const std::size_t first = (p[14] << 8) | p[15];
+        if (p[0] != 0xc0 || p[1] != 0xdb || p[2] != 1 || block == 0 || pos + block > file.size()
+            || used < index_len || used > block || (first != no_start && (first < index_len || first >= used)))
+        {
+            st.bad_bytes += min_block;
+            pos += min_block;
+            in_step = false;
+            continue;
+        }
+        const uint32_t number = (uint32_t(p[4]) << 24) | (uint32_t(p[5]) << 16) | (uint32_t(p[6]) << 8) | p[7];
+        if (st.blocks > 0 && number != expected)
+        {
+            st.lost_blocks += (number > expected) ? number - expected : 0;
+            in_step = false;
+        }
+        const std::size_t from = in_step ? index_len : first;
+        if (from != no_start)
+        {
+            bytes.insert(bytes.end(), p + from, p + used);
+        }
+        st.blocks++;
+        expected = number + 1;
+        in_step = (from != no_start);
+        pos += block;
+    }
+    return bytes;
+}
+
+} // namespace c0de
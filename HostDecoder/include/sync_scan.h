@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define C0DE_SYNC_X86 1
+#endif
+
+
+// ------------------------------------------------------------
+// 0xc0 0xde sync word search
+//
+// Every find_sync_* returns the offset of the first 0xc0 0xde in buf[0, n),
+// or of a 0xc0 in the last byte, since that may start a header in the next
+// chunk; n if there is neither. find_sync() uses best_sync_scan(), chosen
+// the first time it's called.
+// ------------------------------------------------------------
+
+namespace c0de
+{
+
+constexpr uint8_t sync0 = 0xc0;
+constexpr uint8_t sync1 = 0xde;
+
+using sync_scan_fn = std::size_t (*)(const uint8_t* buf, std::size_t n);
+
+// One byte at a time; the reference for the others
+inline std::size_t find_sync_bytewise(const uint8_t* buf, std::size_t n)
+{
+    for (std::size_t j = 0; j < n; j++)
+    {
+        if (buf[j] == sync0 && (j + 1 == n || buf[j + 1] == sync1))
+        {
+            return j;
+        }
+    }
+    return n;
+}
+
+// memchr for 0xc0, then check the next byte; libc's memchr is already
+// vectorized, but stops on every 0xc0 in the binary payloads
+inline std::size_t find_sync_memchr(const uint8_t* buf, std::size_t n)
+{
+    std::size_t i = 0;
+    while (i < n)
+    {
+        const void* hit = std::memchr(buf + i, sync0, n - i);
+        if (hit == nullptr)
+        {
+            return n;
+        }
+        const std::size_t j = static_cast<const uint8_t*>(hit) - buf;
+        if (j + 1 == n || buf[j + 1] == sync1)
+        {
+            return j;
+        }
+        i = j + 1;
+    }
+    return n;
+}
+
+#ifdef C0DE_SYNC_X86
+
+// 64 bytes per step: a quick check for any 0xc0, and only then the bytes
+// one further on against 0xde, so only a real sync word sets a mask bit
+__attribute__((target("sse2")))
+inline std::size_t find_sync_sse2(const uint8_t* buf, std::size_t n)
+{
+    const __m128i c0 = _mm_set1_epi8(static_cast<char>(sync0));
+    const __m128i de = _mm_set1_epi8(static_cast<char>(sync1));
+    std::size_t i = 0;
+    for (; i + 65 <= n; i += 64)
+    {
+        __m128i e[4];
+        for (int k = 0; k < 4; k++)
+        {
+            e[k] = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i + 16 * k)), c0);
+        }
+        const __m128i any = _mm_or_si128(_mm_or_si128(e[0], e[1]), _mm_or_si128(e[2], e[3]));
+        if (_mm_movemask_epi8(any) == 0)
+        {
+            continue;
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            const __m128i next = _mm_loadu_si128(reinterpret_cast<const __m128i*>(buf + i + 16 * k + 1));
+            const int mask = _mm_movemask_epi8(_mm_and_si128(e[k], _mm_cmpeq_epi8(next, de)));
+            if (mask != 0)
+            {
+                return i + 16 * k + __builtin_ctz(mask);
+            }
+        }
+    }
+    return i + find_sync_bytewise(buf + i, n - i);
+}
+
+__attribute__((target("avx2")))
+inline std::size_t find_sync_avx2(const uint8_t* buf, std::size_t n)
+{
+    const __m256i c0 = _mm256_set1_epi8(static_cast<char>(sync0));
+    const __m256i de = _mm256_set1_epi8(static_cast<char>(sync1));
+    std::size_t i = 0;
+    for (; i + 65 <= n; i += 64)
+    {
+        const __m256i e0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i)), c0);
+        const __m256i e1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i + 32)), c0);
+        if (_mm256_testz_si256(_mm256_or_si256(e0, e1), _mm256_or_si256(e0, e1)))
+        {
+            continue;
+        }
+        const __m256i d0 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i + 1)), de);
+        const uint32_t m0 = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(e0, d0)));
+        if (m0 != 0)
+        {
+            return i + __builtin_ctz(m0);
+        }
+        const __m256i d1 = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(buf + i + 33)), de);
+        const uint32_t m1 = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(e1, d1)));
+        if (m1 != 0)
+        {
+            return i + 32 + __builtin_ctz(m1);
+        }
+    }
+    return i + find_sync_sse2(buf + i, n - i);
+}
+
+#endif // C0DE_SYNC_X86
+
+// glibc picks an AVX2/EVEX memchr for the CPU itself, and in packet_framer
+// that measured as fast as find_sync_avx2 on packet-dense streams and faster
+// on mostly-text ones, so it's kept there; other libcs' memchr is word at a
+// time, so they get the vector scans
+inline sync_scan_fn best_sync_scan(void)
+{
+#if defined(C0DE_SYNC_X86) && !defined(__GLIBC__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return find_sync_avx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return find_sync_sse2;
+    }
+#endif
+    return find_sync_memchr;
+}
+
+inline std::size_t find_sync(const uint8_t* buf, std::size_t n)
+{
+    static const sync_scan_fn scan = best_sync_scan();
+    return scan(buf, n);
+}
+
+} // namespace c0de
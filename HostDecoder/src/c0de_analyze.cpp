@@ -0,0 +1,544 @@
+// c0de_analyze: link quality of a brain stream from the extended packet
+// headers (StructuredLogger::set_extended_header): per command, loss,
+// reordering and duplicates from the sequence numbers, the brain's sample
+// interval from the timestamps and, where arrival times are known, transit
+// jitter and latency percentiles
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/c0de_analyze.cpp -o c0de_analyze
+//
+//   c0de_analyze [options] <capture>...
+//     --live PATH       read PATH (e.g. the brain's serial port, or - for
+//                       stdin) instead, stamping every read with the host
+//                       clock; stops at end of input, Ctrl-C or --duration
+//     --duration S      stop --live after S seconds
+//     --record FILE     save what --live read as a timed capture
+//     --histogram       print a latency histogram per command
+//
+// A capture is raw brain output, which has no arrival times, or a timed
+// capture written by --record:
+//   "C0DETS01", then per read u64 host time (us), u32 length, the bytes
+// (little-endian, as written on the host).
+//
+// The brain and host clocks are neither synchronized nor the same speed,
+// so latency is measured from the fastest packets: arrival minus sample
+// time, less a line through the minimum of that over every 10 s of brain
+// time. That removes the clock offset and skew along with the link's
+// minimum latency; what is left is the latency any packet spent queued on
+// the brain or the link beyond the fastest ones.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "c0de_stream.h"
+
+namespace
+{
+
+constexpr char timed_magic[8] = { 'C', '0', 'D', 'E', 'T', 'S', '0', '1' };
+constexpr int64_t skew_window_us = 10000000;
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_sigint(int)
+{
+    g_stop = 1;
+}
+
+int64_t host_time_us(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct command_stats
+{
+    uint64_t packets = 0;
+    uint64_t bytes = 0;
+    uint64_t plain = 0;             // without the extended header
+    uint64_t malformed = 0;
+    c0de::sequence_tracker sequence;
+    // per packet with the extended header, in arrival order: unwrapped brain
+    // time, and host time or -1
+    std::vector<int64_t> sample_us;
+    std::vector<int64_t> arrival_us;
+};
+
+// p in [0, 1] of sorted values
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return NAN;
+    }
+    const std::size_t i = static_cast<std::size_t>(std::lround(p * (sorted.size() - 1)));
+    return sorted[i];
+}
+
+// Offset line of arrival - sample time against sample time
+struct clock_fit
+{
+    double slope = 0;
+    double intercept = 0;
+
+    double at(int64_t sample_us) const { return intercept + slope * sample_us; }
+};
+
+class stream_analyzer
+{
+private:
+    c0de::packet_framer m_framer;
+    std::map<uint8_t, command_stats> m_commands;
+    int64_t m_arrival_us = -1;
+    int64_t m_last_sample_us = -1;
+    uint64_t m_text_bytes = 0;
+
+    // The brain timer wraps every 71.6 minutes; follow it from the last
+    // timestamp seen, on any command
+    int64_t unwrap(uint32_t time_us)
+    {
+        if (m_last_sample_us < 0)
+        {
+            m_last_sample_us = time_us;
+        }
+        else
+        {
+            m_last_sample_us += static_cast<int32_t>(time_us - static_cast<uint32_t>(m_last_sample_us));
+        }
+        return m_last_sample_us;
+    }
+
+    clock_fit fit_clocks(void) const
+    {
+        std::map<int64_t, std::pair<int64_t, int64_t>> minima; // window -> (sample, offset)
+        for (const auto& c : m_commands)
+        {
+            const command_stats& s = c.second;
+            for (std::size_t i = 0; i < s.sample_us.size(); i++)
+            {
+                if (s.arrival_us[i] < 0)
+                {
+                    continue;
+                }
+                const int64_t offset = s.arrival_us[i] - s.sample_us[i];
+                const int64_t window = s.sample_us[i] / skew_window_us;
+                const auto it = minima.find(window);
+                if (it == minima.end() || offset < it->second.second)
+                {
+                    minima[window] = std::make_pair(s.sample_us[i], offset);
+                }
+            }
+        }
+        clock_fit fit;
+        if (minima.empty())
+        {
+            return fit;
+        }
+        if (minima.size() < 3)
+        {
+            fit.intercept = static_cast<double>(minima.begin()->second.second);
+            for (const auto& m : minima)
+            {
+                fit.intercept = std::min(fit.intercept, static_cast<double>(m.second.second));
+            }
+            return fit;
+        }
+        // least squares, relative to the first point to keep the sums small
+        const double x0 = static_cast<double>(minima.begin()->second.first);
+        const double y0 = static_cast<double>(minima.begin()->second.second);
+        double sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (const auto& m : minima)
+        {
+            const double x = m.second.first - x0;
+            const double y = m.second.second - y0;
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+        const double n = static_cast<double>(minima.size());
+        const double d = n * sxx - sx * sx;
+        fit.slope = d != 0 ? (n * sxy - sx * sy) / d : 0;
+        fit.intercept = y0 + (sy - fit.slope * sx) / n - fit.slope * x0;
+        // the line runs through the middle of the minima; drop it to the
+        // lowest of them so no packet comes out faster than the fastest
+        double lowest = 0;
+        bool first = true;
+        for (const auto& m : minima)
+        {
+            const double below = m.second.second - fit.at(m.second.first);
+            lowest = first ? below : std::min(lowest, below);
+            first = false;
+        }
+        fit.intercept += lowest;
+        return fit;
+    }
+
+    static void print_histogram(FILE* out, const std::vector<double>& latency_us)
+    {
+        // bucket k holds [2^(k-1), 2^k) us, bucket 0 below 1 us
+        std::vector<uint64_t> buckets(40, 0);
+        for (double v : latency_us)
+        {
+            int k = 0;
+            while (k + 1 < static_cast<int>(buckets.size()) && v >= std::ldexp(1.0, k))
+            {
+                k++;
+            }
+            buckets[k]++;
+        }
+        std::size_t lo = 0, hi = buckets.size();
+        while (lo < hi && buckets[lo] == 0) lo++;
+        while (hi > lo && buckets[hi - 1] == 0) hi--;
+        const uint64_t most = *std::max_element(buckets.begin(), buckets.end());
+        for (std::size_t k = lo; k < hi; k++)
+        {
+            const double upper_ms = std::ldexp(1.0, static_cast<int>(k)) / 1000;
+            const int bar = most ? static_cast<int>((buckets[k] * 50 + most - 1) / most) : 0;
+            std::fprintf(out, "      < %9.3f ms %9llu %s\n", upper_ms,
+                         (unsigned long long)buckets[k], std::string(bar, '#').c_str());
+        }
+    }
+
+public:
+    explicit stream_analyzer(std::size_t max_payload = 4096)
+        : m_framer(max_payload)
+    {}
+
+    // arrival_us: host time the bytes were read at, or -1 if unknown
+    void feed(const uint8_t* data, std::size_t len, int64_t arrival_us)
+    {
+        m_arrival_us = arrival_us;
+        m_framer.feed(data, len, *this);
+    }
+
+    void finish(void)
+    {
+        m_framer.finish(*this);
+    }
+
+    // packet_framer sink
+    void on_text(const char*, std::size_t len)
+    {
+        m_text_bytes += len;
+    }
+
+    void on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        command_stats& s = m_commands[cmd & ~c0de::extended_header_flag];
+        s.packets++;
+        s.bytes += len;
+        if (!(cmd & c0de::extended_header_flag))
+        {
+            s.plain++;
+            return;
+        }
+        if (len < c0de::extended_header_len)
+        {
+            s.malformed++;
+            return;
+        }
+        s.sequence.add(static_cast<uint16_t>(c0de::read_be(payload, 2)));
+        s.sample_us.push_back(unwrap(static_cast<uint32_t>(c0de::read_be(payload + 2, 4))));
+        s.arrival_us.push_back(m_arrival_us);
+    }
+
+    void report(FILE* out, const char* name, bool histogram) const
+    {
+        const c0de::framer_stats& fs = m_framer.stats();
+        std::fprintf(out, "%s: %llu bytes, %llu packets, %llu crc errors, %llu text bytes\n", name,
+                     (unsigned long long)fs.bytes, (unsigned long long)fs.packets,
+                     (unsigned long long)fs.crc_errors, (unsigned long long)m_text_bytes);
+        const clock_fit fit = fit_clocks();
+        if (fit.slope != 0)
+        {
+            std::fprintf(out, "  host clock runs %+.1f ppm against the brain's\n", fit.slope * 1e6);
+        }
+        std::fprintf(out,
+            "  cmd  packets    lost   loss%%  reord    dup | interval ms mean    sd |"
+            " jitter ms mean   p99 | latency ms  p50     p99    p999     max\n");
+        for (const auto& c : m_commands)
+        {
+            const command_stats& s = c.second;
+            const c0de::sequence_tracker& seq = s.sequence;
+            std::fprintf(out, "  %c %9llu", (c.first >= 0x20 && c.first < 0x7f) ? c.first : '?',
+                         (unsigned long long)s.packets);
+            if (s.sample_us.empty())
+            {
+                std::fprintf(out, "   (no extended header)\n");
+                continue;
+            }
+            const double expected = static_cast<double>(seq.expected());
+            std::fprintf(out, " %7llu %6.2f%% %6llu %6llu |",
+                         (unsigned long long)seq.lost(), expected > 0 ? 100.0 * seq.lost() / expected : 0.0,
+                         (unsigned long long)seq.reordered(), (unsigned long long)seq.duplicates());
+
+            // brain side: time between samples; the packets of one frame
+            // share a sample time
+            std::vector<int64_t> order(s.sample_us);
+            std::sort(order.begin(), order.end());
+            order.erase(std::unique(order.begin(), order.end()), order.end());
+            double sum = 0, sum2 = 0;
+            for (std::size_t i = 1; i < order.size(); i++)
+            {
+                const double d = (order[i] - order[i - 1]) / 1000.0;
+                sum += d;
+                sum2 += d * d;
+            }
+            const double n = order.size() > 1 ? static_cast<double>(order.size() - 1) : NAN;
+            const double mean = sum / n;
+            std::fprintf(out, "        %8.2f %5.2f |", mean, std::sqrt(std::max(0.0, sum2 / n - mean * mean)));
+
+            // link side: change in transit time between consecutive arrivals,
+            // as in RFC 3550, and latency over the fastest packets
+            std::vector<double> jitter;
+            std::vector<double> latency;
+            for (std::size_t i = 0; i < s.sample_us.size(); i++)
+            {
+                if (s.arrival_us[i] < 0)
+                {
+                    continue;
+                }
+                const int64_t transit = s.arrival_us[i] - s.sample_us[i];
+                latency.push_back(std::max(0.0, transit - fit.at(s.sample_us[i])));
+                if (i > 0 && s.arrival_us[i - 1] >= 0)
+                {
+                    jitter.push_back(std::fabs(static_cast<double>(transit - (s.arrival_us[i - 1] - s.sample_us[i - 1]))));
+                }
+            }
+            if (latency.empty())
+            {
+                std::fprintf(out, "    (no arrival times)\n");
+                continue;
+            }
+            std::sort(jitter.begin(), jitter.end());
+            std::sort(latency.begin(), latency.end());
+            double jitter_sum = 0;
+            for (double j : jitter)
+            {
+                jitter_sum += j;
+            }
+            std::fprintf(out, "      %8.2f %5.2f |       %7.2f %7.2f %7.2f %7.2f\n",
+                         jitter.empty() ? NAN : jitter_sum / jitter.size() / 1000.0,
+                         percentile(jitter, 0.99) / 1000.0,
+                         percentile(latency, 0.5) / 1000.0, percentile(latency, 0.99) / 1000.0,
+                         percentile(latency, 0.999) / 1000.0, latency.back() / 1000.0);
+            if (histogram)
+            {
+                print_histogram(out, latency);
+            }
+        }
+    }
+};
+
+// Raw output, or a timed capture if it starts with timed_magic
+bool analyze_file(const char* path, stream_analyzer& analyzer)
+{
+    FILE* f = std::strcmp(path, "-") == 0 ? stdin : std::fopen(path, "rb");
+    if (f == nullptr)
+    {
+        std::perror(path);
+        return false;
+    }
+    std::vector<uint8_t> chunk(1 << 20);
+    std::size_t n = std::fread(chunk.data(), 1, sizeof(timed_magic), f);
+    if (n == sizeof(timed_magic) && std::memcmp(chunk.data(), timed_magic, n) == 0)
+    {
+        uint8_t header[12];
+        while (std::fread(header, 1, sizeof(header), f) == sizeof(header))
+        {
+            int64_t arrival_us;
+            uint32_t len;
+            std::memcpy(&arrival_us, header, 8);
+            std::memcpy(&len, header + 8, 4);
+            if (len > chunk.size())
+            {
+                chunk.resize(len);
+            }
+            if (std::fread(chunk.data(), 1, len, f) != len)
+            {
+                break;
+            }
+            analyzer.feed(chunk.data(), len, arrival_us);
+        }
+    }
+    else
+    {
+        analyzer.feed(chunk.data(), n, -1);
+        while ((n = std::fread(chunk.data(), 1, chunk.size(), f)) > 0)
+        {
+            analyzer.feed(chunk.data(), n, -1);
+        }
+    }
+    if (f != stdin)
+    {
+        std::fclose(f);
+    }
+    return true;
+}
+
+bool analyze_live(const char* path, double duration_s, const char* record_path, stream_analyzer& analyzer)
+{
+    const int fd = std::strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY | O_NOCTTY);
+    if (fd < 0)
+    {
+        std::perror(path);
+        return false;
+    }
+    if (isatty(fd))
+    {
+        termios tio;
+        if (tcgetattr(fd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+    FILE* record = nullptr;
+    if (record_path != nullptr)
+    {
+        record = std::fopen(record_path, "wb");
+        if (record == nullptr)
+        {
+            std::perror(record_path);
+            return false;
+        }
+        std::fwrite(timed_magic, 1, sizeof(timed_magic), record);
+    }
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigaction(SIGINT, &sa, nullptr);
+
+    const int64_t start = host_time_us();
+    const int64_t end = duration_s > 0 ? start + static_cast<int64_t>(duration_s * 1e6) : INT64_MAX;
+    std::vector<uint8_t> chunk(1 << 16);
+    while (!g_stop && host_time_us() < end)
+    {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 100) <= 0)
+        {
+            continue;
+        }
+        const ssize_t n = read(fd, chunk.data(), chunk.size());
+        const int64_t arrival_us = host_time_us();
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        analyzer.feed(chunk.data(), static_cast<std::size_t>(n), arrival_us);
+        if (record != nullptr)
+        {
+            const uint32_t len = static_cast<uint32_t>(n);
+            std::fwrite(&arrival_us, sizeof(arrival_us), 1, record);
+            std::fwrite(&len, sizeof(len), 1, record);
+            std::fwrite(chunk.data(), 1, len, record);
+        }
+    }
+    if (record != nullptr)
+    {
+        std::fclose(record);
+    }
+    if (fd != STDIN_FILENO)
+    {
+        close(fd);
+    }
+    return true;
+}
+
+void usage(void)
+{
+    std::fprintf(stderr,
+        "usage: c0de_analyze [--histogram] <capture>...\n"
+        "       c0de_analyze [--histogram] --live PATH [--duration S] [--record FILE]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* live_path = nullptr;
+    const char* record_path = nullptr;
+    double duration_s = 0;
+    bool histogram = false;
+    std::vector<const char*> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--live" && has_value)
+        {
+            live_path = argv[++i];
+        }
+        else if (arg == "--duration" && has_value)
+        {
+            duration_s = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--record" && has_value)
+        {
+            record_path = argv[++i];
+        }
+        else if (arg == "--histogram")
+        {
+            histogram = true;
+        }
+        else if (!arg.empty() && arg[0] == '-' && arg != "-")
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if ((live_path == nullptr) == inputs.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    if (live_path != nullptr)
+    {
+        stream_analyzer analyzer;
+        if (!analyze_live(live_path, duration_s, record_path, analyzer))
+        {
+            return 1;
+        }
+        analyzer.finish();
+        analyzer.report(stdout, live_path, histogram);
+        return 0;
+    }
+    // every capture is a stream of its own
+    for (const char* path : inputs)
+    {
+        stream_analyzer analyzer;
+        if (!analyze_file(path, analyzer))
+        {
+            return 1;
+        }
+        analyzer.finish();
+        analyzer.report(stdout, path, histogram);
+    }
+    return 0;
+}
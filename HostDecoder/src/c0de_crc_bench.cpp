@@ -0,0 +1,249 @@
+// c0de_crc_bench: the CRC16 of crc16.h against the bitwise loop it
+// replaced, for equality first and speed second
+//
+//   g++ -std=c++17 -O2 -IBLETestCpp/include HostDecoder/src/c0de_crc_bench.cpp
+//       -o c0de_crc_bench
+//
+//   c0de_crc_bench [options]
+//     --cases N         random buffers for the check (default 200000)
+//     --seed N          (default 1)
+//     --ms N            how long each timing runs (default 200)
+//
+// Check: every buffer has a random length (0 to 4 KiB, most under 300 like
+// the brain's packets) and starts at a random offset 0 to 15 from a 64-byte
+// boundary, so the slice loops start and end on every alignment. The bitwise
+// loop's CRC must come out of crc16<1>, <2>, <4> and <8>, of crc16_update()
+// byte by byte, of crc16_update<8>() fed in two random pieces, and of
+// crc16_constexpr() called at run time. On the same buffers crc16_shift()
+// must match feeding zero bytes, and crc16_patch_u16() must match rescanning
+// after two zero bytes are overwritten, as packet_buffer::patch_u16() does.
+//
+// Timing: ns per CRC and MB/s for each of them at the brain's packet sizes
+// and a few larger ones, aligned and not.
+//
+// Exits 1 if any CRC differs.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+
+#include "crc16.h"
+
+namespace
+{
+
+unsigned cases = 200000;
+uint32_t seed = 1;
+unsigned run_ms = 200;
+
+volatile uint16_t g_sink; // keeps results alive
+
+// What append_crc16() did before crc16.h
+uint16_t crc16_bitwise(const uint8_t* data, std::size_t len)
+{
+    uint16_t crc = CRC16_INIT;
+    for (std::size_t i = 0; i < len; ++i)
+    {
+        crc ^= static_cast<uint16_t>(data[i] << 8);
+        for (uint8_t j = 0; j < 8; ++j)
+        {
+            if (crc & 0x8000)
+            {
+                crc = static_cast<uint16_t>((crc << 1) ^ POLYNOMIAL_CRC16);
+            }
+            else
+            {
+                crc = static_cast<uint16_t>(crc << 1);
+            }
+        }
+    }
+    return crc;
+}
+
+uint16_t crc16_bytewise(const uint8_t* data, std::size_t len)
+{
+    uint16_t crc = CRC16_INIT;
+    for (std::size_t i = 0; i < len; ++i)
+    {
+        crc = crc16_update(crc, data[i]);
+    }
+    return crc;
+}
+
+struct engine
+{
+    const char* name;
+    uint16_t (*fn)(const uint8_t*, std::size_t);
+};
+
+const engine engines[] = {
+    { "bitwise", crc16_bitwise },
+    { "crc16_update(byte)", crc16_bytewise },
+    { "table", crc16<1> },
+    { "slice-by-2", crc16<2> },
+    { "slice-by-4", crc16<4> },
+    { "slice-by-8", crc16<8> },
+};
+
+// Mostly packet sized, now and then up to 4 KiB
+std::size_t random_length(std::mt19937& rng)
+{
+    const uint32_t r = rng() % 16;
+    return (r == 0) ? rng() % 4097 : (r < 3) ? rng() % 16 : rng() % 300;
+}
+
+struct failure_count
+{
+    uint64_t count = 0;
+
+    void check(bool same, const char* what, std::size_t len, std::size_t offset)
+    {
+        if (!same && count++ < 10)
+        {
+            std::printf("  %s differs: %zu bytes at offset %zu\n", what, len, offset);
+        }
+    }
+};
+
+bool check(void)
+{
+    std::mt19937 rng(seed);
+    // room for the longest buffer, at the largest offset, with the most zeros after it
+    alignas(64) static uint8_t buf[16 + 4096 + 600];
+    failure_count failed;
+    for (unsigned c = 0; c < cases; c++)
+    {
+        const std::size_t len = random_length(rng);
+        const std::size_t offset = rng() % 16;
+        uint8_t* const p = buf + offset;
+        for (std::size_t i = 0; i < len; i++)
+        {
+            p[i] = static_cast<uint8_t>(rng());
+        }
+        const uint16_t want = crc16_bitwise(p, len);
+        for (const engine& e : engines)
+        {
+            failed.check(e.fn(p, len) == want, e.name, len, offset);
+        }
+        const std::size_t split = (len == 0) ? 0 : rng() % (len + 1);
+        failed.check(crc16_update<8>(crc16_update<8>(CRC16_INIT, p, split), p + split, len - split) == want,
+                     "crc16_update<8> in two pieces", len, offset);
+        failed.check(crc16_constexpr(p, len) == want, "crc16_constexpr", len, offset);
+
+        // the buffer followed by zeros, without and with feeding them
+        const std::size_t zeros = rng() % 600;
+        std::memset(p + len, 0, zeros);
+        failed.check(crc16_shift(want, zeros) == crc16_bitwise(p, len + zeros), "crc16_shift", len, offset);
+
+        // a length placeholder filled in after the CRC was taken
+        if (len >= 2)
+        {
+            const std::size_t at = rng() % (len - 1);
+            p[at] = 0;
+            p[at + 1] = 0;
+            const uint16_t before = crc16_bitwise(p, len);
+            const uint16_t value = static_cast<uint16_t>(rng());
+            p[at] = static_cast<uint8_t>(value >> 8);
+            p[at + 1] = static_cast<uint8_t>(value);
+            failed.check(crc16_patch_u16(before, value, len - at - 2) == crc16_bitwise(p, len), "crc16_patch_u16",
+                         len, offset);
+        }
+    }
+    std::printf("%u random buffers: %s\n\n", cases, failed.count ? "FAILED" : "every CRC matches the bitwise loop");
+    if (failed.count)
+    {
+        std::printf("%llu mismatches\n", static_cast<unsigned long long>(failed.count));
+    }
+    return failed.count == 0;
+}
+
+// ns per CRC of `len` bytes at p, run for run_ms
+double time_crc(const engine& e, const uint8_t* p, std::size_t len)
+{
+    const auto budget = std::chrono::milliseconds(run_ms);
+    const auto start = std::chrono::steady_clock::now();
+    uint64_t calls = 0;
+    uint16_t acc = 0;
+    std::chrono::steady_clock::duration elapsed;
+    do
+    {
+        for (int i = 0; i < 64; i++)
+        {
+            acc ^= e.fn(p, len);
+        }
+        calls += 64;
+        elapsed = std::chrono::steady_clock::now() - start;
+    } while (elapsed < budget);
+    g_sink = acc;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / calls;
+}
+
+void bench(void)
+{
+    const std::size_t lengths[] = { 8, 32, 104, 256, 1024, 4096 };
+    const std::size_t offsets[] = { 0, 3 };
+    alignas(64) static uint8_t buf[64 + 4096];
+    std::mt19937 rng(seed);
+    for (uint8_t& b : buf)
+    {
+        b = static_cast<uint8_t>(rng());
+    }
+
+    for (std::size_t offset : offsets)
+    {
+        std::printf("ns per CRC (MB/s), offset %zu\n%-20s", offset, "bytes");
+        for (std::size_t len : lengths)
+        {
+            std::printf(" %17zu", len);
+        }
+        std::printf("\n");
+        for (const engine& e : engines)
+        {
+            std::printf("%-20s", e.name);
+            for (std::size_t len : lengths)
+            {
+                const double ns = time_crc(e, buf + offset, len);
+                std::printf(" %8.1f (%6.0f)", ns, len / ns * 1e3);
+            }
+            std::printf("\n");
+        }
+        std::printf("\n");
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--cases" && i + 1 < argc)
+        {
+            cases = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--ms" && i + 1 < argc)
+        {
+            run_ms = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: c0de_crc_bench [--cases N] [--seed N] [--ms N]\n");
+            return 2;
+        }
+    }
+
+    if (!check())
+    {
+        return 1;
+    }
+    bench();
+    return 0;
+}
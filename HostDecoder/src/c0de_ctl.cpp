@@ -0,0 +1,436 @@
+// c0de_ctl: send commands (see host_commands.h) to a brain running
+// StructuredLogger, or stand in for one on a pty
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/c0de_ctl.cpp -o c0de_ctl
+//
+//   c0de_ctl PORT COMMAND [ARG]...
+//     subscribe [CODE]...       sample and send these codes; every code if
+//                               none are given
+//     unsubscribe [CODE]...     stop sampling these codes; every code if
+//                               none are given
+//     only CODE...              unsubscribe every code, then subscribe these
+//     rate CODE MS [CODE MS]... sample every MS ms, rounded to the brain's
+//                               tick; 0 goes back to the period it was
+//                               added with
+//     vision on|off             resume or pause vision snapshots
+//     format                    resend the 0x46 format
+//     capture                   trigger a pre-trigger capture (0x48)
+//   PORT is the brain's serial port, or - to write the commands to stdout.
+//   Codes are the ones in the 0x46 format, e.g. the code column of
+//   c0de_decode --csv.
+//
+//   c0de_ctl --pty [--replay CAPTURE] [--bps N]
+//     Stand-in for the brain's serial port when there is no brain: opens a
+//     pty pair, prints the name of the port to use as PORT above, and
+//     prints every command that arrives on it, parsed by the same
+//     command_parser the brain uses. --replay writes a capture of brain
+//     output to the port over and over at N bytes/s (default 4000), for
+//     the tools that read it (c0de_analyze --live PORT). Runs until Ctrl-C.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "host_commands.h"
+
+namespace
+{
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_sigint(int)
+{
+    g_stop = 1;
+}
+
+int64_t host_time_us(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Serial ports and ptys default to a line discipline that turns 0x0d into
+// 0x0a, swallows 0x03 and 0x11/0x13 and echoes; packets need raw bytes
+void make_raw(int fd)
+{
+    if (isatty(fd))
+    {
+        termios tio;
+        if (tcgetattr(fd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+}
+
+bool parse_u16(const char* s, uint16_t& value, unsigned long max)
+{
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long v = std::strtoul(s, &end, 10);
+    if ((end == s) || (*end != '\0') || (errno != 0) || (v > max))
+    {
+        std::fprintf(stderr, "c0de_ctl: bad number '%s'\n", s);
+        return false;
+    }
+    value = static_cast<uint16_t>(v);
+    return true;
+}
+
+void push_var_int(std::vector<uint8_t>& out, uint16_t value)
+{
+    if (value < 128)
+    {
+        out.push_back(static_cast<uint8_t>(value));
+    }
+    else
+    {
+        out.push_back(static_cast<uint8_t>((value >> 8) | 0x80));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+}
+
+// Frames `command` with `items` (each one or more var-ints that must stay
+// together) as payload, in as many packets as max_command_payload needs.
+// With no items, one packet with an empty payload.
+void pack_command_items(std::vector<uint8_t>& out, uint8_t command, const std::vector<std::vector<uint8_t>>& items)
+{
+    std::vector<uint8_t> payload;
+    for (const auto& item : items)
+    {
+        if (!payload.empty() && (payload.size() + item.size() > max_command_payload))
+        {
+            pack_host_command(out, command, payload.data(), payload.size());
+            payload.clear();
+        }
+        payload.insert(payload.end(), item.begin(), item.end());
+    }
+    if (!payload.empty() || items.empty())
+    {
+        pack_host_command(out, command, payload.data(), payload.size());
+    }
+}
+
+// The packets for one command line, or false on a usage error
+bool build_command(int argc, char** argv, std::vector<uint8_t>& out)
+{
+    const std::string name = argv[0];
+    std::vector<std::vector<uint8_t>> items;
+    if ((name == "subscribe") || (name == "unsubscribe") || (name == "only"))
+    {
+        for (int i = 1; i < argc; i++)
+        {
+            uint16_t code;
+            if (!parse_u16(argv[i], code, 0x7fff))
+            {
+                return false;
+            }
+            items.emplace_back();
+            push_var_int(items.back(), code);
+        }
+        if (name == "only")
+        {
+            if (items.empty())
+            {
+                return false;
+            }
+            pack_command_items(out, unsubscribe_command, {});
+            pack_command_items(out, subscribe_command, items);
+        }
+        else
+        {
+            pack_command_items(out, name == "subscribe" ? subscribe_command : unsubscribe_command, items);
+        }
+        return true;
+    }
+    if (name == "rate")
+    {
+        if ((argc < 3) || ((argc - 1) % 2 != 0))
+        {
+            return false;
+        }
+        for (int i = 1; i + 1 < argc; i += 2)
+        {
+            uint16_t code;
+            uint16_t period_ms;
+            if (!parse_u16(argv[i], code, 0x7fff) || !parse_u16(argv[i + 1], period_ms, 0x7fff))
+            {
+                return false;
+            }
+            items.emplace_back();
+            push_var_int(items.back(), code);
+            push_var_int(items.back(), period_ms);
+        }
+        pack_command_items(out, rate_command, items);
+        return true;
+    }
+    if ((name == "vision") && (argc == 2) && (!std::strcmp(argv[1], "on") || !std::strcmp(argv[1], "off")))
+    {
+        const uint8_t on = std::strcmp(argv[1], "on") == 0 ? 1 : 0;
+        pack_host_command(out, vision_command, &on, 1);
+        return true;
+    }
+    if ((name == "format") && (argc == 1))
+    {
+        pack_host_command(out, format_request_command, nullptr, 0);
+        return true;
+    }
+    if ((name == "capture") && (argc == 1))
+    {
+        pack_host_command(out, capture_trigger_command, nullptr, 0);
+        return true;
+    }
+    return false;
+}
+
+bool write_all(int fd, const uint8_t* data, std::size_t len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = write(fd, data, len);
+        if ((n < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+int send_commands(const char* path, const std::vector<uint8_t>& packets)
+{
+    const bool to_stdout = std::strcmp(path, "-") == 0;
+    const int fd = to_stdout ? STDOUT_FILENO : open(path, O_WRONLY | O_NOCTTY);
+    if (fd < 0)
+    {
+        std::perror(path);
+        return 1;
+    }
+    if (!to_stdout)
+    {
+        make_raw(fd);
+    }
+    if (!write_all(fd, packets.data(), packets.size()))
+    {
+        std::perror(path);
+        return 1;
+    }
+    if (!to_stdout)
+    {
+        tcdrain(fd);
+        close(fd);
+    }
+    return 0;
+}
+
+// One line per command, as the brain would act on it
+void print_command(uint8_t command, const uint8_t* payload, std::size_t len)
+{
+    std::string line;
+    std::size_t i = 0;
+    uint16_t value;
+    switch (command)
+    {
+        case format_request_command:
+            line = "format";
+            break;
+        case capture_trigger_command:
+            line = "capture";
+            break;
+        case subscribe_command:
+        case unsubscribe_command:
+            line = command == subscribe_command ? "subscribe" : "unsubscribe";
+            if (len == 0)
+            {
+                line += " all";
+            }
+            while (read_command_var_int(payload, len, i, value))
+            {
+                line += " " + std::to_string(value);
+            }
+            break;
+        case rate_command:
+            line = "rate";
+            while (read_command_var_int(payload, len, i, value))
+            {
+                uint16_t period_ms;
+                if (!read_command_var_int(payload, len, i, period_ms))
+                {
+                    break;
+                }
+                line += " " + std::to_string(value) + "=" + std::to_string(period_ms) + "ms";
+            }
+            break;
+        case vision_command:
+            line = (len >= 1) ? (payload[0] ? "vision on" : "vision off") : "vision (no payload)";
+            break;
+        default:
+            line = "unknown command 0x";
+            line += "0123456789abcdef"[command >> 4];
+            line += "0123456789abcdef"[command & 0x0f];
+            line += ", " + std::to_string(len) + " bytes";
+            break;
+    }
+    std::printf("%s\n", line.c_str());
+    std::fflush(stdout);
+}
+
+int run_pty(const char* replay_path, uint32_t bps)
+{
+    std::vector<uint8_t> replay;
+    if (replay_path != nullptr)
+    {
+        FILE* f = std::fopen(replay_path, "rb");
+        if (f == nullptr)
+        {
+            std::perror(replay_path);
+            return 1;
+        }
+        uint8_t chunk[65536];
+        std::size_t n;
+        while ((n = std::fread(chunk, 1, sizeof(chunk), f)) > 0)
+        {
+            replay.insert(replay.end(), chunk, chunk + n);
+        }
+        std::fclose(f);
+    }
+
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+    {
+        std::perror("posix_openpt");
+        return 1;
+    }
+    const char* const port = ptsname(master);
+    // holding the port open keeps the master from reading EIO whenever no
+    // one else has it open, e.g. between two c0de_ctl runs
+    const int hold = open(port, O_RDWR | O_NOCTTY);
+    if (hold < 0)
+    {
+        std::perror(port);
+        return 1;
+    }
+    make_raw(hold);
+    fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+    std::fprintf(stderr, "brain stand-in on %s\n", port);
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigaction(SIGINT, &sa, nullptr);
+
+    command_parser<max_command_payload> parser;
+    uint8_t chunk[4096];
+    std::size_t replay_pos = 0;
+    uint64_t replay_dropped = 0;
+    const int64_t start = host_time_us();
+    uint64_t replayed = 0;
+    while (!g_stop)
+    {
+        pollfd pfd = { master, POLLIN, 0 };
+        if (poll(&pfd, 1, 10) > 0)
+        {
+            const ssize_t n = read(master, chunk, sizeof(chunk));
+            for (ssize_t i = 0; i < n; i++)
+            {
+                if (parser.feed(chunk[i]))
+                {
+                    print_command(parser.command(), parser.payload(), parser.size());
+                }
+            }
+        }
+        // as much of the capture as the elapsed time allows; what doesn't
+        // fit in the pty buffer is lost, as it would be on the radio link
+        if (!replay.empty())
+        {
+            const uint64_t due = static_cast<uint64_t>(host_time_us() - start) * bps / 1000000;
+            while (replayed < due)
+            {
+                const std::size_t len = static_cast<std::size_t>(
+                    std::min<uint64_t>(due - replayed, replay.size() - replay_pos));
+                const ssize_t n = write(master, replay.data() + replay_pos, len);
+                const std::size_t sent = n > 0 ? static_cast<std::size_t>(n) : 0;
+                replay_dropped += len - sent;
+                replayed += len;
+                replay_pos = (replay_pos + len) % replay.size();
+            }
+        }
+    }
+    std::fprintf(stderr, "crc errors %u, replay bytes dropped %llu\n",
+                 parser.crc_errors(), static_cast<unsigned long long>(replay_dropped));
+    close(hold);
+    close(master);
+    return 0;
+}
+
+void usage(void)
+{
+    std::fprintf(stderr,
+        "usage: c0de_ctl PORT subscribe|unsubscribe [CODE]...\n"
+        "       c0de_ctl PORT only CODE...\n"
+        "       c0de_ctl PORT rate CODE MS [CODE MS]...\n"
+        "       c0de_ctl PORT vision on|off\n"
+        "       c0de_ctl PORT format|capture\n"
+        "       c0de_ctl --pty [--replay CAPTURE] [--bps N]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if ((argc >= 2) && (std::strcmp(argv[1], "--pty") == 0))
+    {
+        const char* replay_path = nullptr;
+        uint32_t bps = 4000;
+        for (int i = 2; i < argc; i++)
+        {
+            const std::string arg = argv[i];
+            const bool has_value = i + 1 < argc;
+            if (arg == "--replay" && has_value)
+            {
+                replay_path = argv[++i];
+            }
+            else if (arg == "--bps" && has_value)
+            {
+                bps = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+            }
+            else
+            {
+                usage();
+                return 1;
+            }
+        }
+        return run_pty(replay_path, bps);
+    }
+
+    if (argc < 3)
+    {
+        usage();
+        return 1;
+    }
+    std::vector<uint8_t> packets;
+    if (!build_command(argc - 2, argv + 2, packets))
+    {
+        usage();
+        return 1;
+    }
+    return send_commands(argv[1], packets);
+}
@@ -0,0 +1,307 @@
+// c0de_delta_bench: bytes on the link for send_structured_data() against
+// send_structured_changes() (0x43 between 0x44 keyframes), on a synthetic
+// session with main.cpp's channels, and whether the host rebuilds every
+// frame from them
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_delta_bench.cpp
+//       -o c0de_delta_bench -pthread
+//
+//   c0de_delta_bench [options]
+//     --seconds N       length of the session (default 60)
+//     --hz N            frames per second (default 50)
+//     --deadband D      deadband on Heading, Roll and Pitch for the last run
+//                       (default 0.1)
+//     --keyframes N     frames between keyframes (default 50)
+//     --seed N          (default 7)
+//
+// The session is ButtonStates, four controller axes, Heading/Roll/Pitch
+// and two distance sensors, as main.cpp sends them: the driver idle two
+// thirds of the time, buttons changing every couple of seconds, IMU noise
+// of a few hundredths of a degree, and the distance sensors updating at
+// their own rate. It is sent three ways: send_structured_data() every frame,
+// send_structured_changes() with no deadband, and with --deadband on the
+// IMU channels. The bytes of each go through the host's stream_decoder,
+// which has to rebuild every frame: exactly, except for the deadbanded
+// channels, which must stay within their deadband of the true value.
+//
+// Exits 1 if a frame comes out wrong.
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vex.h"
+
+// Everything the logger writes
+struct capture_sink
+{
+    std::vector<uint8_t> bytes;
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        bytes.insert(bytes.end(), data, data + len);
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK capture_sink
+#include "structured_logger.h"
+#include "c0de_stream.h"
+
+namespace
+{
+
+unsigned seconds = 60;
+unsigned hz = 50;
+double deadband = 0.1;
+uint16_t keyframes = 50;
+uint32_t seed = 7;
+
+// ------------------------------------------------------------
+// the session
+// ------------------------------------------------------------
+
+constexpr int channel_count = 10;
+constexpr int first_imu = 5; // Heading, Roll, Pitch
+
+const char* const channel_names[channel_count] = {
+    "ButtonStates", "Axis A", "Axis B", "Axis C", "Axis D",
+    "Heading", "Roll", "Pitch", "dist_front", "dist_rear",
+};
+
+struct robot
+{
+    std::mt19937 rng;
+    unsigned t = 0;
+    uint16_t buttons = 0;
+    int8_t axes[4] = {};
+    float heading = 0;
+    float roll = 0;
+    float pitch = 0;
+    int16_t dist_front = 300;
+    int16_t dist_rear = 500;
+
+    explicit robot(uint32_t seed)
+        : rng(seed)
+    {}
+
+    void step(void)
+    {
+        t++;
+        std::uniform_real_distribution<float> noise(-0.03f, 0.03f);
+        const bool driving = (t / 250) % 3 == 1;
+        if (t % 97 == 0)
+        {
+            buttons ^= static_cast<uint16_t>(1u << (rng() % 10));
+        }
+        for (int k = 0; k < 4; k++)
+        {
+            axes[k] = driving ? static_cast<int8_t>(60 * std::sin(t * 0.02 + k)) : 0;
+        }
+        if (driving)
+        {
+            heading += 0.8f;
+        }
+        heading += noise(rng);
+        roll = 0.5f + noise(rng);
+        pitch = -1.2f + noise(rng);
+        // the sensors report about every 10th frame while idle
+        if (driving || t % 10 == 0)
+        {
+            dist_front = static_cast<int16_t>(300 + static_cast<int>(50 * std::sin(t * 0.05)) + rng() % 3);
+        }
+        dist_rear = static_cast<int16_t>(500 + (driving ? t % 40 : 0));
+    }
+
+    double value(int channel) const
+    {
+        switch (channel)
+        {
+            case 0: return buttons;
+            case 1: case 2: case 3: case 4: return axes[channel - 1];
+            case 5: return heading;
+            case 6: return roll;
+            case 7: return pitch;
+            case 8: return dist_front;
+            default: return dist_rear;
+        }
+    }
+};
+
+// ------------------------------------------------------------
+// the host side
+// ------------------------------------------------------------
+
+// Last value of every channel, as the host sees it
+class frame_builder : public c0de::stream_handler
+{
+public:
+    uint16_t codes[channel_count] = {};
+    double values[channel_count] = {};
+    bool seen[channel_count] = {};
+
+    void on_value(uint64_t, int64_t, uint16_t code, const c0de::channel_format&, double value) override
+    {
+        for (int c = 0; c < channel_count; c++)
+        {
+            if (codes[c] == code)
+            {
+                values[c] = value;
+                seen[c] = true;
+            }
+        }
+    }
+};
+
+struct run_result
+{
+    std::size_t bytes = 0;
+    unsigned frames = 0;
+    unsigned wrong = 0;
+    double worst[channel_count] = {};
+};
+
+enum class send_mode
+{
+    data,
+    changes,
+};
+
+run_result run(send_mode mode, double imu_deadband)
+{
+    std::unique_ptr<StructuredLogger> logger(new StructuredLogger());
+    robot r(seed);
+    capture_sink& out = logger_sink();
+    out.bytes.clear();
+
+    frame_builder host;
+    c0de::stream_decoder decoder(host);
+    host.codes[0] = logger->add(channel_names[0], [&r] { return r.buttons; });
+    for (int k = 0; k < 4; k++)
+    {
+        host.codes[1 + k] = logger->add(channel_names[1 + k], [&r, k] { return r.axes[k]; });
+    }
+    host.codes[5] = logger->add(channel_names[5], [&r] { return r.heading; });
+    host.codes[6] = logger->add(channel_names[6], [&r] { return r.roll; });
+    host.codes[7] = logger->add(channel_names[7], [&r] { return r.pitch; });
+    host.codes[8] = logger->add(channel_names[8], [&r] { return r.dist_front; });
+    host.codes[9] = logger->add(channel_names[9], [&r] { return r.dist_rear; });
+    for (int c = first_imu; c < first_imu + 3; c++)
+    {
+        logger->set_deadband(host.codes[c], imu_deadband);
+    }
+    logger->set_keyframe_interval(keyframes);
+    logger->send_data_format();
+    decoder.feed(out.bytes.data(), out.bytes.size());
+    // the format isn't telemetry
+    out.bytes.clear();
+
+    run_result result;
+    const unsigned frames = seconds * hz;
+    for (unsigned f = 0; f < frames; f++)
+    {
+        r.step();
+        if (mode == send_mode::data)
+        {
+            logger->send_structured_data();
+        }
+        else
+        {
+            logger->send_structured_changes();
+        }
+        decoder.feed(out.bytes.data(), out.bytes.size());
+        result.bytes += out.bytes.size();
+        out.bytes.clear();
+
+        bool same = true;
+        for (int c = 0; c < channel_count; c++)
+        {
+            const double error = host.seen[c] ? std::fabs(host.values[c] - r.value(c)) : HUGE_VAL;
+            const bool imu = c >= first_imu && c < first_imu + 3;
+            // a float deadband against a double difference
+            const double allowed = imu ? imu_deadband * (1 + 1e-6) : 0;
+            result.worst[c] = std::max(result.worst[c], error);
+            same = same && error <= allowed;
+        }
+        if (!same && result.wrong++ < 5)
+        {
+            std::printf("  frame %u differs:", f);
+            for (int c = 0; c < channel_count; c++)
+            {
+                std::printf(" %s %g/%g", channel_names[c], host.values[c], r.value(c));
+            }
+            std::printf("\n");
+        }
+        result.frames++;
+    }
+    return result;
+}
+
+void print_run(const char* what, const run_result& r)
+{
+    std::printf("%-34s %7.0f B/s  %s", what, static_cast<double>(r.bytes) / seconds,
+                r.wrong ? "FRAMES DIFFER" : "every frame rebuilt");
+    if (r.wrong)
+    {
+        std::printf(" (%u of %u wrong)", r.wrong, r.frames);
+    }
+    std::printf(", worst IMU error %.3f\n", std::max(r.worst[5], std::max(r.worst[6], r.worst[7])));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--seconds" && i + 1 < argc)
+        {
+            seconds = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--hz" && i + 1 < argc)
+        {
+            hz = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--deadband" && i + 1 < argc)
+        {
+            deadband = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--keyframes" && i + 1 < argc)
+        {
+            keyframes = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::fprintf(stderr,
+                         "usage: c0de_delta_bench [--seconds N] [--hz N] [--deadband D] [--keyframes N] [--seed N]\n");
+            return 2;
+        }
+    }
+    if (seconds == 0 || hz == 0)
+    {
+        std::fprintf(stderr, "c0de_delta_bench: --seconds and --hz must be at least 1\n");
+        return 2;
+    }
+
+    std::printf("%u s at %u Hz, %d channels, a keyframe every %u frames\n", seconds, hz, channel_count, keyframes);
+    const run_result data = run(send_mode::data, 0);
+    const run_result lossless = run(send_mode::changes, 0);
+    const run_result banded = run(send_mode::changes, deadband);
+    print_run("send_structured_data:", data);
+    print_run("send_structured_changes:", lossless);
+    char what[64];
+    std::snprintf(what, sizeof(what), "send_structured_changes, db %g:", deadband);
+    print_run(what, banded);
+    return (data.wrong || lossless.wrong || banded.wrong) ? 1 : 0;
+}
@@ -0,0 +1,433 @@
+// c0de_framer_fuzz: packet_framer (c0de_stream.h) on random and damaged
+// streams, checked against a byte-at-a-time model of what it should do
+//
+//   g++ -std=c++17 -O1 -g -fsanitize=address,undefined -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_framer_fuzz.cpp
+//       -o c0de_framer_fuzz
+//
+//   c0de_framer_fuzz [--runs N] [--seed N]
+//     --runs N          random streams (default 5000)
+//     --seed N          (default 1)
+//
+// or as a libFuzzer target, where the input is the stream:
+//
+//   clang++ -std=c++17 -O1 -g -fsanitize=fuzzer,address,undefined
+//       -DC0DE_LIBFUZZER -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/c0de_framer_fuzz.cpp -o c0de_framer_fuzz
+//
+// The random streams are console lines and packets as the brain writes
+// them, through its stdout: a packet whose CRC ends in 0x0a arrives with
+// 0x0d 0x0a. Then they are damaged: flipped bits, bytes dropped or inserted,
+// stray 0xc0 0xde, headers claiming more than the payload or more than
+// max_payload, \r\n packets with the 0x0a lost, and cuts in the middle of
+// a packet. Each stream is framed all at once, byte by byte and in random
+// chunks, with every sync word search this CPU has, and each time the
+// packets, the text between them and the stats must be the model's. The
+// packets also go through stream_decoder, for the sanitizers.
+//
+// Exits 1 (or aborts, under libFuzzer) on the first difference.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "c0de_stream.h"
+
+namespace
+{
+
+// A packet, or text up to the next packet
+struct event
+{
+    bool packet;
+    uint8_t cmd;
+    std::string bytes;
+
+    bool operator==(const event& other) const
+    {
+        return packet == other.packet && cmd == other.cmd && bytes == other.bytes;
+    }
+};
+
+struct framing
+{
+    std::vector<event> events;
+    c0de::framer_stats stats;
+
+    void on_text(const char* text, std::size_t len)
+    {
+        if (events.empty() || events.back().packet)
+        {
+            events.push_back(event{false, 0, std::string()});
+        }
+        events.back().bytes.append(text, len);
+    }
+
+    void on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        events.push_back(event{true, cmd, std::string(reinterpret_cast<const char*>(payload), len)});
+    }
+};
+
+// What packet_framer must do with the whole stream, one byte at a time:
+// a header with a length over max_payload or a bad CRC is two bytes of
+// text, a packet cut off by the end of the stream is text, and a packet
+// accepted by undoing the \r\n quirk takes the 0x0a after it along
+framing model(const uint8_t* p, std::size_t n, std::size_t max_payload)
+{
+    framing out;
+    out.stats.bytes = n;
+    std::size_t i = 0;
+    const auto text = [&](std::size_t count) {
+        out.on_text(reinterpret_cast<const char*>(p + i), count);
+        out.stats.text_bytes += count;
+        i += count;
+    };
+    while (i < n)
+    {
+        if (p[i] != c0de::sync0 || i + 1 == n || p[i + 1] != c0de::sync1)
+        {
+            text(1);
+            continue;
+        }
+        if (n - i < 4 || ((p[i + 3] & 0x80) && n - i < 5))
+        {
+            text(n - i);
+            break;
+        }
+        const std::size_t header = (p[i + 3] & 0x80) ? 5 : 4;
+        const std::size_t len = (p[i + 3] & 0x80) ? ((p[i + 3] & 0x7f) << 8) | p[i + 4] : p[i + 3];
+        if (len > max_payload)
+        {
+            out.stats.oversize++;
+            text(2);
+            continue;
+        }
+        if (i + header + len + 2 > n)
+        {
+            text(n - i);
+            break;
+        }
+        const uint16_t crc = crc16<1>(p + i, header + len);
+        const uint8_t hi = p[i + header + len];
+        const uint8_t lo = p[i + header + len + 1];
+        const bool valid = (crc >> 8) == hi && (crc & 0xff) == lo;
+        const bool fixed = !valid && (crc >> 8) == hi && (crc & 0xff) == c0de::crc_lf && lo == c0de::crc_cr;
+        if (!valid && !fixed)
+        {
+            out.stats.crc_errors++;
+            text(2);
+            continue;
+        }
+        out.on_packet(p[i + 2], p + i + header, len);
+        out.stats.packets++;
+        i += header + len + 2;
+        if (fixed)
+        {
+            out.stats.crc_fixed++;
+            if (i < n && p[i] == c0de::crc_lf)
+            {
+                i++;
+            }
+        }
+    }
+    return out;
+}
+
+struct scanner
+{
+    const char* name;
+    c0de::sync_scan_fn fn;
+};
+
+std::vector<scanner> scanners(void)
+{
+    std::vector<scanner> out = {
+        { "bytewise", c0de::find_sync_bytewise },
+        { "memchr", c0de::find_sync_memchr },
+    };
+#ifdef C0DE_SYNC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        out.push_back({ "sse2", c0de::find_sync_sse2 });
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        out.push_back({ "avx2", c0de::find_sync_avx2 });
+    }
+#endif
+    return out;
+}
+
+bool same_stats(const c0de::framer_stats& a, const c0de::framer_stats& b)
+{
+    return a.bytes == b.bytes && a.packets == b.packets && a.crc_errors == b.crc_errors
+           && a.crc_fixed == b.crc_fixed && a.oversize == b.oversize && a.text_bytes == b.text_bytes;
+}
+
+void print_stats(const char* name, const c0de::framer_stats& s)
+{
+    std::fprintf(stderr, "  %-8s %llu packets, %llu crc errors, %llu fixed, %llu oversize, %llu text bytes\n", name,
+                 (unsigned long long)s.packets, (unsigned long long)s.crc_errors, (unsigned long long)s.crc_fixed,
+                 (unsigned long long)s.oversize, (unsigned long long)s.text_bytes);
+}
+
+// Frames `p` in chunks of 1 to max_chunk bytes (0: all at once) with each
+// sync word search, and compares with the model; prints the first difference
+bool check_stream(const uint8_t* p, std::size_t n, std::size_t max_payload, std::mt19937& rng, std::size_t max_chunk)
+{
+    static const std::vector<scanner> scans = scanners();
+    const framing want = model(p, n, max_payload);
+    for (const scanner& s : scans)
+    {
+        framing got;
+        c0de::packet_framer framer(max_payload);
+        framer.set_sync_scan(s.fn);
+        for (std::size_t i = 0; i < n;)
+        {
+            std::size_t chunk = (max_chunk == 0) ? n : 1 + rng() % max_chunk;
+            chunk = (chunk < n - i) ? chunk : n - i;
+            framer.feed(p + i, chunk, got);
+            i += chunk;
+        }
+        framer.finish(got);
+        got.stats = framer.stats();
+        if (!(got.events == want.events) || !same_stats(got.stats, want.stats))
+        {
+            std::fprintf(stderr, "%zu bytes, max_payload %zu, chunks up to %zu, %s search: ", n, max_payload,
+                         max_chunk, s.name);
+            std::size_t k = 0;
+            while (k < got.events.size() && k < want.events.size() && got.events[k] == want.events[k])
+            {
+                k++;
+            }
+            std::fprintf(stderr, "event %zu of %zu differs (%zu framed)\n", k, want.events.size(), got.events.size());
+            print_stats("framer", got.stats);
+            print_stats("model", want.stats);
+            return false;
+        }
+    }
+
+    // the payloads, for the sanitizers
+    c0de::stream_handler ignore;
+    c0de::stream_decoder decoder(ignore, max_payload);
+    for (std::size_t i = 0; i < n;)
+    {
+        std::size_t chunk = 1 + rng() % 64;
+        chunk = (chunk < n - i) ? chunk : n - i;
+        decoder.feed(p + i, chunk);
+        i += chunk;
+    }
+    decoder.finish();
+    return true;
+}
+
+// Everything a stream gets checked with
+bool check_all(const uint8_t* p, std::size_t n, std::size_t max_payload, std::mt19937& rng)
+{
+    const std::size_t chunks[] = { 0, 1, 2, 7, 64, 1024 };
+    for (std::size_t max_chunk : chunks)
+    {
+        if (!check_stream(p, n, max_payload, rng, max_chunk))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifndef C0DE_LIBFUZZER
+
+// Bytes the framer cares about, picked more often than the rest
+const uint8_t interesting[] = { 0xc0, 0xde, 0x0d, 0x0a, 0x80, 0x81, 0xff, 0x00, 0x43, 0x44, 0x46, 0x54 };
+
+uint8_t random_byte(std::mt19937& rng)
+{
+    return (rng() % 4 == 0) ? interesting[rng() % sizeof(interesting)] : static_cast<uint8_t>(rng());
+}
+
+// A packet as the brain's stdout writes it; every fourth one has its CRC
+// made to end in 0x0a, so it comes out as 0x0d 0x0a
+void append_packet(std::vector<uint8_t>& out, std::mt19937& rng)
+{
+    const uint8_t commands[] = { 0x43, 0x44, 0x46, 0x48, 0x49, 0x52, 0x54, 0x56, 0xc3, 0xc4, 0xd4 };
+    const std::size_t len = (rng() % 8 == 0) ? 128 + rng() % 600 : rng() % 128;
+    std::vector<uint8_t> p = { c0de::sync0, c0de::sync1, commands[rng() % sizeof(commands)] };
+    if (len >= 0x80)
+    {
+        p.push_back(static_cast<uint8_t>(0x80 | (len >> 8)));
+    }
+    p.push_back(static_cast<uint8_t>(len));
+    for (std::size_t i = 0; i < len; i++)
+    {
+        p.push_back(random_byte(rng));
+    }
+    uint16_t crc = crc16<1>(p.data(), p.size());
+    if (len > 0 && rng() % 4 == 0)
+    {
+        // the last payload byte steers the CRC's low byte
+        for (unsigned b = 0; b < 256 && (crc & 0xff) != c0de::crc_lf; b++)
+        {
+            p.back() = static_cast<uint8_t>(b);
+            crc = crc16<1>(p.data(), p.size());
+        }
+    }
+    p.push_back(static_cast<uint8_t>(crc >> 8));
+    if ((crc & 0xff) == c0de::crc_lf)
+    {
+        p.push_back(c0de::crc_cr);
+    }
+    p.push_back(static_cast<uint8_t>(crc));
+    out.insert(out.end(), p.begin(), p.end());
+}
+
+void append_text(std::vector<uint8_t>& out, std::mt19937& rng)
+{
+    const std::size_t len = rng() % 80;
+    for (std::size_t i = 0; i < len; i++)
+    {
+        out.push_back(static_cast<uint8_t>(' ' + rng() % 95));
+    }
+    out.push_back('\r');
+    out.push_back('\n');
+}
+
+void damage(std::vector<uint8_t>& s, std::mt19937& rng)
+{
+    const unsigned hits = rng() % 6;
+    for (unsigned h = 0; h < hits && !s.empty(); h++)
+    {
+        const std::size_t at = rng() % s.size();
+        switch (rng() % 7)
+        {
+            case 0: s[at] ^= static_cast<uint8_t>(1 << (rng() % 8)); break;
+            case 1: s.erase(s.begin() + at); break;
+            case 2: s.insert(s.begin() + at, random_byte(rng)); break;
+            case 3:
+                // a stray sync word, maybe with a header after it
+                s.insert(s.begin() + at, { c0de::sync0, c0de::sync1, random_byte(rng), random_byte(rng) });
+                break;
+            case 4:
+                // the 0x0a of a \r\n lost
+                for (std::size_t i = at; i + 1 < s.size(); i++)
+                {
+                    if (s[i] == c0de::crc_cr && s[i + 1] == c0de::crc_lf)
+                    {
+                        s.erase(s.begin() + i + 1);
+                        break;
+                    }
+                }
+                break;
+            case 5: s.resize(at); break;
+            case 6:
+                // a run of bytes lost, as with a dropped notification
+                s.erase(s.begin() + at, s.begin() + std::min(s.size(), at + 1 + rng() % 20));
+                break;
+        }
+    }
+}
+
+std::vector<uint8_t> random_stream(std::mt19937& rng)
+{
+    std::vector<uint8_t> s;
+    const unsigned pieces = rng() % 24;
+    for (unsigned k = 0; k < pieces; k++)
+    {
+        if (rng() % 3 == 0)
+        {
+            append_text(s, rng);
+        }
+        else
+        {
+            append_packet(s, rng);
+        }
+    }
+    if (rng() % 8 == 0)
+    {
+        // noise alone, heavy on the bytes that matter
+        for (unsigned k = rng() % 300; k > 0; k--)
+        {
+            s.push_back(random_byte(rng));
+        }
+    }
+    if (rng() % 4 != 0)
+    {
+        damage(s, rng);
+    }
+    return s;
+}
+
+#endif // C0DE_LIBFUZZER
+
+} // namespace
+
+#ifdef C0DE_LIBFUZZER
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size)
+{
+    // the last byte picks max_payload, so the small limits get hit too
+    const std::size_t max_payload = (size > 0 && (data[size - 1] & 1)) ? data[size - 1] : 4096;
+    std::mt19937 rng(static_cast<uint32_t>(size));
+    if (!check_all(data, size, max_payload, rng))
+    {
+        std::abort();
+    }
+    return 0;
+}
+
+#else
+
+int main(int argc, char** argv)
+{
+    unsigned runs = 5000;
+    uint32_t seed = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+        {
+            runs = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: c0de_framer_fuzz [--runs N] [--seed N]\n");
+            return 2;
+        }
+    }
+
+    std::mt19937 rng(seed);
+    c0de::framer_stats total;
+    for (unsigned r = 0; r < runs; r++)
+    {
+        const std::vector<uint8_t> s = random_stream(rng);
+        const std::size_t max_payload = (rng() % 4 == 0) ? 16 + rng() % 200 : 4096;
+        if (!check_all(s.data(), s.size(), max_payload, rng))
+        {
+            std::fprintf(stderr, "run %u (--seed %u) FAILED\n", r, seed);
+            return 1;
+        }
+        const c0de::framer_stats s_stats = model(s.data(), s.size(), max_payload).stats;
+        total.bytes += s_stats.bytes;
+        total.packets += s_stats.packets;
+        total.crc_errors += s_stats.crc_errors;
+        total.crc_fixed += s_stats.crc_fixed;
+        total.oversize += s_stats.oversize;
+        total.text_bytes += s_stats.text_bytes;
+    }
+    std::printf("%u streams, %llu bytes: %llu packets (%llu after the \\r\\n fix), %llu crc errors, %llu oversize "
+                "headers, %llu text bytes; framed the same in every chunking\n",
+                runs, (unsigned long long)total.bytes, (unsigned long long)total.packets,
+                (unsigned long long)total.crc_fixed, (unsigned long long)total.crc_errors,
+                (unsigned long long)total.oversize, (unsigned long long)total.text_bytes);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,413 @@
+// c0de_framing_bench: the 0xc0 0xde sync word framing against COBS framing
+// (cobs.h, PacketWriter::set_framing) on streams damaged the ways the link
+// damages them: how many packets each gets back whole, and how fast
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/c0de_framing_bench.cpp -o c0de_framing_bench
+//
+//   c0de_framing_bench [options] [capture]...
+//     --packets N       synthetic packets when no capture is given
+//                       (default 100000)
+//     --chunk N         bytes per notification for the lost notification
+//                       rows (default 20, BLE's smallest)
+//     --repeat N        decodes of each stream for the timing (default 5)
+//     --seed N          (default 1)
+//
+// Packets are the captures' own, or synthetic ones sized like the brain's
+// (changes, full frames split at 104 bytes, vision snapshots), with a
+// console line every 50 packets. Both streams go through what the brain's
+// stdout does to them: a write ending in 0x0a ends in 0x0d 0x0a. Then per
+// row, with the same random damage to both:
+//   bit errors    every bit flipped with the given probability
+//   lost notif.   whole --chunk byte notifications dropped
+//   inserted      a random byte inserted with the given probability per byte
+// and for each framing:
+//   lost       packets that didn't come out exactly as sent, and in percent
+//   false      packets that passed the CRC but aren't any that was sent
+//   MB/s       decoding the damaged stream, wire bytes per second
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "c0de_stream.h"
+#include "cobs.h"
+
+namespace
+{
+
+struct packet
+{
+    uint8_t cmd;
+    std::vector<uint8_t> payload;
+};
+
+// packet_framer sink that keeps every packet
+struct packet_collector
+{
+    std::vector<packet>& packets;
+
+    void on_text(const char*, std::size_t) {}
+
+    void on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        packets.push_back(packet{cmd, std::vector<uint8_t>(payload, payload + len)});
+    }
+};
+
+// Payload bytes like logged values: mostly small numbers, so plenty of
+// 0x00, and some noise
+void fill_values(std::mt19937& rng, uint8_t* p, std::size_t n)
+{
+    for (std::size_t i = 0; i < n; i++)
+    {
+        const uint32_t r = rng();
+        p[i] = ((r & 7) < 2) ? 0 : static_cast<uint8_t>(r >> 8);
+    }
+}
+
+std::vector<packet> synthetic_packets(std::size_t count, std::mt19937& rng)
+{
+    std::vector<packet> packets(count);
+    for (std::size_t i = 0; i < count; i++)
+    {
+        packet& p = packets[i];
+        const uint32_t kind = rng() % 10;
+        std::size_t len;
+        if (kind < 6)
+        {
+            p.cmd = 0x43;
+            len = 8 + rng() % 32;
+        }
+        else if (kind < 9)
+        {
+            p.cmd = 0x44;
+            len = 60 + rng() % 38;
+        }
+        else
+        {
+            p.cmd = 0x49;
+            len = 150 + rng() % 220;
+        }
+        p.payload.resize(len);
+        fill_values(rng, p.payload.data(), len);
+    }
+    return packets;
+}
+
+// Packets that start with a u32 index can be told apart; the payload's
+// first 4 bytes are overwritten with it
+void number(std::vector<packet>& packets)
+{
+    for (std::size_t i = 0; i < packets.size(); i++)
+    {
+        std::vector<uint8_t>& p = packets[i].payload;
+        if (p.size() < 4)
+        {
+            p.resize(4);
+        }
+        p[0] = static_cast<uint8_t>(i >> 24);
+        p[1] = static_cast<uint8_t>(i >> 16);
+        p[2] = static_cast<uint8_t>(i >> 8);
+        p[3] = static_cast<uint8_t>(i);
+    }
+}
+
+// The packet as the brain builds it, 0xc0 0xde first
+void build(const packet& p, std::vector<uint8_t>& out)
+{
+    out.clear();
+    out.push_back(c0de::sync0);
+    out.push_back(c0de::sync1);
+    out.push_back(p.cmd);
+    out.push_back(static_cast<uint8_t>(0x80 | (p.payload.size() >> 8)));
+    out.push_back(static_cast<uint8_t>(p.payload.size()));
+    out.insert(out.end(), p.payload.begin(), p.payload.end());
+    const uint16_t crc = crc16(out.data(), out.size());
+    out.push_back(static_cast<uint8_t>(crc >> 8));
+    out.push_back(static_cast<uint8_t>(crc));
+}
+
+// One fwrite through the brain's stdout
+void write_out(std::vector<uint8_t>& stream, const uint8_t* p, std::size_t n)
+{
+    if ((n > 0) && (p[n - 1] == c0de::crc_lf))
+    {
+        stream.insert(stream.end(), p, p + n - 1);
+        stream.push_back(c0de::crc_cr);
+        stream.push_back(c0de::crc_lf);
+    }
+    else
+    {
+        stream.insert(stream.end(), p, p + n);
+    }
+}
+
+void build_streams(const std::vector<packet>& packets, std::vector<uint8_t>& sync_word, std::vector<uint8_t>& cobs)
+{
+    std::vector<uint8_t> buf;
+    for (std::size_t i = 0; i < packets.size(); i++)
+    {
+        build(packets[i], buf);
+        write_out(sync_word, buf.data(), buf.size());
+        const std::size_t n = buf.size();
+        buf.resize(n + cobs_max_overhead(n));
+        write_out(cobs, buf.data(), cobs_encode_in_place(buf.data(), n));
+        if (i % 50 == 49)
+        {
+            char line[32];
+            const int len = std::snprintf(line, sizeof(line), "console line %zu\n", i);
+            write_out(sync_word, reinterpret_cast<const uint8_t*>(line), len);
+            write_out(cobs, reinterpret_cast<const uint8_t*>(line), len);
+        }
+    }
+}
+
+enum class damage
+{
+    none,
+    bit_errors,
+    lost_chunks,
+    inserted,
+};
+
+struct scenario
+{
+    const char* name;
+    damage kind;
+    double rate;
+};
+
+std::vector<uint8_t> apply(const std::vector<uint8_t>& in, const scenario& s, std::size_t chunk, uint32_t seed)
+{
+    std::mt19937_64 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    std::vector<uint8_t> out;
+    out.reserve(in.size() + in.size() / 16);
+    switch (s.kind)
+    {
+        case damage::none:
+            out = in;
+            break;
+        case damage::bit_errors:
+        {
+            out = in;
+            // gaps between flipped bits are geometric
+            std::geometric_distribution<uint64_t> gap(s.rate);
+            for (uint64_t bit = gap(rng); bit < 8 * out.size(); bit += 1 + gap(rng))
+            {
+                out[bit / 8] ^= static_cast<uint8_t>(1u << (bit % 8));
+            }
+            break;
+        }
+        case damage::lost_chunks:
+            for (std::size_t i = 0; i < in.size(); i += chunk)
+            {
+                if (uniform(rng) >= s.rate)
+                {
+                    out.insert(out.end(), in.begin() + i, in.begin() + std::min(in.size(), i + chunk));
+                }
+            }
+            break;
+        case damage::inserted:
+            for (uint8_t b : in)
+            {
+                if (uniform(rng) < s.rate)
+                {
+                    out.push_back(static_cast<uint8_t>(rng()));
+                }
+                out.push_back(b);
+            }
+            break;
+    }
+    return out;
+}
+
+// Sink that checks packets off against the ones sent
+struct packet_checker
+{
+    const std::vector<packet>& sent;
+    std::vector<uint8_t> seen;
+    uint64_t whole = 0;
+    uint64_t false_packets = 0;
+
+    explicit packet_checker(const std::vector<packet>& packets)
+        : sent(packets)
+        , seen(packets.size(), 0)
+    {}
+
+    void on_text(const char*, std::size_t) {}
+
+    void on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        if (len < 4)
+        {
+            false_packets++;
+            return;
+        }
+        const uint32_t index = static_cast<uint32_t>(c0de::read_be(payload, 4));
+        if ((index >= sent.size()) || (sent[index].cmd != cmd) || (sent[index].payload.size() != len)
+            || (std::memcmp(sent[index].payload.data(), payload, len) != 0))
+        {
+            false_packets++;
+            return;
+        }
+        if (!seen[index])
+        {
+            seen[index] = 1;
+            whole++;
+        }
+    }
+};
+
+struct result
+{
+    uint64_t whole = 0;
+    uint64_t false_packets = 0;
+    uint64_t crc_errors = 0;
+    double mb_per_s = 0;
+};
+
+template<typename Framer>
+result decode(const std::vector<uint8_t>& stream, const std::vector<packet>& packets, int repeat)
+{
+    constexpr std::size_t read_size = 1 << 16;
+    result r;
+    double best = 0;
+    for (int rep = 0; rep < repeat; rep++)
+    {
+        Framer framer(4096);
+        packet_checker checker(packets);
+        const auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < stream.size(); i += read_size)
+        {
+            framer.feed(stream.data() + i, std::min(read_size, stream.size() - i), checker);
+        }
+        framer.finish(checker);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double mb_per_s = seconds > 0 ? stream.size() / seconds / 1e6 : 0;
+        best = std::max(best, mb_per_s);
+        r.whole = checker.whole;
+        r.false_packets = checker.false_packets;
+        r.crc_errors = framer.stats().crc_errors;
+    }
+    r.mb_per_s = best;
+    return r;
+}
+
+void usage(void)
+{
+    std::fprintf(stderr,
+        "usage: c0de_framing_bench [--packets N] [--chunk N] [--repeat N] [--seed N] [capture]...\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::size_t count = 100000;
+    std::size_t chunk = 20;
+    int repeat = 5;
+    uint32_t seed = 1;
+    std::vector<const char*> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--packets" && has_value)
+        {
+            count = std::strtoul(argv[++i], nullptr, 10);
+        }
+        else if (arg == "--chunk" && has_value)
+        {
+            chunk = std::max<std::size_t>(1, std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--repeat" && has_value)
+        {
+            repeat = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (arg == "--seed" && has_value)
+        {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!arg.empty() && arg[0] == '-')
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+        }
+    }
+
+    std::mt19937 rng(seed);
+    std::vector<packet> packets;
+    if (inputs.empty())
+    {
+        packets = synthetic_packets(count, rng);
+    }
+    for (const char* path : inputs)
+    {
+        FILE* f = std::fopen(path, "rb");
+        if (f == nullptr)
+        {
+            std::perror(path);
+            return 1;
+        }
+        c0de::packet_framer framer;
+        packet_collector collector{packets};
+        uint8_t buf[65536];
+        std::size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+        {
+            framer.feed(buf, n, collector);
+        }
+        framer.finish(collector);
+        std::fclose(f);
+    }
+    if (packets.empty())
+    {
+        std::fprintf(stderr, "c0de_framing_bench: no packets\n");
+        return 1;
+    }
+    number(packets);
+
+    std::vector<uint8_t> sync_word;
+    std::vector<uint8_t> cobs;
+    build_streams(packets, sync_word, cobs);
+    std::printf("%zu packets: sync word %zu bytes, COBS %zu bytes (%+.2f%%)\n\n", packets.size(), sync_word.size(),
+                cobs.size(), 100.0 * (static_cast<double>(cobs.size()) - sync_word.size()) / sync_word.size());
+
+    const scenario scenarios[] = {
+        { "clean", damage::none, 0 },
+        { "bit errors 1e-6", damage::bit_errors, 1e-6 },
+        { "bit errors 1e-5", damage::bit_errors, 1e-5 },
+        { "bit errors 1e-4", damage::bit_errors, 1e-4 },
+        { "lost notif. 0.1%", damage::lost_chunks, 0.001 },
+        { "lost notif. 1%", damage::lost_chunks, 0.01 },
+        { "lost notif. 5%", damage::lost_chunks, 0.05 },
+        { "inserted 1e-4", damage::inserted, 1e-4 },
+        { "inserted 1e-3", damage::inserted, 1e-3 },
+    };
+    std::printf("%-18s | %27s | %27s\n", "", "sync word", "COBS");
+    std::printf("%-18s | %8s %6s %5s %6s | %8s %6s %5s %6s\n", "damage", "lost", "lost%", "false", "MB/s",
+                "lost", "lost%", "false", "MB/s");
+    const double total = static_cast<double>(packets.size());
+    for (const scenario& s : scenarios)
+    {
+        const result a = decode<c0de::packet_framer>(apply(sync_word, s, chunk, seed), packets, repeat);
+        const result b = decode<c0de::cobs_framer>(apply(cobs, s, chunk, seed), packets, repeat);
+        std::printf("%-18s | %8llu %6.3f %5llu %6.0f | %8llu %6.3f %5llu %6.0f\n", s.name,
+                    static_cast<unsigned long long>(packets.size() - a.whole), 100.0 * (total - a.whole) / total,
+                    static_cast<unsigned long long>(a.false_packets), a.mb_per_s,
+                    static_cast<unsigned long long>(packets.size() - b.whole), 100.0 * (total - b.whole) / total,
+                    static_cast<unsigned long long>(b.false_packets), b.mb_per_s);
+    }
+    return 0;
+}
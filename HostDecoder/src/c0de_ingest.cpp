@@ -0,0 +1,822 @@
+// c0de_ingest: records many brains at once, e.g. every robot in the lab
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_ingest.cpp -o c0de_ingest
+//       -pthread
+//
+//   c0de_ingest [options] PORT...
+//     --out DIR         one CSV per robot, DIR/robotNN.csv, as packet,
+//                       time_us,code,name,value rows (c0de_decode --csv)
+//     --workers N       threads writing the recordings (default 2)
+//     --stats MS        print the counters every MS (default 5000, 0 only
+//                       at the end)
+//     --duration MS     stop after MS; otherwise at Ctrl-C or when every
+//                       port has closed
+//     --cobs            the brains use COBS framing
+//     --sim N           N simulated robots of our own, each a
+//                       StructuredLogger on a pty, instead of PORTs
+//     --rate HZ         their tick rate (default 50)
+//
+// One thread reads every port, through epoll, and decodes each with a
+// stream_decoder of its own; the decoders share one schema_cache, so a
+// robot running the same program as one already seen decodes from its
+// first packet. A robot whose data arrives with an unknown schema is sent
+// a format request, at most once a second. Decoded values go to the
+// workers through lock-free rings, one per worker, robot i to worker
+// i % N, so every robot's rows stay in order without a lock.
+//
+// A robot whose worker's ring is full has its values held back, up to
+// max_backlog of them, and its port is left unread until they are
+// queued: the kernel's buffer, then the brain's, takes the backpressure,
+// rather than the robot's neighbours. Values beyond that are dropped and
+// counted.
+//
+// Counters per robot:
+//   bytes/s   read from the port
+//   pkts/s    valid packets
+//   values/s  decoded
+//   crc       packets with a bad CRC
+//   lost      packets missing from extended header sequence numbers
+//   unknown   packets skipped for a schema not seen yet
+//   fmt req   format requests sent
+//   paused    times the port was left unread for a full ring
+//   dropped   values lost to a full backlog
+// The last line has the totals and the share of a core the reading
+// thread took.
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "vex.h"
+
+// The simulated robots' loggers write to whichever robot's pty is being
+// ticked
+struct sim_sink
+{
+    static int& fd(void)
+    {
+        static int fd = -1;
+        return fd;
+    }
+
+    // bytes the pty had no room for, as a full radio link loses them
+    static uint64_t& lost(void)
+    {
+        static uint64_t lost = 0;
+        return lost;
+    }
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        const ssize_t n = ::write(fd(), data, len);
+        lost() += len - (n > 0 ? static_cast<std::size_t>(n) : 0);
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK sim_sink
+#include "structured_logger.h"
+#include "c0de_stream.h"
+
+namespace
+{
+
+constexpr std::size_t ring_capacity = 1 << 14;
+constexpr std::size_t max_backlog = 1 << 16;
+constexpr int64_t format_request_interval_us = 1000000;
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_sigint(int)
+{
+    g_stop = 1;
+}
+
+int64_t host_time_us(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t thread_cpu_us(void)
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+// Serial ports and ptys default to a line discipline that turns 0x0d into
+// 0x0a, swallows 0x03 and 0x11/0x13 and echoes; packets need raw bytes
+void make_raw(int fd)
+{
+    if (isatty(fd))
+    {
+        termios tio;
+        if (tcgetattr(fd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+}
+
+// One decoded value on its way to a worker. Names are interned by the
+// reading thread and never freed, so a worker can hold on to one.
+struct sample
+{
+    const std::string* name;
+    uint64_t packet;
+    int64_t time_us;
+    double value;
+    uint16_t code;
+    uint16_t robot;
+};
+
+using sample_ring = spsc_ring<sample, ring_capacity>;
+
+// stdio with a big buffer and to_chars number formatting
+class output_file
+{
+private:
+    FILE* m_file = nullptr;
+
+public:
+    bool open(const std::string& path)
+    {
+        m_file = std::fopen(path.c_str(), "wb");
+        if (m_file != nullptr)
+        {
+            std::setvbuf(m_file, nullptr, _IOFBF, 1 << 16);
+        }
+        return m_file != nullptr;
+    }
+
+    ~output_file()
+    {
+        if (m_file != nullptr)
+        {
+            std::fclose(m_file);
+        }
+    }
+
+    explicit operator bool() const { return m_file != nullptr; }
+
+    void write(const void* data, std::size_t len) { std::fwrite(data, 1, len, m_file); }
+    void put(char c) { std::fputc(c, m_file); }
+    void str(const std::string& s) { write(s.data(), s.size()); }
+
+    template<typename T>
+    void num(T value)
+    {
+        char buf[32];
+        const std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value);
+        write(buf, r.ptr - buf);
+    }
+};
+
+// Writes the rows of the robots it was given, in the order they came
+class worker
+{
+private:
+    sample_ring m_ring;
+    std::thread m_thread;
+    std::atomic<bool> m_done{false};
+    std::atomic<uint64_t> m_rows{0};
+    int64_t m_cpu_us = 0;
+
+    void run(std::vector<std::unique_ptr<output_file>>* files)
+    {
+        sample s;
+        while (true)
+        {
+            if (!m_ring.pop(s))
+            {
+                if (m_done.load(std::memory_order_acquire) && m_ring.empty())
+                {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            output_file* const out = (*files)[s.robot].get();
+            if (out != nullptr)
+            {
+                out->num(s.packet);
+                out->put(',');
+                if (s.time_us >= 0)
+                {
+                    out->num(s.time_us);
+                }
+                out->put(',');
+                out->num(s.code);
+                out->put(',');
+                out->str(*s.name);
+                out->put(',');
+                out->num(s.value);
+                out->put('\n');
+            }
+            m_rows.fetch_add(1, std::memory_order_relaxed);
+        }
+        m_cpu_us = thread_cpu_us();
+    }
+
+public:
+    sample_ring& ring() { return m_ring; }
+    uint64_t rows() const { return m_rows.load(std::memory_order_relaxed); }
+    // after stop()
+    int64_t cpu_us() const { return m_cpu_us; }
+
+    void start(std::vector<std::unique_ptr<output_file>>& files)
+    {
+        m_thread = std::thread(&worker::run, this, &files);
+    }
+
+    // Write out what's queued and finish
+    void stop(void)
+    {
+        m_done.store(true, std::memory_order_release);
+        if (m_thread.joinable())
+        {
+            m_thread.join();
+        }
+    }
+};
+
+struct stream_counters
+{
+    uint64_t values = 0;
+    uint64_t format_requests = 0;
+    uint64_t paused = 0;
+    uint64_t dropped = 0;
+};
+
+// One port: its decoder, and the values the worker's ring had no room for
+class stream : public c0de::stream_handler
+{
+public:
+    std::string port;
+    int fd = -1;
+    uint16_t index = 0;
+    bool open = false;
+    bool paused = false;
+    c0de::stream_decoder decoder;
+    stream_counters counters;
+    std::vector<sample> backlog;
+
+private:
+    sample_ring& m_ring;
+    std::set<std::string>& m_names;
+    // interned names by channel_format::value_index
+    std::vector<const std::string*> m_series_names;
+    int64_t m_last_format_request_us = -format_request_interval_us;
+
+public:
+    stream(const std::string& port_, uint16_t index_, sample_ring& ring, std::set<std::string>& names,
+           c0de::schema_cache& cache)
+        : port(port_)
+        , index(index_)
+        , decoder(*this)
+        , m_ring(ring)
+        , m_names(names)
+    {
+        decoder.set_schema_cache(cache);
+    }
+
+    // Queue what was held back; true once nothing is
+    bool drain_backlog(void)
+    {
+        std::size_t n = 0;
+        while (n < backlog.size() && m_ring.push(backlog[n]))
+        {
+            n++;
+        }
+        backlog.erase(backlog.begin(), backlog.begin() + n);
+        return backlog.empty();
+    }
+
+    void on_schema(uint16_t) override
+    {
+        m_series_names.clear();
+    }
+
+    void on_unknown_schema(uint16_t) override
+    {
+        const int64_t now = host_time_us();
+        if (now - m_last_format_request_us < format_request_interval_us)
+        {
+            return;
+        }
+        m_last_format_request_us = now;
+        std::vector<uint8_t> command;
+        pack_host_command(command, format_request_command, nullptr, 0);
+        if (::write(fd, command.data(), command.size()) == static_cast<ssize_t>(command.size()))
+        {
+            counters.format_requests++;
+        }
+    }
+
+    void on_value(uint64_t packet, int64_t time_us, uint16_t code, const c0de::channel_format& ch, double value) override
+    {
+        if (ch.value_index >= m_series_names.size())
+        {
+            m_series_names.resize(ch.value_index + 1, nullptr);
+        }
+        const std::string*& name = m_series_names[ch.value_index];
+        if (name == nullptr || *name != ch.name)
+        {
+            name = &*m_names.insert(ch.name).first;
+        }
+        counters.values++;
+        const sample s = { name, packet, time_us, value, code, index };
+        if (backlog.empty() && m_ring.push(s))
+        {
+            return;
+        }
+        if (backlog.size() < max_backlog)
+        {
+            backlog.push_back(s);
+        }
+        else
+        {
+            counters.dropped++;
+        }
+    }
+};
+
+// ------------------------------------------------------------
+// Simulated robots
+// ------------------------------------------------------------
+
+// What a drive base might log: pose, motors, battery; every third robot
+// runs a program with one more channel, so there are two schemas
+class sim_robot
+{
+public:
+    int master = -1;
+    std::string port;
+    StructuredLogger logger;
+
+private:
+    float m_t = 0;
+    float m_phase = 0;
+    int32_t m_ticks = 0;
+
+public:
+    explicit sim_robot(int index)
+        : m_phase(index * 0.37f)
+    {
+        logger.add(LOGGER_NAME("x"), [this]() -> float { return 60 * std::cos(m_t * 0.2f + m_phase); });
+        logger.add(LOGGER_NAME("y"), [this]() -> float { return 60 * std::sin(m_t * 0.2f + m_phase); });
+        logger.add(LOGGER_NAME("heading"), [this]() -> float { return std::fmod(m_t * 11.5f + m_phase * 57, 360.f); });
+        for (int m = 0; m < 4; m++)
+        {
+            logger.add("motor" + std::to_string(m) + ".rpm",
+                       [this, m]() -> int16_t { return static_cast<int16_t>(400 * std::sin(m_t + m)); });
+            logger.add("motor" + std::to_string(m) + ".amps",
+                       [this, m]() -> float { return 1.5f + std::sin(m_t * 3 + m) * 0.5f; }, true);
+        }
+        logger.add(LOGGER_NAME("battery"), [this]() -> uint8_t { return static_cast<uint8_t>(100 - m_ticks / 3000 % 100); });
+        logger.add(LOGGER_NAME("ticks"), [this]() -> int32_t { return m_ticks; });
+        if (index % 3 == 2)
+        {
+            logger.add(LOGGER_NAME("intake.rpm"), [this]() -> int16_t { return static_cast<int16_t>(m_ticks % 600); });
+        }
+        logger.set_extended_header(true);
+        logger.set_keyframe_interval(50);
+    }
+
+    ~sim_robot()
+    {
+        if (master >= 0)
+        {
+            ::close(master);
+        }
+    }
+
+    bool open(void)
+    {
+        master = posix_openpt(O_RDWR | O_NOCTTY);
+        if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+        {
+            return false;
+        }
+        port = ptsname(master);
+        fcntl(master, F_SETFL, fcntl(master, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    void tick(float dt)
+    {
+        // host commands, e.g. format requests
+        uint8_t chunk[256];
+        ssize_t n;
+        while ((n = ::read(master, chunk, sizeof(chunk))) > 0)
+        {
+            vex_host_serial_push(chunk, static_cast<std::size_t>(n));
+        }
+        sim_sink::fd() = master;
+        logger.poll_host_commands();
+        logger.send_structured_changes();
+        m_t += dt;
+        m_ticks++;
+    }
+};
+
+// Ticks every robot at `rate` Hz until `stop`
+void run_sim(std::vector<std::unique_ptr<sim_robot>>* robots, unsigned rate, std::atomic<bool>* stop,
+             int64_t* cpu_us)
+{
+    const auto period = std::chrono::microseconds(1000000 / rate);
+    auto next = std::chrono::steady_clock::now();
+    while (!stop->load(std::memory_order_relaxed))
+    {
+        for (auto& robot : *robots)
+        {
+            robot->tick(1.0f / rate);
+        }
+        next += period;
+        std::this_thread::sleep_until(next);
+    }
+    *cpu_us = thread_cpu_us();
+}
+
+// ------------------------------------------------------------
+// Counters
+// ------------------------------------------------------------
+
+struct stream_totals
+{
+    uint64_t bytes = 0;
+    uint64_t packets = 0;
+    uint64_t values = 0;
+    uint64_t crc_errors = 0;
+    uint64_t lost = 0;
+    uint64_t unknown = 0;
+    uint64_t format_requests = 0;
+    uint64_t paused = 0;
+    uint64_t dropped = 0;
+
+    static stream_totals of(const stream& s)
+    {
+        stream_totals t;
+        t.bytes = s.decoder.framing().bytes;
+        t.packets = s.decoder.framing().packets;
+        t.values = s.counters.values;
+        t.crc_errors = s.decoder.framing().crc_errors;
+        t.lost = s.decoder.stats().lost_packets;
+        t.unknown = s.decoder.stats().unknown_schemas;
+        t.format_requests = s.counters.format_requests;
+        t.paused = s.counters.paused;
+        t.dropped = s.counters.dropped;
+        return t;
+    }
+
+    void add(const stream_totals& t)
+    {
+        bytes += t.bytes;
+        packets += t.packets;
+        values += t.values;
+        crc_errors += t.crc_errors;
+        lost += t.lost;
+        unknown += t.unknown;
+        format_requests += t.format_requests;
+        paused += t.paused;
+        dropped += t.dropped;
+    }
+};
+
+void print_row(const char* name, const stream_totals& now, const stream_totals& before, double seconds)
+{
+    std::fprintf(stderr, "%-14s %9.0f %7.0f %8.0f %5llu %5llu %7llu %7llu %6llu %8llu\n", name,
+                 (now.bytes - before.bytes) / seconds, (now.packets - before.packets) / seconds,
+                 (now.values - before.values) / seconds, static_cast<unsigned long long>(now.crc_errors),
+                 static_cast<unsigned long long>(now.lost), static_cast<unsigned long long>(now.unknown),
+                 static_cast<unsigned long long>(now.format_requests), static_cast<unsigned long long>(now.paused),
+                 static_cast<unsigned long long>(now.dropped));
+}
+
+// Rates since the previous call, counts since the start
+class stats_printer
+{
+private:
+    std::vector<stream_totals> m_before;
+    int64_t m_before_us = host_time_us();
+    int64_t m_before_cpu_us = thread_cpu_us();
+
+public:
+    void print(const std::vector<std::unique_ptr<stream>>& streams, const std::vector<std::unique_ptr<worker>>& workers)
+    {
+        const int64_t now_us = host_time_us();
+        const int64_t cpu_us = thread_cpu_us();
+        const double seconds = std::max<int64_t>(now_us - m_before_us, 1) / 1e6;
+        m_before.resize(streams.size());
+        std::fprintf(stderr, "%-14s %9s %7s %8s %5s %5s %7s %7s %6s %8s\n", "robot", "bytes/s", "pkts/s", "values/s",
+                     "crc", "lost", "unknown", "fmt req", "paused", "dropped");
+        stream_totals total;
+        stream_totals total_before;
+        for (std::size_t i = 0; i < streams.size(); i++)
+        {
+            const stream_totals t = stream_totals::of(*streams[i]);
+            char name[32];
+            std::snprintf(name, sizeof(name), "robot%02u%s", static_cast<unsigned>(i), streams[i]->open ? "" : " (closed)");
+            print_row(name, t, m_before[i], seconds);
+            total.add(t);
+            total_before.add(m_before[i]);
+            m_before[i] = t;
+        }
+        print_row("total", total, total_before, seconds);
+        uint64_t rows = 0;
+        for (const auto& w : workers)
+        {
+            rows += w->rows();
+        }
+        std::fprintf(stderr, "reading thread %.1f%% of a core, %llu rows written\n\n",
+                     100.0 * (cpu_us - m_before_cpu_us) / (now_us - m_before_us + 1),
+                     static_cast<unsigned long long>(rows));
+        m_before_us = now_us;
+        m_before_cpu_us = cpu_us;
+    }
+};
+
+void usage(void)
+{
+    std::fprintf(stderr,
+        "usage: c0de_ingest [--out DIR] [--workers N] [--stats MS] [--duration MS] [--cobs]\n"
+        "                   PORT... | --sim N [--rate HZ]\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> ports;
+    const char* out_dir = nullptr;
+    unsigned worker_count = 2;
+    unsigned stats_ms = 5000;
+    unsigned duration_ms = 0;
+    bool cobs = false;
+    unsigned sim_count = 0;
+    unsigned sim_rate = 50;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--out" && has_value)
+        {
+            out_dir = argv[++i];
+        }
+        else if (arg == "--workers" && has_value)
+        {
+            worker_count = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--stats" && has_value)
+        {
+            stats_ms = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--duration" && has_value)
+        {
+            duration_ms = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--cobs")
+        {
+            cobs = true;
+        }
+        else if (arg == "--sim" && has_value)
+        {
+            sim_count = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--rate" && has_value)
+        {
+            sim_rate = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!arg.empty() && arg[0] != '-')
+        {
+            ports.push_back(arg);
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if ((ports.empty() == (sim_count == 0)) || (worker_count == 0) || (sim_rate == 0) || (sim_rate > 1000))
+    {
+        usage();
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<sim_robot>> robots;
+    for (unsigned i = 0; i < sim_count; i++)
+    {
+        robots.emplace_back(new sim_robot(static_cast<int>(i)));
+        if (!robots.back()->open())
+        {
+            std::perror("posix_openpt");
+            return 1;
+        }
+        ports.push_back(robots.back()->port);
+    }
+    if (ports.size() > 0xffff)
+    {
+        std::fprintf(stderr, "c0de_ingest: too many ports\n");
+        return 1;
+    }
+
+    std::vector<std::unique_ptr<worker>> workers;
+    for (unsigned i = 0; i < worker_count; i++)
+    {
+        workers.emplace_back(new worker());
+    }
+
+    const int epoll_fd = epoll_create1(0);
+    if (epoll_fd < 0)
+    {
+        std::perror("epoll_create1");
+        return 1;
+    }
+    c0de::schema_cache schemas;
+    std::set<std::string> names;
+    std::vector<std::unique_ptr<stream>> streams;
+    std::vector<std::unique_ptr<output_file>> files(ports.size());
+    for (std::size_t i = 0; i < ports.size(); i++)
+    {
+        streams.emplace_back(new stream(ports[i], static_cast<uint16_t>(i), workers[i % worker_count]->ring(), names,
+                                        schemas));
+        stream& s = *streams.back();
+        if (cobs)
+        {
+            s.decoder.set_framing(packet_framing::cobs);
+        }
+        s.fd = open(s.port.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (s.fd < 0)
+        {
+            std::perror(s.port.c_str());
+            return 1;
+        }
+        make_raw(s.fd);
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.u32 = static_cast<uint32_t>(i);
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, s.fd, &ev) != 0)
+        {
+            std::perror("epoll_ctl");
+            return 1;
+        }
+        s.open = true;
+        if (out_dir != nullptr)
+        {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/robot%02u.csv", static_cast<unsigned>(i));
+            files[i].reset(new output_file());
+            if (!files[i]->open(out_dir + std::string(name)))
+            {
+                std::perror((out_dir + std::string(name)).c_str());
+                return 1;
+            }
+            files[i]->str("packet,time_us,code,name,value\n");
+        }
+        std::fprintf(stderr, "robot%02u %s\n", static_cast<unsigned>(i), s.port.c_str());
+    }
+    for (auto& w : workers)
+    {
+        w->start(files);
+    }
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigaction(SIGINT, &sa, nullptr);
+
+    std::atomic<bool> sim_stop{false};
+    int64_t sim_cpu_us = 0;
+    std::thread sim;
+    if (!robots.empty())
+    {
+        sim = std::thread(run_sim, &robots, sim_rate, &sim_stop, &sim_cpu_us);
+    }
+
+    const int64_t start_us = host_time_us();
+    const int64_t start_cpu_us = thread_cpu_us();
+    int64_t next_stats_us = start_us + static_cast<int64_t>(stats_ms) * 1000;
+    stats_printer printer;
+    std::size_t open_streams = streams.size();
+    std::vector<epoll_event> events(streams.size());
+    uint8_t chunk[4096];
+    while (!g_stop && open_streams > 0)
+    {
+        const int64_t now = host_time_us();
+        if (duration_ms != 0 && now - start_us >= static_cast<int64_t>(duration_ms) * 1000)
+        {
+            break;
+        }
+        if (stats_ms != 0 && now >= next_stats_us)
+        {
+            printer.print(streams, workers);
+            next_stats_us += static_cast<int64_t>(stats_ms) * 1000;
+        }
+
+        // held back values first; a port is read again once its are queued
+        for (auto& sp : streams)
+        {
+            stream& s = *sp;
+            if (s.paused && s.drain_backlog() && s.open)
+            {
+                epoll_event ev{};
+                ev.events = EPOLLIN;
+                ev.data.u32 = s.index;
+                epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s.fd, &ev);
+                s.paused = false;
+            }
+        }
+
+        // level triggered, one read per ready port per pass, so a busy
+        // robot can't starve the others
+        const int n = epoll_wait(epoll_fd, events.data(), static_cast<int>(events.size()), 10);
+        for (int e = 0; e < n; e++)
+        {
+            stream& s = *streams[events[e].data.u32];
+            const ssize_t len = read(s.fd, chunk, sizeof(chunk));
+            if (len > 0)
+            {
+                s.decoder.feed(chunk, static_cast<std::size_t>(len));
+                if (!s.backlog.empty())
+                {
+                    epoll_event ev{};
+                    ev.events = 0;
+                    ev.data.u32 = s.index;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_MOD, s.fd, &ev);
+                    s.paused = true;
+                    s.counters.paused++;
+                }
+            }
+            else if (len == 0 || (errno != EAGAIN && errno != EINTR))
+            {
+                // unplugged, or the pty's other end closed
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, s.fd, nullptr);
+                s.decoder.finish();
+                s.open = false;
+                open_streams--;
+            }
+        }
+    }
+    const int64_t elapsed_us = host_time_us() - start_us;
+    const int64_t cpu_us = thread_cpu_us() - start_cpu_us;
+
+    sim_stop = true;
+    if (sim.joinable())
+    {
+        sim.join();
+    }
+    // whatever is still held back, now that nothing else is coming
+    for (auto& sp : streams)
+    {
+        while (!sp->drain_backlog())
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    for (auto& w : workers)
+    {
+        w->stop();
+    }
+    printer.print(streams, workers);
+
+    int64_t worker_cpu_us = 0;
+    for (const auto& w : workers)
+    {
+        worker_cpu_us += w->cpu_us();
+    }
+    std::fprintf(stderr, "%.1f s; reading thread %.1f%%, workers %.1f%% of a core\n", elapsed_us / 1e6,
+                 100.0 * cpu_us / elapsed_us, 100.0 * worker_cpu_us / elapsed_us);
+    if (!robots.empty())
+    {
+        std::fprintf(stderr, "simulated robots %.1f%% of a core, %llu bytes lost to full ptys\n",
+                     100.0 * sim_cpu_us / elapsed_us, static_cast<unsigned long long>(sim_sink::lost()));
+    }
+
+    for (auto& sp : streams)
+    {
+        close(sp->fd);
+    }
+    close(epoll_fd);
+    return 0;
+}
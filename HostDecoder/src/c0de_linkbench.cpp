@@ -0,0 +1,551 @@
+// c0de_linkbench: link throughput and latency sweep against a brain running
+// BLEBandwidthTest (see link_bench.h)
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/c0de_linkbench.cpp -o c0de_linkbench
+//
+//   c0de_linkbench [options] PORT
+//     --sizes LIST      bytes per write (default 16,64,104,256,512,1024)
+//     --buffers LIST    stdout buffer sizes, 0 for unbuffered (default
+//                       0,1024,10240)
+//     --flush LIST      flush policies: none, write, tick (default
+//                       write,tick)
+//     --tick MS         brain tick (default 20); 0 writes back to back
+//     --writes N        writes per tick (default 1)
+//     --offered N       bytes/s to offer instead: writes per tick worked
+//                       out for each size, at least 1
+//     --duration MS     length of each run (default 3000)
+//     --csv             one CSV line per run instead of the table
+//
+// Every combination of size, buffer and flush is one run. Per run:
+//   sent      bytes/s fwrite took on the brain
+//   recv      bytes/s of whole blocks arriving, first to last
+//   lost      blocks the brain wrote that never arrived whole, in percent
+//   bad       blocks with a good CRC but the wrong filler
+//   short     writes fwrite took only part of; those blocks are lost
+//   latency   arrival time minus the brain's timestamp, less the run's
+//             smallest, in ms: the delay queues add over the best case,
+//             p50 / p99 / max
+//   fwrite    longest fwrite (with its flush), in ms
+// Arrival is when the host read returned, so latency is no finer than the
+// port's read chunks.
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "c0de_stream.h"
+#include "host_commands.h"
+#include "link_bench.h"
+
+namespace
+{
+
+volatile std::sig_atomic_t g_stop = 0;
+
+void on_sigint(int)
+{
+    g_stop = 1;
+}
+
+int64_t host_time_us(void)
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Serial ports and ptys default to a line discipline that turns 0x0d into
+// 0x0a, swallows 0x03 and 0x11/0x13 and echoes; packets need raw bytes
+void make_raw(int fd)
+{
+    if (isatty(fd))
+    {
+        termios tio;
+        if (tcgetattr(fd, &tio) == 0)
+        {
+            cfmakeraw(&tio);
+            tcsetattr(fd, TCSANOW, &tio);
+        }
+    }
+}
+
+bool write_all(int fd, const uint8_t* data, std::size_t len)
+{
+    while (len > 0)
+    {
+        const ssize_t n = write(fd, data, len);
+        if ((n < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+bool parse_list(const char* s, unsigned long max, std::vector<uint16_t>& values)
+{
+    values.clear();
+    while (*s != '\0')
+    {
+        char* end = nullptr;
+        errno = 0;
+        const unsigned long v = std::strtoul(s, &end, 10);
+        if ((end == s) || ((*end != ',') && (*end != '\0')) || (errno != 0) || (v > max))
+        {
+            std::fprintf(stderr, "c0de_linkbench: bad number in '%s'\n", s);
+            return false;
+        }
+        values.push_back(static_cast<uint16_t>(v));
+        s = (*end == ',') ? end + 1 : end;
+    }
+    return !values.empty();
+}
+
+bool parse_flush_list(const char* s, std::vector<uint8_t>& values)
+{
+    values.clear();
+    std::string list = s;
+    std::size_t start = 0;
+    while (start <= list.size())
+    {
+        const std::size_t comma = std::min(list.find(',', start), list.size());
+        const std::string name = list.substr(start, comma - start);
+        if (name == "none")
+        {
+            values.push_back(link_bench_flush_none);
+        }
+        else if (name == "write")
+        {
+            values.push_back(link_bench_flush_write);
+        }
+        else if (name == "tick")
+        {
+            values.push_back(link_bench_flush_tick);
+        }
+        else
+        {
+            std::fprintf(stderr, "c0de_linkbench: bad flush policy '%s'\n", name.c_str());
+            return false;
+        }
+        start = comma + 1;
+    }
+    return !values.empty();
+}
+
+const char* flush_name(uint8_t flush)
+{
+    switch (flush)
+    {
+        case link_bench_flush_none:
+            return "none";
+        case link_bench_flush_write:
+            return "write";
+        default:
+            return "tick";
+    }
+}
+
+// packet_framer sink for one run: the blocks it sent and its summary
+struct run_sink
+{
+    uint8_t id = 0;
+    uint16_t write_size = 0;
+    int64_t arrival_us = 0; // of the chunk being fed
+
+    std::vector<uint8_t> seen; // by sequence
+    uint64_t blocks = 0;       // distinct, checked out
+    uint64_t bad = 0;
+    uint64_t duplicates = 0;
+    uint64_t stale = 0; // other runs' packets
+    uint64_t bytes = 0; // of blocks, framing included
+    int64_t first_us = -1;
+    int64_t last_us = -1;
+    uint32_t first_brain_us = 0;
+    std::vector<int64_t> delays_us;
+
+    bool done = false;
+    link_bench_result result;
+
+    void on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        if ((len == 0) || (payload[0] != id))
+        {
+            stale++;
+            return;
+        }
+        if (cmd == link_bench_done_command)
+        {
+            done = result.unpack(payload, len);
+            return;
+        }
+        if (cmd != link_bench_block_command)
+        {
+            stale++;
+            return;
+        }
+        if ((len + link_bench_framing_len != write_size) || !link_bench_check_block(payload, len))
+        {
+            bad++;
+            return;
+        }
+        const uint32_t sequence = link_bench_block_sequence(payload);
+        if (sequence >= seen.size())
+        {
+            seen.resize(sequence + 1, 0);
+        }
+        if (seen[sequence])
+        {
+            duplicates++;
+            return;
+        }
+        seen[sequence] = 1;
+        blocks++;
+        bytes += write_size;
+
+        // brain time as an offset from the first block's, so the u32
+        // wrapping doesn't matter over a run
+        const uint32_t brain_us = link_bench_block_time_us(payload);
+        if (first_us < 0)
+        {
+            first_us = arrival_us;
+            first_brain_us = brain_us;
+        }
+        last_us = arrival_us;
+        delays_us.push_back(arrival_us - static_cast<int32_t>(brain_us - first_brain_us));
+    }
+
+    void on_text(const char*, std::size_t) {}
+};
+
+struct run_row
+{
+    link_bench_config config;
+    bool summary = false;
+    uint32_t writes = 0;
+    double offered_bps = 0; // 0 when back to back
+    double sent_bps = 0;
+    double recv_bps = 0;
+    double lost_pct = 0;
+    uint64_t bad = 0;
+    uint32_t short_writes = 0;
+    double p50_ms = 0;
+    double p99_ms = 0;
+    double max_ms = 0;
+    double fwrite_ms = 0;
+};
+
+double percentile_ms(const std::vector<int64_t>& sorted, double p)
+{
+    if (sorted.empty())
+    {
+        return 0;
+    }
+    const std::size_t i = std::min(sorted.size() - 1, static_cast<std::size_t>(p * sorted.size()));
+    return sorted[i] / 1000.0;
+}
+
+run_row summarize(const link_bench_config& config, run_sink& sink)
+{
+    run_row row;
+    row.config = config;
+    row.summary = sink.done;
+    if (config.tick_ms > 0)
+    {
+        row.offered_bps = 1000.0 * config.write_size * config.writes_per_tick / config.tick_ms;
+    }
+    // without the summary, go by the highest sequence that arrived, or what
+    // the pace should have come to
+    row.writes = sink.done ? sink.result.writes : static_cast<uint32_t>(sink.seen.size());
+    if (!sink.done && (config.tick_ms > 0))
+    {
+        row.writes = std::max<uint32_t>(row.writes, static_cast<uint32_t>(config.duration_ms) / config.tick_ms
+                                                        * config.writes_per_tick);
+    }
+    if (sink.done && (sink.result.elapsed_us > 0))
+    {
+        row.sent_bps = 1e6 * sink.result.bytes / sink.result.elapsed_us;
+        row.short_writes = sink.result.short_writes;
+        row.fwrite_ms = sink.result.longest_write_us / 1000.0;
+    }
+    if (sink.last_us > sink.first_us)
+    {
+        // the first block's bytes arrived before first_us
+        row.recv_bps = 1e6 * (sink.bytes - config.write_size) / (sink.last_us - sink.first_us);
+    }
+    if (row.writes > 0)
+    {
+        row.lost_pct = 100.0 * (row.writes - std::min<uint64_t>(sink.blocks, row.writes)) / row.writes;
+    }
+    row.bad = sink.bad;
+
+    std::vector<int64_t>& delays = sink.delays_us;
+    std::sort(delays.begin(), delays.end());
+    if (!delays.empty())
+    {
+        const int64_t best = delays.front();
+        for (int64_t& d : delays)
+        {
+            d -= best;
+        }
+        row.p50_ms = percentile_ms(delays, 0.50);
+        row.p99_ms = percentile_ms(delays, 0.99);
+        row.max_ms = delays.back() / 1000.0;
+    }
+    return row;
+}
+
+void print_header(bool csv)
+{
+    if (csv)
+    {
+        std::printf("run,size,buffer,flush,writes_per_tick,tick_ms,offered_bps,writes,sent_bps,recv_bps,"
+                    "lost_pct,bad,short,p50_ms,p99_ms,max_ms,fwrite_ms,summary\n");
+    }
+    else
+    {
+        std::printf("%4s %5s %6s %5s %7s | %8s %8s %8s | %7s %5s %6s %5s | %7s %7s %7s | %7s\n",
+                    "run", "size", "buffer", "flush", "w/tick", "offered", "sent", "recv",
+                    "writes", "lost%", "bad", "short", "p50 ms", "p99 ms", "max ms", "fwrite");
+    }
+}
+
+void print_row(const run_row& row, bool csv)
+{
+    const link_bench_config& c = row.config;
+    if (csv)
+    {
+        std::printf("%u,%u,%u,%s,%u,%u,%.0f,%u,%.0f,%.0f,%.2f,%llu,%u,%.2f,%.2f,%.2f,%.2f,%d\n",
+                    c.id, c.write_size, c.buffer_size, flush_name(c.flush), c.writes_per_tick, c.tick_ms,
+                    row.offered_bps, row.writes, row.sent_bps, row.recv_bps, row.lost_pct,
+                    static_cast<unsigned long long>(row.bad), row.short_writes, row.p50_ms, row.p99_ms,
+                    row.max_ms, row.fwrite_ms, row.summary ? 1 : 0);
+    }
+    else
+    {
+        char offered[16];
+        if (row.offered_bps > 0)
+        {
+            std::snprintf(offered, sizeof(offered), "%.0f", row.offered_bps);
+        }
+        else
+        {
+            std::snprintf(offered, sizeof(offered), "max");
+        }
+        std::printf("%4u %5u %6u %5s %7u | %8s %8.0f %8.0f | %7u %5.1f %6llu %5u | %7.1f %7.1f %7.1f | %7.1f%s\n",
+                    c.id, c.write_size, c.buffer_size, flush_name(c.flush), c.writes_per_tick,
+                    offered, row.sent_bps, row.recv_bps, row.writes, row.lost_pct,
+                    static_cast<unsigned long long>(row.bad), row.short_writes, row.p50_ms, row.p99_ms,
+                    row.max_ms, row.fwrite_ms, row.summary ? "" : "  (no summary)");
+    }
+    std::fflush(stdout);
+}
+
+// Reads the port until the run's summary arrives, or, past `quiet_from_us`,
+// nothing has for `quiet_us`; the summary is lost along with everything
+// else on a link that can't keep up
+void receive(int fd, c0de::packet_framer& framer, run_sink& sink, int64_t quiet_from_us, int64_t quiet_us)
+{
+    uint8_t chunk[4096];
+    int64_t last_read_us = host_time_us();
+    while (!g_stop && !sink.done)
+    {
+        pollfd pfd = { fd, POLLIN, 0 };
+        if (poll(&pfd, 1, 20) <= 0)
+        {
+            const int64_t now = host_time_us();
+            if ((now >= quiet_from_us) && (now - last_read_us >= quiet_us))
+            {
+                break;
+            }
+            continue;
+        }
+        const ssize_t n = read(fd, chunk, sizeof(chunk));
+        if ((n < 0) && (errno == EINTR))
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        sink.arrival_us = host_time_us();
+        last_read_us = sink.arrival_us;
+        framer.feed(chunk, static_cast<std::size_t>(n), sink);
+    }
+}
+
+void usage(void)
+{
+    std::fprintf(stderr,
+        "usage: c0de_linkbench [--sizes LIST] [--buffers LIST] [--flush LIST] [--tick MS]\n"
+        "                      [--writes N | --offered BYTES_PER_S] [--duration MS] [--csv] PORT\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<uint16_t> sizes = { 16, 64, 104, 256, 512, 1024 };
+    std::vector<uint16_t> buffers = { 0, 1024, 10240 };
+    std::vector<uint8_t> flushes = { link_bench_flush_write, link_bench_flush_tick };
+    uint16_t tick_ms = 20;
+    uint16_t writes = 1;
+    uint32_t offered = 0;
+    uint16_t duration_ms = 3000;
+    bool csv = false;
+    const char* port = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        std::vector<uint16_t> one;
+        if (arg == "--sizes" && has_value)
+        {
+            if (!parse_list(argv[++i], link_bench_max_write, sizes))
+            {
+                return 1;
+            }
+            for (uint16_t size : sizes)
+            {
+                if (size < link_bench_min_write)
+                {
+                    std::fprintf(stderr, "c0de_linkbench: writes are at least %zu bytes\n", link_bench_min_write);
+                    return 1;
+                }
+            }
+        }
+        else if (arg == "--buffers" && has_value)
+        {
+            if (!parse_list(argv[++i], 0xffff, buffers))
+            {
+                return 1;
+            }
+        }
+        else if (arg == "--flush" && has_value)
+        {
+            if (!parse_flush_list(argv[++i], flushes))
+            {
+                return 1;
+            }
+        }
+        else if ((arg == "--tick" || arg == "--writes" || arg == "--duration") && has_value)
+        {
+            if (!parse_list(argv[++i], 0xffff, one) || (one.size() != 1))
+            {
+                return 1;
+            }
+            (arg == "--tick" ? tick_ms : arg == "--writes" ? writes : duration_ms) = one[0];
+        }
+        else if (arg == "--offered" && has_value)
+        {
+            offered = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--csv")
+        {
+            csv = true;
+        }
+        else if ((arg[0] != '-') && (port == nullptr))
+        {
+            port = argv[i];
+        }
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if ((port == nullptr) || (writes == 0) || ((offered > 0) && (tick_ms == 0)))
+    {
+        usage();
+        return 1;
+    }
+
+    const int fd = open(port, O_RDWR | O_NOCTTY);
+    if (fd < 0)
+    {
+        std::perror(port);
+        return 1;
+    }
+    make_raw(fd);
+
+    struct sigaction sa;
+    std::memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_sigint;
+    sigaction(SIGINT, &sa, nullptr);
+
+    // whatever the brain had already sent isn't part of any run
+    c0de::packet_framer framer(link_bench_max_write);
+    {
+        run_sink idle;
+        idle.id = 0xff;
+        receive(fd, framer, idle, host_time_us(), 200000);
+    }
+
+    print_header(csv);
+    uint8_t id = 0;
+    for (uint16_t size : sizes)
+    {
+        for (uint16_t buffer : buffers)
+        {
+            for (uint8_t flush : flushes)
+            {
+                if (g_stop)
+                {
+                    break;
+                }
+                link_bench_config config;
+                config.id = ++id;
+                config.write_size = size;
+                config.tick_ms = tick_ms;
+                config.writes_per_tick = writes;
+                if (offered > 0)
+                {
+                    const uint32_t per_tick = offered * tick_ms / 1000 / size;
+                    config.writes_per_tick = static_cast<uint16_t>(std::max<uint32_t>(1, std::min<uint32_t>(per_tick, 0xffff)));
+                }
+                config.flush = flush;
+                config.buffer_size = buffer;
+                config.duration_ms = duration_ms;
+
+                uint8_t payload[link_bench_config_len];
+                config.pack(payload);
+                std::vector<uint8_t> command;
+                pack_host_command(command, link_bench_command, payload, sizeof(payload));
+                if (!write_all(fd, command.data(), command.size()))
+                {
+                    std::perror(port);
+                    return 1;
+                }
+
+                run_sink sink;
+                sink.id = config.id;
+                sink.write_size = size;
+                receive(fd, framer, sink, host_time_us() + duration_ms * 1000ll, 2000000);
+                print_row(summarize(config, sink), csv);
+            }
+        }
+    }
+    const c0de::framer_stats& stats = framer.stats();
+    std::fprintf(stderr, "%llu bytes, %llu packets, %llu crc errors\n",
+                 static_cast<unsigned long long>(stats.bytes), static_cast<unsigned long long>(stats.packets),
+                 static_cast<unsigned long long>(stats.crc_errors));
+    close(fd);
+    return 0;
+}
@@ -0,0 +1,219 @@
+// c0de_linksim: a timed capture of a simulated link with known loss,
+// queueing and clock skew, to check what c0de_analyze makes of it
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_linksim.cpp
+//       -o c0de_linksim -pthread
+//
+//   c0de_linksim [options] <timed capture to write>
+//     --frames N        0x44 packets, one per tick (default 60000)
+//     --tick-ms N       brain time between them (default 10)
+//     --drop P          share of packets lost (default 0.01)
+//     --queue-ms M      mean of the exponential queueing delay (default 1.5)
+//     --stall P         share of packets held up by a stall (default 0.005)
+//     --stall-ms M      how long a stall adds (default 40)
+//     --ppm N           how much faster the host clock runs (default 50)
+//     --seed N          (default 7)
+//
+// A StructuredLogger with extended headers sends a few channels every tick,
+// its timer starting 300 s before the u32 microsecond count wraps so that
+// the wrap falls in the middle of a default run. Each packet then takes
+// 2 ms plus its queueing delay to arrive, on a host clock with an offset
+// and --ppm of skew, and is written as one read of the capture in arrival
+// order, so a stalled packet arrives after later ones.
+//
+// What c0de_analyze should report is printed: the packets lost, the skew,
+// and the queueing delay percentiles. Its latency is measured above the
+// fastest packets, so it comes out lower by about the smallest delay.
+//
+//   c0de_linksim link.ts && c0de_analyze link.ts
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vex.h"
+
+// Every write the logger makes
+struct capture_sink
+{
+    std::vector<uint8_t> bytes;
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        bytes.insert(bytes.end(), data, data + len);
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK capture_sink
+#include "structured_logger.h"
+
+namespace
+{
+
+unsigned frames = 60000;
+unsigned tick_ms = 10;
+double drop = 0.01;
+double queue_ms = 1.5;
+double stall = 0.005;
+double stall_ms = 40;
+double ppm = 50;
+uint32_t seed = 7;
+
+constexpr char timed_magic[8] = { 'C', '0', 'D', 'E', 'T', 'S', '0', '1' };
+constexpr int64_t brain_start_us = (int64_t(1) << 32) - 300000000;
+constexpr int64_t host_offset_us = 123456789;
+constexpr double base_latency_us = 2000;
+
+struct arrival
+{
+    int64_t host_us;
+    std::vector<uint8_t> bytes;
+};
+
+void put_le(std::vector<uint8_t>& out, uint64_t value, int bytes)
+{
+    for (int i = 0; i < bytes; i++)
+    {
+        out.push_back(static_cast<uint8_t>(value >> (8 * i)));
+    }
+}
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    return sorted[static_cast<std::size_t>(std::llround(p * (sorted.size() - 1)))];
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            frames = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--tick-ms" && i + 1 < argc)
+        {
+            tick_ms = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--drop" && i + 1 < argc)
+        {
+            drop = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--queue-ms" && i + 1 < argc)
+        {
+            queue_ms = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--stall" && i + 1 < argc)
+        {
+            stall = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--stall-ms" && i + 1 < argc)
+        {
+            stall_ms = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--ppm" && i + 1 < argc)
+        {
+            ppm = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg[0] != '-' && path == nullptr)
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = nullptr;
+            break;
+        }
+    }
+    if (path == nullptr || frames == 0 || tick_ms == 0 || queue_ms <= 0)
+    {
+        std::fprintf(stderr,
+                     "usage: c0de_linksim [--frames N] [--tick-ms N] [--drop P] [--queue-ms M] [--stall P]\n"
+                     "                    [--stall-ms M] [--ppm N] [--seed N] <timed capture>\n");
+        return 2;
+    }
+
+    // the brain
+    static StructuredLogger logger;
+    capture_sink& out = logger_sink();
+    static unsigned t = 0;
+    logger.set_extended_header(true);
+    logger.set_tick_period(static_cast<uint16_t>(tick_ms));
+    logger.add("Heading", [] { return static_cast<float>(std::fmod(t * 0.3, 360.0)); });
+    logger.add("Axis A", [] { return static_cast<int8_t>(t % 200 - 100); });
+    logger.add("dist_front", [] { return static_cast<int16_t>(300 + t % 50); });
+    vex_host_clock_us() = brain_start_us;
+    logger.send_data_format();
+
+    // the link
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::exponential_distribution<double> queueing(1 / (queue_ms * 1000));
+    std::vector<arrival> arrivals;
+    std::vector<double> delays;
+    unsigned lost = 0;
+    // the format goes first, as fast as the link goes
+    arrivals.push_back({ host_offset_us + static_cast<int64_t>(base_latency_us), out.bytes });
+    for (t = 0; t < frames; t++)
+    {
+        const int64_t brain_us = brain_start_us + static_cast<int64_t>(t) * tick_ms * 1000;
+        vex_host_clock_us() = brain_us;
+        out.bytes.clear();
+        logger.send_structured_data();
+        if (coin(rng) < drop)
+        {
+            lost++;
+            continue;
+        }
+        double delay = queueing(rng);
+        if (coin(rng) < stall)
+        {
+            delay += stall_ms * 1000;
+        }
+        delays.push_back(delay);
+        const double since_start = static_cast<double>(brain_us - brain_start_us);
+        const int64_t host_us = host_offset_us + static_cast<int64_t>(since_start * (1 + ppm * 1e-6))
+                                + static_cast<int64_t>(base_latency_us + delay);
+        arrivals.push_back({ host_us, out.bytes });
+    }
+    std::stable_sort(arrivals.begin(), arrivals.end(),
+                     [](const arrival& a, const arrival& b) { return a.host_us < b.host_us; });
+
+    std::vector<uint8_t> capture(timed_magic, timed_magic + sizeof(timed_magic));
+    for (const arrival& a : arrivals)
+    {
+        put_le(capture, static_cast<uint64_t>(a.host_us), 8);
+        put_le(capture, a.bytes.size(), 4);
+        capture.insert(capture.end(), a.bytes.begin(), a.bytes.end());
+    }
+    FILE* f = std::fopen(path, "wb");
+    if (f == nullptr || std::fwrite(capture.data(), 1, capture.size(), f) != capture.size() || std::fclose(f) != 0)
+    {
+        std::perror(path);
+        return 1;
+    }
+
+    std::sort(delays.begin(), delays.end());
+    std::printf("%s: %u packets over %.0f s, brain timer wrapping at %.0f s\n", path, frames,
+                frames * tick_ms / 1000.0, -brain_start_us / 1e6 + 4294.967296);
+    std::printf("lost %u, host clock %+.1f ppm\n", lost, ppm);
+    std::printf("queueing delay ms: p50 %.2f p99 %.2f p999 %.2f max %.2f, min %.3f\n", percentile(delays, 0.5) / 1000,
+                percentile(delays, 0.99) / 1000, percentile(delays, 0.999) / 1000, delays.back() / 1000,
+                delays.front() / 1000);
+    return 0;
+}
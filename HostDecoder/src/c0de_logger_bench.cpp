@@ -0,0 +1,726 @@
+// c0de_logger_bench: what the brain's side of the logger (structured_logger.h)
+// costs per call, built for this machine against the vex.h stand-in in
+// HostDecoder/vex_host, with the brain's compiler flags
+//
+//   g++ -std=gnu++11 -O2 -fno-exceptions -fno-rtti -IHostDecoder/vex_host
+//       -IBLETestCpp/include HostDecoder/src/c0de_logger_bench.cpp
+//       -o c0de_logger_bench -pthread
+//
+//   c0de_logger_bench [options]
+//     --sink memory     stdout is copied into a buffer in memory (default)
+//     --sink null       stdout goes to /dev/null, a write() per fflush as on
+//                       the brain
+//     --time-ms N       time per run of each benchmark (default 200)
+//     --repeat N        runs of each benchmark, the fastest counts (default 5)
+//     --golden          print the golden bytes of the current wire format,
+//                       to paste in below after a deliberate change
+//
+// Before timing anything, every benchmarked call is run on fixed inputs
+// and its output checked byte for byte against the golden bytes below;
+// a change to the wire format fails here instead of on the host. Timings
+// are ns per call and bytes out per call on this machine; the brain's
+// Cortex-A9 is some 10 to 20 times slower, and its stdout far slower still.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vex.h"
+#include "structured_logger.h"
+
+namespace
+{
+
+// ------------------------------------------------------------
+// stdout sinks
+// ------------------------------------------------------------
+
+// Where the logger's stdout goes: copied into `ring`, or written to `fd`
+struct output_sink
+{
+    int fd = -1;
+    uint8_t ring[1 << 16];
+    std::size_t pos = 0;
+    uint64_t bytes = 0;
+    bool capturing = false;
+    std::string captured;
+};
+
+output_sink sink;
+
+ssize_t sink_write(void*, const char* data, size_t len)
+{
+    if (sink.capturing)
+    {
+        sink.captured.append(data, len);
+    }
+    sink.bytes += len;
+    if (sink.fd >= 0)
+    {
+        return write(sink.fd, data, len);
+    }
+    for (size_t done = 0; done < len;)
+    {
+        const size_t n = std::min(len - done, sizeof(sink.ring) - sink.pos);
+        std::memcpy(sink.ring + sink.pos, data + done, n);
+        sink.pos = (sink.pos + n) % sizeof(sink.ring);
+        done += n;
+    }
+    return static_cast<ssize_t>(len);
+}
+
+// stdout as a FILE* that writes into `sink`
+FILE* open_sink(void)
+{
+    cookie_io_functions_t io{};
+    io.write = sink_write;
+    return fopencookie(nullptr, "w", io);
+}
+
+// ------------------------------------------------------------
+// The logger and vision data every benchmark and golden check uses
+// ------------------------------------------------------------
+
+using deg16 = fixed_point<int16_t, std::ratio<1, 100>, std::ratio<-180>, std::ratio<180>>;
+
+// what the channels read; step() moves it on like a robot driving an arc
+struct robot_state
+{
+    int frame = 0;
+    float x = 0;
+    float y = 0;
+    float heading = 0;
+    int16_t left = 0;
+    int16_t right = 0;
+    uint8_t battery = 87;
+    uint32_t time_ms = 0;
+    double gyro_rate = 0;
+
+    void step(void)
+    {
+        frame++;
+        x += 0.5f;
+        y += 0.25f;
+        heading = std::fmod(frame * 1.5f, 360.0f) - 180.0f;
+        left = static_cast<int16_t>(200 + (frame % 7));
+        right = static_cast<int16_t>(180 - (frame % 5));
+        battery = static_cast<uint8_t>(87 - frame / 40);
+        time_ms += 20;
+        gyro_rate = (frame % 3) * 0.75;
+    }
+};
+
+robot_state robot;
+
+void add_channels(StructuredLogger& logger)
+{
+    logger.add(LOGGER_NAME("x"), [] { return robot.x; });
+    logger.add(LOGGER_NAME("y"), [] { return robot.y; });
+    logger.add(LOGGER_NAME("Heading"), quantize<deg16>([] { return robot.heading; }));
+    logger.add(LOGGER_NAME("left"), [] { return robot.left; });
+    logger.add(LOGGER_NAME("right"), [] { return robot.right; });
+    logger.add(LOGGER_NAME("battery"), [] { return robot.battery; }, false, 5);
+    logger.add(LOGGER_NAME("time_ms"), [] { return robot.time_ms; });
+    logger.add(LOGGER_NAME("gyro"), [] { return robot.gyro_rate; }, true);
+}
+
+using vision_objects = vex::safearray<vex::aivision::object, AIVISION_MAX_OBJECTS>;
+
+// 3 color blobs, 2 color codes and 3 AprilTags, drifting with `frame`
+void make_objects(vision_objects& objs, int frame)
+{
+    using type = vex::aivision::objectType;
+    const type types[] = {type::colorObject, type::colorObject, type::colorObject, type::codeObject,
+                          type::codeObject, type::tagObject, type::tagObject, type::tagObject};
+    objs.setLength(8);
+    for (int i = 0; i < 8; i++)
+    {
+        vex::aivision::object& obj = objs[i];
+        obj = vex::aivision::object();
+        obj.exists = true;
+        obj.type = types[i];
+        obj.id = i + 1;
+        obj.originX = 20 + 35 * i + frame % 4;
+        obj.originY = 10 + 25 * i;
+        obj.width = 30 + i;
+        obj.height = 20 + 2 * i;
+        obj.centerX = obj.originX + obj.width / 2;
+        obj.centerY = obj.originY + obj.height / 2;
+        obj.score = 60 + 4 * i;
+        obj.angle = 12.5 * i + frame;
+        for (int k = 0; k < 4; k++)
+        {
+            obj.tag.x[k] = obj.originX + ((k == 1 || k == 2) ? 40 : 0);
+            obj.tag.y[k] = obj.originY + ((k >= 2) ? 40 : 0);
+        }
+    }
+}
+
+const int8_t pack_int8_value = -5;
+const uint16_t pack_uint16_value = 0xbeef;
+const int32_t pack_int32_value = -123456;
+const float pack_float_value = 1.5f;
+const double pack_double_value = -2.25;
+const int16_t var_int_values[] = {0, 1, 127, 128, 300, 16383, 16384, 32767};
+
+// ------------------------------------------------------------
+// Golden bytes
+// ------------------------------------------------------------
+
+std::string hex(const std::string& bytes)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string out;
+    for (unsigned char c : bytes)
+    {
+        out += digits[c >> 4];
+        out += digits[c & 0xf];
+    }
+    return out;
+}
+
+template<typename Container>
+std::string to_string(const Container& buf)
+{
+    return std::string(reinterpret_cast<const char*>(buf.data()), buf.size());
+}
+
+// What `func` writes to stdout
+template<typename Func>
+std::string capture(Func func)
+{
+    std::fflush(stdout);
+    sink.captured.clear();
+    sink.capturing = true;
+    func();
+    std::fflush(stdout);
+    sink.capturing = false;
+    return sink.captured;
+}
+
+struct golden_case
+{
+    const char* name;
+    const char* bytes; // hex
+    std::string (*run)(void);
+};
+
+std::string golden_pack_var_int(void)
+{
+    std::array<uint8_t, 64> storage{};
+    static_vector<uint8_t> buf{storage};
+    for (int16_t v : var_int_values)
+    {
+        pack_var_int(buf, v);
+    }
+    return to_string(buf);
+}
+
+std::string golden_pack(void)
+{
+    std::array<uint8_t, 64> storage{};
+    static_vector<uint8_t> buf{storage};
+    pack<int8_t>(buf, pack_int8_value);
+    pack<uint16_t>(buf, pack_uint16_value);
+    pack<int32_t>(buf, pack_int32_value);
+    pack(buf, pack_float_value);
+    pack(buf, pack_double_value);
+    pack(buf, deg16::from(-90.5f));
+    return to_string(buf);
+}
+
+std::string golden_append_crc16(void)
+{
+    std::array<uint8_t, 64> storage{};
+    static_vector<uint8_t> buf{storage};
+    std::array<uint8_t, 64> packet_storage{};
+    packet_buffer packet{packet_storage};
+    for (const char* c = "123456789"; *c; c++)
+    {
+        buf.push_back(static_cast<uint8_t>(*c));
+        packet.push_back(static_cast<uint8_t>(*c));
+    }
+    append_crc16(buf);
+    append_crc16(packet);
+    return to_string(buf) + to_string(packet);
+}
+
+std::string golden_send_data_format(void)
+{
+    robot = robot_state();
+    StructuredLogger logger;
+    add_channels(logger);
+    return capture([&] { logger.send_data_format(); });
+}
+
+// 0x46 ahead of the first frame, then three frames
+std::string golden_send_structured_data(void)
+{
+    robot = robot_state();
+    StructuredLogger logger;
+    add_channels(logger);
+    return capture([&] {
+        for (int i = 0; i < 3; i++)
+        {
+            logger.send_structured_data();
+            robot.step();
+        }
+    });
+}
+
+// keyframe, then changes only
+std::string golden_send_structured_changes(void)
+{
+    robot = robot_state();
+    StructuredLogger logger;
+    add_channels(logger);
+    logger.send_data_format();
+    return capture([&] {
+        for (int i = 0; i < 4; i++)
+        {
+            logger.send_structured_changes();
+            robot.step();
+        }
+    });
+}
+
+std::string golden_send_vision_data(void)
+{
+    StructuredLogger logger;
+    vision_objects objs;
+    make_objects(objs, 0);
+    return capture([&] { logger.send_vision_data(objs); });
+}
+
+std::string golden_pack_vision_object(void)
+{
+    StructuredLogger logger;
+    vision_objects objs;
+    make_objects(objs, 0);
+    std::array<uint8_t, 256> storage{};
+    static_vector<uint8_t> buf{storage};
+    for (int i = 0; i < objs.getLength(); i++)
+    {
+        logger.pack_vision_object(buf, objs[i]);
+    }
+    return to_string(buf);
+}
+
+// keyframe, then a snapshot with every object moved a little
+std::string golden_send_vision_changes(void)
+{
+    StructuredLogger logger;
+    vision_objects objs;
+    return capture([&] {
+        for (int i = 0; i < 2; i++)
+        {
+            make_objects(objs, i);
+            logger.send_vision_changes(objs);
+        }
+    });
+}
+
+// a control queue smaller than the packets the logger builds: what is
+// queued goes out ahead of a packet too big for it, none of it dropped,
+// whether that packet is built (the 0x44) or ready-made (send_bytes())
+std::string golden_oversize_packet(void)
+{
+    robot = robot_state();
+    StructuredLogger logger;
+    add_channels(logger);
+    logger.send_data_format();
+    output_scheduler scheduler;
+    std::array<uint8_t, 64> storage{};
+    scheduler.set_channel(output_channel::control, storage, 0);
+    logger.set_output_scheduler(&scheduler);
+    std::array<uint8_t, 64> big{};
+    for (std::size_t i = 0; i < big.size(); i++)
+    {
+        big[i] = static_cast<uint8_t>(i);
+    }
+    const std::string out = capture([&] {
+        logger.send_bytes(reinterpret_cast<const uint8_t*>("one"), 3);
+        logger.send_bytes(reinterpret_cast<const uint8_t*>("two"), 3);
+        logger.send_structured_data();
+        logger.send_bytes(reinterpret_cast<const uint8_t*>("three"), 5);
+        logger.send_bytes(big.data(), big.size());
+        logger.flush_output();
+    });
+    logger.set_output_scheduler(nullptr);
+    return (scheduler.dropped(output_channel::control) == 0) ? out : "dropped";
+}
+
+const golden_case golden_cases[] = {
+    {"pack_var_int",
+     "00017f8080812cbfffc000ffff"
+     , golden_pack_var_int},
+    {"pack",
+     "fbbeeffffe1dc03fc00000c002000000000000dca6"
+     , golden_pack},
+    {"append_crc16",
+     "31323334353637383931c331323334353637383931c3"
+     , golden_append_crc16},
+    {"send_data_format",
+     "c0de46804ee74600667800140166790014027948656164696e6700143c23d70a"
+     "0000000003686c65667400140468726967687400140542626174746572790064"
+     "064974696d655f6d73001407e46779726f00149ff6"
+     , golden_send_data_format},
+    {"send_structured_data",
+     "c0de46804ee74600667800140166790014027948656164696e6700143c23d70a"
+     "0000000003686c65667400140468726967687400140542626174746572790064"
+     "064974696d655f6d73001407e46779726f00149ff6c0de448025e74600000000"
+     "0001000000000200000300000400000557060000000007000000000000000002"
+     "f2c0de448023e746003f000000013e80000002ba460300c90400b30600000014"
+     "073fe8000000000000a665c0de448023e746003f800000013f00000002badc03"
+     "00ca0400b20600000028073ff80000000000008a99"
+     , golden_send_structured_data},
+    {"send_structured_changes",
+     "c0de448025e74600000000000100000000020000030000040000055706000000"
+     "0007000000000000000002f2c0de43801d0001df3f0000003e800000ba4600c9"
+     "00b3000000143fe80000000000003fb5c0de43801d0001df3f8000003f000000"
+     "badc00ca00b2000000283ff80000000000002253c0de43801d0001df3fc00000"
+     "3f400000bb7200cb00b10000003c00000000000000000231"
+     , golden_send_structured_changes},
+    {"send_vision_data",
+     "c0de49804c01140a1e143c0237231f1640035a3c201844447d55211a484580a0"
+     "6e221c4cc680c38780eb8780ebaf80c3af8271c780e6a0810ea0810ec880e6c8"
+     "82eec88109b98131b98131e18109e1836b0a20"
+     , golden_send_vision_data},
+    {"pack_vision_object",
+     "01140a1e143c0237231f1640035a3c201844447d55211a484580a06e221c4cc6"
+     "80c38780eb8780ebaf80c3af8271c780e6a0810ea0810ec880e6c882eec88109"
+     "b98131b98131e18109e1836b"
+     , golden_pack_vision_object},
+    {"send_vision_changes",
+     "c0de5680448020010a0507851e00437230f8b4000cb478201888221f55442352"
+     "045503708872618cc38775c3baebd875e4e263b9a821d410ec8736417719109b"
+     "998dccc78613c26d60489dc0de56801b012206844d091a133428685642850a15"
+     "5690a1428555e42850a154e6e3"
+     , golden_send_vision_changes},
+    {"oversize_packet",
+     "6f6e6574776fc0de448025e74600000000000100000000020000030000040000"
+     "0557060000000007000000000000000002f27468726565000102030405060708"
+     "090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f202122232425262728"
+     "292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+     , golden_oversize_packet},
+};
+
+// ------------------------------------------------------------
+// Timing
+// ------------------------------------------------------------
+
+// Keeps the compiler from dropping a result nobody reads
+template<typename T>
+inline void keep(T& value)
+{
+    asm volatile("" : : "g"(&value) : "memory");
+}
+
+struct timing
+{
+    double ns_per_op;
+    double bytes_per_op;
+};
+
+unsigned time_ms = 200;
+unsigned repeat = 5;
+
+// `batch` runs `n` calls and returns the bytes they produced; the fastest
+// of `repeat` runs of at least time_ms each counts
+template<typename Batch>
+timing measure(Batch batch)
+{
+    using clock = std::chrono::steady_clock;
+    timing best{1e30, 0};
+    batch(1000); // warm up
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        uint64_t ops = 0;
+        uint64_t bytes = 0;
+        const clock::time_point start = clock::now();
+        double elapsed_ns = 0;
+        std::size_t n = 64;
+        while (elapsed_ns < time_ms * 1e6)
+        {
+            bytes += batch(n);
+            ops += n;
+            elapsed_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+            if (n < (1u << 16))
+            {
+                n *= 2;
+            }
+        }
+        const double ns = elapsed_ns / ops;
+        if (ns < best.ns_per_op)
+        {
+            best.ns_per_op = ns;
+            best.bytes_per_op = static_cast<double>(bytes) / ops;
+        }
+    }
+    return best;
+}
+
+// Bytes written to stdout while `func` runs
+template<typename Func>
+uint64_t output_of(Func func)
+{
+    const uint64_t before = sink.bytes;
+    func();
+    std::fflush(stdout);
+    return sink.bytes - before;
+}
+
+void report(FILE* out, const char* name, const timing& t)
+{
+    std::fprintf(out, "%-28s %10.1f %10.1f\n", name, t.ns_per_op, t.bytes_per_op);
+}
+
+void run_benchmarks(FILE* out)
+{
+    std::fprintf(out, "%-28s %10s %10s\n", "", "ns/op", "bytes/op");
+
+    std::array<uint8_t, 4096> storage{};
+    static_vector<uint8_t> buf{storage};
+
+    report(out, "pack_var_int", measure([&](std::size_t n) -> uint64_t {
+        uint64_t bytes = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            if (buf.size() + 2 > buf.capacity())
+            {
+                bytes += buf.size();
+                buf.clear();
+            }
+            pack_var_int(buf, var_int_values[i & 7]);
+        }
+        keep(storage);
+        bytes += buf.size();
+        buf.clear();
+        return bytes;
+    }));
+
+    // one call per type: int8, uint16, int32, float, double
+    report(out, "pack<T> (5 types)", measure([&](std::size_t n) -> uint64_t {
+        uint64_t bytes = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            if (buf.size() + 19 > buf.capacity())
+            {
+                bytes += buf.size();
+                buf.clear();
+            }
+            pack<int8_t>(buf, pack_int8_value);
+            pack<uint16_t>(buf, pack_uint16_value);
+            pack<int32_t>(buf, pack_int32_value);
+            pack(buf, pack_float_value);
+            pack(buf, pack_double_value);
+        }
+        keep(storage);
+        bytes += buf.size();
+        buf.clear();
+        return bytes;
+    }));
+
+    // a full 104-byte packet's worth, scanned as the generic overload does
+    std::array<uint8_t, 128> crc_storage{};
+    static_vector<uint8_t> crc_buf{crc_storage};
+    report(out, "append_crc16 (102 B)", measure([&](std::size_t n) -> uint64_t {
+        for (std::size_t i = 0; i < n; i++)
+        {
+            crc_buf.clear();
+            for (uint8_t b = 0; b < 102; b++)
+            {
+                crc_buf.push_back(b);
+            }
+            crc_storage[0] = static_cast<uint8_t>(i);
+            append_crc16(crc_buf);
+            keep(crc_storage);
+        }
+        return 0;
+    }));
+
+    robot = robot_state();
+    StructuredLogger logger;
+    add_channels(logger);
+    logger.send_data_format();
+
+    report(out, "send_data_format", measure([&](std::size_t n) {
+        return output_of([&] {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                logger.send_data_format();
+            }
+        });
+    }));
+
+    report(out, "send_structured_data", measure([&](std::size_t n) {
+        return output_of([&] {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                robot.step();
+                logger.send_structured_data();
+            }
+        });
+    }));
+
+    report(out, "send_structured_changes", measure([&](std::size_t n) {
+        return output_of([&] {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                robot.step();
+                logger.send_structured_changes();
+            }
+        });
+    }));
+
+    vision_objects objs;
+    make_objects(objs, 0);
+    report(out, "pack_vision_object", measure([&](std::size_t n) -> uint64_t {
+        uint64_t bytes = 0;
+        for (std::size_t i = 0; i < n; i++)
+        {
+            if (buf.size() + 15 > buf.capacity())
+            {
+                bytes += buf.size();
+                buf.clear();
+            }
+            logger.pack_vision_object(buf, objs[i & 7]);
+        }
+        keep(storage);
+        bytes += buf.size();
+        buf.clear();
+        return bytes;
+    }));
+
+    report(out, "send_vision_data (8 obj)", measure([&](std::size_t n) {
+        return output_of([&] {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                logger.send_vision_data(objs);
+            }
+        });
+    }));
+
+    vision_objects moving[2];
+    make_objects(moving[0], 0);
+    make_objects(moving[1], 1);
+    report(out, "send_vision_changes (8 obj)", measure([&](std::size_t n) {
+        return output_of([&] {
+            for (std::size_t i = 0; i < n; i++)
+            {
+                logger.send_vision_changes(moving[i & 1]);
+            }
+        });
+    }));
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool print_golden = false;
+    bool null_output = false;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--sink" && i + 1 < argc)
+        {
+            const std::string sink_name = argv[++i];
+            if (sink_name != "memory" && sink_name != "null")
+            {
+                std::fprintf(stderr, "unknown sink: %s\n", sink_name.c_str());
+                return 2;
+            }
+            null_output = (sink_name == "null");
+        }
+        else if (arg == "--time-ms" && i + 1 < argc)
+        {
+            time_ms = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            repeat = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--golden")
+        {
+            print_golden = true;
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: c0de_logger_bench [--sink memory|null] [--time-ms N] [--repeat N] [--golden]\n");
+            return 2;
+        }
+    }
+    if (repeat == 0)
+    {
+        repeat = 1;
+    }
+
+    // results go to the real stdout; the logger writes to the sink
+    FILE* const out = stdout;
+    std::fflush(out);
+    FILE* const logger_out = open_sink();
+    if (logger_out == nullptr)
+    {
+        std::perror("fopencookie");
+        return 1;
+    }
+    vex_host_clock_us() = 1000000;
+    stdout = logger_out;
+
+    int failed = 0;
+    for (const golden_case& c : golden_cases)
+    {
+        const std::string got = hex(c.run());
+        std::string expected;
+        for (const char* p = c.bytes; *p; p++)
+        {
+            if (*p != ' ')
+            {
+                expected += *p;
+            }
+        }
+        if (print_golden)
+        {
+            std::fprintf(out, "    {\"%s\",\n", c.name);
+            for (std::size_t i = 0; i < got.size(); i += 64)
+            {
+                std::fprintf(out, "     \"%s\"\n", got.substr(i, 64).c_str());
+            }
+            std::fprintf(out, "     , golden_%s},\n", c.name);
+        }
+        else if (got != expected)
+        {
+            std::fprintf(out, "golden %s: wire format changed\n  expected %s\n  got      %s\n", c.name, expected.c_str(),
+                         got.c_str());
+            failed++;
+        }
+    }
+    if (print_golden)
+    {
+        return 0;
+    }
+    if (failed)
+    {
+        return 1;
+    }
+    std::fprintf(out, "golden: %u cases ok\n", static_cast<unsigned>(sizeof(golden_cases) / sizeof(golden_cases[0])));
+
+    if (null_output)
+    {
+        sink.fd = open("/dev/null", O_WRONLY);
+        if (sink.fd < 0)
+        {
+            std::perror("/dev/null");
+            return 1;
+        }
+    }
+    vex_host_clock_us() = -1;
+    run_benchmarks(out);
+    return 0;
+}
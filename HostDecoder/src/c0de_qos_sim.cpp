@@ -0,0 +1,341 @@
+// c0de_qos_sim: control telemetry latency behind vision packets on a slow
+// link, written straight out as before output_scheduler and through it as
+// main.cpp sets it up
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_qos_sim.cpp
+//       -o c0de_qos_sim -pthread
+//
+//   c0de_qos_sim [options]
+//     --ticks N         10 ms ticks per run (default 6000)
+//     --vision-every N  ticks between vision snapshots (default 4)
+//     --link R          link rate in bytes per ms; may be given more than
+//                       once (default 20, 12 and 8)
+//
+// Every tick the brain samples 12 float channels (one 0x44 with extended
+// headers) and every --vision-every ticks sends 24 AprilTags as 0x49, then
+// calls flush_output(). What it writes in a tick goes into a FIFO link
+// draining R bytes per ms. A 0x44's latency runs from its sample time to
+// its last byte leaving the link, even after the end of the run; the first
+// sixth of each run is left out as warm-up.
+//
+// Three ways per link rate:
+//   direct          everything written as it is sent, telemetry first
+//   vision first    the same, with the vision packet sent before the
+//                   telemetry within a tick
+//   scheduled       output_scheduler with main.cpp's queues, control at
+//                   priority 0 and vision at 1, and the link budget set to
+//                   what the link carries in a tick
+//
+// For each: control latency p99 and max, 0x44 packets that made it off
+// the link by the end, the share of vision snapshots sent, and how far
+// behind the link is at the end.
+//
+// Before that, packet_queue is checked against a std::deque of packets
+// under random pushes and pops, dropping the oldest when it is full: same
+// packets out, same drop count; a packet too big for the whole queue drops
+// nothing. Build with -fsanitize=address,undefined to check its compaction
+// too, and run with ASAN_OPTIONS=detect_leaks=0: the loggers never free
+// their entries, as on the brain. Exits 1 if the queue differs.
+
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vex.h"
+
+// What the brain wrote since the last tick
+struct capture_sink
+{
+    std::vector<uint8_t> bytes;
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        bytes.insert(bytes.end(), data, data + len);
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK capture_sink
+#include "structured_logger.h"
+#include "output_scheduler.h"
+#include "c0de_stream.h"
+
+namespace
+{
+
+unsigned ticks = 6000;
+unsigned vision_every = 4;
+std::vector<double> links;
+
+constexpr double tick_ms = 10;
+
+enum class send_mode
+{
+    direct,
+    vision_first,
+    scheduled,
+};
+
+const char* const mode_names[] = { "direct", "vision first", "scheduled" };
+
+struct run_result
+{
+    std::vector<double> latency_ms; // after warm-up
+    unsigned control_sent = 0;      // 0x44 packets off the link by the end
+    unsigned vision_made = 0;       // after warm-up
+    unsigned vision_sent = 0;
+    double backlog_ms = 0;
+};
+
+// main.cpp's queues
+std::array<uint8_t, 512> control_queue_storage;
+std::array<uint8_t, 1024> vision_queue_storage;
+
+// packet_queue against a model; the odd capacity keeps items from lining up
+// with the end of the buffer
+bool check_queue(void)
+{
+    std::array<uint8_t, 97> storage;
+    packet_queue q;
+    q.attach(storage.data(), storage.size());
+    std::deque<std::vector<uint8_t>> model;
+    std::mt19937 rng(1);
+    uint32_t drops = 0;
+    unsigned failures = 0;
+    // each item has a u16 length and a u16 tick in front of it
+    const std::size_t overhead = 4;
+    for (unsigned n = 0; n < 200000 && failures < 10; n++)
+    {
+        if (rng() % 3 != 0)
+        {
+            const std::size_t len = rng() % 60 + 1;
+            if (!q.make_room(len))
+            {
+                std::printf("  push %u: no room for %zu bytes\n", n, len);
+                failures++;
+                continue;
+            }
+            std::size_t pending = 0;
+            for (const std::vector<uint8_t>& item : model)
+            {
+                pending += item.size() + overhead;
+            }
+            while (pending + overhead + len > storage.size())
+            {
+                pending -= model.front().size() + overhead;
+                model.pop_front();
+                drops++;
+            }
+            std::vector<uint8_t> item(len);
+            for (uint8_t& b : item)
+            {
+                b = static_cast<uint8_t>(rng());
+            }
+            std::memcpy(q.tail(), item.data(), len);
+            q.commit(len, static_cast<uint16_t>(n));
+            model.push_back(item);
+        }
+        else if (!model.empty())
+        {
+            if (q.front_size() != model.front().size()
+                || std::memcmp(q.front_data(), model.front().data(), model.front().size()) != 0)
+            {
+                std::printf("  pop %u: a different packet\n", n);
+                failures++;
+            }
+            q.pop_front();
+            model.pop_front();
+        }
+        if (q.dropped() != drops)
+        {
+            std::printf("  step %u: %u dropped, want %u\n", n, q.dropped(), drops);
+            failures++;
+        }
+    }
+
+    // nothing bigger than the whole queue, and no drops for trying
+    std::array<uint8_t, 10> small;
+    packet_queue s;
+    s.attach(small.data(), small.size());
+    if (s.make_room(small.size() - overhead + 1) || !s.make_room(small.size() - overhead))
+    {
+        std::printf("  10-byte queue: wrong room for a 6 or 7-byte packet\n");
+        failures++;
+    }
+    s.commit(1, 0);
+    if (s.make_room(small.size() - overhead + 1) || s.empty() || s.dropped() != 0)
+    {
+        std::printf("  10-byte queue: a 7-byte packet dropped what was queued\n");
+        failures++;
+    }
+    std::printf("packet_queue against a model: %s, %u dropped\n\n", failures ? "DIFFERS" : "same packets", drops);
+    return failures == 0;
+}
+
+run_result run(send_mode mode, double link_rate)
+{
+    static unsigned t;
+    std::unique_ptr<StructuredLogger> logger(new StructuredLogger());
+    std::unique_ptr<output_scheduler> scheduler(new output_scheduler());
+    capture_sink& out = logger_sink();
+    logger->set_tick_period(static_cast<uint16_t>(tick_ms));
+    logger->set_extended_header(true);
+    for (int i = 0; i < 12; i++)
+    {
+        logger->add("ch" + std::to_string(i), [i]() -> float { return t * 0.5f + i; });
+    }
+    if (mode == send_mode::scheduled)
+    {
+        scheduler->set_channel(output_channel::control, control_queue_storage, 0);
+        scheduler->set_channel(output_channel::vision, vision_queue_storage, 1);
+        scheduler->set_link_budget(static_cast<uint16_t>(link_rate * tick_ms));
+        logger->set_output_scheduler(scheduler.get());
+    }
+    logger->send_data_format();
+    logger->flush_output();
+    out.bytes.clear();
+
+    run_result r;
+    const unsigned warm_up = ticks / 6;
+    vex::safearray<vex::aivision::object, AIVISION_MAX_OBJECTS> objs;
+    objs.setLength(AIVISION_MAX_OBJECTS);
+    double link_free_ms = 0;
+    const double end_ms = ticks * tick_ms;
+    for (t = 0; t < ticks; t++)
+    {
+        const double now_ms = t * tick_ms;
+        vex_host_clock_us() = static_cast<int64_t>(t) * 10000;
+        const bool vision = t % vision_every == 0;
+        if (mode != send_mode::vision_first)
+        {
+            logger->send_structured_data();
+        }
+        if (vision)
+        {
+            for (int i = 0; i < AIVISION_MAX_OBJECTS; i++)
+            {
+                vex::aivision::object& o = objs[i];
+                o = vex::aivision::object{};
+                o.exists = true;
+                o.type = vex::aivision::objectType::tagObject;
+                o.id = i;
+                for (int k = 0; k < 4; k++)
+                {
+                    o.tag.x[k] = static_cast<int>((t * 7 + i * 13 + k) % 320);
+                    o.tag.y[k] = static_cast<int>((t * 3 + i) % 240);
+                }
+                o.angle = (t + i) % 360;
+            }
+            logger->send_vision_data(objs);
+            r.vision_made += t >= warm_up;
+        }
+        if (mode == send_mode::vision_first)
+        {
+            logger->send_structured_data();
+        }
+        logger->flush_output();
+
+        // onto the link, packet by packet
+        const std::vector<uint8_t>& chunk = out.bytes;
+        const double start_ms = std::max(now_ms, link_free_ms);
+        for (std::size_t i = 0; i + 5 <= chunk.size();)
+        {
+            uint16_t len;
+            const std::size_t header = 3 + c0de::read_var_int(chunk.data() + i + 3, len);
+            const std::size_t end = i + header + len + 2;
+            const double left_ms = start_ms + end / link_rate;
+            const uint8_t cmd = chunk[i + 2] & 0x7f;
+            const uint32_t sample_us = static_cast<uint32_t>(c0de::read_be(chunk.data() + i + header + 2, 4));
+            const bool warm = sample_us >= warm_up * tick_ms * 1000;
+            if (cmd == 0x44 && warm)
+            {
+                r.latency_ms.push_back(left_ms - sample_us / 1000.0);
+            }
+            if (left_ms <= end_ms)
+            {
+                r.control_sent += cmd == 0x44;
+                r.vision_sent += (cmd == 0x49) && warm;
+            }
+            i = end;
+        }
+        link_free_ms = start_ms + chunk.size() / link_rate;
+        out.bytes.clear();
+    }
+    r.backlog_ms = std::max(0.0, link_free_ms - end_ms);
+    std::sort(r.latency_ms.begin(), r.latency_ms.end());
+    return r;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--ticks" && i + 1 < argc)
+        {
+            ticks = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--vision-every" && i + 1 < argc)
+        {
+            vision_every = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--link" && i + 1 < argc)
+        {
+            links.push_back(std::strtod(argv[++i], nullptr));
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: c0de_qos_sim [--ticks N] [--vision-every N] [--link R]...\n");
+            return 2;
+        }
+    }
+    if (links.empty())
+    {
+        links = { 20, 12, 8 };
+    }
+    if (ticks < 6 || vision_every == 0 || *std::min_element(links.begin(), links.end()) <= 0)
+    {
+        std::fprintf(stderr, "c0de_qos_sim: need --ticks 6 or more, and --vision-every and --link above 0\n");
+        return 2;
+    }
+
+    if (!check_queue())
+    {
+        return 1;
+    }
+    std::printf("%u ticks of %.0f ms, 12 float channels every tick, 24 AprilTags every %u\n\n", ticks, tick_ms,
+                vision_every);
+    std::printf("%-8s %-13s %16s %12s %12s %12s\n", "link", "", "control p99/max", "control out", "vision sent",
+                "backlog ms");
+    for (double rate : links)
+    {
+        for (send_mode mode : { send_mode::direct, send_mode::vision_first, send_mode::scheduled })
+        {
+            const run_result r = run(mode, rate);
+            if (r.latency_ms.empty())
+            {
+                std::printf("%3.0f B/ms %-13s %16s %7u/%-4u\n", rate, mode_names[static_cast<int>(mode)],
+                            "none out", r.control_sent, ticks);
+                continue;
+            }
+            char latency[32];
+            std::snprintf(latency, sizeof(latency), "%.1f / %.1f",
+                          r.latency_ms[r.latency_ms.size() * 99 / 100], r.latency_ms.back());
+            std::printf("%3.0f B/ms %-13s %16s %7u/%-4u %11.0f%% %12.0f\n", rate, mode_names[static_cast<int>(mode)],
+                        latency, r.control_sent, ticks, 100.0 * r.vision_sent / std::max(1u, r.vision_made),
+                        r.backlog_ms);
+        }
+    }
+    return 0;
+}
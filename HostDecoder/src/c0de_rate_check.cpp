@@ -0,0 +1,288 @@
+// c0de_rate_check: per-channel sample rates (the divisor of
+// StructuredLogger::add()) from the getters to the host: how often each
+// getter runs, what arrives, and the sample period 0x46 advertises
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_rate_check.cpp
+//       -o c0de_rate_check -pthread
+//
+//   c0de_rate_check [options]
+//     --ticks N         ticks per run (default 1000)
+//     --tick-ms N       set_tick_period() (default 10)
+//
+// The channels are laid out like main.cpp's: three IMU channels every tick,
+// four controller channels every 2nd, two distance sensors every 10th, and
+// one each every 3rd, 5th and 7th tick. Every getter returns how many times
+// it has been called.
+//
+// send_structured_data(): each getter must run on exactly one tick in
+// `divisor`, and the host must get each of its values, in order, `divisor`
+// ticks apart; a tick on which no getter ran must send nothing. The host
+// must read back tick_ms * divisor as each channel's period. The most
+// channels sampled on one tick shows how well equal divisors are spread.
+// This runs twice, the second time with only the channels of divisor 5 and
+// up.
+//
+// send_structured_changes(): after every tick the host's last value of each
+// channel must be the last value its getter returned, keyframes included.
+//
+// Exits 1 if a check fails.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "vex.h"
+
+// Everything the logger writes
+struct capture_sink
+{
+    std::vector<uint8_t> bytes;
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        bytes.insert(bytes.end(), data, data + len);
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK capture_sink
+#include "structured_logger.h"
+#include "c0de_stream.h"
+
+namespace
+{
+
+unsigned ticks = 1000;
+uint16_t tick_ms = 10;
+
+struct channel
+{
+    const char* name;
+    uint16_t divisor;
+    uint16_t code = 0;
+    int32_t calls = 0;
+    // host side
+    uint16_t period_ms = 0;
+    int32_t last_value = 0;
+    long last_tick = -1;
+    unsigned received = 0;
+};
+
+std::vector<channel> make_channels(void)
+{
+    return {
+        { "Heading", 1 }, { "Roll", 1 }, { "Pitch", 1 },
+        { "Axis A", 2 }, { "Axis B", 2 }, { "Axis C", 2 }, { "Axis D", 2 },
+        { "dist_front", 10 }, { "dist_rear", 10 },
+        { "every3", 3 }, { "every5", 5 }, { "every7", 7 },
+    };
+}
+
+class rate_host : public c0de::stream_handler
+{
+public:
+    std::vector<channel>& channels;
+    long tick = -1;
+
+    explicit rate_host(std::vector<channel>& channels)
+        : channels(channels)
+    {}
+
+    channel* find(uint16_t code)
+    {
+        for (channel& ch : channels)
+        {
+            if (ch.code == code)
+            {
+                return &ch;
+            }
+        }
+        return nullptr;
+    }
+
+    void on_format(uint16_t code, const c0de::channel_format& format) override
+    {
+        if (channel* ch = find(code))
+        {
+            ch->period_ms = format.period_ms;
+        }
+    }
+
+    void on_value(uint64_t, int64_t, uint16_t code, const c0de::channel_format&, double value) override
+    {
+        channel* ch = find(code);
+        if (ch == nullptr)
+        {
+            return;
+        }
+        ch->last_value = static_cast<int32_t>(value);
+        ch->received++;
+        ch->last_tick = tick;
+    }
+};
+
+unsigned failures = 0;
+
+void fail(const char* what, const channel& ch, long value, long want)
+{
+    if (failures++ < 10)
+    {
+        std::printf("  %s: %s %ld, want %ld\n", ch.name, what, value, want);
+    }
+}
+
+enum class send_mode
+{
+    data,
+    changes,
+};
+
+// `slow_only` leaves out the channels sampled more often than every 5th tick,
+// so some ticks have nothing due
+void run(send_mode mode, bool slow_only)
+{
+    std::vector<channel> channels = make_channels();
+    if (slow_only)
+    {
+        channels.erase(std::remove_if(channels.begin(), channels.end(),
+                                      [](const channel& ch) { return ch.divisor < 5; }),
+                       channels.end());
+    }
+    std::unique_ptr<StructuredLogger> logger(new StructuredLogger());
+    rate_host host(channels);
+    c0de::stream_decoder decoder(host);
+    capture_sink& out = logger_sink();
+    out.bytes.clear();
+
+    logger->set_tick_period(tick_ms);
+    for (channel& ch : channels)
+    {
+        channel* const p = &ch;
+        ch.code = logger->add(ch.name, [p]() -> int32_t { return ++p->calls; }, false, ch.divisor);
+    }
+    logger->send_data_format();
+    decoder.feed(out.bytes.data(), out.bytes.size());
+    out.bytes.clear();
+
+    std::vector<int32_t> calls_before(channels.size());
+    unsigned busiest = 0;
+    unsigned empty_ticks = 0;
+    for (unsigned t = 0; t < ticks; t++)
+    {
+        for (std::size_t c = 0; c < channels.size(); c++)
+        {
+            calls_before[c] = channels[c].calls;
+        }
+        host.tick = t;
+        if (mode == send_mode::data)
+        {
+            logger->send_structured_data();
+        }
+        else
+        {
+            logger->send_structured_changes();
+        }
+        const bool sent = !out.bytes.empty();
+        decoder.feed(out.bytes.data(), out.bytes.size());
+        out.bytes.clear();
+
+        unsigned sampled = 0;
+        for (std::size_t c = 0; c < channels.size(); c++)
+        {
+            channel& ch = channels[c];
+            const bool ran = ch.calls != calls_before[c];
+            sampled += ran;
+            if (mode == send_mode::changes)
+            {
+                if (ch.received && ch.last_value != ch.calls)
+                {
+                    fail("host value after tick", ch, ch.last_value, ch.calls);
+                }
+                continue;
+            }
+            if (ran && (ch.last_tick != static_cast<long>(t) || ch.last_value != ch.calls))
+            {
+                fail("sample not received on its tick, value", ch, ch.last_value, ch.calls);
+            }
+        }
+        if (mode == send_mode::data)
+        {
+            if (sampled == 0)
+            {
+                empty_ticks++;
+                if (sent && failures++ < 10)
+                {
+                    std::printf("  tick %u: no getter ran but something was sent\n", t);
+                }
+            }
+            busiest = std::max(busiest, sampled);
+        }
+    }
+
+    if (mode == send_mode::changes)
+    {
+        std::printf("send_structured_changes: %u ticks, host in step with every getter after each\n", ticks);
+        return;
+    }
+    std::printf("send_structured_data: %u ticks of %u ms, %u with nothing due, at most %u of %zu channels on one "
+                "tick\n",
+                ticks, tick_ms, empty_ticks, busiest, channels.size());
+    std::printf("  %-12s %8s %8s %9s %10s\n", "channel", "divisor", "calls", "received", "period ms");
+    for (channel& ch : channels)
+    {
+        std::printf("  %-12s %8u %8d %9u %10u\n", ch.name, ch.divisor, ch.calls, ch.received, ch.period_ms);
+        const long lo = ticks / ch.divisor;
+        const long hi = (ticks + ch.divisor - 1) / ch.divisor;
+        if (ch.calls < lo || ch.calls > hi)
+        {
+            fail("getter calls", ch, ch.calls, lo);
+        }
+        if (ch.received != static_cast<unsigned>(ch.calls))
+        {
+            fail("values received", ch, ch.received, ch.calls);
+        }
+        if (ch.period_ms != tick_ms * ch.divisor)
+        {
+            fail("period", ch, ch.period_ms, tick_ms * ch.divisor);
+        }
+    }
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--ticks" && i + 1 < argc)
+        {
+            ticks = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--tick-ms" && i + 1 < argc)
+        {
+            tick_ms = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: c0de_rate_check [--ticks N] [--tick-ms N]\n");
+            return 2;
+        }
+    }
+    if (tick_ms == 0)
+    {
+        std::fprintf(stderr, "c0de_rate_check: --tick-ms must be at least 1\n");
+        return 2;
+    }
+
+    run(send_mode::data, false);
+    run(send_mode::data, true);
+    run(send_mode::changes, false);
+    std::printf("%s\n", failures ? "FAILED" : "rates ok");
+    return failures ? 1 : 0;
+}
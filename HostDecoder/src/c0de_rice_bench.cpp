@@ -0,0 +1,460 @@
+// c0de_rice_bench: what Rice coding (0x52, StructuredLogger::
+// send_structured_compressed) would make of recorded data: every 0x44
+// packet and 0x54 record of the captures is one frame, coded as the brain
+// would code it, and checked to decode back to the same values
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/c0de_rice_bench.cpp -o c0de_rice_bench
+//
+//   c0de_rice_bench [options] <capture>...
+//     --ble-log         captures are "[BLE Hook]" console logs
+//     --keyframe N      frames between keyframes (default 50, as on the brain)
+//     --repeat N        times to code the whole session for the timing
+//                       (default 20)
+//
+// Sizes are whole packets without the extended header, both formats split
+// at the brain's 104-byte packet buffer. Coding time is per frame on this
+// machine, in ns and, on x86, TSC cycles; the brain's Cortex-A9 is some 10
+// to 20 times slower.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define C0DE_HAVE_TSC 1
+#endif
+
+#include "c0de_stream.h"
+#include "rice_codec.h"
+
+namespace
+{
+
+constexpr std::size_t packet_capacity = 104; // StructuredLogger::m_buffer
+constexpr std::size_t packet_overhead = 5 + 2 + 2; // header, schema hash, CRC
+
+struct frame_value
+{
+    uint16_t code;
+    uint8_t element_size;
+    uint16_t offset; // into frame::body, of the value
+    uint16_t size;
+};
+
+// one 0x44 body, as it was sent
+struct frame
+{
+    uint16_t hash;
+    std::vector<uint8_t> body;
+    std::vector<frame_value> values;
+};
+
+using encoder_type = rice_encoder<1024, 8192>;
+
+// packet_framer sink that passes everything on to a stream_decoder, for
+// the channel formats, and keeps the data frames
+class frame_collector
+{
+private:
+    c0de::stream_decoder& m_decoder;
+    std::vector<frame>& m_frames;
+
+    void add(uint16_t hash, const uint8_t* p, std::size_t len)
+    {
+        const std::vector<c0de::channel_format>& channels = m_decoder.channels();
+        frame f;
+        f.hash = hash;
+        f.body.assign(p, p + len);
+        std::size_t i = 0;
+        while (i < len)
+        {
+            uint16_t code;
+            if ((p[i] & 0x80) && i + 2 > len)
+            {
+                return;
+            }
+            i += c0de::read_var_int(p + i, code);
+            if ((code >= channels.size()) || !channels[code].valid || (channels[code].size == 0))
+            {
+                skipped++;
+                return;
+            }
+            const c0de::channel_format& ch = channels[code];
+            if (i + ch.size > len)
+            {
+                return;
+            }
+            const uint8_t element_size = static_cast<uint8_t>(ch.elements.empty() ? ch.size : ch.elements[0].size);
+            f.values.push_back(frame_value{code, element_size, static_cast<uint16_t>(i), ch.size});
+            i += ch.size;
+        }
+        if (!f.values.empty())
+        {
+            m_frames.push_back(std::move(f));
+        }
+    }
+
+public:
+    uint64_t skipped = 0; // frames before their schema
+
+    frame_collector(c0de::stream_decoder& decoder, std::vector<frame>& frames)
+        : m_decoder(decoder)
+        , m_frames(frames)
+    {}
+
+    void on_text(const char* text, std::size_t len)
+    {
+        m_decoder.on_text(text, len);
+    }
+
+    void on_packet(uint8_t cmd, const uint8_t* payload, std::size_t len)
+    {
+        m_decoder.on_packet(cmd, payload, len);
+        if (cmd & c0de::extended_header_flag)
+        {
+            if (len < c0de::extended_header_len)
+            {
+                return;
+            }
+            cmd &= ~c0de::extended_header_flag;
+            payload += c0de::extended_header_len;
+            len -= c0de::extended_header_len;
+        }
+        if (len < 2)
+        {
+            return;
+        }
+        const uint16_t hash = static_cast<uint16_t>(c0de::read_be(payload, 2));
+        if (cmd == 0x44)
+        {
+            add(hash, payload + 2, len - 2);
+        }
+        else if (cmd == 0x54)
+        {
+            for (std::size_t i = 2; i + 5 <= len;)
+            {
+                const std::size_t size = payload[i + 4];
+                if (i + 5 + size > len)
+                {
+                    break;
+                }
+                add(hash, payload + i + 5, size);
+                i += 5 + size;
+            }
+        }
+    }
+};
+
+void append_packet(std::vector<uint8_t>& out, uint8_t cmd, uint16_t hash, const uint8_t* body, std::size_t len)
+{
+    const std::size_t start = out.size();
+    const std::size_t payload_len = 2 + len;
+    out.push_back(0xc0);
+    out.push_back(0xde);
+    out.push_back(cmd);
+    out.push_back(static_cast<uint8_t>(0x80 | (payload_len >> 8)));
+    out.push_back(static_cast<uint8_t>(payload_len));
+    out.push_back(static_cast<uint8_t>(hash >> 8));
+    out.push_back(static_cast<uint8_t>(hash));
+    out.insert(out.end(), body, body + len);
+    const uint16_t crc = crc16(out.data() + start, out.size() - start);
+    out.push_back(static_cast<uint8_t>(crc >> 8));
+    out.push_back(static_cast<uint8_t>(crc));
+}
+
+// The frame as 0x44 packets, split where the brain would split it
+std::size_t pack_plain(const frame& f, std::vector<uint8_t>* out)
+{
+    std::size_t bytes = 0;
+    std::size_t start = 0; // of the packet's first (code, value) pair
+    std::size_t end = 0;
+    for (const frame_value& v : f.values)
+    {
+        const std::size_t pair_end = v.offset + v.size;
+        if ((end > start) && (packet_overhead + pair_end - start > packet_capacity))
+        {
+            bytes += packet_overhead + end - start;
+            if (out != nullptr)
+            {
+                append_packet(*out, 0x44, f.hash, f.body.data() + start, end - start);
+            }
+            start = end;
+        }
+        end = pair_end;
+    }
+    if (out != nullptr)
+    {
+        append_packet(*out, 0x44, f.hash, f.body.data() + start, end - start);
+    }
+    return bytes + packet_overhead + end - start;
+}
+
+// The frame as 0x52 packets, coded against `reference` (last values by
+// code, as on the brain); their bodies go to `out` if it isn't null
+std::size_t pack_rice(const frame& f, bool keyframe, encoder_type& encoder, std::vector<std::vector<uint8_t>>& reference,
+                      std::vector<uint8_t>& body, std::vector<uint8_t>* out, std::vector<uint32_t>* k_counts)
+{
+    encoder.begin(keyframe);
+    for (const frame_value& v : f.values)
+    {
+        if (v.code >= reference.size())
+        {
+            reference.resize(v.code + 1);
+        }
+        reference[v.code].resize(v.size);
+        encoder.add(v.code, v.element_size, f.body.data() + v.offset, reference[v.code].data(), v.size);
+    }
+    std::size_t bytes = 0;
+    std::size_t next = 0;
+    while (next < encoder.size())
+    {
+        body.clear();
+        const std::size_t end = encoder.encode(body, next, packet_capacity - packet_overhead);
+        if (end == next)
+        {
+            break;
+        }
+        bytes += packet_overhead + body.size();
+        if (out != nullptr)
+        {
+            append_packet(*out, 0x52, f.hash, body.data(), body.size());
+        }
+        if (k_counts != nullptr)
+        {
+            // k is the top 4 bits after the bitmap
+            const std::size_t bitmap_at = 1 + ((body[1] & 0x80) ? 2 : 1);
+            (*k_counts)[body[bitmap_at + 1 + body[bitmap_at]] >> 4]++;
+        }
+        next = end;
+    }
+    return bytes;
+}
+
+class value_list : public c0de::stream_handler
+{
+public:
+    std::vector<std::pair<uint16_t, double>> values;
+
+    void on_value(uint64_t, int64_t, uint16_t code, const c0de::channel_format&, double value) override
+    {
+        values.emplace_back(code, value);
+    }
+};
+
+// The 0x46 of each schema before its first frame, as a decoder needs it
+void append_format(std::vector<uint8_t>& out, uint16_t hash, c0de::schema_cache& schemas)
+{
+    const std::vector<uint8_t>* descriptions = schemas.find(hash);
+    if (descriptions != nullptr)
+    {
+        append_packet(out, 0x46, hash, descriptions->data(), descriptions->size());
+    }
+}
+
+std::vector<std::pair<uint16_t, double>> decode_all(const std::vector<uint8_t>& stream, uint64_t& unsynced)
+{
+    value_list values;
+    c0de::stream_decoder decoder(values, 1 << 16);
+    decoder.feed(stream.data(), stream.size());
+    decoder.finish();
+    unsynced = decoder.stats().rice_unsynced + decoder.stats().malformed;
+    return values.values;
+}
+
+bool same_values(const std::vector<std::pair<uint16_t, double>>& a, const std::vector<std::pair<uint16_t, double>>& b)
+{
+    if (a.size() != b.size())
+    {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); i++)
+    {
+        // NaN payloads come back bit for bit, but don't compare equal
+        if ((a[i].first != b[i].first) || (std::memcmp(&a[i].second, &b[i].second, sizeof(double)) != 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    bool ble_log = false;
+    unsigned keyframe_interval = 50;
+    unsigned repeat = 20;
+    std::vector<const char*> inputs;
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--ble-log")
+        {
+            ble_log = true;
+        }
+        else if (arg == "--keyframe" && i + 1 < argc)
+        {
+            keyframe_interval = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            repeat = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (!arg.empty() && arg[0] == '-' && arg != "-")
+        {
+            std::fprintf(stderr, "usage: c0de_rice_bench [--ble-log] [--keyframe N] [--repeat N] <capture>...\n");
+            return 2;
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty() || repeat == 0)
+    {
+        std::fprintf(stderr, "usage: c0de_rice_bench [--ble-log] [--keyframe N] [--repeat N] <capture>...\n");
+        return 2;
+    }
+
+    c0de::stream_handler ignore;
+    c0de::stream_decoder decoder(ignore, 1 << 16);
+    std::vector<frame> frames;
+    frame_collector collector(decoder, frames);
+    c0de::packet_framer framer(1 << 16);
+    std::vector<uint8_t> chunk(1 << 20);
+    for (const char* path : inputs)
+    {
+        FILE* f = std::strcmp(path, "-") == 0 ? stdin : std::fopen(path, "rb");
+        if (f == nullptr)
+        {
+            std::perror(path);
+            return 1;
+        }
+        if (ble_log)
+        {
+            const std::vector<uint8_t> bytes = c0de::read_ble_log(f);
+            framer.feed(bytes.data(), bytes.size(), collector);
+        }
+        else
+        {
+            std::size_t n;
+            while ((n = std::fread(chunk.data(), 1, chunk.size(), f)) > 0)
+            {
+                framer.feed(chunk.data(), n, collector);
+            }
+        }
+        if (f != stdin)
+        {
+            std::fclose(f);
+        }
+    }
+    framer.finish(collector);
+    if (frames.empty())
+    {
+        std::fprintf(stderr, "no 0x44 or 0x54 data with a known format in the captures (%llu frames skipped)\n",
+                     (unsigned long long)collector.skipped);
+        return 1;
+    }
+
+    // sizes, and the streams to check against each other
+    static encoder_type encoder;
+    std::vector<std::vector<uint8_t>> reference;
+    std::vector<uint8_t> body;
+    body.reserve(packet_capacity);
+    std::vector<uint8_t> plain_stream;
+    std::vector<uint8_t> rice_stream;
+    std::vector<uint32_t> k_counts(16);
+    std::size_t plain_bytes = 0;
+    std::size_t rice_bytes = 0;
+    std::size_t values = 0;
+    std::size_t elements = 0;
+    bool have_hash = false;
+    uint16_t hash = 0;
+    unsigned since_keyframe = 0;
+    for (const frame& f : frames)
+    {
+        const bool new_schema = !have_hash || (f.hash != hash);
+        if (new_schema)
+        {
+            append_format(plain_stream, f.hash, decoder.schemas());
+            append_format(rice_stream, f.hash, decoder.schemas());
+            reference.clear();
+            have_hash = true;
+            hash = f.hash;
+        }
+        const bool keyframe = new_schema || (since_keyframe >= keyframe_interval);
+        since_keyframe = keyframe ? 0 : since_keyframe + 1;
+        plain_bytes += pack_plain(f, &plain_stream);
+        rice_bytes += pack_rice(f, keyframe, encoder, reference, body, &rice_stream, &k_counts);
+        values += f.values.size();
+        for (const frame_value& v : f.values)
+        {
+            elements += v.size / v.element_size;
+        }
+    }
+
+    uint64_t plain_errors = 0;
+    uint64_t rice_errors = 0;
+    const bool same = same_values(decode_all(plain_stream, plain_errors), decode_all(rice_stream, rice_errors));
+
+    // coding time: what send_structured_compressed() adds over sending
+    // 0x44, i.e. differences, k and bit packing, without the framing
+    const auto start = std::chrono::steady_clock::now();
+#ifdef C0DE_HAVE_TSC
+    const uint64_t start_tsc = __rdtsc();
+#endif
+    std::size_t sink = 0;
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        reference.clear();
+        have_hash = false;
+        for (const frame& f : frames)
+        {
+            const bool new_schema = !have_hash || (f.hash != hash);
+            if (new_schema)
+            {
+                reference.clear();
+                have_hash = true;
+                hash = f.hash;
+            }
+            const bool keyframe = new_schema || (since_keyframe >= keyframe_interval);
+            since_keyframe = keyframe ? 0 : since_keyframe + 1;
+            sink += pack_rice(f, keyframe, encoder, reference, body, nullptr, nullptr);
+        }
+    }
+#ifdef C0DE_HAVE_TSC
+    const double cycles = static_cast<double>(__rdtsc() - start_tsc) / repeat / frames.size();
+#endif
+    const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count()
+                    / repeat / frames.size();
+
+    std::printf("%zu frames, %zu values, %zu elements (%llu frames before their schema skipped)\n", frames.size(), values,
+                elements, (unsigned long long)collector.skipped);
+    std::printf("0x44: %zu bytes, %.1f per frame\n", plain_bytes, static_cast<double>(plain_bytes) / frames.size());
+    std::printf("0x52: %zu bytes, %.1f per frame, %.3f of 0x44 (%.2fx), %.2f bits per element with headers\n", rice_bytes,
+                static_cast<double>(rice_bytes) / frames.size(), static_cast<double>(rice_bytes) / plain_bytes,
+                static_cast<double>(plain_bytes) / rice_bytes, 8.0 * rice_bytes / elements);
+    std::printf("k:");
+    for (int k = 0; k < 16; k++)
+    {
+        if (k_counts[k] > 0)
+        {
+            std::printf(" %d:%u", k, k_counts[k]);
+        }
+    }
+    std::printf("\n");
+#ifdef C0DE_HAVE_TSC
+    std::printf("coding: %.0f ns, %.0f cycles per frame (%.1f ns per element)\n", ns, cycles, ns * frames.size() / elements);
+#else
+    std::printf("coding: %.0f ns per frame (%.1f ns per element)\n", ns, ns * frames.size() / elements);
+#endif
+    std::printf("round trip: %s (decode errors 0x44 %llu, 0x52 %llu)\n", same ? "same values" : "VALUES DIFFER",
+                (unsigned long long)plain_errors, (unsigned long long)rice_errors);
+    return (same && sink > 0) ? 0 : 1;
+}
@@ -0,0 +1,241 @@
+// c0de_ring_stress: spsc_ring and the logger's sender thread under real
+// threads, for a run under ThreadSanitizer as much as for the checks
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_ring_stress.cpp
+//       -o c0de_ring_stress -pthread
+//   (add -fsanitize=thread -g for the race check)
+//
+//   c0de_ring_stress [--ms N]
+//     --ms N            how long each part runs (default 1000)
+//
+// Ring: a producer thread pushes numbered 64-byte records as fast as it
+// can into rings of 2, 32 and 1024 slots under both overflow policies,
+// while a consumer pops them. Every record popped must be whole, come
+// after the one before it, and popped plus dropped must add up to pushed.
+//
+// Logger: the control loop calls sample_structured_data() at full speed,
+// feeds the logger format and rate requests and now and then adds a
+// channel, while the sender thread started with start_sender() writes 0x54
+// (and the 0x46 those requests and channels call for). The output must decode with no CRC errors, malformed packets
+// or sequence gaps.
+//
+// Exits 1 if anything doesn't add up.
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <unistd.h>
+
+#include "vex.h"
+
+// The sender thread writes, the checker reads at the end
+struct locked_sink
+{
+    std::mutex lock;
+    std::vector<uint8_t> bytes;
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        bytes.insert(bytes.end(), data, data + len);
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK locked_sink
+#include "structured_logger.h"
+#include "c0de_stream.h"
+
+namespace
+{
+
+unsigned run_ms = 1000;
+
+// Big enough that a torn copy would show
+struct record
+{
+    uint32_t number;
+    uint32_t check[15];
+};
+
+template<std::size_t Capacity, overflow_policy Policy>
+bool stress_ring(const char* name)
+{
+    std::unique_ptr<spsc_ring<record, Capacity, Policy>> ring(new spsc_ring<record, Capacity, Policy>());
+    std::atomic<bool> done{false};
+    uint64_t pushed = 0;
+    std::thread producer([&] {
+        const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(run_ms);
+        record r;
+        while (std::chrono::steady_clock::now() < end)
+        {
+            for (int burst = 0; burst < 256; burst++)
+            {
+                r.number = static_cast<uint32_t>(++pushed);
+                for (uint32_t i = 0; i < 15; i++)
+                {
+                    r.check[i] = r.number * 2654435761u + i;
+                }
+                ring->push(r);
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    uint64_t popped = 0;
+    uint64_t torn = 0;
+    uint64_t out_of_order = 0;
+    uint32_t last = 0;
+    record r;
+    while (true)
+    {
+        const bool finished = done.load(std::memory_order_acquire);
+        if (!ring->pop(r))
+        {
+            if (finished)
+            {
+                break;
+            }
+            continue;
+        }
+        popped++;
+        for (uint32_t i = 0; i < 15; i++)
+        {
+            if (r.check[i] != r.number * 2654435761u + i)
+            {
+                torn++;
+                break;
+            }
+        }
+        if (r.number <= last)
+        {
+            out_of_order++;
+        }
+        last = r.number;
+    }
+    producer.join();
+
+    const uint64_t dropped = ring->dropped();
+    const bool ok = (torn == 0) && (out_of_order == 0) && (popped + dropped == pushed);
+    std::printf("%-24s %10llu pushed %10llu popped %10llu dropped %llu torn %llu out of order%s\n", name,
+                static_cast<unsigned long long>(pushed), static_cast<unsigned long long>(popped),
+                static_cast<unsigned long long>(dropped), static_cast<unsigned long long>(torn),
+                static_cast<unsigned long long>(out_of_order), ok ? "" : "  FAILED");
+    return ok;
+}
+
+void push_command(uint8_t command, const std::vector<uint8_t>& payload)
+{
+    std::vector<uint8_t> bytes;
+    pack_host_command(bytes, command, payload.data(), payload.size());
+    vex_host_serial_push(bytes.data(), bytes.size());
+}
+
+bool stress_logger(void)
+{
+    static std::atomic<int32_t> t{0};
+    // the sender thread never stops, so neither does the logger
+    StructuredLogger* const logger = new StructuredLogger();
+    for (int i = 0; i < 8; i++)
+    {
+        logger->add("ch" + std::to_string(i), [i]() -> int32_t { return t.load() * (i + 1); });
+    }
+    logger->add(LOGGER_NAME("slow"), []() -> float { return t.load() * 0.5f; }, false, 4);
+    logger->set_extended_header(true);
+    logger->start_sender(1);
+
+    const auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(run_ms);
+    uint32_t ticks = 0;
+    int late = 0;
+    while (std::chrono::steady_clock::now() < end)
+    {
+        t++;
+        logger->sample_structured_data();
+        if (ticks % 500 == 0)
+        {
+            push_command(format_request_command, {});
+        }
+        if (ticks % 1500 == 750)
+        {
+            // channel 8 between every 2 and every 6 ticks: a schema change
+            push_command(rate_command, { 8, static_cast<uint8_t>(40 + (ticks / 1500 % 3) * 40) });
+        }
+        if ((ticks % 2000 == 1000) && (late < 16))
+        {
+            // a channel added while the sender may be sending 0x46
+            logger->add("late" + std::to_string(late), [late]() -> int16_t { return static_cast<int16_t>(late); });
+            late++;
+        }
+        logger->poll_host_commands();
+        ticks++;
+        if (ticks % 64 == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    }
+    // let the sender catch up
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    std::vector<uint8_t> bytes;
+    {
+        std::lock_guard<std::mutex> guard(logger_sink().lock);
+        bytes = logger_sink().bytes;
+    }
+    c0de::stream_handler ignore;
+    c0de::stream_decoder decoder(ignore);
+    decoder.feed(bytes.data(), bytes.size());
+    decoder.finish();
+    const c0de::framer_stats& framing = decoder.framing();
+    const c0de::decoder_stats& stats = decoder.stats();
+    const bool ok = (framing.crc_errors == 0) && (stats.malformed == 0) && (stats.lost_packets == 0)
+                    && (stats.unknown_schemas == 0) && (stats.values > 0);
+    std::printf("logger: %u ticks, %zu bytes, %llu packets, %llu values, %llu schema changes, %u records "
+                "dropped, %llu crc errors, %llu malformed, %llu lost%s\n",
+                ticks, bytes.size(), static_cast<unsigned long long>(framing.packets),
+                static_cast<unsigned long long>(stats.values), static_cast<unsigned long long>(stats.schema_changes),
+                logger->sample_drops(), static_cast<unsigned long long>(framing.crc_errors),
+                static_cast<unsigned long long>(stats.malformed), static_cast<unsigned long long>(stats.lost_packets),
+                ok ? "" : "  FAILED");
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--ms" && i + 1 < argc)
+        {
+            run_ms = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: c0de_ring_stress [--ms N]\n");
+            return 2;
+        }
+    }
+
+    bool ok = true;
+    ok &= stress_ring<2, overflow_policy::drop_newest>("2 slots, drop_newest");
+    ok &= stress_ring<2, overflow_policy::drop_oldest>("2 slots, drop_oldest");
+    ok &= stress_ring<32, overflow_policy::drop_newest>("32 slots, drop_newest");
+    ok &= stress_ring<32, overflow_policy::drop_oldest>("32 slots, drop_oldest");
+    ok &= stress_ring<1024, overflow_policy::drop_newest>("1024 slots, drop_newest");
+    ok &= stress_ring<1024, overflow_policy::drop_oldest>("1024 slots, drop_oldest");
+    ok &= stress_logger();
+    std::fflush(stdout);
+    // the sender thread is still running; don't destroy what it uses
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,323 @@
+// c0de_sink_bench: throughput of the logger's output sinks (output_sink.h)
+// on this machine, and a check that what file_sink records reads back
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_sink_bench.cpp
+//       -o c0de_sink_bench -pthread
+//
+//   c0de_sink_bench [options]
+//     --frames N        logger frames to record (default 20000)
+//     --repeat N        passes over them per sink, the fastest counts
+//                       (default 5)
+//     --dir DIR         where the file sinks write (default /tmp)
+//     --fsync           count an fsync() at the end of each pass, for the
+//                       disk rather than the page cache
+//
+// The stream is what a StructuredLogger writes for 12 channels and 8
+// vision objects a frame, captured write by write through a sink of this
+// tool's own. Every sink is then fed the same writes: ring_sink, file_sink
+// at block sizes from 512 B to 64 KiB, and a tee of both. Each file is read
+// back with c0de::read_block_file() and must give back the stream exactly,
+// with every block's index record pointing at the first write that starts
+// in it. The brain's SD card is far slower than any disk here; the numbers
+// are the sinks' own cost, and how block size trades against it.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "vex.h"
+
+// Every write the logger makes, kept with where it ends
+struct capture_sink
+{
+    std::vector<uint8_t> bytes;
+    std::vector<std::size_t> ends;
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        bytes.insert(bytes.end(), data, data + len);
+        ends.push_back(bytes.size());
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK capture_sink
+#include "structured_logger.h"
+#include "c0de_stream.h"
+
+namespace
+{
+
+unsigned frames = 20000;
+unsigned repeat = 5;
+std::string dir = "/tmp";
+bool sync_file = false;
+
+void record_stream(void)
+{
+    static float t = 0;
+    StructuredLogger logger;
+    for (int i = 0; i < 12; i++)
+    {
+        logger.add("ch" + std::to_string(i), [i]() -> float { return t * 0.5f + i; });
+    }
+    logger.add(LOGGER_NAME("counter"), []() -> int32_t { return static_cast<int32_t>(t); });
+    vex::safearray<vex::aivision::object, AIVISION_MAX_OBJECTS> objs;
+    objs.setLength(8);
+    for (unsigned f = 0; f < frames; f++)
+    {
+        t = static_cast<float>(f);
+        logger.send_structured_data();
+        for (int i = 0; i < 8; i++)
+        {
+            vex::aivision::object& obj = objs[i];
+            obj.exists = true;
+            obj.type = (i < 4) ? vex::aivision::objectType::colorObject : vex::aivision::objectType::tagObject;
+            obj.id = i;
+            obj.originX = (f * 3 + i * 40) % 300;
+            obj.originY = (f + i * 25) % 220;
+            obj.width = 20 + i;
+            obj.height = 30 - i;
+            obj.score = 80;
+            obj.angle = (f + i * 10) % 360;
+            for (int k = 0; k < 4; k++)
+            {
+                obj.tag.x[k] = obj.originX + k * 5;
+                obj.tag.y[k] = obj.originY + k * 3;
+            }
+        }
+        logger.send_vision_changes(objs);
+    }
+}
+
+// Feed every captured write to `sink`, timed; `finish` runs inside the
+// timing (e.g. close the file)
+template<typename Sink, typename Finish>
+double replay(Sink& sink, Finish finish)
+{
+    const capture_sink& s = logger_sink();
+    const auto start = std::chrono::steady_clock::now();
+    std::size_t begin = 0;
+    for (std::size_t end : s.ends)
+    {
+        sink.write(&s.bytes[begin], end - begin);
+        sink.flush();
+        begin = end;
+    }
+    finish();
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+void fsync_path(const std::string& path)
+{
+    const int fd = ::open(path.c_str(), O_WRONLY);
+    if (fd >= 0)
+    {
+        ::fsync(fd);
+        ::close(fd);
+    }
+}
+
+// Reads `path` back and checks it against the captured stream and its
+// write boundaries; prints what is wrong, if anything
+bool check_file(const std::string& path, std::size_t block_size)
+{
+    const capture_sink& s = logger_sink();
+    FILE* f = std::fopen(path.c_str(), "rb");
+    if (f == nullptr)
+    {
+        std::perror(path.c_str());
+        return false;
+    }
+    c0de::block_file_stats stats;
+    const std::vector<uint8_t> bytes = c0de::read_block_file(f, &stats);
+
+    // index records, straight from the file
+    std::set<std::size_t> starts{0};
+    for (std::size_t end : s.ends)
+    {
+        starts.insert(end);
+    }
+    std::fseek(f, 0, SEEK_SET);
+    std::vector<uint8_t> block(block_size);
+    std::size_t offset = 0; // in the stream, of the block's first byte
+    std::size_t bad_index = 0;
+    while (std::fread(block.data(), 1, block_size, f) == block_size)
+    {
+        std::size_t used = (block[12] << 8) | block[13];
+        used = (used == 0) ? block_size : used;
+        const std::size_t first = (block[14] << 8) | block[15];
+        const auto next = starts.lower_bound(offset);
+        const bool none = (next == starts.end()) || (*next >= offset + used - 16) || (*next == s.bytes.size());
+        if (none ? (first != 0xffff) : (first == 0xffff || offset + first - 16 != *next))
+        {
+            bad_index++;
+        }
+        offset += used - 16;
+    }
+    std::fclose(f);
+
+    const bool same = (bytes.size() == s.bytes.size()) && std::equal(bytes.begin(), bytes.end(), s.bytes.begin());
+    if (!same || bad_index || stats.lost_blocks || stats.bad_bytes)
+    {
+        std::printf("  %s: read back %s, %zu bad index records, %llu lost blocks, %llu bad bytes\n", path.c_str(),
+                    same ? "the same" : "DIFFERENT", bad_index, (unsigned long long)stats.lost_blocks,
+                    (unsigned long long)stats.bad_bytes);
+        return false;
+    }
+    return true;
+}
+
+void report(const char* name, double seconds, std::size_t out_bytes)
+{
+    const capture_sink& s = logger_sink();
+    std::printf("%-22s %9.1f %10.1f %9.1f %12zu\n", name, s.bytes.size() / seconds / 1e6,
+                s.ends.size() / seconds / 1e6, seconds * 1e9 / s.ends.size(), out_bytes);
+}
+
+template<std::size_t BlockSize>
+bool run_file(const char* name)
+{
+    const std::string path = dir + "/c0de_sink_bench." + std::to_string(BlockSize) + ".bin";
+    double best = 1e30;
+    std::unique_ptr<file_sink<BlockSize>> sink(new file_sink<BlockSize>());
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        if (!sink->open(path.c_str()))
+        {
+            std::perror(path.c_str());
+            return false;
+        }
+        const double seconds = replay(*sink, [&] {
+            sink->close();
+            if (sync_file)
+            {
+                fsync_path(path);
+            }
+        });
+        best = (seconds < best) ? seconds : best;
+    }
+    report(name, best, static_cast<std::size_t>(sink->blocks_written()) * BlockSize);
+    const bool ok = check_file(path, BlockSize);
+    std::remove(path.c_str());
+    return ok;
+}
+
+bool run_ring(void)
+{
+    static constexpr std::size_t capacity = 1 << 16;
+    const capture_sink& s = logger_sink();
+    std::unique_ptr<ring_sink<capacity>> sink(new ring_sink<capacity>());
+    double best = 1e30;
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        sink->clear();
+        const double seconds = replay(*sink, [] {});
+        best = (seconds < best) ? seconds : best;
+    }
+    report("ring_sink<64K>", best, sink->size());
+
+    // it holds the newest bytes
+    std::vector<uint8_t> out(capacity);
+    const std::size_t n = sink->read(out.data(), out.size());
+    const std::size_t keep = (s.bytes.size() < capacity) ? s.bytes.size() : capacity;
+    if ((n != keep) || !std::equal(out.begin(), out.begin() + n, s.bytes.end() - keep))
+    {
+        std::printf("  ring_sink: newest bytes DIFFERENT\n");
+        return false;
+    }
+    return true;
+}
+
+bool run_tee(void)
+{
+    const std::string path = dir + "/c0de_sink_bench.tee.bin";
+    using tee = tee_sink<ring_sink<1 << 16>, file_sink<4096>>;
+    std::unique_ptr<tee> sink(new tee());
+    double best = 1e30;
+    for (unsigned r = 0; r < repeat; r++)
+    {
+        sink->first().clear();
+        if (!sink->second().open(path.c_str()))
+        {
+            std::perror(path.c_str());
+            return false;
+        }
+        const double seconds = replay(*sink, [&] {
+            sink->second().close();
+            if (sync_file)
+            {
+                fsync_path(path);
+            }
+        });
+        best = (seconds < best) ? seconds : best;
+    }
+    report("tee ring + file<4K>", best, static_cast<std::size_t>(sink->second().blocks_written()) * 4096);
+    const bool ok = check_file(path, 4096);
+    std::remove(path.c_str());
+    return ok;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            frames = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            repeat = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--dir" && i + 1 < argc)
+        {
+            dir = argv[++i];
+        }
+        else if (arg == "--fsync")
+        {
+            sync_file = true;
+        }
+        else
+        {
+            std::fprintf(stderr, "usage: c0de_sink_bench [--frames N] [--repeat N] [--dir DIR] [--fsync]\n");
+            return 2;
+        }
+    }
+    if (repeat == 0)
+    {
+        repeat = 1;
+    }
+
+    record_stream();
+    const capture_sink& s = logger_sink();
+    std::printf("%zu writes, %zu bytes, %.1f bytes per write\n\n", s.ends.size(), s.bytes.size(),
+                static_cast<double>(s.bytes.size()) / s.ends.size());
+    std::printf("%-22s %9s %10s %9s %12s\n", "sink", "MB/s", "Mwrites/s", "ns/write", "bytes out");
+
+    bool ok = run_ring();
+    ok &= run_file<512>("file_sink<512>");
+    ok &= run_file<1024>("file_sink<1K>");
+    ok &= run_file<2048>("file_sink<2K>");
+    ok &= run_file<4096>("file_sink<4K>");
+    ok &= run_file<8192>("file_sink<8K>");
+    ok &= run_file<16384>("file_sink<16K>");
+    ok &= run_file<32768>("file_sink<32K>");
+    ok &= run_file<65536>("file_sink<64K>");
+    ok &= run_tee();
+    std::printf(ok ? "\nall recordings read back exactly\n" : "\nFAILED\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,547 @@
+// c0de_vision_bench: the bit-packed vision stream (0x56, vision_codec.h)
+// end to end, from StructuredLogger::send_vision_changes() to the host's
+// stream_decoder, against what the objects should decode to; then its size
+// next to 0x49 and its cost
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/vex_host -IHostDecoder/include
+//       -IBLETestCpp/include HostDecoder/src/c0de_vision_bench.cpp
+//       -o c0de_vision_bench -pthread
+//
+//   c0de_vision_bench [options]
+//     --frames N        snapshots (default 20000)
+//     --seed N          (default 1)
+//     --drop P          share of 0x56 packets lost on the way (default 0.01)
+//     --repeat N        times to code the whole session for the timing
+//                       (default 5)
+//     --dump FILE       every 0x56 payload that arrived and what it decoded
+//                       to, for c0de_vision_check.js to run index.html's
+//                       decoder on
+//
+// The scenes are up to 24 objects a snapshot: color, code and model objects
+// drifting, growing and jumping further than the encoder matches, AprilTags
+// turning through 0/360 degrees both ways, objects coming and going, ones
+// off the edge of the image or bigger than a field holds, and objects of a
+// type the stream can't carry, which must be left out. Every snapshot the
+// host decodes must be exactly the objects sent, clamped to the field
+// widths; after a lost packet it must decode nothing until the next
+// keyframe, and that one right again.
+//
+// Exits 1 if anything decodes differently.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "vex.h"
+
+// Every write the logger makes, one packet each
+struct capture_sink
+{
+    std::vector<uint8_t> bytes;
+
+    void write(const uint8_t* data, std::size_t len)
+    {
+        bytes.insert(bytes.end(), data, data + len);
+    }
+
+    void flush(void) {}
+};
+
+#define LOGGER_OUTPUT_SINK capture_sink
+#include "structured_logger.h"
+#include "c0de_stream.h"
+
+namespace
+{
+
+using object = vex::aivision::object;
+using object_type = vex::aivision::objectType;
+using snapshot = vex::safearray<object, AIVISION_MAX_OBJECTS>;
+
+unsigned frames = 20000;
+uint32_t seed = 1;
+double drop = 0.01;
+unsigned repeat = 5;
+const char* dump_path = nullptr;
+
+// ------------------------------------------------------------
+// scenes
+// ------------------------------------------------------------
+
+struct tracked
+{
+    object obj;
+    double vx;
+    double vy;
+    double spin; // degrees per snapshot, tags only
+};
+
+class scene
+{
+private:
+    std::mt19937 m_rng;
+    std::vector<tracked> m_objects;
+
+    int uniform(int lo, int hi)
+    {
+        return lo + static_cast<int>(m_rng() % static_cast<uint32_t>(hi - lo + 1));
+    }
+
+    tracked spawn(void)
+    {
+        static const object_type types[] = { object_type::colorObject, object_type::codeObject,
+                                             object_type::modelObject, object_type::tagObject,
+                                             object_type::tagObject, object_type::unknownObject };
+        tracked t{};
+        object& o = t.obj;
+        o.exists = true;
+        o.type = types[m_rng() % 6];
+        o.id = (o.type == object_type::tagObject) ? uniform(0, 36) : uniform(0, 8);
+        // now and then off the edge, or bigger than the fields hold
+        o.originX = uniform(-20, 330);
+        o.originY = uniform(-20, 250);
+        o.width = (m_rng() % 20 == 0) ? uniform(512, 700) : uniform(5, 120);
+        o.height = uniform(5, 100);
+        o.score = (m_rng() % 20 == 0) ? 200 : uniform(0, 100);
+        o.angle = uniform(0, 3599) / 10.0;
+        t.vx = (static_cast<int>(m_rng() % 9) - 4) * 0.7;
+        t.vy = (static_cast<int>(m_rng() % 7) - 3) * 0.6;
+        t.spin = (static_cast<int>(m_rng() % 11) - 5) * 1.3;
+        return t;
+    }
+
+public:
+    explicit scene(uint32_t seed)
+        : m_rng(seed)
+    {}
+
+    void next(snapshot& out)
+    {
+        // come and go
+        if (!m_objects.empty() && m_rng() % 10 == 0)
+        {
+            m_objects.erase(m_objects.begin() + m_rng() % m_objects.size());
+        }
+        while (m_objects.size() < AIVISION_MAX_OBJECTS && (m_objects.size() < 4 || m_rng() % 8 == 0))
+        {
+            m_objects.push_back(spawn());
+        }
+        for (tracked& t : m_objects)
+        {
+            object& o = t.obj;
+            if (m_rng() % 50 == 0)
+            {
+                // a jump no delta covers
+                o.originX = uniform(0, 315);
+                o.originY = uniform(0, 211);
+            }
+            else
+            {
+                o.originX += static_cast<int>(std::lround(t.vx * uniform(0, 3)));
+                o.originY += static_cast<int>(std::lround(t.vy * uniform(0, 3)));
+            }
+            if (m_rng() % 4 == 0)
+            {
+                o.width += uniform(-2, 2);
+                o.height += uniform(-2, 2);
+                o.score = (o.score > 100) ? o.score : uniform(60, 100);
+            }
+            o.angle = std::fmod(o.angle + t.spin + 360.0, 360.0);
+            for (int k = 0; k < 4; k++)
+            {
+                const double a = (o.angle + 90.0 * k) * 3.14159265358979 / 180.0;
+                o.tag.x[k] = o.originX + static_cast<int>(std::lround(15 * std::cos(a)));
+                o.tag.y[k] = o.originY + static_cast<int>(std::lround(15 * std::sin(a)));
+            }
+        }
+        out.setLength(static_cast<int>(m_objects.size()));
+        for (std::size_t i = 0; i < m_objects.size(); i++)
+        {
+            out[static_cast<int>(i)] = m_objects[i].obj;
+        }
+    }
+};
+
+// What the host should get for `o`, from the layout in vision_codec.h
+// rather than from make_vision_record(); false if it must be left out
+bool expected_record(const object& o, vision_record& rec)
+{
+    const auto clamp = [](int value, int width) -> uint16_t {
+        return static_cast<uint16_t>(std::min(std::max(value, 0), (1 << width) - 1));
+    };
+    rec = vision_record{};
+    switch (o.type)
+    {
+        case object_type::colorObject: rec.type = 0; break;
+        case object_type::codeObject: rec.type = 1; break;
+        case object_type::modelObject: rec.type = 2; break;
+        case object_type::tagObject: rec.type = 3; break;
+        default: return false;
+    }
+    rec.id = static_cast<uint8_t>(o.id & 63);
+    if (rec.type == 3)
+    {
+        for (int k = 0; k < 4; k++)
+        {
+            rec.field[2 * k] = clamp(o.tag.x[k], 9);
+            rec.field[2 * k + 1] = clamp(o.tag.y[k], 8);
+        }
+        // tenths of a degree, 0 to 3599
+        const long tenths = std::lround(o.angle * 10);
+        rec.field[8] = static_cast<uint16_t>(((tenths % 3600) + 3600) % 3600);
+    }
+    else
+    {
+        rec.field[0] = clamp(o.originX, 9);
+        rec.field[1] = clamp(o.originY, 8);
+        rec.field[2] = clamp(o.width, 9);
+        rec.field[3] = clamp(o.height, 8);
+        rec.field[4] = clamp(o.score, 7);
+    }
+    return true;
+}
+
+bool same_record(const vision_record& a, const vision_record& b)
+{
+    return a.type == b.type && a.id == b.id && std::memcmp(a.field, b.field, sizeof(a.field)) == 0;
+}
+
+// ------------------------------------------------------------
+// the round trip
+// ------------------------------------------------------------
+
+// stream_decoder handler keeping the latest snapshot it decoded
+class vision_catcher : public c0de::stream_handler
+{
+public:
+    bool got = false;
+    std::vector<vision_record> records;
+
+    void on_vision(uint64_t, const vision_record* objs, std::size_t count) override
+    {
+        got = true;
+        records.assign(objs, objs + count);
+    }
+};
+
+// One 0x56 packet as it left the brain, with what it must decode to
+struct sent_frame
+{
+    std::vector<uint8_t> packet;
+    std::vector<vision_record> expected;
+    bool keyframe;
+};
+
+struct round_trip_result
+{
+    unsigned decoded = 0;
+    unsigned dropped = 0;
+    unsigned unsynced = 0;  // arrived but not decodable, waiting for a keyframe
+    unsigned wrong = 0;     // decoded to something else
+    unsigned missing = 0;   // should have decoded and didn't, or the other way round
+    unsigned unsupported = 0;
+    unsigned clamped = 0;
+    unsigned wraps = 0;     // tag angle deltas across 0/360
+    std::size_t objects = 0;
+};
+
+void print_record(const char* what, const vision_record& r)
+{
+    std::printf("    %s type %u id %2u:", what, r.type, r.id);
+    for (int f = 0; f < vision_field_count(r.type); f++)
+    {
+        std::printf(" %u", r.field[f]);
+    }
+    std::printf("\n");
+}
+
+// Payload of a whole packet built by StructuredLogger, extended header or not
+const uint8_t* packet_payload(const std::vector<uint8_t>& p, std::size_t& len)
+{
+    uint16_t payload_len;
+    const std::size_t header = 3 + c0de::read_var_int(p.data() + 3, payload_len);
+    const std::size_t skip = (p[2] & c0de::extended_header_flag) ? c0de::extended_header_len : 0;
+    len = payload_len - skip;
+    return p.data() + header + skip;
+}
+
+round_trip_result round_trip(const std::vector<sent_frame>& sent, std::mt19937& rng, FILE* dump)
+{
+    round_trip_result r;
+    vision_catcher catcher;
+    c0de::stream_decoder decoder(catcher);
+    std::uniform_real_distribution<double> coin(0, 1);
+    bool lost_since_keyframe = false;
+    std::vector<vision_record> prev_expected;
+    for (std::size_t i = 0; i < sent.size(); i++)
+    {
+        const sent_frame& f = sent[i];
+        for (const vision_record& rec : f.expected)
+        {
+            for (const vision_record& p : prev_expected)
+            {
+                if (rec.type == 3 && p.type == 3 && rec.id == p.id && std::abs(rec.field[8] - p.field[8]) > 1800)
+                {
+                    r.wraps++;
+                }
+            }
+        }
+        prev_expected = f.expected;
+        if (coin(rng) < drop)
+        {
+            r.dropped++;
+            lost_since_keyframe = true;
+            continue;
+        }
+        lost_since_keyframe = lost_since_keyframe && !f.keyframe;
+        catcher.got = false;
+        decoder.feed(f.packet.data(), f.packet.size());
+        const bool want = !lost_since_keyframe;
+        if (dump != nullptr)
+        {
+            std::size_t len;
+            const uint8_t* payload = packet_payload(f.packet, len);
+            std::fprintf(dump, "%zu ", i);
+            for (std::size_t k = 0; k < len; k++)
+            {
+                std::fprintf(dump, "%02x", payload[k]);
+            }
+            if (!catcher.got)
+            {
+                std::fprintf(dump, " -");
+            }
+            for (const vision_record& rec : catcher.records)
+            {
+                if (!catcher.got)
+                {
+                    break;
+                }
+                std::fprintf(dump, " %u:%u", rec.type, rec.id);
+                for (int k = 0; k < vision_field_count(rec.type); k++)
+                {
+                    std::fprintf(dump, ":%u", rec.field[k]);
+                }
+            }
+            std::fprintf(dump, "\n");
+        }
+        if (!catcher.got)
+        {
+            r.unsynced++;
+            if (want && r.missing++ < 5)
+            {
+                std::printf("  snapshot %zu: not decoded\n", i);
+            }
+            continue;
+        }
+        if (!want)
+        {
+            if (r.missing++ < 5)
+            {
+                std::printf("  snapshot %zu: decoded after a lost packet, before a keyframe\n", i);
+            }
+            continue;
+        }
+        r.decoded++;
+        bool same = catcher.records.size() == f.expected.size();
+        for (std::size_t k = 0; same && k < f.expected.size(); k++)
+        {
+            same = same_record(catcher.records[k], f.expected[k]);
+        }
+        if (!same && r.wrong++ < 5)
+        {
+            std::printf("  snapshot %zu: %zu objects decoded, %zu sent\n", i, catcher.records.size(),
+                        f.expected.size());
+            for (std::size_t k = 0; k < f.expected.size() || k < catcher.records.size(); k++)
+            {
+                if (k < f.expected.size() && k < catcher.records.size()
+                    && same_record(catcher.records[k], f.expected[k]))
+                {
+                    continue;
+                }
+                if (k < f.expected.size())
+                {
+                    print_record("sent", f.expected[k]);
+                }
+                if (k < catcher.records.size())
+                {
+                    print_record("got ", catcher.records[k]);
+                }
+                break;
+            }
+        }
+    }
+    return r;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc)
+        {
+            frames = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--seed" && i + 1 < argc)
+        {
+            seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--drop" && i + 1 < argc)
+        {
+            drop = std::strtod(argv[++i], nullptr);
+        }
+        else if (arg == "--repeat" && i + 1 < argc)
+        {
+            repeat = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if (arg == "--dump" && i + 1 < argc)
+        {
+            dump_path = argv[++i];
+        }
+        else
+        {
+            std::fprintf(stderr,
+                         "usage: c0de_vision_bench [--frames N] [--seed N] [--drop P] [--repeat N] [--dump FILE]\n");
+            return 2;
+        }
+    }
+    if (repeat == 0)
+    {
+        repeat = 1;
+    }
+
+    // the session, through the logger: 0x56 packet by packet, and 0x49 for
+    // the size
+    static StructuredLogger logger;
+    capture_sink& out = logger_sink();
+    scene sc(seed);
+    snapshot objs;
+    std::vector<snapshot> snapshots;
+    std::vector<sent_frame> sent;
+    std::size_t plain_bytes = 0;
+    round_trip_result counts;
+    for (unsigned n = 0; n < frames; n++)
+    {
+        sc.next(objs);
+        snapshots.push_back(objs);
+        sent_frame f;
+        for (int k = 0; k < objs.getLength(); k++)
+        {
+            vision_record rec;
+            if (!objs[k].exists)
+            {
+                continue;
+            }
+            if (!expected_record(objs[k], rec))
+            {
+                counts.unsupported++;
+                continue;
+            }
+            const object& o = objs[k];
+            counts.clamped += (rec.type != 3) && ((o.originX < 0) || (o.originX > 511) || (o.originY < 0)
+                                                  || (o.originY > 255) || (o.width > 511) || (o.score > 127));
+            if (f.expected.size() < AIVISION_MAX_OBJECTS)
+            {
+                f.expected.push_back(rec);
+            }
+        }
+        counts.objects += f.expected.size();
+        out.bytes.clear();
+        logger.send_vision_changes(objs);
+        f.packet = out.bytes;
+        std::size_t len;
+        f.keyframe = (packet_payload(f.packet, len)[0] & 0x80) != 0;
+        sent.push_back(std::move(f));
+        // 0x49 prints for every object it can't carry; it would leave them
+        // out too
+        snapshot plain = objs;
+        for (int k = 0; k < plain.getLength(); k++)
+        {
+            plain[k].exists = plain[k].exists && plain[k].type != object_type::unknownObject;
+        }
+        out.bytes.clear();
+        logger.send_vision_data(plain);
+        plain_bytes += out.bytes.size();
+    }
+
+    FILE* dump = nullptr;
+    if (dump_path != nullptr)
+    {
+        dump = std::fopen(dump_path, "w");
+        if (dump == nullptr)
+        {
+            std::perror(dump_path);
+            return 1;
+        }
+    }
+    std::mt19937 rng(seed);
+    round_trip_result r = round_trip(sent, rng, dump);
+    if (dump != nullptr)
+    {
+        std::fclose(dump);
+    }
+
+    // coding and decoding time, without the framing
+    std::vector<std::vector<vision_record>> records;
+    for (const sent_frame& f : sent)
+    {
+        records.push_back(f.expected);
+    }
+    std::vector<uint8_t> body;
+    body.reserve(vision_encoder<AIVISION_MAX_OBJECTS>::max_size);
+    std::vector<std::vector<uint8_t>> bodies(records.size());
+    std::size_t sink = 0;
+    double encode_ns = 1e30;
+    double decode_ns = 1e30;
+    for (unsigned run = 0; run < repeat; run++)
+    {
+        vision_encoder<AIVISION_MAX_OBJECTS> encoder;
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < records.size(); i++)
+        {
+            bodies[i].clear();
+            encoder.encode(bodies[i], records[i].data(), records[i].size(), i % 25 == 0);
+        }
+        const double e = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        encode_ns = std::min(encode_ns, e / records.size());
+
+        vision_decoder<AIVISION_MAX_OBJECTS> decoder;
+        vision_record decoded[AIVISION_MAX_OBJECTS];
+        start = std::chrono::steady_clock::now();
+        for (const std::vector<uint8_t>& b : bodies)
+        {
+            sink += static_cast<std::size_t>(decoder.decode(b.data(), b.size(), decoded));
+        }
+        const double d = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        decode_ns = std::min(decode_ns, d / records.size());
+    }
+
+    std::size_t changes_bytes = 0;
+    unsigned keyframes = 0;
+    for (const sent_frame& f : sent)
+    {
+        changes_bytes += f.packet.size();
+        keyframes += f.keyframe;
+    }
+    std::printf("%u snapshots, %zu objects (%.1f per snapshot), %u left out as unsupported, %u clamped, "
+                "%u tag angle steps across 0/360\n",
+                frames, counts.objects, static_cast<double>(counts.objects) / frames, counts.unsupported,
+                counts.clamped, r.wraps);
+    std::printf("0x49: %zu bytes, %.1f per snapshot\n", plain_bytes, static_cast<double>(plain_bytes) / frames);
+    std::printf("0x56: %zu bytes, %.1f per snapshot, %.3f of 0x49 (%u keyframes)\n", changes_bytes,
+                static_cast<double>(changes_bytes) / frames, static_cast<double>(changes_bytes) / plain_bytes,
+                keyframes);
+    std::printf("coding: %.0f ns to encode, %.0f ns to decode per snapshot\n", encode_ns, decode_ns);
+    const bool ok = (r.wrong == 0) && (r.missing == 0) && (sink > 0);
+    std::printf("round trip: %u decoded, %u lost, %u waiting for a keyframe, %u wrong, %u decoded when they "
+                "shouldn't or not when they should: %s\n",
+                r.decoded, r.dropped, r.unsynced, r.wrong, r.missing, ok ? "same objects" : "OBJECTS DIFFER");
+    return ok ? 0 : 1;
+}
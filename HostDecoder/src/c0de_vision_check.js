@@ -0,0 +1,93 @@
+// c0de_vision_check: index.html's 0x56 decoder (process_vision_changes) on
+// what c0de_vision_bench sent, against what the host decoded
+//
+//   c0de_vision_bench --drop 0.05 --dump vision.txt
+//   node HostDecoder/src/c0de_vision_check.js vision.txt [index.html] [vision_codec.h]
+//
+// The page's block from "// 0x56: bit-packed vision objects" up to
+// CRC_CHECK is run as it is, with drawVisionObjects() and
+// VisionObject.fromRecord() replaced by ones keeping the records. Each line
+// of the dump is one packet that arrived: its index, the payload in hex, then
+// the records the host decoded (type:id:field:...) or "-" when it decoded
+// nothing. The page must decode the same records, and skip the same packets
+// after a lost one. Its VISION_OBJECT_WIDTHS, VISION_TAG_WIDTHS and
+// VISION_ANGLE_MODULUS must also be the arrays in vision_codec.h.
+//
+// Exits 1 if anything differs.
+
+'use strict';
+
+const fs = require('fs');
+const path = require('path');
+
+const root = path.join(__dirname, '..', '..');
+const dumpPath = process.argv[2];
+const htmlPath = process.argv[3] || path.join(root, 'index.html');
+const codecPath = process.argv[4] || path.join(root, 'BLETestCpp', 'include', 'vision_codec.h');
+if (!dumpPath) {
+  console.error('usage: node c0de_vision_check.js DUMP [index.html] [vision_codec.h]');
+  process.exit(2);
+}
+
+// the page's decoder, on its own
+const html = fs.readFileSync(htmlPath, 'utf8');
+const start = html.indexOf('// 0x56: bit-packed vision objects');
+const end = html.indexOf('const CRC_CHECK', start);
+if (start < 0 || end < 0) {
+  console.error(`${htmlPath}: no 0x56 decoder block`);
+  process.exit(1);
+}
+let drawn = null;
+const page = new Function('drawVisionObjects', 'VisionObject',
+  html.slice(start, end) +
+  '\nreturn {process_vision_changes, VISION_OBJECT_WIDTHS, VISION_TAG_WIDTHS, VISION_ANGLE_MODULUS};')(
+  objs => { drawn = objs; },
+  {fromRecord: (type, id, fields) => ({type, id, fields})});
+
+let failures = 0;
+function fail(message) {
+  if (failures++ < 10) {
+    console.log(`  ${message}`);
+  }
+}
+
+// layout constants against vision_codec.h
+const codec = fs.readFileSync(codecPath, 'utf8');
+function codecArray(name) {
+  const m = codec.match(new RegExp(`${name}\\[[^\\]]*\\]\\s*=\\s*\\{([^}]*)\\}`));
+  return m ? m[1].split(',').map(s => parseInt(s, 10)) : null;
+}
+const modulus = codec.match(/vision_angle_modulus\s*=\s*(\d+)/);
+const layout = [
+  ['VISION_OBJECT_WIDTHS', page.VISION_OBJECT_WIDTHS, codecArray('vision_object_widths')],
+  ['VISION_TAG_WIDTHS', page.VISION_TAG_WIDTHS, codecArray('vision_tag_widths')],
+  ['VISION_ANGLE_MODULUS', page.VISION_ANGLE_MODULUS, modulus ? parseInt(modulus[1], 10) : null],
+];
+for (const [name, js, c] of layout) {
+  if (JSON.stringify(js) !== JSON.stringify(c)) {
+    fail(`${name} is ${JSON.stringify(js)} in the page, ${JSON.stringify(c)} in vision_codec.h`);
+  }
+}
+
+// the dumped packets
+let packets = 0;
+let decoded = 0;
+for (const line of fs.readFileSync(dumpPath, 'utf8').split('\n')) {
+  if (!line) {
+    continue;
+  }
+  const [index, hex, ...want] = line.split(' ');
+  const bytes = Uint8Array.from(hex.match(/../g) || [], h => parseInt(h, 16));
+  drawn = null;
+  page.process_vision_changes(new DataView(bytes.buffer));
+  packets++;
+  const got = drawn === null ? ['-'] : drawn.map(r => [r.type, r.id, ...r.fields].join(':'));
+  if (got.join(' ') !== want.join(' ')) {
+    fail(`packet ${index}: page ${got.slice(0, 3).join(' ')}..., host ${want.slice(0, 3).join(' ')}...`);
+  }
+  decoded += drawn !== null;
+}
+
+console.log(`layout: ${layout.map(l => l[0]).join(', ')} checked against vision_codec.h`);
+console.log(`${packets} packets, ${decoded} decoded by the page: ${failures ? 'DIFFER' : 'same objects as the host'}`);
+process.exit(failures ? 1 : 0);
@@ -0,0 +1,473 @@
+// c0de_decode: turn captured brain output into CSV or a columnar file
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/main.cpp -o c0de_decode
+//
+//   c0de_decode [options] <capture>...
+//     --csv FILE        values as packet,time_us,code,name,value rows
+//     --columnar FILE   values as a binary columnar file (see write_columnar)
+//     --vision FILE     vision objects as packet,index,type,id,f0..f8 rows
+//     --capture FILE    pre-trigger captures (0x48) as
+//                       capture,time_us,code,name,value rows
+//     --text FILE       console text found between packets
+//     --ble-log         captures are "[BLE Hook]" console logs; decode the
+//                       bytes of their [NOTIFY] lines
+//     --block-file      captures are file_sink recordings (output_sink.h),
+//                       e.g. from the brain's SD card
+//     --max-payload N   longest payload to accept (default 4096)
+//     --cobs            the brain sends COBS frames (set_framing) instead of
+//                       0xc0 0xde packets
+//     --schema-cache DIR  load the channel formats saved in DIR, so a
+//                       capture that starts after the brain's last 0x46
+//                       still decodes, and save the ones found in it
+//   FILE may be - for stdout. Statistics go to stderr.
+
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "c0de_stream.h"
+
+namespace
+{
+
+// stdio with a big buffer and to_chars number formatting
+class output_file
+{
+private:
+    FILE* m_file = nullptr;
+    bool m_close = false;
+
+public:
+    bool open(const char* path)
+    {
+        if (std::strcmp(path, "-") == 0)
+        {
+            m_file = stdout;
+        }
+        else
+        {
+            m_file = std::fopen(path, "wb");
+            m_close = true;
+        }
+        if (m_file != nullptr)
+        {
+            std::setvbuf(m_file, nullptr, _IOFBF, 1 << 20);
+        }
+        return m_file != nullptr;
+    }
+
+    ~output_file()
+    {
+        if (m_close && m_file != nullptr)
+        {
+            std::fclose(m_file);
+        }
+        else if (m_file != nullptr)
+        {
+            std::fflush(m_file);
+        }
+    }
+
+    explicit operator bool() const { return m_file != nullptr; }
+    FILE* get() { return m_file; }
+
+    void write(const void* data, std::size_t len) { std::fwrite(data, 1, len, m_file); }
+    void put(char c) { std::fputc(c, m_file); }
+    void str(const std::string& s) { write(s.data(), s.size()); }
+
+    template<typename T>
+    void num(T value)
+    {
+        char buf[32];
+        const std::to_chars_result r = std::to_chars(buf, buf + sizeof(buf), value);
+        write(buf, r.ptr - buf);
+    }
+};
+
+struct column
+{
+    uint16_t code;
+    c0de::channel_format format;
+    std::vector<uint64_t> packet;
+    std::vector<int64_t> time_us;
+    std::vector<double> value;
+};
+
+class capture_writer : public c0de::stream_handler
+{
+public:
+    output_file csv;
+    output_file vision;
+    output_file capture;
+    output_file text;
+    bool collect_columns = false;
+
+    std::vector<column> columns;
+
+private:
+    // index into columns by channel_format::value_index, -1 if none yet;
+    // array channels have one column per element
+    std::vector<int> m_column_for_series;
+
+public:
+    void on_text(const char* s, std::size_t len) override
+    {
+        if (text)
+        {
+            text.write(s, len);
+        }
+    }
+
+    void on_format(uint16_t code, const c0de::channel_format& ch) override
+    {
+        if (!collect_columns)
+        {
+            return;
+        }
+        if (ch.value_index >= m_column_for_series.size())
+        {
+            m_column_for_series.resize(ch.value_index + 1, -1);
+        }
+        // a renamed or retyped channel gets a column of its own
+        const int index = m_column_for_series[ch.value_index];
+        if (index < 0 || columns[index].code != code || columns[index].format.name != ch.name
+            || columns[index].format.fmt != ch.fmt)
+        {
+            m_column_for_series[ch.value_index] = static_cast<int>(columns.size());
+            columns.push_back(column{ code, ch, {}, {}, {} });
+        }
+    }
+
+    void on_value(uint64_t packet, int64_t time_us, uint16_t code, const c0de::channel_format& ch, double value) override
+    {
+        if (csv)
+        {
+            csv.num(packet);
+            csv.put(',');
+            if (time_us >= 0)
+            {
+                csv.num(time_us);
+            }
+            csv.put(',');
+            csv.num(code);
+            csv.put(',');
+            csv.str(ch.name);
+            csv.put(',');
+            csv.num(value);
+            csv.put('\n');
+        }
+        if (collect_columns && ch.value_index < m_column_for_series.size() && m_column_for_series[ch.value_index] >= 0)
+        {
+            column& c = columns[m_column_for_series[ch.value_index]];
+            c.packet.push_back(packet);
+            c.time_us.push_back(time_us);
+            c.value.push_back(value);
+        }
+    }
+
+    void on_capture_value(uint8_t number, int64_t time_us, uint16_t code, const c0de::channel_format& ch, double value) override
+    {
+        if (capture)
+        {
+            capture.num(number);
+            capture.put(',');
+            capture.num(time_us);
+            capture.put(',');
+            capture.num(code);
+            capture.put(',');
+            capture.str(ch.name);
+            capture.put(',');
+            capture.num(value);
+            capture.put('\n');
+        }
+    }
+
+    void on_vision(uint64_t packet, const vision_record* objs, std::size_t count) override
+    {
+        if (!vision)
+        {
+            return;
+        }
+        for (std::size_t i = 0; i < count; i++)
+        {
+            vision.num(packet);
+            vision.put(',');
+            vision.num(i);
+            vision.put(',');
+            vision.num(objs[i].type);
+            vision.put(',');
+            vision.num(objs[i].id);
+            for (int f = 0; f < vision_max_fields; f++)
+            {
+                vision.put(',');
+                if (f < vision_field_count(objs[i].type))
+                {
+                    vision.num(objs[i].field[f]);
+                }
+            }
+            vision.put('\n');
+        }
+    }
+};
+
+// Little-endian, as written on the host:
+//   "C0DECOL1", u32 column count, then per column
+//   u16 code, u8 fmt, u8 name length, name, u64 n,
+//   u64 packet[n], i64 time_us[n] (-1 when unknown), f64 value[n]
+bool write_columnar(const char* path, const std::vector<column>& columns)
+{
+    output_file out;
+    if (!out.open(path))
+    {
+        return false;
+    }
+    out.write("C0DECOL1", 8);
+    const uint32_t count = static_cast<uint32_t>(columns.size());
+    out.write(&count, sizeof(count));
+    for (const column& c : columns)
+    {
+        const uint8_t fmt = static_cast<uint8_t>(c.format.fmt);
+        const uint8_t name_len = static_cast<uint8_t>(c.format.name.size() < 255 ? c.format.name.size() : 255);
+        const uint64_t n = c.value.size();
+        out.write(&c.code, sizeof(c.code));
+        out.write(&fmt, 1);
+        out.write(&name_len, 1);
+        out.write(c.format.name.data(), name_len);
+        out.write(&n, sizeof(n));
+        out.write(c.packet.data(), n * sizeof(uint64_t));
+        out.write(c.time_us.data(), n * sizeof(int64_t));
+        out.write(c.value.data(), n * sizeof(double));
+    }
+    return true;
+}
+
+// One file per schema, named by its hash in hex, holding its 0x46
+// descriptions as they are hashed
+void load_schemas(const std::string& dir, c0de::schema_cache& cache)
+{
+    std::error_code ec;
+    for (const auto& file : std::filesystem::directory_iterator(dir, ec))
+    {
+        const std::string stem = file.path().stem().string();
+        if (file.path().extension() != ".fmt" || stem.size() != 4)
+        {
+            continue;
+        }
+        FILE* f = std::fopen(file.path().string().c_str(), "rb");
+        if (f == nullptr)
+        {
+            continue;
+        }
+        std::vector<uint8_t> bytes;
+        uint8_t buf[4096];
+        std::size_t n;
+        while ((n = std::fread(buf, 1, sizeof(buf), f)) > 0)
+        {
+            bytes.insert(bytes.end(), buf, buf + n);
+        }
+        std::fclose(f);
+        const uint16_t hash = static_cast<uint16_t>(std::strtoul(stem.c_str(), nullptr, 16));
+        if (!cache.add(hash, bytes.data(), bytes.size()))
+        {
+            std::fprintf(stderr, "%s: doesn't match its hash, ignored\n", file.path().string().c_str());
+        }
+    }
+}
+
+bool save_schemas(const std::string& dir, const c0de::schema_cache& cache)
+{
+    std::error_code ec;
+    std::filesystem::create_directories(dir, ec);
+    for (const auto& schema : cache.schemas())
+    {
+        char name[16];
+        std::snprintf(name, sizeof(name), "%04x.fmt", schema.first);
+        const std::filesystem::path path = std::filesystem::path(dir) / name;
+        if (std::filesystem::exists(path, ec))
+        {
+            continue;
+        }
+        output_file out;
+        if (!out.open(path.string().c_str()))
+        {
+            return false;
+        }
+        out.write(schema.second.data(), schema.second.size());
+    }
+    return true;
+}
+
+void usage(void)
+{
+    std::fprintf(stderr,
+        "usage: c0de_decode [--csv FILE] [--columnar FILE] [--vision FILE] [--capture FILE]\n"
+        "                   [--text FILE] [--ble-log] [--block-file] [--max-payload N] [--cobs]\n"
+        "                   [--schema-cache DIR]\n"
+        "                   <capture>...\n");
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    capture_writer writer;
+    const char* columnar_path = nullptr;
+    const char* schema_dir = nullptr;
+    bool ble_log = false;
+    bool block_file = false;
+    bool cobs = false;
+    std::size_t max_payload = 4096;
+    std::vector<const char*> inputs;
+
+    for (int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--csv" && has_value)
+        {
+            if (!writer.csv.open(argv[++i])) { std::perror(argv[i]); return 1; }
+            std::fputs("packet,time_us,code,name,value\n", writer.csv.get());
+        }
+        else if (arg == "--vision" && has_value)
+        {
+            if (!writer.vision.open(argv[++i])) { std::perror(argv[i]); return 1; }
+            std::fputs("packet,index,type,id,f0,f1,f2,f3,f4,f5,f6,f7,f8\n", writer.vision.get());
+        }
+        else if (arg == "--capture" && has_value)
+        {
+            if (!writer.capture.open(argv[++i])) { std::perror(argv[i]); return 1; }
+            std::fputs("capture,time_us,code,name,value\n", writer.capture.get());
+        }
+        else if (arg == "--text" && has_value)
+        {
+            if (!writer.text.open(argv[++i])) { std::perror(argv[i]); return 1; }
+        }
+        else if (arg == "--columnar" && has_value)
+        {
+            columnar_path = argv[++i];
+            writer.collect_columns = true;
+        }
+        else if (arg == "--max-payload" && has_value)
+        {
+            max_payload = std::strtoul(argv[++i], nullptr, 0);
+        }
+        else if (arg == "--schema-cache" && has_value)
+        {
+            schema_dir = argv[++i];
+        }
+        else if (arg == "--ble-log")
+        {
+            ble_log = true;
+        }
+        else if (arg == "--block-file")
+        {
+            block_file = true;
+        }
+        else if (arg == "--cobs")
+        {
+            cobs = true;
+        }
+        else if (!arg.empty() && arg[0] == '-' && arg != "-")
+        {
+            usage();
+            return 1;
+        }
+        else
+        {
+            inputs.push_back(argv[i]);
+        }
+    }
+    if (inputs.empty())
+    {
+        usage();
+        return 1;
+    }
+
+    c0de::stream_decoder decoder(writer, max_payload);
+    if (cobs)
+    {
+        decoder.set_framing(packet_framing::cobs);
+    }
+    if (schema_dir != nullptr)
+    {
+        load_schemas(schema_dir, decoder.schemas());
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<uint8_t> chunk(1 << 20);
+    c0de::block_file_stats blocks;
+    for (const char* path : inputs)
+    {
+        FILE* f = std::strcmp(path, "-") == 0 ? stdin : std::fopen(path, "rb");
+        if (f == nullptr)
+        {
+            std::perror(path);
+            return 1;
+        }
+        if (ble_log)
+        {
+            const std::vector<uint8_t> bytes = c0de::read_ble_log(f);
+            decoder.feed(bytes.data(), bytes.size());
+        }
+        else if (block_file)
+        {
+            const std::vector<uint8_t> bytes = c0de::read_block_file(f, &blocks);
+            decoder.feed(bytes.data(), bytes.size());
+        }
+        else
+        {
+            std::size_t n;
+            while ((n = std::fread(chunk.data(), 1, chunk.size(), f)) > 0)
+            {
+                decoder.feed(chunk.data(), n);
+            }
+        }
+        if (f != stdin)
+        {
+            std::fclose(f);
+        }
+    }
+    decoder.finish();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (columnar_path != nullptr && !write_columnar(columnar_path, writer.columns))
+    {
+        std::perror(columnar_path);
+        return 1;
+    }
+    if (schema_dir != nullptr && !save_schemas(schema_dir, decoder.schemas()))
+    {
+        std::perror(schema_dir);
+        return 1;
+    }
+
+    const c0de::framer_stats& fs = decoder.framing();
+    const c0de::decoder_stats& ds = decoder.stats();
+    std::fprintf(stderr,
+        "%llu bytes in %.3f s (%.1f MB/s): %llu packets, %llu values, %llu vision frames\n"
+        "crc errors %llu, crc \\r\\n fixes %llu, oversize headers %llu, text bytes %llu\n"
+        "unknown codes %llu, malformed %llu, unknown commands %llu, vision unsynced %llu\n"
+        "schema changes %llu, packets with an unknown schema %llu, lost packets %llu\n"
+        "captures %llu, capture values %llu, compressed unsynced %llu, changes unsynced %llu\n",
+        (unsigned long long)fs.bytes, seconds, seconds > 0 ? fs.bytes / seconds / 1e6 : 0.0,
+        (unsigned long long)fs.packets, (unsigned long long)ds.values, (unsigned long long)ds.vision_frames,
+        (unsigned long long)fs.crc_errors, (unsigned long long)fs.crc_fixed,
+        (unsigned long long)fs.oversize, (unsigned long long)fs.text_bytes,
+        (unsigned long long)ds.unknown_codes, (unsigned long long)ds.malformed,
+        (unsigned long long)ds.unknown_commands, (unsigned long long)ds.vision_unsynced,
+        (unsigned long long)ds.schema_changes, (unsigned long long)ds.unknown_schemas,
+        (unsigned long long)ds.lost_packets,
+        (unsigned long long)ds.captures, (unsigned long long)ds.capture_values,
+        (unsigned long long)ds.rice_unsynced, (unsigned long long)ds.changes_unsynced);
+    if (block_file)
+    {
+        std::fprintf(stderr, "blocks %llu, lost blocks %llu, bad bytes %llu\n", (unsigned long long)blocks.blocks,
+                     (unsigned long long)blocks.lost_blocks, (unsigned long long)blocks.bad_bytes);
+    }
+    return 0;
+}
@@ -0,0 +1,203 @@
+// scan_bench: sync word search and CRC validation throughput of the host
+// decoder, on synthetic streams with more or less console text between
+// packets
+//
+//   g++ -std=c++17 -O2 -IHostDecoder/include -IBLETestCpp/include
+//       HostDecoder/src/scan_bench.cpp -o scan_bench
+//
+//   scan_bench [megabytes]      (default 64)
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "c0de_stream.h"
+
+namespace
+{
+
+// text_share of the bytes are printable console lines, the rest packets of
+// 8 to 120 random payload bytes
+std::vector<uint8_t> make_stream(std::size_t size, double text_share, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> coin(0, 1);
+    std::vector<uint8_t> out;
+    out.reserve(size + 256);
+    while (out.size() < size)
+    {
+        if (coin(rng) < text_share)
+        {
+            const std::size_t len = 20 + rng() % 60;
+            for (std::size_t i = 0; i < len; i++)
+            {
+                out.push_back(static_cast<uint8_t>(' ' + rng() % 95));
+            }
+            out.push_back('\n');
+        }
+        else
+        {
+            const std::size_t len = 8 + rng() % 113;
+            const std::size_t start = out.size();
+            out.push_back(0xc0);
+            out.push_back(0xde);
+            out.push_back(0x44);
+            out.push_back(static_cast<uint8_t>(0x80 | (len >> 8)));
+            out.push_back(static_cast<uint8_t>(len));
+            for (std::size_t i = 0; i < len; i++)
+            {
+                out.push_back(static_cast<uint8_t>(rng()));
+            }
+            const uint16_t crc = crc16<4>(out.data() + start, out.size() - start);
+            out.push_back(static_cast<uint8_t>(crc >> 8));
+            out.push_back(static_cast<uint8_t>(crc));
+        }
+    }
+    return out;
+}
+
+template<typename Func>
+double gbps(std::size_t bytes, Func func)
+{
+    // best of 5
+    double best = 0;
+    for (int run = 0; run < 5; run++)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        const double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        const double rate = bytes / s / 1e9;
+        best = rate > best ? rate : best;
+    }
+    return best;
+}
+
+struct null_sink
+{
+    std::size_t packets = 0;
+    void on_packet(uint8_t, const uint8_t*, std::size_t) { packets++; }
+    void on_text(const char*, std::size_t) {}
+};
+
+struct scanner
+{
+    const char* name;
+    c0de::sync_scan_fn fn;
+    bool supported;
+};
+
+volatile std::size_t g_sink; // keeps results alive
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const std::size_t size = (argc > 1 ? std::strtoul(argv[1], nullptr, 0) : 64) << 20;
+
+    std::vector<scanner> scanners = {
+        { "bytewise", c0de::find_sync_bytewise, true },
+        { "memchr", c0de::find_sync_memchr, true },
+    };
+#ifdef C0DE_SYNC_X86
+    __builtin_cpu_init();
+    scanners.push_back({ "sse2", c0de::find_sync_sse2, __builtin_cpu_supports("sse2") != 0 });
+    scanners.push_back({ "avx2", c0de::find_sync_avx2, __builtin_cpu_supports("avx2") != 0 });
+#endif
+
+    const double shares[] = { 0.0, 0.5, 0.9, 0.99, 1.0 };
+    std::printf("%u MB per stream, GB/s, best of 5\n\n", static_cast<unsigned>(size >> 20));
+
+    std::printf("sync scan   text:");
+    for (double share : shares) std::printf(" %7.0f%%", share * 100);
+    std::printf("\n");
+    std::vector<std::vector<uint8_t>> streams;
+    for (double share : shares)
+    {
+        streams.push_back(make_stream(size, share, 1));
+    }
+    for (const scanner& s : scanners)
+    {
+        if (!s.supported)
+        {
+            continue;
+        }
+        std::printf("  %-16s", s.name);
+        for (const std::vector<uint8_t>& stream : streams)
+        {
+            std::printf(" %8.2f", gbps(stream.size(), [&]() {
+                std::size_t found = 0;
+                for (std::size_t i = 0; i < stream.size(); found++)
+                {
+                    i += s.fn(stream.data() + i, stream.size() - i) + 1;
+                }
+                g_sink = found;
+            }));
+        }
+        std::printf("\n");
+    }
+
+    // every packet of the all-packets stream, slice-by-4 as on the brain vs
+    // slice-by-8 as in packet_framer
+    const std::vector<uint8_t>& packets = streams[0];
+    std::vector<const uint8_t*> data;
+    std::vector<std::size_t> len;
+    for (std::size_t i = 0; i + 5 <= packets.size();)
+    {
+        const std::size_t payload = ((packets[i + 3] & 0x7f) << 8) | packets[i + 4];
+        if (i + 7 + payload > packets.size())
+        {
+            break;
+        }
+        data.push_back(packets.data() + i);
+        len.push_back(5 + payload);
+        i += 7 + payload;
+    }
+    std::printf("\ncrc, %zu packets\n", data.size());
+    std::printf("  %-16s %8.2f\n", "slice-by-4", gbps(packets.size(), [&]() {
+        uint16_t acc = 0;
+        for (std::size_t k = 0; k < data.size(); k++)
+        {
+            acc ^= crc16<4>(data[k], len[k]);
+        }
+        g_sink = acc;
+    }));
+    std::printf("  %-16s %8.2f\n", "slice-by-8", gbps(packets.size(), [&]() {
+        uint16_t acc = 0;
+        for (std::size_t k = 0; k < data.size(); k++)
+        {
+            acc ^= crc16<8>(data[k], len[k]);
+        }
+        g_sink = acc;
+    }));
+
+    std::printf("\npacket_framer text:");
+    for (double share : shares) std::printf(" %7.0f%%", share * 100);
+    std::printf("\n");
+    for (const scanner& s : scanners)
+    {
+        if (!s.supported)
+        {
+            continue;
+        }
+        std::printf("  %-16s", s.name);
+        for (const std::vector<uint8_t>& stream : streams)
+        {
+            std::printf(" %8.2f", gbps(stream.size(), [&]() {
+                null_sink sink;
+                c0de::packet_framer framer;
+                framer.set_sync_scan(s.fn);
+                for (std::size_t i = 0; i < stream.size(); i += 1 << 20)
+                {
+                    const std::size_t n = stream.size() - i < (1u << 20) ? stream.size() - i : (1u << 20);
+                    framer.feed(stream.data() + i, n, sink);
+                }
+                framer.finish(sink);
+                g_sink = sink.packets;
+            }));
+        }
+        std::printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#ifndef VEX_H_
+#define VEX_H_
+
+// Stand-in for the VEX SDK's vex.h, with just enough of it to build the
+// brain's headers (BLETestCpp/include) on a workstation: put this
+// directory before BLETestCpp/include on the include path, and include
+// vex.h before any brain header. It has the include guard of the
+// project's vex.h, so a brain header's own #include "vex.h", which finds
+// that one next to it, then comes to nothing.
+//
+//   g++ -std=gnu++11 -O2 -fno-exceptions -fno-rtti -IHostDecoder/vex_host
+//       -IBLETestCpp/include ... -pthread
+//
+// Time comes from the host's steady clock unless a tool sets
+// vex_host_clock_us(), e.g. to get the same bytes on every run; the user
+// serial channel reads what the tool queued with vex_host_serial_push().
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <thread>
+
+#define AIVISION_MAX_OBJECTS 24
+
+// Fixed brain timer in us; -1 (the default) follows the host's clock
+inline int64_t& vex_host_clock_us(void)
+{
+    static int64_t us = -1;
+    return us;
+}
+
+inline std::deque<uint8_t>& vex_host_serial(void)
+{
+    static std::deque<uint8_t> bytes;
+    return bytes;
+}
+
+// Bytes for vexSerialReadChar() to return, as if the host had sent them
+inline void vex_host_serial_push(const uint8_t* data, size_t len)
+{
+    vex_host_serial().insert(vex_host_serial().end(), data, data + len);
+}
+
+inline int32_t vexSerialReadChar(uint32_t)
+{
+    std::deque<uint8_t>& bytes = vex_host_serial();
+    if (bytes.empty())
+    {
+        return -1;
+    }
+    const uint8_t c = bytes.front();
+    bytes.pop_front();
+    return c;
+}
+
+namespace vex
+{
+
+template<class T, int N>
+class safearray
+{
+private:
+    T m_data[N];
+    int m_length = 0;
+
+public:
+    int getLength(void) const { return m_length; }
+    void setLength(int length) { m_length = (length < N) ? length : N; }
+    T& operator[](int i) { return m_data[i]; }
+};
+
+class aivision
+{
+public:
+    enum class objectType
+    {
+        unknownObject,
+        colorObject,
+        codeObject,
+        modelObject,
+        tagObject,
+    };
+
+    struct tagcoords
+    {
+        int x[4];
+        int y[4];
+    };
+
+    struct object
+    {
+        int id = 0;
+        objectType type = objectType::unknownObject;
+        int originX = 0;
+        int originY = 0;
+        int centerX = 0;
+        int centerY = 0;
+        int width = 0;
+        int height = 0;
+        double angle = 0;
+        bool exists = false;
+        int score = 0;
+        tagcoords tag{};
+    };
+};
+
+class timer
+{
+public:
+    static uint64_t systemHighResolution(void)
+    {
+        if (vex_host_clock_us() >= 0)
+        {
+            return static_cast<uint64_t>(vex_host_clock_us());
+        }
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+class thread
+{
+public:
+    thread(int (*callback)(void*), void* arg)
+    {
+        std::thread(callback, arg).detach();
+    }
+};
+
+namespace this_thread
+{
+inline void sleep_for(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+} // namespace this_thread
+
+} // namespace vex
+
+#endif
@@ -3116,12 +3116,12 @@ class VEXBLEDeviceManager {
         };
         /**
          * Write data to the device's user channel
-         * @param data string to send
+         * @param data string to send, or a Uint8Array of bytes to send as is
          * @returns
          */
         this.WriteDataUser = (data) => __awaiter(this, void 0, void 0, function* () {
             if (this.isConnected() && this.characteristics[BLECharacteristicsID.AIMRXUser]) {
-                let dataToSend = new TextEncoder().encode(data);
+                let dataToSend = (data instanceof Uint8Array) ? data : new TextEncoder().encode(data);
                 try {
                     yield writeCharacteristicValue(this.characteristics[BLECharacteristicsID.AIMRXUser], dataToSend);
                     return true;
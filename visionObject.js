@@ -83,14 +83,16 @@ const unpackFloat64 = (d, i) => [d.getFloat64(i), i+8];
 class VisionObject {
     /*
     * @constructor
-    * @param {DataView} dv
+    * @param {DataView} dv - a 0x49 object, or undefined to fill in the fields by hand
     */
     constructor(dv) {
+        if (dv === undefined) {
+            return;
+        }
         let i = 0;
         const obj_id = dv.getUint8(i++);
         this.id = obj_id & 0b111111;
         this.type = (obj_id & 0b11000000) >> 6;
-        this.name = getName(this.id, this.type, "GameElementsMixAndMatch");
 
         if (this.type == 3) {
             // AprilTag: build quad from tag points
@@ -103,7 +105,47 @@ class VisionObject {
             }
             [this.angle, i] = unpackVarInt(dv, i);
             this.angle /= 10.0;
+        } else {
+            [this.originX, i] = unpackVarInt(dv, i);
+            [this.originY, i] = unpackUint8(dv, i);
+            [this.width,   i] = unpackVarInt(dv, i);
+            [this.height,  i] = unpackUint8(dv, i);
+            [this.score,   i] = unpackUint8(dv, i);
+        }
+        this.finish();
+
+        this.byteLength = i;
+    }
 
+    /*
+    * Build from a decoded 0x56 record
+    * @param {Number} type
+    * @param {Number} id
+    * @param {Number[]} fields - originX, originY, width, height, score; or
+    *   the four AprilTag corners as x, y pairs followed by angle * 10
+    */
+    static fromRecord(type, id, fields) {
+        const obj = new VisionObject();
+        obj.id = id;
+        obj.type = type;
+        if (type == 3) {
+            obj.quad = [];
+            for (let j = 0; j < 4; j++) {
+                obj.quad.push({x: fields[2 * j], y: fields[2 * j + 1]});
+            }
+            obj.angle = fields[8] / 10.0;
+        } else {
+            [obj.originX, obj.originY, obj.width, obj.height, obj.score] = fields;
+        }
+        obj.finish();
+        return obj;
+    }
+
+    // name, center and bounding box from the unpacked fields
+    finish() {
+        this.name = getName(this.id, this.type, "GameElementsMixAndMatch");
+
+        if (this.type == 3) {
             this.quad.reverse();
 
             this.centerX = this.quad.reduce((s, p) => s + p.x, 0) / 4;
@@ -122,16 +164,8 @@ class VisionObject {
             this.width  = maxX - this.originX;
             this.height = maxY - this.originY;
         } else {
-            [this.originX, i] = unpackVarInt(dv, i);
-            [this.originY, i] = unpackUint8(dv, i);
-            [this.width,   i] = unpackVarInt(dv, i);
-            [this.height,  i] = unpackUint8(dv, i);
-            [this.score,   i] = unpackUint8(dv, i);
-
             this.centerX = this.originX + (this.width / 2.0);
             this.centerY = this.originY + (this.height / 2.0);
         }
-
-        this.byteLength = i;
     }
 }